@@ -0,0 +1,669 @@
+/*!
+ * \file Benchmark.h
+ * \author Robert 'Bob' Caddy (rvc@pitt.edu)
+ * \brief Contains the Benchmark class, a microbenchmark runner built on
+ * PerfTimer that warms up, picks the number of iterations, repeats until the
+ * mean is known precisely enough, rejects outliers, and compares the results
+ * against a saved baseline. Also contains doNotOptimize(), clobberMemory(),
+ * and pinThreadToCpu()
+ *
+ */
+
+#pragma once
+
+// STL Includes
+#include <string>
+#include <vector>
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <cerrno>
+#include <stdexcept>
+
+// External Includes
+#if defined(__linux__)
+    #include <pthread.h>
+    #include <sched.h>
+#endif  // __linux__
+
+// Local Includes
+#include "PerfTimer.h"
+
+// =============================================================================
+// Declaration of the benchmark utilities
+// =============================================================================
+/*!
+ * \brief Make the compiler assume that `value` is read, so the computation of
+ * it can't be optimized away, without generating any instructions
+ *
+ * \tparam T The type of the value
+ * \param[in] value The value
+ */
+template <typename T>
+inline void doNotOptimize(T const &value)
+{
+#if defined(__GNUC__) || defined(__clang__)
+    asm volatile("" : : "r,m"(value) : "memory");
+#else  // __GNUC__ || __clang__
+    static_cast<void>(*static_cast<char const volatile *>(
+        static_cast<void const *>(&value)));
+#endif  // __GNUC__ || __clang__
+}
+
+/*!
+ * \brief Make the compiler assume that all memory is read and written, so
+ * stores before it can't be optimized away
+ *
+ */
+inline void clobberMemory()
+{
+#if defined(__GNUC__) || defined(__clang__)
+    asm volatile("" : : : "memory");
+#endif  // __GNUC__ || __clang__
+}
+
+/*!
+ * \brief Pin the calling thread to a single CPU. Only supported on Linux
+ *
+ * \param[in] cpu The index of the CPU
+ * \return true The thread is pinned
+ * \return false The thread couldn't be pinned
+ */
+inline bool pinThreadToCpu(int const cpu);
+// =============================================================================
+// End declaration of the benchmark utilities
+// =============================================================================
+
+// =============================================================================
+// Declaration of Benchmark class
+// =============================================================================
+/// The settings of a Benchmark. All times are in nanoseconds
+struct BenchmarkOptions
+{
+    /// How long to run the function for before measuring
+    double warmupTime = 1.E8;
+
+    /// The shortest time per sample. The number of iterations per sample is
+    /// chosen so that a sample takes at least this long, which keeps the
+    /// timer resolution and overhead out of the results
+    double minSampleTime = 1.E5;
+
+    /// The number of samples to take before checking the confidence interval
+    size_t minSamples = 10;
+
+    /// The number of samples to stop at if the confidence interval isn't
+    /// reached
+    size_t maxSamples = 1000;
+
+    /// The time to stop at if the confidence interval isn't reached
+    double maxTime = 5.E9;
+
+    /// Stop when the half width of the 95% confidence interval of the mean is
+    /// at most this fraction of the mean
+    double targetRelativeError = 0.01;
+
+    /// Samples with a modified z-score, based on the median absolute
+    /// deviation, larger than this are rejected as outliers
+    double outlierThreshold = 3.5;
+
+    /// The CPU to pin the thread to while running. Negative to not pin
+    int cpu = -1;
+};
+
+/// The result of a benchmark. All times are per iteration and in nanoseconds
+struct BenchmarkResult
+{
+    /// The name of the benchmark
+    std::string name;
+
+    /// The number of times the function was called in each sample
+    size_t iterationsPerSample;
+
+    /// The number of samples that were rejected as outliers
+    size_t numOutliers;
+
+    /// The median of the samples, including the outliers
+    double median;
+
+    /// The half width of the 95% confidence interval of the mean
+    double confidenceHalfWidth;
+
+    /// Indicates if the confidence interval reached the target
+    bool converged;
+
+    /// The samples that weren't rejected. Holds the mean, standard deviation,
+    /// extremes, and percentiles
+    PerfTimer timer;
+};
+
+/*!
+ * \brief A microbenchmark runner
+ *
+ * \details `run()` benchmarks a function in four steps:
+ * 1. Warm up, calling the function for `warmupTime` so caches, branch
+ *    predictors, page tables, and clock frequencies settle.
+ * 2. Choose the number of iterations per sample so that each sample takes at
+ *    least `minSampleTime`, from the median warmup call.
+ * 3. Take samples until the half width of the 95% confidence interval of the
+ *    mean is at most `targetRelativeError` of the mean, or `maxSamples` or
+ *    `maxTime` is reached.
+ * 4. Reject outliers whose modified z-score, `0.6745 |x - median| / MAD`, is
+ *    above `outlierThreshold`. This is done before every convergence check
+ *    so a few interrupted samples don't keep the benchmark running.
+ *
+ * The function should use doNotOptimize() on its results so they aren't
+ * optimized away. The results can be printed with `reportStats()`, saved as
+ * csv with `saveResults()`, and compared against saved results with
+ * `compare()`, for example
+ *
+ * \code
+ * Benchmark benchmark;
+ * benchmark.run("triad", [&]{triad(a, b, c); doNotOptimize(a.data());});
+ * benchmark.reportStats();
+ * size_t const regressions = benchmark.compare("baseline.csv");
+ * \endcode
+ *
+ */
+class Benchmark
+{
+public:
+    /*!
+     * \brief Construct a new Benchmark object
+     *
+     * \param[in] options The settings. Defaults to BenchmarkOptions()
+     */
+    explicit Benchmark(BenchmarkOptions const &options = BenchmarkOptions())
+        : _options(options) {}
+
+    /*!
+     * \brief Benchmark a function and keep the result. Throws a
+     * std::invalid_argument error if the name contains a comma or newline,
+     * since they would break the csv output
+     *
+     * \tparam Function The type of the function, callable with no arguments
+     * \param[in] name The name of the benchmark
+     * \param[in] function The function to benchmark
+     * \return BenchmarkResult The result
+     */
+    template <typename Function>
+    BenchmarkResult run(std::string const &name, Function &&function);
+
+    /*!
+     * \brief Get the results of every benchmark run, in order
+     *
+     * \return std::vector<BenchmarkResult> const& The results
+     */
+    std::vector<BenchmarkResult> const &results() const {return _results;}
+
+    /*!
+     * \brief Print out the statistics of every result
+     *
+     * \param[in] outStream What stream to write out to. Defaults to std::cout
+     */
+    void reportStats(std::ostream &outStream = std::cout);
+
+    /*!
+     * \brief Write every result to a csv file, one line per benchmark. If the
+     * file already exists it will be overwritten without asking
+     *
+     * \param[in] filePath The path at which to write the output file
+     */
+    void saveResults(std::string const &filePath) const;
+
+    /*!
+     * \brief Read the results written by `saveResults()`. The timers only
+     * hold the statistics. Throws a std::runtime_error if the file can't be
+     * opened or isn't in the right format
+     *
+     * \param[in] filePath The path of the file
+     * \return std::vector<BenchmarkResult> The results
+     */
+    static std::vector<BenchmarkResult> readResults(std::string const &filePath);
+
+    /*!
+     * \brief Compare every result to the baseline result with the same name
+     * and print out the change in the mean. A result is a regression if its
+     * mean is more than `threshold` slower than the baseline and the
+     * difference is larger than the two confidence intervals together
+     *
+     * \param[in] baseline The baseline results
+     * \param[in] outStream What stream to write out to. Defaults to std::cout
+     * \param[in] threshold The relative slowdown that counts as a regression.
+     * Defaults to 0.05
+     * \return size_t The number of regressions
+     */
+    size_t compare(std::vector<BenchmarkResult> const &baseline,
+                   std::ostream &outStream = std::cout,
+                   double const threshold = 0.05) const;
+
+    /*!
+     * \brief Compare every result to the baseline results saved at
+     * `baselinePath`, see the other overload
+     *
+     * \param[in] baselinePath The path of a file written by `saveResults()`
+     * \param[in] outStream What stream to write out to. Defaults to std::cout
+     * \param[in] threshold The relative slowdown that counts as a regression.
+     * Defaults to 0.05
+     * \return size_t The number of regressions
+     */
+    size_t compare(std::string const &baselinePath,
+                   std::ostream &outStream = std::cout,
+                   double const threshold = 0.05) const
+        {return compare(readResults(baselinePath), outStream, threshold);}
+
+private:
+    /// The settings
+    BenchmarkOptions _options;
+
+    /// The results of every benchmark run
+    std::vector<BenchmarkResult> _results;
+
+    /*!
+     * \brief Reject the outliers and compute the confidence interval of the
+     * rest of the samples
+     *
+     * \param[in] samples The samples
+     * \param[out] kept The samples that weren't rejected
+     * \param[out] result The median, number of outliers, confidence interval,
+     * and convergence are set
+     */
+    void _summarize(std::vector<double> const &samples,
+                    std::vector<double> &kept,
+                    BenchmarkResult &result) const;
+
+    /*!
+     * \brief Get the two sided 95% critical value of Student's t distribution
+     *
+     * \param[in] degreesOfFreedom The degrees of freedom, at least one
+     * \return double The critical value
+     */
+    static double _studentT95(size_t const degreesOfFreedom);
+};
+// =============================================================================
+// End declaration of Benchmark class
+// =============================================================================
+
+// =============================================================================
+// Implementation of the benchmark utilities
+// =============================================================================
+
+// =============================================================================
+inline bool pinThreadToCpu(int const cpu)
+{
+#if defined(__linux__)
+    if (cpu < 0 or cpu >= CPU_SETSIZE)
+    {
+        return false;
+    }
+    cpu_set_t cpuSet;
+    CPU_ZERO(&cpuSet);
+    CPU_SET(cpu, &cpuSet);
+    return pthread_setaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet)
+           == 0;
+#else  // __linux__
+    return false;
+#endif  // __linux__
+}
+// =============================================================================
+
+// =============================================================================
+// End implementation of the benchmark utilities
+// =============================================================================
+
+// =============================================================================
+// Implementation of Benchmark class
+// =============================================================================
+
+// =============================================================================
+// Public Methods
+// =============================================================================
+
+// =============================================================================
+template <typename Function>
+BenchmarkResult Benchmark::run(std::string const &name, Function &&function)
+{
+    if (name.find_first_of(",\n") != std::string::npos)
+    {
+        throw std::invalid_argument("Warning: Benchmark.run() the name " + name
+                                    + " contains a comma or newline");
+    }
+
+    // Pin the thread, remembering the old affinity to restore afterwards
+#if defined(__linux__)
+    cpu_set_t oldCpuSet;
+    bool const pinned = (_options.cpu >= 0)
+        and (pthread_getaffinity_np(pthread_self(), sizeof(oldCpuSet),
+                                    &oldCpuSet) == 0)
+        and pinThreadToCpu(_options.cpu);
+#else  // __linux__
+    bool const pinned = false;
+#endif  // __linux__
+    if (_options.cpu >= 0 and not pinned)
+    {
+        std::cerr << "Benchmark failed to pin " << name << " to CPU "
+                  << _options.cpu << ", running unpinned" << std::endl;
+    }
+
+    // Warm up and estimate the time of a call. A fast function is called
+    // millions of times here so don't store every time, the median comes from
+    // the histogram
+    PerfTimer warmup(name, PerfTimer::Mode::streaming);
+    do
+    {
+        warmup.startTimer();
+        function();
+        warmup.stopTimer();
+    } while (warmup.totalTime() < _options.warmupTime);
+
+    double const callTime = std::max(warmup.percentile(50.), 1.);
+    size_t const iterations = static_cast<size_t>(
+        std::max(1., std::ceil(_options.minSampleTime / callTime)));
+
+    // Take samples until the confidence interval is reached
+    PerfTimer timer(name);
+    std::vector<double> samples, kept;
+    samples.reserve(_options.maxSamples);
+    BenchmarkResult result{name, iterations, 0, 0., 0., false, PerfTimer(name)};
+    while (true)
+    {
+        double const before = timer.totalTime();
+        timer.startTimer();
+        for (size_t i = 0; i < iterations; i++)
+        {
+            function();
+        }
+        timer.stopTimer();
+        samples.push_back((timer.totalTime() - before)
+                          / static_cast<double>(iterations));
+
+        if (samples.size() >= _options.minSamples)
+        {
+            _summarize(samples, kept, result);
+            if (result.converged
+                or samples.size() >= _options.maxSamples
+                or timer.totalTime() >= _options.maxTime)
+            {
+                break;
+            }
+        }
+    }
+
+#if defined(__linux__)
+    if (pinned)
+    {
+        pthread_setaffinity_np(pthread_self(), sizeof(oldCpuSet), &oldCpuSet);
+    }
+#endif  // __linux__
+
+    for (double const sample : kept)
+    {
+        result.timer.addSample(sample);
+    }
+    _results.push_back(result);
+    return result;
+}
+// =============================================================================
+
+// =============================================================================
+inline void Benchmark::reportStats(std::ostream &outStream)
+{
+    for (BenchmarkResult &result : _results)
+    {
+        double median = result.median;
+        double halfWidth = result.confidenceHalfWidth;
+        std::string medianUnit, halfWidthUnit;
+        PerfTimer::convertTime(median,    medianUnit);
+        PerfTimer::convertTime(halfWidth, halfWidthUnit);
+        double const relativeError = (result.timer.averageTime() > 0.)?
+            100. * result.confidenceHalfWidth / result.timer.averageTime(): 0.;
+
+        result.timer.reportStats(outStream);
+        outStream << "  " <<
+        "Iterations per sample: " << result.iterationsPerSample  << ", " <<
+        "Outliers rejected: "     << result.numOutliers          << ", " <<
+        "Median: "                << median << medianUnit        << ", " <<
+        "95% confidence interval: ±" << halfWidth << halfWidthUnit
+                                  << " (" << relativeError << "%)" << ", " <<
+        "Converged: "             << (result.converged? "yes": "no")
+                                  << std::endl;
+    }
+}
+// =============================================================================
+
+// =============================================================================
+inline void Benchmark::saveResults(std::string const &filePath) const
+{
+    std::ofstream saveFile(filePath);
+    if (not saveFile.is_open())
+    {
+        std::cerr << "Benchmark output file failed to open. Error: "
+                  <<  std::strerror(errno)
+                  << std::endl;
+        return;
+    }
+
+    saveFile << "name,iterations per sample,samples,outliers,mean (ns),"
+                "median (ns),standard deviation (ns),"
+                "confidence half width (ns),min (ns),max (ns),converged"
+             << std::endl;
+    saveFile.precision(17);
+    for (BenchmarkResult const &result : _results)
+    {
+        saveFile << result.name                       << ","
+                 << result.iterationsPerSample        << ","
+                 << result.timer.numTrials()          << ","
+                 << result.numOutliers                << ","
+                 << result.timer.averageTime()        << ","
+                 << result.median                     << ","
+                 << result.timer.standardDeviation()  << ","
+                 << result.confidenceHalfWidth        << ","
+                 << result.timer.minTime()            << ","
+                 << result.timer.maxTime()            << ","
+                 << (result.converged? 1: 0)          << std::endl;
+    }
+
+    saveFile.close();
+}
+// =============================================================================
+
+// =============================================================================
+inline std::vector<BenchmarkResult> Benchmark::readResults(
+    std::string const &filePath)
+{
+    std::ifstream readFile(filePath);
+    if (not readFile.is_open())
+    {
+        throw std::runtime_error("Warning: Benchmark.readResults() failed to "
+                                 "open " + filePath + ". Error: "
+                                 + std::strerror(errno));
+    }
+
+    std::vector<BenchmarkResult> results;
+    std::string line;
+    std::getline(readFile, line);  // The header
+    while (std::getline(readFile, line))
+    {
+        if (line.empty())
+        {
+            continue;
+        }
+
+        std::vector<std::string> fields;
+        std::stringstream lineStream(line);
+        std::string field;
+        while (std::getline(lineStream, field, ','))
+        {
+            fields.push_back(field);
+        }
+        if (fields.size() != 11)
+        {
+            throw std::runtime_error("Warning: Benchmark.readResults() "
+                                     + filePath + " has a malformed line: "
+                                     + line);
+        }
+
+        // Rebuild the timer from the statistics, PerfTimer's standard
+        // deviation is the population one
+        double const count = std::stod(fields[2]);
+        double const standardDeviation = std::stod(fields[6]);
+        PerfTimer::Statistics statistics;
+        statistics.count     = static_cast<size_t>(count);
+        statistics.mean      = std::stod(fields[4]);
+        statistics.totalTime = statistics.mean * count;
+        statistics.m2        = standardDeviation * standardDeviation * count;
+        statistics.minTime   = std::stod(fields[8]);
+        statistics.maxTime   = std::stod(fields[9]);
+
+        BenchmarkResult result{fields[0],
+                               std::stoul(fields[1]),
+                               std::stoul(fields[3]),
+                               std::stod(fields[5]),
+                               std::stod(fields[7]),
+                               fields[10] == "1",
+                               PerfTimer(fields[0])};
+        if (statistics.count > 0)
+        {
+            result.timer.merge(statistics, LogLinearHistogram());
+        }
+        results.push_back(result);
+    }
+    return results;
+}
+// =============================================================================
+
+// =============================================================================
+inline size_t Benchmark::compare(std::vector<BenchmarkResult> const &baseline,
+                                 std::ostream &outStream,
+                                 double const threshold) const
+{
+    size_t numRegressions = 0;
+    for (BenchmarkResult const &result : _results)
+    {
+        auto const match = std::find_if(baseline.begin(), baseline.end(),
+            [&result](BenchmarkResult const &base)
+            {return base.name == result.name;});
+        if (match == baseline.end())
+        {
+            outStream << result.name << ": no baseline" << std::endl;
+            continue;
+        }
+
+        double const baseMean   = match->timer.averageTime();
+        double const mean       = result.timer.averageTime();
+        double const difference = mean - baseMean;
+        double const change     = (baseMean > 0.)? difference / baseMean: 0.;
+        bool const significant  = std::abs(difference)
+            > result.confidenceHalfWidth + match->confidenceHalfWidth;
+
+        char const *verdict = "unchanged";
+        if (significant and change > threshold)
+        {
+            verdict = "REGRESSION";
+            numRegressions++;
+        }
+        else if (significant and change < -threshold)
+        {
+            verdict = "improved";
+        }
+
+        double baseTime = baseMean, time = mean;
+        std::string baseUnit, unit;
+        PerfTimer::convertTime(baseTime, baseUnit);
+        PerfTimer::convertTime(time,     unit);
+        outStream << result.name << ": "
+                  << "Baseline: " << baseTime << baseUnit << ", "
+                  << "Current: "  << time     << unit     << ", "
+                  << "Change: "   << ((change > 0.)? "+": "")
+                  << 100. * change << "%, " << verdict << std::endl;
+    }
+    return numRegressions;
+}
+// =============================================================================
+
+// =============================================================================
+// Private Methods
+// =============================================================================
+
+// =============================================================================
+inline void Benchmark::_summarize(std::vector<double> const &samples,
+                                  std::vector<double> &kept,
+                                  BenchmarkResult &result) const
+{
+    // The median and the median absolute deviation
+    auto const median = [](std::vector<double> values)
+    {
+        size_t const middle = values.size() / 2;
+        std::nth_element(values.begin(), values.begin() + middle, values.end());
+        double const upper = values[middle];
+        if (values.size() % 2 == 1)
+        {
+            return upper;
+        }
+        double const lower = *std::max_element(values.begin(),
+                                                values.begin() + middle);
+        return 0.5 * (lower + upper);
+    };
+    result.median = median(samples);
+
+    std::vector<double> deviations(samples.size());
+    for (size_t i = 0; i < samples.size(); i++)
+    {
+        deviations[i] = std::abs(samples[i] - result.median);
+    }
+    double const mad = median(deviations);
+
+    // Keep everything if over half the samples are identical
+    kept.clear();
+    for (double const sample : samples)
+    {
+        if (mad == 0.
+            or 0.6745 * std::abs(sample - result.median) / mad
+               <= _options.outlierThreshold)
+        {
+            kept.push_back(sample);
+        }
+    }
+    result.numOutliers = samples.size() - kept.size();
+
+    // The confidence interval of the mean of the rest
+    double mean = 0., m2 = 0.;
+    for (size_t i = 0; i < kept.size(); i++)
+    {
+        double const delta = kept[i] - mean;
+        mean += delta / static_cast<double>(i + 1);
+        m2   += delta * (kept[i] - mean);
+    }
+    size_t const n = kept.size();
+    double const standardDeviation = (n > 1)? std::sqrt(m2 / double(n - 1)): 0.;
+    result.confidenceHalfWidth = (n > 1)?
+        _studentT95(n - 1) * standardDeviation / std::sqrt(double(n)): 0.;
+    result.converged = (n > 1) and (result.confidenceHalfWidth
+                                    <= _options.targetRelativeError * mean);
+}
+// =============================================================================
+
+// =============================================================================
+inline double Benchmark::_studentT95(size_t const degreesOfFreedom)
+{
+    static double const table[] = {12.706, 4.303, 3.182, 2.776, 2.571,
+                                    2.447, 2.365, 2.306, 2.262, 2.228,
+                                    2.201, 2.179, 2.160, 2.145, 2.131,
+                                    2.120, 2.110, 2.101, 2.093, 2.086,
+                                    2.080, 2.074, 2.069, 2.064, 2.060,
+                                    2.056, 2.052, 2.048, 2.045, 2.042};
+    if (degreesOfFreedom <= 30)
+    {
+        return table[std::max<size_t>(degreesOfFreedom, 1) - 1];
+    }
+
+    // Within 0.2% of the exact value above 30 degrees of freedom
+    return 1.960 + 2.4 / static_cast<double>(degreesOfFreedom);
+}
+// =============================================================================
+
+// =============================================================================
+// End implementation of Benchmark class
+// =============================================================================
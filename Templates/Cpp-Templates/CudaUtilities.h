@@ -0,0 +1,155 @@
+/*!
+ * \file CudaUtilities.h
+ * \author Robert 'Bob' Caddy (rvc@pitt.edu)
+ * \brief Contains small utilities shared by the CUDA templates such as the
+ * CudaSafeCall error checking macro and the CudaDeviceGuard class
+ *
+ */
+
+#pragma once
+
+// STL Includes
+#include <cstdio>
+#include <cstdlib>
+
+// External Includes
+#include <cuda_runtime.h>
+
+// Local Includes
+
+// =============================================================================
+// Macros for CUDA calls
+// =============================================================================
+#define CudaSafeCall( err ) __cudaSafeCall( err, __FILE__, __LINE__ )
+
+inline void __cudaSafeCall( cudaError err, const char *file, const int line )
+{
+#ifdef CUDA_ERROR_CHECK
+    if ( cudaSuccess != err )
+    {
+        fprintf( stderr, "cudaSafeCall() failed at %s:%i : %s\n",
+                 file, line, cudaGetErrorString( err ) );
+        exit( -1 );
+    }
+#endif
+
+    return;
+}
+// =============================================================================
+// End macros for CUDA calls
+// =============================================================================
+
+
+// =============================================================================
+// Declaration and implementation of CudaDeviceGuard class
+// =============================================================================
+/*!
+ * \brief Sets the current device for the lifetime of the object and restores
+ * the previous device when it goes out of scope. Used by classes that own
+ * memory on a specific device so that allocations, frees, and kernel launches
+ * happen on the right device regardless of what the caller's current device
+ * is.
+ *
+ */
+class CudaDeviceGuard
+{
+public:
+    /*!
+     * \brief Construct a new Cuda Device Guard object and set the current
+     * device to `device`. Does nothing if `device` is already current
+     *
+     * \param[in] device The device to make current
+     */
+    explicit CudaDeviceGuard(int const device)
+    {
+        CudaSafeCall(cudaGetDevice(&_previousDevice));
+        if (device != _previousDevice)
+        {
+            CudaSafeCall(cudaSetDevice(device));
+        }
+        _changed = device != _previousDevice;
+    }
+
+    /*!
+     * \brief Destroy the Cuda Device Guard object and restore the previous
+     * device
+     *
+     */
+    ~CudaDeviceGuard()
+    {
+        if (_changed)
+        {
+            CudaSafeCall(cudaSetDevice(_previousDevice));
+        }
+    }
+
+    CudaDeviceGuard(CudaDeviceGuard const &)            = delete;
+    CudaDeviceGuard &operator=(CudaDeviceGuard const &) = delete;
+
+private:
+    /// The device that was current when the guard was created
+    int _previousDevice=0;
+
+    /// Whether or not the guard changed the current device
+    bool _changed=false;
+};
+// =============================================================================
+// End declaration and implementation of CudaDeviceGuard class
+// =============================================================================
+
+// =============================================================================
+// Multi-GPU utility functions
+// =============================================================================
+/*!
+ * \brief Get the current device
+ *
+ * \return int The current device
+ */
+inline int getCurrentDevice()
+{
+    int device = 0;
+    CudaSafeCall(cudaGetDevice(&device));
+    return device;
+}
+
+/*!
+ * \brief Enable peer access from `device` to the memory of `peerDevice` so
+ * that copies between them go directly over NVLink/PCIe instead of being
+ * staged through the host. It is safe to call this more than once for the
+ * same pair of devices.
+ *
+ * \param[in] device The device that will access the peer's memory
+ * \param[in] peerDevice The device that owns the memory
+ * \return true Peer access is enabled, or the devices are the same
+ * \return false The devices cannot access each other directly
+ */
+inline bool enablePeerAccess(int const device, int const peerDevice)
+{
+    if (device == peerDevice)
+    {
+        return true;
+    }
+
+    int canAccess = 0;
+    CudaSafeCall(cudaDeviceCanAccessPeer(&canAccess, device, peerDevice));
+    if (canAccess == 0)
+    {
+        return false;
+    }
+
+    CudaDeviceGuard guard(device);
+    cudaError_t const err = cudaDeviceEnablePeerAccess(peerDevice, 0);
+    if (err == cudaErrorPeerAccessAlreadyEnabled)
+    {
+        // Clear the sticky error, access was enabled by an earlier call
+        cudaGetLastError();
+    }
+    else
+    {
+        CudaSafeCall(err);
+    }
+    return true;
+}
+// =============================================================================
+// End multi-GPU utility functions
+// =============================================================================
@@ -0,0 +1,602 @@
+/*!
+ * \file DeviceAllocators.h
+ * \author Robert 'Bob' Caddy (rvc@pitt.edu)
+ * \brief Contains the allocators that DeviceVector can use to get device
+ * memory along with the DeviceMemoryPool class, a size-class caching pool of
+ * device memory
+ *
+ */
+
+#pragma once
+
+// STL Includes
+#include <map>
+#include <unordered_map>
+#include <mutex>
+#include <iostream>
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <type_traits>
+
+// External Includes
+#include <cuda_runtime.h>
+
+// Local Includes
+#include "CudaUtilities.h"
+
+// =============================================================================
+// Declaration of the allocators
+// =============================================================================
+/*!
+ * \brief The default allocator used by DeviceVector. Every allocation and
+ * deallocation is a direct call to `cudaMalloc` or `cudaFree`.
+ *
+ * \details Any class with the same two static methods can be used as the
+ * `Allocator` template parameter of DeviceVector
+ */
+struct CudaMallocAllocator
+{
+    /*!
+     * \brief Allocate `bytes` bytes of device memory on the current device
+     *
+     * \param[in] bytes The number of bytes to allocate
+     * \param[in] stream The stream the memory will be used on. Unused
+     * \return void* The pointer to the device memory
+     */
+    static void *allocate(size_t const bytes, cudaStream_t const stream=0)
+    {
+        void *ptr = nullptr;
+        CudaSafeCall(cudaMalloc(&ptr, bytes));
+        return ptr;
+    }
+
+    /*!
+     * \brief Free device memory allocated with `allocate`
+     *
+     * \param[in] ptr The pointer to free
+     * \param[in] stream The stream the memory was last used on. Unused
+     */
+    static void deallocate(void *ptr, cudaStream_t const stream=0)
+    {
+        CudaSafeCall(cudaFree(ptr));
+    }
+};
+
+/*!
+ * \brief An allocator that gets its memory from the global DeviceMemoryPool.
+ * Use this for vectors that are created, reset, or resized often, e.g.
+ * `DeviceVector<double, CachingDeviceAllocator>`
+ *
+ */
+struct CachingDeviceAllocator
+{
+    /*!
+     * \brief Allocate `bytes` bytes of device memory from the pool
+     *
+     * \param[in] bytes The number of bytes to allocate
+     * \param[in] stream The stream the memory will be used on
+     * \return void* The pointer to the device memory
+     */
+    static void *allocate(size_t const bytes, cudaStream_t const stream=0);
+
+    /*!
+     * \brief Return memory to the pool. Unlike `cudaFree` this doesn't
+     * synchronize the device so any work using the memory on streams other
+     * than `stream` must already be ordered before `stream`. DeviceVector
+     * does this for every stream passed to `DeviceVector::recordStream`
+     *
+     * \param[in] ptr The pointer to return
+     * \param[in] stream The stream the memory was last used on
+     */
+    static void deallocate(void *ptr, cudaStream_t const stream=0);
+};
+
+/*!
+ * \brief An allocator for unified (managed) memory from
+ * `cudaMallocManaged`. Managed memory is accessible from both the host and
+ * any device and is migrated on demand by the driver, which allows the
+ * working set to exceed device memory. DeviceVectors using this allocator
+ * can use the `prefetch` and `advise` methods to control the migration.
+ *
+ */
+struct ManagedAllocator
+{
+    /*!
+     * \brief Allocate `bytes` bytes of managed memory
+     *
+     * \param[in] bytes The number of bytes to allocate
+     * \param[in] stream The stream the memory will be used on. Unused
+     * \return void* The pointer to the managed memory
+     */
+    static void *allocate(size_t const bytes, cudaStream_t const stream=0)
+    {
+        void *ptr = nullptr;
+        CudaSafeCall(cudaMallocManaged(&ptr, bytes, cudaMemAttachGlobal));
+        return ptr;
+    }
+
+    /*!
+     * \brief Free managed memory allocated with `allocate`
+     *
+     * \param[in] ptr The pointer to free
+     * \param[in] stream The stream the memory was last used on. Unused
+     */
+    static void deallocate(void *ptr, cudaStream_t const stream=0)
+    {
+        CudaSafeCall(cudaFree(ptr));
+    }
+};
+
+/*!
+ * \brief An allocator for host-mapped (zero-copy) memory from
+ * `cudaHostAlloc`. The memory lives in pinned host memory and kernels access
+ * it directly over the interconnect, which is useful for data that is only
+ * touched once per kernel. This relies on unified virtual addressing (all
+ * 64-bit platforms) so that the host and device pointers are the same.
+ *
+ */
+struct MappedHostAllocator
+{
+    /*!
+     * \brief Allocate `bytes` bytes of mapped pinned host memory
+     *
+     * \param[in] bytes The number of bytes to allocate
+     * \param[in] stream The stream the memory will be used on. Unused
+     * \return void* The device pointer to the mapped memory
+     */
+    static void *allocate(size_t const bytes, cudaStream_t const stream=0)
+    {
+        void *hostPtr = nullptr, *devPtr = nullptr;
+        CudaSafeCall(cudaHostAlloc(&hostPtr, bytes,
+                                   cudaHostAllocMapped | cudaHostAllocPortable));
+        if (hostPtr != nullptr)
+        {
+            CudaSafeCall(cudaHostGetDevicePointer(&devPtr, hostPtr, 0));
+        }
+        return devPtr;
+    }
+
+    /*!
+     * \brief Free mapped memory allocated with `allocate`
+     *
+     * \param[in] ptr The pointer to free
+     * \param[in] stream The stream the memory was last used on. Unused
+     */
+    static void deallocate(void *ptr, cudaStream_t const stream=0)
+    {
+        CudaSafeCall(cudaFreeHost(ptr));
+    }
+};
+
+/*!
+ * \brief Trait to check if an allocator returns managed memory. Specialize
+ * this for custom allocators that return managed memory so that
+ * `DeviceVector::prefetch` and `DeviceVector::advise` are allowed.
+ *
+ * \tparam Allocator The allocator to check
+ */
+template <typename Allocator>
+struct isManagedAllocator : std::false_type {};
+
+template <>
+struct isManagedAllocator<ManagedAllocator> : std::true_type {};
+// =============================================================================
+// End declaration of the allocators
+// =============================================================================
+
+// =============================================================================
+// Declaration of DeviceMemoryPool class
+// =============================================================================
+/*!
+ * \brief A caching pool of device memory. Freed blocks are kept and handed
+ * back out by later allocations of the same size class instead of going
+ * through `cudaFree` and `cudaMalloc`, both of which synchronize the device.
+ *
+ * \details Requests are rounded up to the next power of two between
+ * `_minBinBytes` and `_maxBinBytes`; requests larger than `_maxBinBytes` are
+ * not cached. Blocks are stream ordered: when a block is freed an event is
+ * recorded on the stream it was last used on and the block is only reused by
+ * the same stream or, once that event has completed, by any other stream.
+ * Blocks are cached per device. Access the pool with
+ * `DeviceMemoryPool::instance()`, all methods are thread safe.
+ */
+class DeviceMemoryPool
+{
+public:
+    /*!
+     * \brief Statistics about the usage of the pool. All sizes are in bytes
+     *
+     */
+    struct Statistics
+    {
+        /// The number of allocation requests
+        size_t numAllocations = 0;
+        /// The number of allocation requests served from the cache
+        size_t numHits = 0;
+        /// The number of bytes currently handed out to users
+        size_t bytesInUse = 0;
+        /// The number of bytes currently cached and ready for reuse
+        size_t bytesCached = 0;
+        /// The maximum of `bytesInUse + bytesCached` over the life of the pool
+        size_t highWaterMark = 0;
+
+        /// The fraction of allocations served from the cache
+        double hitRate() const
+        {
+            return (numAllocations == 0)? 0.0:
+                   static_cast<double>(numHits) / numAllocations;
+        }
+
+        /// The total number of bytes held from the driver
+        size_t bytesHeld() const {return bytesInUse + bytesCached;}
+    };
+
+    /*!
+     * \brief Get the global pool
+     *
+     * \return DeviceMemoryPool& The pool
+     */
+    static DeviceMemoryPool &instance()
+    {
+        static DeviceMemoryPool pool;
+        return pool;
+    }
+
+    // The pool is a singleton so it can't be copied or moved
+    DeviceMemoryPool(DeviceMemoryPool const &)            = delete;
+    DeviceMemoryPool &operator=(DeviceMemoryPool const &) = delete;
+
+    /*!
+     * \brief Get a block of at least `bytes` bytes on the current device
+     *
+     * \param[in] bytes The number of bytes needed
+     * \param[in] stream The stream the memory will be used on
+     * \return void* The pointer to the device memory. `nullptr` if `bytes`
+     * is zero
+     */
+    void *allocate(size_t const bytes, cudaStream_t const stream=0);
+
+    /*!
+     * \brief Return a block to the pool. If the cache already holds more
+     * than the limit set with `setMaxCachedBytes` the block is freed instead
+     *
+     * \param[in] ptr The pointer returned by `allocate`
+     * \param[in] stream The stream the memory was last used on
+     */
+    void deallocate(void *ptr, cudaStream_t const stream=0);
+
+    /*!
+     * \brief Free all the cached blocks that are not currently in use
+     *
+     */
+    void releaseCached();
+
+    /*!
+     * \brief Set the maximum number of bytes to keep cached. Defaults to
+     * unlimited
+     *
+     * \param[in] maxCachedBytes The maximum number of bytes to cache
+     */
+    void setMaxCachedBytes(size_t const maxCachedBytes);
+
+    /*!
+     * \brief Get the usage statistics of the pool
+     *
+     * \return Statistics The current statistics
+     */
+    Statistics getStatistics() const;
+
+    /*!
+     * \brief Print out the usage statistics of the pool
+     *
+     * \param[in] outStream What stream to write out to. Defaults to std::cout
+     */
+    void reportStats(std::ostream &outStream = std::cout) const;
+
+private:
+    /// A block of device memory
+    struct _Block
+    {
+        void         *ptr    = nullptr;
+        size_t        bytes  = 0;
+        int           device = 0;
+        cudaStream_t  stream = 0;
+        cudaEvent_t   event  = nullptr;
+    };
+
+    /// The smallest size class, smaller requests are rounded up to this
+    static size_t constexpr _minBinBytes = size_t(1) << 9;
+
+    /// The largest size class, larger requests are not cached
+    static size_t constexpr _maxBinBytes = size_t(1) << 30;
+
+    /// Guards all the members below
+    mutable std::mutex _mutex;
+
+    /// Blocks ready for reuse, keyed by device and size class
+    std::multimap<std::pair<int, size_t>, _Block> _cachedBlocks;
+
+    /// Blocks currently handed out, keyed by pointer
+    std::unordered_map<void*, _Block> _liveBlocks;
+
+    /// The maximum number of bytes to keep in `_cachedBlocks`
+    size_t _maxCachedBytes = std::numeric_limits<size_t>::max();
+
+    /// The usage statistics
+    Statistics _stats;
+
+    /*!
+     * \brief Construct the pool. Private since the pool is a singleton
+     *
+     */
+    DeviceMemoryPool() = default;
+
+    /*!
+     * \brief Destroy the pool and free the cached blocks. Errors are ignored
+     * here since the CUDA runtime may have already been torn down at exit
+     *
+     */
+    ~DeviceMemoryPool();
+
+    /*!
+     * \brief Round `bytes` up to its size class
+     *
+     * \param[in] bytes The number of bytes requested
+     * \return size_t The size of the block that will be allocated
+     */
+    static size_t _binSize(size_t const bytes);
+
+    /*!
+     * \brief Free a block and its event. `_mutex` must be held
+     *
+     * \param[in] block The block to free
+     */
+    void _freeBlock(_Block &block);
+
+    /*!
+     * \brief Free all the cached blocks on `device`. `_mutex` must be held
+     *
+     * \param[in] device The device to free blocks from, -1 for all devices
+     */
+    void _releaseCached(int const device);
+};
+// =============================================================================
+// End declaration of DeviceMemoryPool class
+// =============================================================================
+
+// =============================================================================
+// Definition of the allocators
+// =============================================================================
+
+// =============================================================================
+inline void *CachingDeviceAllocator::allocate(size_t const bytes,
+                                              cudaStream_t const stream)
+{
+    return DeviceMemoryPool::instance().allocate(bytes, stream);
+}
+// =============================================================================
+
+// =============================================================================
+inline void CachingDeviceAllocator::deallocate(void *ptr,
+                                               cudaStream_t const stream)
+{
+    DeviceMemoryPool::instance().deallocate(ptr, stream);
+}
+// =============================================================================
+
+// =============================================================================
+// End definition of the allocators
+// =============================================================================
+
+// =============================================================================
+// Definition of DeviceMemoryPool class
+// =============================================================================
+
+// =============================================================================
+// Public Methods
+// =============================================================================
+
+// =============================================================================
+inline void *DeviceMemoryPool::allocate(size_t const bytes,
+                                        cudaStream_t const stream)
+{
+    if (bytes == 0)
+    {
+        return nullptr;
+    }
+
+    _Block block;
+    block.bytes  = _binSize(bytes);
+    block.stream = stream;
+    CudaSafeCall(cudaGetDevice(&block.device));
+
+    std::lock_guard<std::mutex> lock(_mutex);
+    _stats.numAllocations++;
+
+    // Search the cache for a block of the right size that is either from the
+    // same stream or no longer in use by its stream
+    if (block.bytes <= _maxBinBytes)
+    {
+        auto const range = _cachedBlocks.equal_range({block.device,
+                                                      block.bytes});
+        for (auto itr = range.first; itr != range.second; itr++)
+        {
+            if ((itr->second.stream == stream)
+                or (cudaEventQuery(itr->second.event) == cudaSuccess))
+            {
+                block.ptr   = itr->second.ptr;
+                block.event = itr->second.event;
+                _cachedBlocks.erase(itr);
+
+                _stats.numHits++;
+                _stats.bytesCached -= block.bytes;
+                _stats.bytesInUse  += block.bytes;
+                _liveBlocks[block.ptr] = block;
+                return block.ptr;
+            }
+        }
+    }
+
+    // Nothing suitable was cached so allocate a new block. If that fails
+    // then free the cached blocks on this device and try again
+    if (cudaMalloc(&block.ptr, block.bytes) != cudaSuccess)
+    {
+        cudaGetLastError();  // Clear the error
+        _releaseCached(block.device);
+        CudaSafeCall(cudaMalloc(&block.ptr, block.bytes));
+    }
+
+    _stats.bytesInUse   += block.bytes;
+    _stats.highWaterMark = std::max(_stats.highWaterMark, _stats.bytesHeld());
+    _liveBlocks[block.ptr] = block;
+    return block.ptr;
+}
+// =============================================================================
+
+// =============================================================================
+inline void DeviceMemoryPool::deallocate(void *ptr, cudaStream_t const stream)
+{
+    if (ptr == nullptr)
+    {
+        return;
+    }
+
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    auto const itr = _liveBlocks.find(ptr);
+    if (itr == _liveBlocks.end())
+    {
+        throw std::invalid_argument("DeviceMemoryPool::deallocate was passed a"
+                                    " pointer that it did not allocate");
+    }
+    _Block block = itr->second;
+    _liveBlocks.erase(itr);
+    _stats.bytesInUse -= block.bytes;
+
+    // Uncacheable blocks and blocks that would exceed the cache limit are
+    // freed immediately
+    if ((block.bytes > _maxBinBytes)
+        or (_stats.bytesCached + block.bytes > _maxCachedBytes))
+    {
+        _freeBlock(block);
+        return;
+    }
+
+    // Record when the stream is done with the block then cache it
+    if (block.event == nullptr)
+    {
+        CudaSafeCall(cudaEventCreateWithFlags(&block.event,
+                                              cudaEventDisableTiming));
+    }
+    block.stream = stream;
+    CudaSafeCall(cudaEventRecord(block.event, stream));
+
+    _stats.bytesCached += block.bytes;
+    _cachedBlocks.emplace(std::make_pair(block.device, block.bytes), block);
+}
+// =============================================================================
+
+// =============================================================================
+inline void DeviceMemoryPool::releaseCached()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _releaseCached(-1);
+}
+// =============================================================================
+
+// =============================================================================
+inline void DeviceMemoryPool::setMaxCachedBytes(size_t const maxCachedBytes)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    _maxCachedBytes = maxCachedBytes;
+}
+// =============================================================================
+
+// =============================================================================
+inline DeviceMemoryPool::Statistics DeviceMemoryPool::getStatistics() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+    return _stats;
+}
+// =============================================================================
+
+// =============================================================================
+inline void DeviceMemoryPool::reportStats(std::ostream &outStream) const
+{
+    Statistics const stats = getStatistics();
+
+    outStream << "DeviceMemoryPool statistics:" << std::endl << "  " <<
+    "Allocations: "     << stats.numAllocations               << ", " <<
+    "Cache hit rate: "  << 100.0 * stats.hitRate() << "%"     << ", " <<
+    "Bytes in use: "    << stats.bytesInUse                   << ", " <<
+    "Bytes cached: "    << stats.bytesCached                  << ", " <<
+    "High-water mark: " << stats.highWaterMark << " bytes"    << std::endl;
+}
+// =============================================================================
+
+// =============================================================================
+// Private Methods
+// =============================================================================
+
+// =============================================================================
+inline DeviceMemoryPool::~DeviceMemoryPool()
+{
+    for (auto &cached : _cachedBlocks)
+    {
+        cudaEventDestroy(cached.second.event);
+        cudaFree(cached.second.ptr);
+    }
+}
+// =============================================================================
+
+// =============================================================================
+inline size_t DeviceMemoryPool::_binSize(size_t const bytes)
+{
+    if (bytes > _maxBinBytes)
+    {
+        return bytes;
+    }
+
+    size_t binBytes = _minBinBytes;
+    while (binBytes < bytes)
+    {
+        binBytes <<= 1;
+    }
+    return binBytes;
+}
+// =============================================================================
+
+// =============================================================================
+inline void DeviceMemoryPool::_freeBlock(_Block &block)
+{
+    if (block.event != nullptr)
+    {
+        CudaSafeCall(cudaEventDestroy(block.event));
+    }
+    CudaSafeCall(cudaFree(block.ptr));
+}
+// =============================================================================
+
+// =============================================================================
+inline void DeviceMemoryPool::_releaseCached(int const device)
+{
+    for (auto itr = _cachedBlocks.begin(); itr != _cachedBlocks.end();)
+    {
+        if ((device == -1) or (itr->second.device == device))
+        {
+            _stats.bytesCached -= itr->second.bytes;
+            _freeBlock(itr->second);
+            itr = _cachedBlocks.erase(itr);
+        }
+        else
+        {
+            itr++;
+        }
+    }
+}
+// =============================================================================
+
+// =============================================================================
+// End definition of DeviceMemoryPool class
+// =============================================================================
@@ -0,0 +1,342 @@
+/*!
+ * \file DevicePerfTimer.h
+ * \author Robert 'Bob' Caddy (rvc@pitt.edu)
+ * \brief Contains the DevicePerfTimer class which times work on a CUDA stream
+ * with pairs of CUDA events, without synchronizing the stream, and feeds the
+ * times into a PerfTimer
+ *
+ */
+
+#pragma once
+
+// STL Includes
+#include <string>
+#include <vector>
+#include <deque>
+#include <iostream>
+
+// External Includes
+#include <cuda_runtime.h>
+
+// Local Includes
+#include "CudaUtilities.h"
+#include "PerfTimer.h"
+
+// =============================================================================
+// Declaration of DevicePerfTimer class
+// =============================================================================
+/*!
+ * \brief A timer for work on a CUDA stream
+ *
+ * \details DevicePerfTimer::startTimer() and DevicePerfTimer::stopTimer() only
+ * record a CUDA event on the stream, they never wait for the device, so the
+ * work being timed and anything else in flight on other streams runs exactly
+ * as it would without the timer. The elapsed times of the recorded event
+ * pairs are resolved lazily, in order, by DevicePerfTimer::resolve() which
+ * is called by everything that reads the statistics. The times then go into
+ * a regular PerfTimer so the statistics, percentiles, and csv output are the
+ * same as for host timers.
+ *
+ * The event pairs are reused once they have been resolved. If every pair is
+ * in flight when `stopTimer()` is called the pairs that the device has
+ * already finished are resolved without blocking and, if there still aren't
+ * any free ones, more are created, so the host never waits on the device
+ * until the statistics are read.
+ *
+ * The events are created on the device that was current when the timer was
+ * constructed and the streams used must belong to that device. CUDA events
+ * have a resolution of about half a microsecond.
+ *
+ */
+class DevicePerfTimer
+{
+public:
+    /*!
+     * \brief Construct a new Device Perf Timer object
+     *
+     * \param[in] name The name of the timer
+     * \param[in] stream The stream to record events on when no stream is
+     * passed to `startTimer()`. Defaults to the default stream
+     * \param[in] initialPairs The number of event pairs to create up front.
+     * Defaults to 64
+     * \param[in] mode How the PerfTimer stores the raw time differences.
+     * Defaults to storing all of them
+     * \param[in] numRawSamples The size of the PerfTimer ring buffer in
+     * streaming mode. Defaults to 1024
+     */
+    DevicePerfTimer(std::string     const &name,
+                    cudaStream_t    const stream = 0,
+                    size_t          const initialPairs = 64,
+                    PerfTimer::Mode const mode = PerfTimer::Mode::storeAll,
+                    size_t          const numRawSamples = 1024);
+
+    /*!
+     * \brief Destroy the Device Perf Timer object and all of its events. Any
+     * event pairs that haven't been resolved are discarded
+     *
+     */
+    ~DevicePerfTimer();
+
+    // Copying would destroy the same events twice
+    DevicePerfTimer(DevicePerfTimer const &)            = delete;
+    DevicePerfTimer &operator=(DevicePerfTimer const &) = delete;
+
+    /*!
+     * \brief Record the start event on the stream given to the constructor
+     *
+     */
+    void startTimer() {startTimer(_stream);}
+
+    /*!
+     * \brief Record the start event on the given stream. If the timer is
+     * already started then nothing is done and an error message is printed
+     *
+     * \param[in] stream The stream to record on. The stop event is recorded
+     * on the same stream
+     */
+    void startTimer(cudaStream_t const stream);
+
+    /*!
+     * \brief Record the stop event on the stream that the start event was
+     * recorded on. If the timer isn't started then nothing is done and an
+     * error message is printed
+     *
+     */
+    void stopTimer();
+
+    /*!
+     * \brief Wait for all the recorded event pairs to complete and add their
+     * elapsed times to the PerfTimer
+     *
+     */
+    void resolve() {_resolve(true);}
+
+    /*!
+     * \brief Get the number of event pairs that have been recorded but not
+     * resolved yet
+     *
+     * \return size_t The number of pending event pairs
+     */
+    size_t numPending() const {return _pending.size();}
+
+    /*!
+     * \brief Resolve all the event pairs and get the PerfTimer holding the
+     * statistics
+     *
+     * \return PerfTimer& The timer
+     */
+    PerfTimer &timer() {resolve(); return _timer;}
+
+    /*!
+     * \brief Resolve all the event pairs and print out the statistics. See
+     * PerfTimer::reportStats()
+     *
+     * \param[in] outStream What stream to write out to. Defaults to std::cout
+     */
+    void reportStats(std::ostream &outStream = std::cout)
+        {timer().reportStats(outStream);}
+
+    /*!
+     * \brief Resolve all the event pairs and write out the statistics and time
+     * differences. See PerfTimer::saveTimingData()
+     *
+     * \param[in] filePath The path at which to write the output file
+     */
+    void saveTimingData(std::string const &filePath)
+        {timer().saveTimingData(filePath);}
+
+private:
+    /// A start and stop event
+    struct EventPair
+    {
+        cudaEvent_t  start;
+        cudaEvent_t  stop;
+    };
+
+    /// The PerfTimer that the resolved times are added to
+    PerfTimer _timer;
+
+    /// The default stream to record events on
+    cudaStream_t _stream;
+
+    /// The device that the events were created on
+    int _device;
+
+    /// The event pairs that can be recorded
+    std::vector<EventPair> _free;
+
+    /// The recorded event pairs that haven't been resolved, oldest first
+    std::deque<EventPair> _pending;
+
+    /// The event pair that has been started but not stopped
+    EventPair _active;
+
+    /// The stream that the active pair was started on
+    cudaStream_t _activeStream;
+
+    /// Indicates if a timer is active
+    bool _activeTimer = false;
+
+    /*!
+     * \brief Add the elapsed time of the pending event pairs to the PerfTimer
+     * in order and free them
+     *
+     * \param[in] blocking If true wait for every pending pair, otherwise stop at
+     * the first pair that the device hasn't finished yet
+     */
+    void _resolve(bool const blocking);
+
+    /*!
+     * \brief Create a new event pair
+     *
+     * \return EventPair The new event pair
+     */
+    EventPair _createPair();
+};
+// =============================================================================
+// End declaration of DevicePerfTimer class
+// =============================================================================
+
+// =============================================================================
+// Implementation of DevicePerfTimer class
+// =============================================================================
+
+// =============================================================================
+// Public Methods
+// =============================================================================
+
+// =============================================================================
+inline DevicePerfTimer::DevicePerfTimer(std::string     const &name,
+                                        cudaStream_t    const stream,
+                                        size_t          const initialPairs,
+                                        PerfTimer::Mode const mode,
+                                        size_t          const numRawSamples)
+    :
+    _timer(name, mode, numRawSamples),
+    _stream(stream),
+    _device(getCurrentDevice())
+{
+    _free.reserve(initialPairs);
+    for (size_t i = 0; i < initialPairs; i++)
+    {
+        _free.push_back(_createPair());
+    }
+}
+// =============================================================================
+
+// =============================================================================
+inline DevicePerfTimer::~DevicePerfTimer()
+{
+    CudaDeviceGuard guard(_device);
+
+    if (_activeTimer)
+    {
+        _pending.push_back(_active);
+    }
+    _free.insert(_free.end(), _pending.begin(), _pending.end());
+    for (EventPair &pair : _free)
+    {
+        CudaSafeCall(cudaEventDestroy(pair.start));
+        CudaSafeCall(cudaEventDestroy(pair.stop));
+    }
+}
+// =============================================================================
+
+// =============================================================================
+inline void DevicePerfTimer::startTimer(cudaStream_t const stream)
+{
+    // Check if a timer is already running
+    if (_activeTimer)
+    {
+        std::cout << "DevicePerfTimer::timer is already active. No action "
+                     "taken";
+        return;
+    }
+
+    if (_free.empty())
+    {
+        _free.push_back(_createPair());
+    }
+    _active = _free.back();
+    _free.pop_back();
+    _activeStream = stream;
+    _activeTimer  = true;
+
+    CudaSafeCall(cudaEventRecord(_active.start, _activeStream));
+}
+// =============================================================================
+
+// =============================================================================
+inline void DevicePerfTimer::stopTimer()
+{
+    if (not _activeTimer)
+    {
+        std::cout << "DevicePerfTimer::timer is not active. No action taken";
+        return;
+    }
+
+    CudaSafeCall(cudaEventRecord(_active.stop, _activeStream));
+    _pending.push_back(_active);
+    _activeTimer = false;
+
+    // Recycle the pairs that are already done so the pool only grows if the
+    // device is far behind the host
+    if (_free.empty())
+    {
+        _resolve(false);
+    }
+}
+// =============================================================================
+
+// =============================================================================
+// Private Methods
+// =============================================================================
+
+// =============================================================================
+inline void DevicePerfTimer::_resolve(bool const blocking)
+{
+    while (not _pending.empty())
+    {
+        EventPair const pair = _pending.front();
+        if (blocking)
+        {
+            CudaSafeCall(cudaEventSynchronize(pair.stop));
+        }
+        else
+        {
+            // Stop at the first pair that isn't done so the samples are added
+            // in the order they were recorded. Later pairs recorded on other
+            // streams may already be done, they're picked up on a later call
+            cudaError_t const status = cudaEventQuery(pair.stop);
+            if (status == cudaErrorNotReady)
+            {
+                return;
+            }
+            CudaSafeCall(status);
+        }
+
+        float milliseconds;
+        CudaSafeCall(cudaEventElapsedTime(&milliseconds, pair.start, pair.stop));
+        _timer.addSample(static_cast<double>(milliseconds) * 1.E6);
+
+        _pending.pop_front();
+        _free.push_back(pair);
+    }
+}
+// =============================================================================
+
+// =============================================================================
+inline DevicePerfTimer::EventPair DevicePerfTimer::_createPair()
+{
+    CudaDeviceGuard guard(_device);
+
+    EventPair pair;
+    CudaSafeCall(cudaEventCreate(&pair.start));
+    CudaSafeCall(cudaEventCreate(&pair.stop));
+    return pair;
+}
+// =============================================================================
+
+// =============================================================================
+// End implementation of DevicePerfTimer class
+// =============================================================================
@@ -0,0 +1,526 @@
+/*!
+ * \file DevicePersistentCommunicator.h
+ * \author Robert 'Bob' Caddy (rvc@pitt.edu)
+ * \brief Contains the declartion and implementation of the
+ * DevicePersistentCommunicator class which performs MPI persistent
+ * communication directly on DeviceVectors, using CUDA-aware MPI when it is
+ * available and pipelined pinned host staging when it isn't. Note that since
+ * this is a templated class the implementation must be in the header file
+ *
+ */
+
+#pragma once
+
+// STL Includes
+#include <vector>
+#include <string>
+#include <memory>
+#include <cstdlib>
+#include <climits>
+#include <limits>
+#include <algorithm>
+#include <stdexcept>
+
+// External Includes
+#include <mpi.h>
+#if defined(OPEN_MPI) && OPEN_MPI
+#include <mpi-ext.h>
+#endif  // OPEN_MPI
+#include <cuda_runtime.h>
+
+// Local Includes
+#include "CudaUtilities.h"
+#include "DeviceVector.h"
+#include "PinnedHostVector.h"
+#include "PersistentCommunicator.h"
+
+// =============================================================================
+// CUDA-aware MPI detection
+// =============================================================================
+/*!
+ * \brief Check if the MPI library can communicate device memory directly.
+ *
+ * \details The `CUDA_AWARE_MPI` environment variable takes precedence, set it
+ * to `0` or `1` to override the detection. Otherwise Open MPI is queried with
+ * `MPIX_Query_cuda_support` and MVAPICH2 and Cray MPICH are detected from the
+ * environment variables that enable their GPU support. Anything else is
+ * assumed not to be CUDA-aware.
+ *
+ * \return true The MPI library is CUDA-aware
+ * \return false The MPI library is not CUDA-aware, device buffers must be
+ * staged through host memory
+ */
+inline bool isCudaAwareMpi()
+{
+    if (char const *forced = std::getenv("CUDA_AWARE_MPI"))
+    {
+        return std::string(forced) != "0";
+    }
+
+#if defined(MPIX_CUDA_AWARE_SUPPORT) && MPIX_CUDA_AWARE_SUPPORT
+    if (MPIX_Query_cuda_support() == 1)
+    {
+        return true;
+    }
+#endif  // MPIX_CUDA_AWARE_SUPPORT
+
+    for (char const *variable : {"MV2_USE_CUDA", "MPICH_GPU_SUPPORT_ENABLED"})
+    {
+        char const *value = std::getenv(variable);
+        if ((value != nullptr) and (std::string(value) == "1"))
+        {
+            return true;
+        }
+    }
+
+    return false;
+}
+// =============================================================================
+// End CUDA-aware MPI detection
+// =============================================================================
+
+// =============================================================================
+// Declaration of DevicePersistentCommunicator class
+// =============================================================================
+/*!
+ * \brief A class for performing persistent MPI communication on all or part of
+ * a DeviceVector. The MPI_Datatype is inferred from `T`.
+ *
+ * \details If the MPI library is CUDA-aware the device pointer is handed
+ * directly to MPI and no staging is done. Otherwise the data is staged
+ * through a pinned host buffer and the message is split into chunks with one
+ * persistent request each, so that the device to host copy of one chunk
+ * overlaps with sending the previous chunk, and the host to device copy of
+ * one chunk overlaps with receiving the next chunk. Both modes use the same
+ * chunking so ranks using different modes can communicate with each other,
+ * but both sides must use the same chunk size.
+ *
+ * All device work is ordered on `stream`: `start()` on a send waits for the
+ * work already enqueued on `stream` and once `wait()` or a successful `test()`
+ * returns on a receive the data is valid for any work enqueued on `stream`
+ * afterwards. The DeviceVector must not be resized, reset, or moved while
+ * this object exists.
+ *
+ * \tparam T The type of the elements. Must have an MpiType specialization
+ * \tparam Allocator The allocator of the DeviceVector
+ */
+template <typename T, typename Allocator = CudaMallocAllocator>
+class DevicePersistentCommunicator
+{
+public:
+    /// The default chunk size in bytes. Large enough that most halos are
+    /// sent in a single message
+    static size_t constexpr defaultChunkBytes = 4 * 1024 * 1024;
+
+    /// Passed as `count` to communicate everything from `offset` to the end
+    /// of the DeviceVector
+    static size_t constexpr toEnd = std::numeric_limits<size_t>::max();
+
+    /*!
+     * \brief Construct a new Device Persistent Communicator object that
+     * communicates `count` elements of the DeviceVector starting at `offset`,
+     * by default the whole vector. Throws a std::out_of_range error if the
+     * range isn't in the vector
+     *
+     * \param[in] commKind What kind of communication to perform. Options are
+     * "send" and "receive". Anything else will throw a std::invalid_argument
+     * error
+     * \param[in] deviceVector The DeviceVector to communicate
+     * \param[in] otherRank The rank of the other MPI processing being
+     * communicated with. In the case of a send this is the recipient rank and
+     * in the case of a receive this is the senders rank
+     * \param[in] tag Tag for the communication, defaults to zero.
+     * \param[in] mpiCommunicator The MPI communicator to use. Defaults to
+     * `MPI_COMM_WORLD`
+     * \param[in] offset The first element to communicate. Defaults to zero
+     * \param[in] count The number of elements to communicate. Defaults to
+     * `toEnd` which communicates everything after `offset`
+     * \param[in] stream The stream that device work is ordered on. Defaults
+     * to the default stream
+     * \param[in] cudaAware Whether to pass device pointers directly to MPI.
+     * Defaults to the result of `isCudaAwareMpi()`
+     * \param[in] chunkBytes The size of the chunks the message is split into.
+     * Must be the same on both sides. Defaults to `defaultChunkBytes`
+     */
+    DevicePersistentCommunicator(std::string  const &commKind,
+                                 DeviceVector<T, Allocator> &deviceVector,
+                                 int          const &otherRank,
+                                 int          const &tag = 0,
+                                 MPI_Comm     const &mpiCommunicator = MPI_COMM_WORLD,
+                                 size_t       const &offset = 0,
+                                 size_t       const &count = toEnd,
+                                 cudaStream_t const stream = 0,
+                                 bool         const cudaAware = isCudaAwareMpi(),
+                                 size_t       const chunkBytes = defaultChunkBytes);
+
+    /*!
+     * \brief Destroy the Device Persistent Communicator object. The staging
+     * events are destroyed and the persistent requests free themselves
+     *
+     */
+    ~DevicePersistentCommunicator();
+
+    // The persistent requests point into this object so it can't be copied
+    // or moved
+    DevicePersistentCommunicator(DevicePersistentCommunicator const &) = delete;
+    DevicePersistentCommunicator &operator=(
+        DevicePersistentCommunicator const &) = delete;
+
+    /*!
+     * \brief Start the communication. For a staged send this enqueues the
+     * device to host copies and starts each chunk as soon as its copy is
+     * done, so it returns once the last chunk has been copied
+     *
+     */
+    void start();
+
+    /*!
+     * \brief Wait on the communication to finish. For a staged receive this
+     * enqueues the host to device copy of each chunk as soon as it arrives
+     *
+     */
+    void wait();
+
+    /*!
+     * \brief Test if the communication is complete. For a staged receive the
+     * host to device copies of the chunks that have arrived are enqueued
+     *
+     * \param[out] flag True if the communication is complete
+     */
+    void test(int &flag);
+
+    /*!
+     * \brief Check if the device pointer is passed directly to MPI
+     *
+     * \return true CUDA-aware MPI is used
+     * \return false The data is staged through pinned host memory
+     */
+    bool isCudaAware() const {return _cudaAware;}
+
+    /*!
+     * \brief Get the number of chunks, one persistent request each, the
+     * message is split into
+     *
+     * \return size_t The number of chunks
+     */
+    size_t numChunks() const {return _chunks.size();}
+
+    /// Whether this is a send, otherwise it's a receive
+    bool         const isSend;
+
+    /// The number of elements being communicated
+    size_t       const count;
+
+    /// The other rank being communicated with
+    int          const otherRank;
+
+    /// The tag of this communication
+    int          const tag;
+
+private:
+    /// The device pointer to the first element being communicated
+    T *_devicePtr;
+
+    /// The device that owns the DeviceVector
+    int _device;
+
+    /// The stream device work is ordered on
+    cudaStream_t _stream;
+
+    /// Whether the device pointer is passed directly to MPI
+    bool _cudaAware;
+
+    /// The number of elements in each chunk, the last one might be smaller
+    size_t _chunkElements;
+
+    /// The pinned buffer used for staging, empty if `_cudaAware`
+    PinnedHostVector<T> _stagingBuffer;
+
+    /// The persistent communication of each chunk
+    std::vector<std::unique_ptr<PersistentCommunicator>> _chunks;
+
+    /// One event per chunk, recorded after the device to host copy of that
+    /// chunk. Only used for staged sends
+    std::vector<cudaEvent_t> _chunkEvents;
+
+    /// Recorded after the host to device copies of a staged receive so the
+    /// staging buffer isn't overwritten while they are in flight
+    cudaEvent_t _completeEvent=nullptr;
+
+    /// The index of the next chunk of a staged receive to copy to the device
+    size_t _nextChunk=0;
+
+    /*!
+     * \brief Get the first element of chunk `chunk`
+     *
+     * \param[in] chunk The index of the chunk
+     * \return size_t The index of the chunk's first element
+     */
+    size_t _chunkOffset(size_t const chunk) const {return chunk*_chunkElements;}
+
+    /*!
+     * \brief Get the number of elements in chunk `chunk`
+     *
+     * \param[in] chunk The index of the chunk
+     * \return size_t The number of elements in the chunk
+     */
+    size_t _chunkCount(size_t const chunk) const
+        {return std::min(_chunkElements, count - _chunkOffset(chunk));}
+
+    /*!
+     * \brief Enqueue the host to device copy of the next chunk of a staged
+     * receive and record `_completeEvent` after the last one
+     *
+     */
+    void _copyNextChunkToDevice();
+};
+// =============================================================================
+// End declaration of DevicePersistentCommunicator class
+// =============================================================================
+
+// =============================================================================
+// Implementation of DevicePersistentCommunicator class
+// =============================================================================
+
+// =============================================================================
+// Public Methods
+// =============================================================================
+
+// =============================================================================
+template <typename T, typename Allocator>
+DevicePersistentCommunicator<T, Allocator>::DevicePersistentCommunicator(
+    std::string  const &commKind,
+    DeviceVector<T, Allocator> &deviceVector,
+    int          const &otherRank,
+    int          const &tag,
+    MPI_Comm     const &mpiCommunicator,
+    size_t       const &offset,
+    size_t       const &count,
+    cudaStream_t const stream,
+    bool         const cudaAware,
+    size_t       const chunkBytes)
+    :
+    isSend(commKind == "send"),
+    count((count == toEnd)? deviceVector.size() - std::min(offset,
+                                                           deviceVector.size())
+                          : count),
+    otherRank(otherRank),
+    tag(tag),
+    _device(deviceVector.device()),
+    _stream(stream),
+    _cudaAware(cudaAware),
+    _chunkElements(std::max(size_t(1), chunkBytes / sizeof(T)))
+{
+    if ((commKind != "send") and (commKind != "receive"))
+    {
+        throw std::invalid_argument("Invalid commKind passed to "
+                                    "DevicePersistentCommunicator. Expected "
+                                    "\"send\" or \"receive\", got " + commKind);
+    }
+    if ((offset > deviceVector.size())
+        or (this->count > deviceVector.size() - offset))
+    {
+        throw std::out_of_range("Warning: DevicePersistentCommunicator tried "
+                                "to communicate elements ["
+                                + std::to_string(offset)
+                                + ", "
+                                + std::to_string(offset + this->count)
+                                + ") of a DeviceVector with "
+                                + std::to_string(deviceVector.size())
+                                + " elements");
+    }
+
+    // MPI counts are ints
+    _chunkElements = std::min(_chunkElements, size_t(INT_MAX));
+    _devicePtr     = deviceVector.data() + offset;
+
+    if (not _cudaAware)
+    {
+        _stagingBuffer.reset(this->count);
+    }
+    T *buffer = (_cudaAware)? _devicePtr: _stagingBuffer.data();
+
+    size_t const numChunks = (this->count + _chunkElements - 1)
+                             / _chunkElements;
+    for (size_t chunk = 0; chunk < numChunks; chunk++)
+    {
+        _chunks.emplace_back(new PersistentCommunicator(
+            commKind,
+            buffer + _chunkOffset(chunk),
+            static_cast<int>(_chunkCount(chunk)),
+            mpiTypeOf<T>(),
+            otherRank,
+            tag,
+            mpiCommunicator));
+    }
+
+    if (not _cudaAware)
+    {
+        CudaDeviceGuard guard(_device);
+        if (isSend)
+        {
+            _chunkEvents.resize(numChunks);
+            for (cudaEvent_t &event : _chunkEvents)
+            {
+                CudaSafeCall(cudaEventCreateWithFlags(&event,
+                                                      cudaEventDisableTiming));
+            }
+        }
+        else
+        {
+            CudaSafeCall(cudaEventCreateWithFlags(&_completeEvent,
+                                                  cudaEventDisableTiming));
+        }
+    }
+}
+// =============================================================================
+
+// =============================================================================
+template <typename T, typename Allocator>
+DevicePersistentCommunicator<T, Allocator>::~DevicePersistentCommunicator()
+{
+    CudaDeviceGuard guard(_device);
+    for (cudaEvent_t const event : _chunkEvents)
+    {
+        CudaSafeCall(cudaEventDestroy(event));
+    }
+    if (_completeEvent != nullptr)
+    {
+        CudaSafeCall(cudaEventDestroy(_completeEvent));
+    }
+}
+// =============================================================================
+
+// =============================================================================
+template <typename T, typename Allocator>
+void DevicePersistentCommunicator<T, Allocator>::start()
+{
+    CudaDeviceGuard guard(_device);
+
+    if (_cudaAware)
+    {
+        // MPI isn't stream aware so the data must be ready before sending
+        if (isSend)
+        {
+            CudaSafeCall(cudaStreamSynchronize(_stream));
+        }
+        for (std::unique_ptr<PersistentCommunicator> &chunk : _chunks)
+        {
+            chunk->start();
+        }
+    }
+    else if (isSend)
+    {
+        // Enqueue all the copies then send each chunk as soon as it's on the
+        // host
+        for (size_t chunk = 0; chunk < _chunks.size(); chunk++)
+        {
+            size_t const chunkOffset = _chunkOffset(chunk);
+            CudaSafeCall(cudaMemcpyAsync(_stagingBuffer.data() + chunkOffset,
+                                         _devicePtr + chunkOffset,
+                                         _chunkCount(chunk)*sizeof(T),
+                                         cudaMemcpyDefault,
+                                         _stream));
+            CudaSafeCall(cudaEventRecord(_chunkEvents[chunk], _stream));
+        }
+        for (size_t chunk = 0; chunk < _chunks.size(); chunk++)
+        {
+            CudaSafeCall(cudaEventSynchronize(_chunkEvents[chunk]));
+            _chunks[chunk]->start();
+        }
+    }
+    else
+    {
+        // Make sure the copies from the last receive are done with the
+        // staging buffer
+        CudaSafeCall(cudaEventSynchronize(_completeEvent));
+        _nextChunk = 0;
+        for (std::unique_ptr<PersistentCommunicator> &chunk : _chunks)
+        {
+            chunk->start();
+        }
+    }
+}
+// =============================================================================
+
+// =============================================================================
+template <typename T, typename Allocator>
+void DevicePersistentCommunicator<T, Allocator>::wait()
+{
+    if (_cudaAware or isSend)
+    {
+        for (std::unique_ptr<PersistentCommunicator> &chunk : _chunks)
+        {
+            chunk->wait();
+        }
+    }
+    else
+    {
+        while (_nextChunk < _chunks.size())
+        {
+            _chunks[_nextChunk]->wait();
+            _copyNextChunkToDevice();
+        }
+    }
+}
+// =============================================================================
+
+// =============================================================================
+template <typename T, typename Allocator>
+void DevicePersistentCommunicator<T, Allocator>::test(int &flag)
+{
+    flag = 1;
+    if (_cudaAware or isSend)
+    {
+        for (std::unique_ptr<PersistentCommunicator> &chunk : _chunks)
+        {
+            int chunkFlag;
+            chunk->test(chunkFlag);
+            flag = flag and chunkFlag;
+        }
+    }
+    else
+    {
+        // Copy the chunks that have arrived, in order, to the device
+        while (_nextChunk < _chunks.size())
+        {
+            int chunkFlag;
+            _chunks[_nextChunk]->test(chunkFlag);
+            if (not chunkFlag)
+            {
+                flag = 0;
+                break;
+            }
+            _copyNextChunkToDevice();
+        }
+    }
+}
+// =============================================================================
+
+// =============================================================================
+// Private Methods
+// =============================================================================
+
+// =============================================================================
+template <typename T, typename Allocator>
+void DevicePersistentCommunicator<T, Allocator>::_copyNextChunkToDevice()
+{
+    CudaDeviceGuard guard(_device);
+    size_t const chunkOffset = _chunkOffset(_nextChunk);
+    CudaSafeCall(cudaMemcpyAsync(_devicePtr + chunkOffset,
+                                 _stagingBuffer.data() + chunkOffset,
+                                 _chunkCount(_nextChunk)*sizeof(T),
+                                 cudaMemcpyDefault,
+                                 _stream));
+    _nextChunk++;
+
+    if (_nextChunk == _chunks.size())
+    {
+        CudaSafeCall(cudaEventRecord(_completeEvent, _stream));
+    }
+}
+// =============================================================================
+
+// =============================================================================
+// End implementation of DevicePersistentCommunicator class
+// =============================================================================
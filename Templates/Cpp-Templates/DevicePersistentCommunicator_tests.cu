@@ -0,0 +1,99 @@
+/*!
+ * \file device_persistent_communicator_tests.cu
+ * \author Robert 'Bob' Caddy (rvc@pitt.edu)
+ * \brief Tests for the DevicePersistentCommunicator class. These are kept
+ * separate from the DeviceVector tests since they need MPI
+ *
+ */
+
+// STL Includes
+#include <vector>
+#include <numeric>
+
+// External Includes
+#include <gtest/gtest.h>    // Include GoogleTest and related libraries/headers
+#include <mpi.h>
+
+// Local Includes
+#include "../global/global.h"
+#include "../utils/testing_utilities.h"
+#include "../utils/DeviceVector.h"
+#include "../utils/DevicePersistentCommunicator.h"
+
+
+namespace // Anonymous namespace
+{
+    /// Initializes MPI if nothing else has, the tests only communicate within
+    /// MPI_COMM_SELF so they don't need mpirun. MPI is only finalized if it
+    /// was initialized here
+    class MpiEnvironment : public ::testing::Environment
+    {
+    public:
+        void SetUp() override
+        {
+            int initialized;
+            MPI_Initialized(&initialized);
+            if (not initialized)
+            {
+                MPI_Init(nullptr, nullptr);
+                _ownsMpi = true;
+            }
+        }
+        void TearDown() override
+        {
+            if (_ownsMpi)
+            {
+                MPI_Finalize();
+            }
+        }
+
+    private:
+        bool _ownsMpi = false;
+    };
+    ::testing::Environment *const mpiEnvironment
+        = ::testing::AddGlobalTestEnvironment(new MpiEnvironment);
+} // Anonymous namespace
+
+// =============================================================================
+// Tests for expected behavior
+// =============================================================================
+TEST(tALLDevicePersistentCommunicator,
+     StagedRoundTripExpectCorrectChunksAndValues)
+{
+    // Send a sub-range of one vector to the start of another through the host
+    // staging buffer, in chunks that don't divide the message evenly
+    size_t const vectorSize = 1000, offset = 100, count = 777;
+    size_t const chunkBytes = 64 * sizeof(double);
+    cuda_utilities::DeviceVector<double> source{vectorSize}, destination{vectorSize};
+    std::vector<double> stdVec(vectorSize), hostResult(vectorSize);
+    std::iota(stdVec.begin(), stdVec.end(), 0);
+    source.cpyHostToDevice(stdVec);
+
+    DevicePersistentCommunicator<double> receive("receive", destination, 0, 0,
+                                                 MPI_COMM_SELF, 0, count, 0,
+                                                 false, chunkBytes);
+    DevicePersistentCommunicator<double> send("send", source, 0, 0,
+                                              MPI_COMM_SELF, offset, count, 0,
+                                              false, chunkBytes);
+    EXPECT_FALSE(send.isCudaAware());
+    EXPECT_EQ(13U, send.numChunks());
+    EXPECT_EQ(send.numChunks(), receive.numChunks());
+
+    // Persistent requests are reused, so check that a second exchange works
+    for (int exchange = 0; exchange < 2; exchange++)
+    {
+        destination.fill(-1.0);
+        receive.start();
+        send.start();
+        send.wait();
+        receive.wait();
+        CudaSafeCall(cudaDeviceSynchronize());
+
+        destination.cpyDeviceToHost(hostResult);
+        for (size_t i = 0; i < vectorSize; i++)
+        {
+            double const expected = (i < count)? stdVec.at(offset + i): -1.0;
+            EXPECT_EQ(expected, hostResult.at(i));
+        }
+    }
+}
@@ -14,32 +14,273 @@
 #include <string>
 #include <stdexcept>
 #include <algorithm>
+#include <cstring>
+#include <utility>
+#include <limits>
 
 // External Includes
 #include <cuda_runtime.h>
 
 // Local Includes
+#include "CudaUtilities.h"
+#include "PinnedHostVector.h"
+#include "DeviceAllocators.h"
 
 // =============================================================================
-// Macros for CUDA calls
+// Kernels used by DeviceVector
 // =============================================================================
-#define CudaSafeCall( err ) __cudaSafeCall( err, __FILE__, __LINE__ )
-
-inline void __cudaSafeCall( cudaError err, const char *file, const int line )
+#ifdef __CUDACC__
+namespace device_vector_kernels
 {
-#ifdef CUDA_ERROR_CHECK
-    if ( cudaSuccess != err )
+    /// The number of threads per block used by the DeviceVector kernels
+    unsigned int constexpr threadsPerBlock = 256;
+
+    /*!
+     * \brief Compute the number of blocks to launch for a grid-stride kernel
+     * over `numElements` elements
+     *
+     * \param[in] numElements The number of elements the kernel processes
+     * \return unsigned int The number of blocks
+     */
+    inline unsigned int numBlocks(size_t const numElements)
     {
-        fprintf( stderr, "cudaSafeCall() failed at %s:%i : %s\n",
-                 file, line, cudaGetErrorString( err ) );
-        exit( -1 );
+        size_t const maxBlocks = 65535;
+        return static_cast<unsigned int>(
+            std::min((numElements + threadsPerBlock - 1) / threadsPerBlock,
+                     maxBlocks));
     }
-#endif
 
-    return;
-}
+    /*!
+     * \brief Gather `source[indices[i]]` into `destination[i]`
+     *
+     */
+    template <typename T>
+    __global__ void gather(T const * source,
+                           size_t const * indices,
+                           T * destination,
+                           size_t const numIndices)
+    {
+        for (size_t i = size_t(blockIdx.x) * blockDim.x + threadIdx.x;
+             i < numIndices;
+             i += size_t(blockDim.x) * gridDim.x)
+        {
+            destination[i] = source[indices[i]];
+        }
+    }
+
+    /*!
+     * \brief Scatter `source[i]` into `destination[indices[i]]`
+     *
+     */
+    template <typename T>
+    __global__ void scatter(T const * source,
+                            size_t const * indices,
+                            T * destination,
+                            size_t const numIndices)
+    {
+        for (size_t i = size_t(blockIdx.x) * blockDim.x + threadIdx.x;
+             i < numIndices;
+             i += size_t(blockDim.x) * gridDim.x)
+        {
+            destination[indices[i]] = source[i];
+        }
+    }
+
+    /*!
+     * \brief Set every element of `destination` to `value`
+     *
+     */
+    template <typename T>
+    __global__ void fill(T * destination,
+                         size_t const numElements,
+                         T const value)
+    {
+        for (size_t i = size_t(blockIdx.x) * blockDim.x + threadIdx.x;
+             i < numElements;
+             i += size_t(blockDim.x) * gridDim.x)
+        {
+            destination[i] = value;
+        }
+    }
+
+    /*!
+     * \brief Set `destination[i]` to `start + i*step`
+     *
+     */
+    template <typename T>
+    __global__ void iota(T * destination,
+                         size_t const numElements,
+                         T const start,
+                         T const step)
+    {
+        for (size_t i = size_t(blockIdx.x) * blockDim.x + threadIdx.x;
+             i < numElements;
+             i += size_t(blockDim.x) * gridDim.x)
+        {
+            destination[i] = start + static_cast<T>(i) * step;
+        }
+    }
+
+    /*!
+     * \brief Replace every element of `destination` with `op(element)`
+     *
+     */
+    template <typename T, typename UnaryOp>
+    __global__ void transform(T * destination,
+                              size_t const numElements,
+                              UnaryOp op)
+    {
+        for (size_t i = size_t(blockIdx.x) * blockDim.x + threadIdx.x;
+             i < numElements;
+             i += size_t(blockDim.x) * gridDim.x)
+        {
+            destination[i] = op(destination[i]);
+        }
+    }
+
+    /*!
+     * \brief Reduce `source` with `op` and write one partial result per block
+     * to `destination[blockIdx.x]`. Each thread first reduces a grid-stride
+     * slice of the array then the block reduces the thread values in shared
+     * memory. Must be launched with a power of two number of threads, no more
+     * than `threadsPerBlock`
+     *
+     */
+    template <typename T, typename BinaryOp>
+    __global__ void reduce(T const * source,
+                           size_t const numElements,
+                           BinaryOp op,
+                           T const init,
+                           T * destination)
+    {
+        __shared__ T sharedValues[threadsPerBlock];
+
+        T threadValue = init;
+        for (size_t i = size_t(blockIdx.x) * blockDim.x + threadIdx.x;
+             i < numElements;
+             i += size_t(blockDim.x) * gridDim.x)
+        {
+            threadValue = op(threadValue, source[i]);
+        }
+        sharedValues[threadIdx.x] = threadValue;
+        __syncthreads();
+
+        for (unsigned int stride = blockDim.x / 2; stride > 0; stride /= 2)
+        {
+            if (threadIdx.x < stride)
+            {
+                sharedValues[threadIdx.x] = op(sharedValues[threadIdx.x],
+                                               sharedValues[threadIdx.x + stride]);
+            }
+            __syncthreads();
+        }
+
+        if (threadIdx.x == 0)
+        {
+            destination[blockIdx.x] = sharedValues[0];
+        }
+    }
+
+    /// Binary functor for sums, used by `DeviceVector::sum`
+    struct Sum
+    {
+        template <typename T>
+        __host__ __device__ T operator()(T const &a, T const &b) const
+            {return a + b;}
+    };
+
+    /// Binary functor for minimums, used by `DeviceVector::min`
+    struct Min
+    {
+        template <typename T>
+        __host__ __device__ T operator()(T const &a, T const &b) const
+            {return (b < a)? b: a;}
+    };
+
+    /// Binary functor for maximums, used by `DeviceVector::max`
+    struct Max
+    {
+        template <typename T>
+        __host__ __device__ T operator()(T const &a, T const &b) const
+            {return (a < b)? b: a;}
+    };
+} // namespace device_vector_kernels
+#endif  // __CUDACC__
+// =============================================================================
+// End kernels used by DeviceVector
+// =============================================================================
+
+// =============================================================================
+// Declaration of DeviceVectorSnapshot class
+// =============================================================================
+/*!
+ * \brief A read-only host side copy of a contiguous range of a DeviceVector,
+ * created with `DeviceVector::snapshot`. The values are indexed with the
+ * indices of the DeviceVector they were copied from, i.e. `snap[offset()]` is
+ * the first value in the snapshot.
+ *
+ * \tparam T The type of the values
+ */
+template <typename T>
+class DeviceVectorSnapshot
+{
+public:
+    /*!
+     * \brief Construct a new Device Vector Snapshot object
+     *
+     * \param[in] offset The index in the device array of the first value
+     * \param[in] values The values
+     */
+    DeviceVectorSnapshot(size_t const offset, std::vector<T> &&values)
+        : _offset(offset), _values(std::move(values)) {}
+
+    /*!
+     * \brief Get the index in the device array of the first value
+     *
+     * \return size_t The index of the first value
+     */
+    size_t offset() const {return _offset;}
+
+    /*!
+     * \brief Get the number of values in the snapshot
+     *
+     * \return size_t The number of values
+     */
+    size_t size() const {return _values.size();}
+
+    /*!
+     * \brief Get a value without bounds checking
+     *
+     * \param[in] index The index in the device array of the desired value
+     * \return T const& The value that was at dev_ptr[index]
+     */
+    T const &operator [] (size_t const &index) const
+        {return _values[index - _offset];}
+
+    /*!
+     * \brief Get a value with bounds checking
+     *
+     * \param[in] index The index in the device array of the desired value
+     * \return T const& The value that was at dev_ptr[index]
+     */
+    T const &at(size_t const index) const;
+
+    /*!
+     * \brief Get the values as a std::vector
+     *
+     * \return std::vector<T> const& The values
+     */
+    std::vector<T> const &values() const {return _values;}
+
+private:
+    /// The index in the device array of the first value
+    size_t _offset;
+
+    /// The values
+    std::vector<T> _values;
+};
 // =============================================================================
-// End macros for CUDA calls
+// End declaration of DeviceVectorSnapshot class
 // =============================================================================
 
 // =============================================================================
@@ -53,10 +294,23 @@ inline void __cudaSafeCall( cudaError err, const char *file, const int line )
  * `data()` method. This class works for any device side pointer, scalar or
  * array valued.
  *
+ * \details Each vector records the device that owns its memory, by default
+ * the device that was current when it was constructed, and switches to that
+ * device for allocations and kernel launches. Use `copyTo` to copy between
+ * vectors on different devices and ShardedDeviceVector to split one array
+ * across several devices. Every copy uses `cudaMemcpyDefault` so that the
+ * driver infers the direction from the pointers, which is required since
+ * the allocator may return managed or host memory instead of device memory.
+ *
  * \tparam T Any serialized type where `sizeof(T)` returns correct results
  * should work but non-primitive types have not been tested.
+ * \tparam Allocator The allocator used to get device memory. Defaults to
+ * CudaMallocAllocator which calls `cudaMalloc` and `cudaFree` directly. Use
+ * CachingDeviceAllocator for vectors that are created, reset, or resized
+ * often, ManagedAllocator for unified memory, or MappedHostAllocator for
+ * zero-copy host memory. See DeviceAllocators.h for details
  */
-template <typename T>
+template <typename T, typename Allocator = CudaMallocAllocator>
 class DeviceVector
 {
 public:
@@ -69,12 +323,161 @@ public:
      */
     DeviceVector(size_t const size) {_allocate(size);}
 
+    /*!
+     * \brief Construct a new Device Vector object on a specific device. The
+     * vector remembers the device and all allocations and kernel launches
+     * are performed on it regardless of the current device when they are
+     * called
+     *
+     * \param[in] size The number of elements desired in the array. Can be
+     * any positive integer.
+     * \param[in] device The device to allocate the array on
+     */
+    DeviceVector(size_t const size, int const device)
+        : _device(device) {_allocate(size);}
+
+    /*!
+     * \brief Construct a new, empty, Device Vector object. No memory is
+     * allocated until the vector is resized, reset, or appended to
+     *
+     */
+    DeviceVector() = default;
+
     /*!
      * \brief Destroy the Device Vector object by calling the `_deAllocate`
-     * private method
+     * private method and cleaning up the staging event if it exists
+     *
+     */
+    ~DeviceVector()
+    {
+        _deAllocate();
+        _freeScratchBuffer();
+        if (_stagingEvent != nullptr)
+        {
+            CudaSafeCall(cudaEventDestroy(_stagingEvent));
+        }
+        if (_scratchEvent != nullptr)
+        {
+            CudaSafeCall(cudaEventDestroy(_scratchEvent));
+        }
+    }
+
+    // Copying would result in a double free, use `clone()` to explicitly
+    // make a deep copy
+    DeviceVector(DeviceVector const &)            = delete;
+    DeviceVector &operator=(DeviceVector const &) = delete;
+
+    /*!
+     * \brief Move construct a Device Vector. Takes ownership of the device
+     * memory of `other` without any device work and leaves `other` empty.
+     * This allows DeviceVectors to be stored by value in STL containers
+     *
+     * \param[in,out] other The vector to move from
+     */
+    DeviceVector(DeviceVector &&other) noexcept
+        :
+        _size(other._size),
+        _capacity(other._capacity),
+        _ptr(other._ptr),
+        _device(other._device),
+        _stagingBuffer(std::move(other._stagingBuffer)),
+        _stagingEvent(other._stagingEvent),
+        _scratchBuffer(other._scratchBuffer),
+        _scratchBytes(other._scratchBytes),
+        _scratchEvent(other._scratchEvent),
+        _streamEvents(std::move(other._streamEvents))
+    {
+        other._size          = 0;
+        other._capacity      = 0;
+        other._ptr           = nullptr;
+        other._stagingEvent  = nullptr;
+        other._scratchBuffer = nullptr;
+        other._scratchBytes  = 0;
+        other._scratchEvent  = nullptr;
+        other._streamEvents.clear();
+    }
+
+    /*!
+     * \brief Move assign a Device Vector. Frees the current device memory
+     * then takes ownership of the device memory of `other` without any
+     * device work and leaves `other` empty
+     *
+     * \param[in,out] other The vector to move from
+     * \return DeviceVector& This vector
+     */
+    DeviceVector &operator=(DeviceVector &&other) noexcept
+    {
+        if (this != &other)
+        {
+            _deAllocate();
+            _size     = 0;
+            _capacity = 0;
+            std::swap(_size,          other._size);
+            std::swap(_capacity,      other._capacity);
+            std::swap(_ptr,           other._ptr);
+            std::swap(_device,        other._device);
+            std::swap(_stagingBuffer, other._stagingBuffer);
+            std::swap(_stagingEvent,  other._stagingEvent);
+            std::swap(_scratchBuffer, other._scratchBuffer);
+            std::swap(_scratchBytes,  other._scratchBytes);
+            std::swap(_scratchEvent,  other._scratchEvent);
+            std::swap(_streamEvents,  other._streamEvents);
+        }
+        return *this;
+    }
+
+    /*!
+     * \brief Make a deep copy of this vector. The new vector has the same
+     * size and the values are copied device to device with `cudaMemcpyAsync`
+     * on `stream`, as such the values in the new vector are not valid until
+     * the copy is complete.
+     *
+     * \param[in] stream The stream to issue the copy on. Defaults to the
+     * default stream
+     * \return DeviceVector The new vector
+     */
+    DeviceVector clone(cudaStream_t const stream=0) const;
+
+    /*!
+     * \brief Copy the whole array into `destination`, which may be on a
+     * different device. If the devices can access each other peer access is
+     * enabled and the copy goes directly over NVLink/PCIe with
+     * `cudaMemcpyPeerAsync`, otherwise the driver stages it through the
+     * host. Throws a std::out_of_range error if `destination` is smaller
+     * than this vector.
+     *
+     * \tparam OtherAllocator The allocator of the destination vector
+     * \param[in,out] destination The vector to copy into
+     * \param[in] stream The stream to issue the copy on. Must belong to the
+     * device of this vector or be the default stream. Defaults to the
+     * default stream
+     */
+    template <typename OtherAllocator>
+    void copyTo(DeviceVector<T, OtherAllocator> &destination,
+                cudaStream_t const stream=0);
+
+    /*!
+     * \brief Record that work using the array has been enqueued on `stream`
+     * so that freeing or reallocating the array, e.g. in the destructor,
+     * `reset`, or `resize`, is ordered after it. Without this an allocator
+     * that doesn't synchronize the device when freeing, like
+     * CachingDeviceAllocator, could hand the memory to a new owner while
+     * that work is still running. All the methods of this class that take a
+     * stream already call this; call it yourself after launching kernels or
+     * copies on `data()` on any stream other than the default stream.
+     *
+     * \param[in] stream The stream the work was enqueued on. Must belong to
+     * the device of this vector or be the default stream
+     */
+    void recordStream(cudaStream_t const stream) const
+        {_recordStream(stream, _device);}
+
+    /*!
+     * \brief Get the device that owns the array
      *
+     * \return int The device the array is allocated on
      */
-    ~DeviceVector() {_deAllocate();}
+    int device() const {return _device;}
 
     /*!
      * \brief Get the raw device pointer
@@ -90,6 +493,14 @@ public:
      */
     size_t size() {return _size;}
 
+    /*!
+     * \brief Get the number of elements that the array has room for before
+     * it has to be reallocated
+     *
+     * \return size_t The number of elements allocated
+     */
+    size_t capacity() {return _capacity;}
+
     /*!
      * \brief Overload the [] operator to return a value from device memory.
      * This method performs a cudaMemcpy to copy the desired element to the
@@ -121,31 +532,269 @@ public:
      */
     void assign(T const &hostValue, size_t const &index=0);
 
+    /*!
+     * \brief Prefetch the whole array to `device` with
+     * `cudaMemPrefetchAsync`. Only available when using the ManagedAllocator
+     *
+     * \param[in] device The device to migrate the memory to. Use
+     * `cudaCpuDeviceId` to migrate it to the host
+     * \param[in] stream The stream to perform the prefetch on. Defaults to
+     * the default stream
+     */
+    void prefetch(int const device, cudaStream_t const stream=0)
+        {prefetch(0, _size, device, stream);}
+
+    /*!
+     * \brief Prefetch `count` elements starting at `offset` to `device` with
+     * `cudaMemPrefetchAsync`. Targeted prefetching of the part of the array
+     * that is about to be used is much faster than waiting on page faults
+     * when the array doesn't fit in device memory. Only available when using
+     * the ManagedAllocator
+     *
+     * \param[in] offset The first element to prefetch
+     * \param[in] count The number of elements to prefetch
+     * \param[in] device The device to migrate the memory to. Use
+     * `cudaCpuDeviceId` to migrate it to the host
+     * \param[in] stream The stream to perform the prefetch on. Defaults to
+     * the default stream
+     */
+    void prefetch(size_t const offset,
+                  size_t const count,
+                  int const device,
+                  cudaStream_t const stream=0);
+
+    /*!
+     * \brief Give the driver a hint about how the whole array will be used
+     * with `cudaMemAdvise`. Only available when using the ManagedAllocator
+     *
+     * \param[in] advice The advice, e.g. `cudaMemAdviseSetReadMostly` or
+     * `cudaMemAdviseSetPreferredLocation`
+     * \param[in] device The device the advice applies to. Use
+     * `cudaCpuDeviceId` for the host
+     */
+    void advise(cudaMemoryAdvise const advice, int const device)
+        {advise(0, _size, advice, device);}
+
+    /*!
+     * \brief Give the driver a hint about how `count` elements starting at
+     * `offset` will be used with `cudaMemAdvise`. Only available when using
+     * the ManagedAllocator
+     *
+     * \param[in] offset The first element the advice applies to
+     * \param[in] count The number of elements the advice applies to
+     * \param[in] advice The advice, e.g. `cudaMemAdviseSetReadMostly` or
+     * `cudaMemAdviseSetPreferredLocation`
+     * \param[in] device The device the advice applies to. Use
+     * `cudaCpuDeviceId` for the host
+     */
+    void advise(size_t const offset,
+                size_t const count,
+                cudaMemoryAdvise const advice,
+                int const device);
+
+    /*!
+     * \brief Copy a host side snapshot of the whole array. See the
+     * `snapshot(offset, count)` overload for details
+     *
+     * \return DeviceVectorSnapshot<T> The snapshot
+     */
+    DeviceVectorSnapshot<T> snapshot() {return snapshot(0, _size);}
+
+    /*!
+     * \brief Copy the `count` elements starting at `offset` to the host in a
+     * single transfer and return them in a read-only DeviceVectorSnapshot.
+     * The snapshot is indexed with the same indices as this vector so it can
+     * replace many `[]` or `at()` calls, each of which is a separate
+     * cudaMemcpy, when reading lots of values. The snapshot is not updated if
+     * the device values change.
+     *
+     * \param[in] offset The first element to copy
+     * \param[in] count The number of elements to copy
+     * \return DeviceVectorSnapshot<T> The snapshot
+     */
+    DeviceVectorSnapshot<T> snapshot(size_t const offset, size_t const count);
+
+#ifdef __CUDACC__
+    /*!
+     * \brief Read the values at many scattered indices at once. The indices
+     * are copied to the device, a kernel gathers the values into a
+     * contiguous buffer, and the values are copied back in one transfer.
+     * This is much faster than calling `[]` or `at()` for each index. This
+     * method blocks until the values are on the host. Bounds checking is
+     * performed on all the indices. Only available when compiling with nvcc
+     *
+     * \param[in] indices The indices of the values to read
+     * \param[in] stream The stream to perform the work on. Defaults to the
+     * default stream
+     * \return std::vector<T> The values, `result[i]` is `dev_ptr[indices[i]]`
+     */
+    std::vector<T> gather(std::vector<size_t> const &indices,
+                          cudaStream_t const stream=0);
+
+    /*!
+     * \brief Write values to many scattered indices at once. The indices and
+     * values are packed into one buffer, copied to the device in one
+     * transfer, and a kernel scatters the values into the array. This is
+     * much faster than calling `assign` for each index. The work is
+     * asynchronous with respect to the host but `indices` and `values` can
+     * be modified as soon as this method returns. If an index appears more
+     * than once which of its values is written is undefined. Bounds checking
+     * is performed on all the indices. Only available when compiling with
+     * nvcc
+     *
+     * \param[in] indices The indices to write to
+     * \param[in] values The values to write, `dev_ptr[indices[i]]` is set to
+     * `values[i]`. Must be the same size as `indices`
+     * \param[in] stream The stream to perform the work on. Defaults to the
+     * default stream
+     */
+    void scatter(std::vector<size_t> const &indices,
+                 std::vector<T> const &values,
+                 cudaStream_t const stream=0);
+
+    /*!
+     * \brief Set every element of the array to `value` with a kernel on
+     * `stream`. Only available when compiling with nvcc
+     *
+     * \param[in] value The value to set
+     * \param[in] stream The stream to launch the kernel on. Defaults to the
+     * default stream
+     */
+    void fill(T const &value, cudaStream_t const stream=0);
+
+    /*!
+     * \brief Set element `i` of the array to `start + i*step` with a kernel
+     * on `stream`, like `std::iota`. Only available when compiling with nvcc
+     *
+     * \param[in] start The value of the first element. Defaults to zero
+     * \param[in] step The difference between consecutive elements. Defaults
+     * to one
+     * \param[in] stream The stream to launch the kernel on. Defaults to the
+     * default stream
+     */
+    void iota(T const &start=T(0),
+              T const &step=T(1),
+              cudaStream_t const stream=0);
+
+    /*!
+     * \brief Replace every element of the array with `op(element)` with a
+     * kernel on `stream`. `op` must be callable on the device, i.e. a functor
+     * with a `__device__` call operator or a `__device__` lambda (which
+     * requires nvcc's `--extended-lambda` flag). Only available when
+     * compiling with nvcc
+     *
+     * \tparam UnaryOp The type of the functor
+     * \param[in] op The functor to apply
+     * \param[in] stream The stream to launch the kernel on. Defaults to the
+     * default stream
+     */
+    template <typename UnaryOp>
+    void transform(UnaryOp op, cudaStream_t const stream=0);
+
+    /*!
+     * \brief Reduce the array on the device with the binary operation `op`.
+     * `op` must be associative and commutative and `init` must be its
+     * identity, e.g. zero for sums. Only the result is copied back to the
+     * host and this method blocks until it is available. `op` must be
+     * callable on the device, see `transform`. Only available when compiling
+     * with nvcc
+     *
+     * \tparam BinaryOp The type of the functor
+     * \param[in] op The binary operation to reduce with
+     * \param[in] init The identity of `op`, returned if the array is empty
+     * \param[in] stream The stream to launch the kernels on. Defaults to the
+     * default stream
+     * \return T The result of the reduction
+     */
+    template <typename BinaryOp>
+    T reduce(BinaryOp op, T const &init, cudaStream_t const stream=0);
+
+    /*!
+     * \brief Compute the sum of the array on the device. See `reduce`
+     *
+     * \param[in] stream The stream to launch the kernels on
+     * \return T The sum of all the elements
+     */
+    T sum(cudaStream_t const stream=0)
+        {return reduce(device_vector_kernels::Sum(), T(0), stream);}
+
+    /*!
+     * \brief Compute the minimum of the array on the device. See `reduce`
+     *
+     * \param[in] stream The stream to launch the kernels on
+     * \return T The smallest element. `std::numeric_limits<T>::max()` if
+     * the array is empty
+     */
+    T min(cudaStream_t const stream=0)
+        {return reduce(device_vector_kernels::Min(),
+                       std::numeric_limits<T>::max(), stream);}
+
+    /*!
+     * \brief Compute the maximum of the array on the device. See `reduce`
+     *
+     * \param[in] stream The stream to launch the kernels on
+     * \return T The largest element. `std::numeric_limits<T>::lowest()` if
+     * the array is empty
+     */
+    T max(cudaStream_t const stream=0)
+        {return reduce(device_vector_kernels::Max(),
+                       std::numeric_limits<T>::lowest(), stream);}
+#endif  // __CUDACC__
+
+    /*!
+     * \brief Append a single value to the end of the array. If the array is
+     * full then the capacity is doubled so a sequence of `push_back` calls
+     * has amortized O(1) cost. Like `assign` this performs a cudaMemcpy of a
+     * single element so use `resize` and one of the copy methods when
+     * appending many values at once.
+     *
+     * \param[in] hostValue The value to append to the device array
+     */
+    void push_back(T const &hostValue);
+
     /*!
      * \brief Resize the device container to contain `newSize` elements. If
      * `newSize` is greater than the current size then all the values are
-     * kept and the rest of the array is default initialized. If `newSize`
-     * is smaller than the current size then the array is truncated and
-     * values at locations greater than `newSize` are lost. Keeping the
-     * values in the array requires that the new array be allocated, the
-     * values be copied, then the old array be freed; as such this method is
-     * quite slow and can use a large amount of memory. If you don't care
-     * about the values in the array then use the `reset` method
+     * kept and the rest of the array is not initialized. If `newSize` is
+     * smaller than the current size then the array is truncated and values
+     * at locations greater than `newSize` are lost. If `newSize` fits in the
+     * current capacity this only changes the size, otherwise a new array of
+     * `max(newSize, 2*capacity())` elements is allocated, the values are
+     * copied, and the old array is freed. The geometric growth makes growing
+     * a vector one element at a time amortized O(1) per element. If you don't
+     * care about the values in the array then use the `reset` method
      *
      * \param[in] newSize The desired size of the array
      */
     void resize(size_t const newSize);
 
     /*!
-     * \brief Reset the size of the array. This frees the old array and
-     * allocates a new one; all values in the array may be lost. The values
-     * in memory are not initialized and therefore the behaviour of the
-     * default values is undefined
+     * \brief Reset the size of the array; all values in the array may be
+     * lost. If `newSize` is greater than the capacity then the old array is
+     * freed and a new one is allocated, otherwise the current allocation is
+     * reused. The values in memory are not initialized and therefore the
+     * behaviour of the default values is undefined
      *
      * \param newSize
      */
     void reset(size_t const newSize);
 
+    /*!
+     * \brief Increase the capacity of the array to at least `newCapacity`
+     * elements without changing the size. All values are kept. Does nothing
+     * if `newCapacity` is not greater than the current capacity
+     *
+     * \param[in] newCapacity The number of elements to allocate room for
+     */
+    void reserve(size_t const newCapacity);
+
+    /*!
+     * \brief Reduce the capacity of the array to its size, freeing the unused
+     * memory. All values are kept
+     *
+     */
+    void shrink_to_fit();
+
     /*!
      * \brief Copy the first `arrSize` elements of `arrIn` to the device.
      *
@@ -163,6 +812,14 @@ public:
     void cpyHostToDevice(std::vector<T> const &vecIn)
         {cpyHostToDevice(vecIn.data(), vecIn.size());}
 
+    /*!
+     * \brief Copy the contents of a PinnedHostVector to the device
+     *
+     * \param[in] vecIn The array whose contents are to be copied
+     */
+    void cpyHostToDevice(PinnedHostVector<T> const &vecIn)
+        {cpyHostToDevice(vecIn.data(), vecIn.size());}
+
     /*!
      * \brief Copy the array from the device to a host array. Checks if the
      * host array is large enough based on the `arrSize` parameter.
@@ -181,89 +838,506 @@ public:
     void cpyDeviceToHost(std::vector<T> &vecOut)
         {cpyDeviceToHost(vecOut.data(), vecOut.size());}
 
-private:
-    /// The size of the device array
-    size_t _size;
+    /*!
+     * \brief Copy the array from the device to a host PinnedHostVector.
+     * Checks if the host array is large enough.
+     *
+     * \param[out] vecOut The PinnedHostVector to copy the device array into
+     */
+    void cpyDeviceToHost(PinnedHostVector<T> &vecOut)
+        {cpyDeviceToHost(vecOut.data(), vecOut.size());}
 
-    /// The pointer to the device array
-    T *_ptr=nullptr;
+    /*!
+     * \brief Asynchronously copy `arrSize` elements of `arrIn` into the device
+     * array starting at element `offset`. The copy is issued on `stream` and
+     * this method returns immediately so `arrIn` must not be modified or
+     * freed until the copy is complete. Note that the copy is only truly
+     * asynchronous if `arrIn` points to page-locked (pinned) host memory.
+     *
+     * \param[in] arrIn The pointer to the array to be copied to the device
+     * \param[in] arrSize The number of elements to copy to the device
+     * \param[in] stream The stream to issue the copy on
+     * \param[in] offset The element of the device array to start writing at.
+     * Defaults to zero
+     * \param[in] event If not `nullptr` this event is recorded on `stream`
+     * after the copy so other streams or the host can wait on it. Defaults to
+     * `nullptr`
+     */
+    void cpyHostToDeviceAsync(const T * arrIn,
+                              size_t const &arrSize,
+                              cudaStream_t const stream,
+                              size_t const &offset=0,
+                              cudaEvent_t const event=nullptr);
 
     /*!
-     * \brief Allocate the device side array
+     * \brief Asynchronously copy the contents of a PinnedHostVector to the
+     * device. This is the preferred way to perform asynchronous copies. See
+     * the pointer version of `cpyHostToDeviceAsync` for details.
      *
-     * \param[in] size The size of the array to allocate
+     * \param[in] vecIn The array whose contents are to be copied
+     * \param[in] stream The stream to issue the copy on
+     * \param[in] offset The element of the device array to start writing at
+     * \param[in] event If not `nullptr` this event is recorded after the copy
      */
-    void _allocate(size_t const size)
-    {
-        _size=size;
-        CudaSafeCall(cudaMalloc(&_ptr, size*sizeof(T)));
-    }
+    void cpyHostToDeviceAsync(PinnedHostVector<T> const &vecIn,
+                              cudaStream_t const stream,
+                              size_t const &offset=0,
+                              cudaEvent_t const event=nullptr)
+        {cpyHostToDeviceAsync(vecIn.data(), vecIn.size(),
+                              stream, offset, event);}
 
     /*!
-     * \brief Free the device side array
+     * \brief Asynchronously copy the contents of a std::vector to the device.
+     * Since a std::vector is in pageable memory the values are first copied
+     * into an internal PinnedHostVector staging buffer and then transferred
+     * from there, as such `vecIn` can be modified as soon as this method
+     * returns. The staging buffer is shared by all staged copies of this
+     * DeviceVector so this method will block until any previous staged copy
+     * is complete. Use a PinnedHostVector directly to avoid the extra host
+     * copy and blocking.
      *
+     * \param[in] vecIn The array whose contents are to be copied
+     * \param[in] stream The stream to issue the copy on
+     * \param[in] offset The element of the device array to start writing at
+     * \param[in] event If not `nullptr` this event is recorded after the copy
      */
-    void _deAllocate(){CudaSafeCall(cudaFree(_ptr));}
-};
-// =============================================================================
-// End declaration of DeviceVector class
-// =============================================================================
+    void cpyHostToDeviceAsync(std::vector<T> const &vecIn,
+                              cudaStream_t const stream,
+                              size_t const &offset=0,
+                              cudaEvent_t const event=nullptr);
 
+    /*!
+     * \brief Asynchronously copy `arrSize` elements, starting at element
+     * `offset` of the device array, into the host array `arrOut`. The copy is
+     * issued on `stream` and this method returns immediately so `arrOut`
+     * must not be read until the copy is complete. Note that the copy is only
+     * truly asynchronous if `arrOut` points to page-locked (pinned) host
+     * memory.
+     *
+     * \param[out] arrOut The pointer to the host array
+     * \param[in] arrSize The number of elements to copy to the host
+     * \param[in] stream The stream to issue the copy on
+     * \param[in] offset The element of the device array to start reading at.
+     * Defaults to zero
+     * \param[in] event If not `nullptr` this event is recorded on `stream`
+     * after the copy so other streams or the host can wait on it. Defaults to
+     * `nullptr`
+     */
+    void cpyDeviceToHostAsync(T * arrOut,
+                              size_t const &arrSize,
+                              cudaStream_t const stream,
+                              size_t const &offset=0,
+                              cudaEvent_t const event=nullptr);
 
-// =============================================================================
-// Definition of DeviceVector class
-// =============================================================================
+    /*!
+     * \brief Asynchronously copy `vecOut.size()` elements of the device array
+     * into a host PinnedHostVector. This is the preferred way to perform
+     * asynchronous copies. See the pointer version of `cpyDeviceToHostAsync`
+     * for details.
+     *
+     * \param[out] vecOut The PinnedHostVector to copy the device array into
+     * \param[in] stream The stream to issue the copy on
+     * \param[in] offset The element of the device array to start reading at
+     * \param[in] event If not `nullptr` this event is recorded after the copy
+     */
+    void cpyDeviceToHostAsync(PinnedHostVector<T> &vecOut,
+                              cudaStream_t const stream,
+                              size_t const &offset=0,
+                              cudaEvent_t const event=nullptr)
+        {cpyDeviceToHostAsync(vecOut.data(), vecOut.size(),
+                              stream, offset, event);}
 
-// =============================================================================
-// Public Methods
-// =============================================================================
+    /*!
+     * \brief Asynchronously copy `vecOut.size()` elements of the device array
+     * into a host std::vector. Since a std::vector is in pageable memory the
+     * values are transferred into an internal PinnedHostVector staging buffer
+     * and then copied into `vecOut` by a host function enqueued on `stream`.
+     * `vecOut` must not be read, resized, or destroyed until the copy is
+     * complete, i.e. until `event` or `stream` has been synchronized. The
+     * staging buffer is shared by all staged copies of this DeviceVector so
+     * this method will block until any previous staged copy is complete. Use
+     * a PinnedHostVector directly to avoid the extra host copy and blocking.
+     *
+     * \param[out] vecOut The std::vector to copy the device array into
+     * \param[in] stream The stream to issue the copy on
+     * \param[in] offset The element of the device array to start reading at
+     * \param[in] event If not `nullptr` this event is recorded after the copy
+     * into `vecOut` is complete
+     */
+    void cpyDeviceToHostAsync(std::vector<T> &vecOut,
+                              cudaStream_t const stream,
+                              size_t const &offset=0,
+                              cudaEvent_t const event=nullptr);
 
-// =============================================================================
+private:
+    /// The size of the device array
+    size_t _size=0;
+
+    /// The number of elements allocated for the device array
+    size_t _capacity=0;
+
+    /// The pointer to the device array
+    T *_ptr=nullptr;
+
+    /// The device that owns the array. Defaults to the device that was
+    /// current when the vector was constructed
+    int _device=getCurrentDevice();
+
+    /// Pinned buffer used to stage asynchronous copies of std::vectors and
+    /// the batched element access methods
+    PinnedHostVector<char> _stagingBuffer;
+
+    /// Recorded after each use of `_stagingBuffer` so that it isn't
+    /// overwritten while a copy is still in flight
+    cudaEvent_t _stagingEvent=nullptr;
+
+    /// Device buffer reused by the methods that need temporary device
+    /// memory, e.g. gather and reduce, so they don't allocate on every call
+    char *_scratchBuffer=nullptr;
+
+    /// The size of `_scratchBuffer` in bytes
+    size_t _scratchBytes=0;
+
+    /// Recorded after each use of `_scratchBuffer` so that the next use,
+    /// possibly on another stream, is ordered after it
+    cudaEvent_t _scratchEvent=nullptr;
+
+    /// One event for each stream other than the default stream that has
+    /// used the array since it was allocated, recorded after the latest work
+    /// on that stream. Mutable since reading the array on a stream also has
+    /// to be recorded. See `recordStream`
+    mutable std::vector<std::pair<cudaStream_t, cudaEvent_t>> _streamEvents;
+
+    /// The arguments of a host side copy enqueued with `cudaLaunchHostFunc`
+    struct _HostCopy
+    {
+        void       *destination;
+        void const *source;
+        size_t      bytes;
+    };
+
+    /*!
+     * \brief Allocate the device side array
+     *
+     * \param[in] size The size of the array to allocate
+     */
+    void _allocate(size_t const size)
+    {
+        CudaDeviceGuard guard(_device);
+        _size=size;
+        _capacity=size;
+        _ptr = static_cast<T*>(Allocator::allocate(size*sizeof(T)));
+    }
+
+    /*!
+     * \brief Move the array to a new allocation of `newCapacity` elements,
+     * keeping as many values as fit
+     *
+     * \param[in] newCapacity The number of elements to allocate
+     */
+    void _reallocate(size_t const newCapacity);
+
+    /*!
+     * \brief Free the device side array
+     *
+     */
+    void _deAllocate()
+    {
+        CudaDeviceGuard guard(_device);
+        _waitForStreams();
+        Allocator::deallocate(_ptr);
+        _ptr = nullptr;
+    }
+
+    /*!
+     * \brief Order the default stream after all the work recorded with
+     * `recordStream` and destroy the events. The array is freed on the
+     * default stream so this makes the free wait for that work
+     *
+     */
+    void _waitForStreams();
+
+    /*!
+     * \brief Implementation of `recordStream` for a stream on any device.
+     * `copyTo` uses this to record its stream, which belongs to the source
+     * device, on the destination vector
+     *
+     * \param[in] stream The stream the work was enqueued on
+     * \param[in] streamDevice The device that `stream` belongs to
+     */
+    void _recordStream(cudaStream_t const stream, int const streamDevice) const;
+
+    // copyTo records its stream on destinations with other allocators
+    template <typename OtherT, typename OtherAllocator>
+    friend class DeviceVector;
+
+    /*!
+     * \brief Check that the range [`offset`, `offset + count`) lies within
+     * the device array and throw a std::out_of_range error if it doesn't
+     *
+     * \param[in] offset The first element of the range
+     * \param[in] count The number of elements in the range
+     * \param[in] caller The name of the calling method, used in the error
+     * message
+     */
+    void _checkRange(size_t const &offset,
+                     size_t const &count,
+                     std::string const &caller) const;
+
+    /*!
+     * \brief Get the staging buffer, ensuring that it has at least `bytes`
+     * bytes and that any previous staged copy is complete
+     *
+     * \param[in] bytes The number of bytes needed
+     * \return char* The pointer to the staging buffer
+     */
+    char *_getStagingBuffer(size_t const &bytes);
+
+    /*!
+     * \brief Get the device scratch buffer, ensuring that it has at least
+     * `bytes` bytes, and order `stream` after the previous use of it. Call
+     * `_releaseScratchBuffer()` once the work using it has been enqueued
+     *
+     * \param[in] bytes The number of bytes needed
+     * \param[in] stream The stream the buffer will be used on
+     * \return char* The pointer to the scratch buffer
+     */
+    char *_getScratchBuffer(size_t const &bytes, cudaStream_t const stream);
+
+    /*!
+     * \brief Mark the end of the work using the scratch buffer that was
+     * enqueued on `stream`
+     *
+     * \param[in] stream The stream the buffer was used on
+     */
+    void _releaseScratchBuffer(cudaStream_t const stream)
+        {CudaSafeCall(cudaEventRecord(_scratchEvent, stream));}
+
+    /*!
+     * \brief Free the scratch buffer once the work using it is done
+     *
+     */
+    void _freeScratchBuffer();
+
+    /*!
+     * \brief Round `bytes` up so that an array of T can start at that offset
+     * in a buffer with good alignment
+     *
+     * \param[in] bytes The number of bytes to round up
+     * \return size_t The rounded number of bytes
+     */
+    static size_t _alignedOffset(size_t const bytes)
+    {
+        size_t const alignment = 256;
+        return ((bytes + alignment - 1) / alignment) * alignment;
+    }
+
+    /*!
+     * \brief Check that all the indices are within the array and throw a
+     * std::out_of_range error if any aren't
+     *
+     * \param[in] indices The indices to check
+     * \param[in] caller The name of the calling method, used in the error
+     * message
+     */
+    void _checkIndices(std::vector<size_t> const &indices,
+                       std::string const &caller) const;
+
+    /*!
+     * \brief Perform a host side copy. Used as the callback for
+     * `cudaLaunchHostFunc`, takes ownership of and deletes `userData`
+     *
+     * \param[in] userData A pointer to a heap allocated `_HostCopy`
+     */
+    static void _hostCopy(void *userData);
+};
+// =============================================================================
+// End declaration of DeviceVector class
+// =============================================================================
+
+// =============================================================================
+// Definition of DeviceVectorSnapshot class
+// =============================================================================
+
+// =============================================================================
 template <typename T>
-void DeviceVector<T>::resize(size_t const newSize)
+T const &DeviceVectorSnapshot<T>::at(size_t const index) const
 {
-    // Assign old array to a new pointer
-    T * oldDevPtr = _ptr;
+    if ((index >= _offset) and (index - _offset < _values.size()))
+    {
+        return _values[index - _offset];
+    }
+    else
+    {
+        throw std::out_of_range("Warning: DeviceVectorSnapshot.at() detected"
+                                " an out of bounds memory access. Tried to"
+                                " access element "
+                                + std::to_string(index)
+                                + " of the range ["
+                                + std::to_string(_offset)
+                                + ", "
+                                + std::to_string(_offset + _values.size())
+                                + ")");
+    }
+}
+// =============================================================================
 
-    // Determine how many elements to copy
-    size_t const count = std::min(_size, newSize) * sizeof(T);
+// =============================================================================
+// End definition of DeviceVectorSnapshot class
+// =============================================================================
 
-    // Allocate new array
-    _allocate(newSize);
+// =============================================================================
+// Definition of DeviceVector class
+// =============================================================================
 
-    // Copy the values from the old array to the new array
-    CudaSafeCall(cudaMemcpyPeer(_ptr, 0, oldDevPtr, 0, count));
+// =============================================================================
+// Public Methods
+// =============================================================================
 
-    // Free the old array
-    CudaSafeCall(cudaFree(oldDevPtr));
+// =============================================================================
+template <typename T, typename Allocator>
+DeviceVector<T, Allocator>
+DeviceVector<T, Allocator>::clone(cudaStream_t const stream) const
+{
+    DeviceVector<T, Allocator> newVector(_size, _device);
+    CudaSafeCall(cudaMemcpyAsync(newVector._ptr,
+                                 _ptr,
+                                 _size*sizeof(T),
+                                 cudaMemcpyDefault,
+                                 stream));
+    recordStream(stream);
+    newVector.recordStream(stream);
+    return newVector;
 }
 // =============================================================================
 
 // =============================================================================
-template <typename T>
-void DeviceVector<T>::reset(size_t const newSize)
+template <typename T, typename Allocator>
+template <typename OtherAllocator>
+void DeviceVector<T, Allocator>::copyTo(
+    DeviceVector<T, OtherAllocator> &destination,
+    cudaStream_t const stream)
 {
-    _deAllocate();
-    _allocate(newSize);
+    if (destination.size() < _size)
+    {
+        throw std::out_of_range("Warning: DeviceVector.copyTo() requires a"
+                                " destination with at least "
+                                + std::to_string(_size)
+                                + " elements, got "
+                                + std::to_string(destination.size()));
+    }
+
+    int const destinationDevice = destination.device();
+    if (destinationDevice == _device)
+    {
+        CudaSafeCall(cudaMemcpyAsync(destination.data(),
+                                     _ptr,
+                                     _size*sizeof(T),
+                                     cudaMemcpyDefault,
+                                     stream));
+    }
+    else
+    {
+        // The copy engine of either device can perform the copy so enable
+        // access in both directions
+        enablePeerAccess(_device, destinationDevice);
+        enablePeerAccess(destinationDevice, _device);
+
+        CudaDeviceGuard guard(_device);
+        CudaSafeCall(cudaMemcpyPeerAsync(destination.data(),
+                                         destinationDevice,
+                                         _ptr,
+                                         _device,
+                                         _size*sizeof(T),
+                                         stream));
+    }
+    recordStream(stream);
+    destination._recordStream(stream, _device);
 }
 // =============================================================================
 
 // =============================================================================
-template <typename T>
-T DeviceVector<T>::operator [] (size_t const &index)
+template <typename T, typename Allocator>
+void DeviceVector<T, Allocator>::push_back(T const &hostValue)
+{
+    if (_size == _capacity)
+    {
+        _reallocate(std::max(size_t(1), 2*_capacity));
+    }
+
+    assign(hostValue, _size);
+    _size++;
+}
+// =============================================================================
+
+// =============================================================================
+template <typename T, typename Allocator>
+void DeviceVector<T, Allocator>::resize(size_t const newSize)
+{
+    // Grow geometrically if the current allocation is too small
+    if (newSize > _capacity)
+    {
+        _reallocate(std::max(newSize, 2*_capacity));
+    }
+
+    _size = newSize;
+}
+// =============================================================================
+
+// =============================================================================
+template <typename T, typename Allocator>
+void DeviceVector<T, Allocator>::reset(size_t const newSize)
+{
+    if (newSize > _capacity)
+    {
+        _deAllocate();
+        _allocate(newSize);
+    }
+    else
+    {
+        _size = newSize;
+    }
+}
+// =============================================================================
+
+// =============================================================================
+template <typename T, typename Allocator>
+void DeviceVector<T, Allocator>::reserve(size_t const newCapacity)
+{
+    if (newCapacity > _capacity)
+    {
+        _reallocate(newCapacity);
+    }
+}
+// =============================================================================
+
+// =============================================================================
+template <typename T, typename Allocator>
+void DeviceVector<T, Allocator>::shrink_to_fit()
+{
+    if (_capacity > _size)
+    {
+        _reallocate(_size);
+    }
+}
+// =============================================================================
+
+// =============================================================================
+template <typename T, typename Allocator>
+T DeviceVector<T, Allocator>::operator [] (size_t const &index)
 {
     T hostValue;
     CudaSafeCall(cudaMemcpy(&hostValue,
                             &(_ptr[index]),
                             sizeof(T),
-                            cudaMemcpyDeviceToHost));
+                            cudaMemcpyDefault));
     return hostValue;
 }
 // =============================================================================
 
 // =============================================================================
-template <typename T>
-T const DeviceVector<T>::at(size_t const index)
+template <typename T, typename Allocator>
+T const DeviceVector<T, Allocator>::at(size_t const index)
 {
     if (index < _size)
     {
@@ -284,26 +1358,27 @@ T const DeviceVector<T>::at(size_t const index)
 // =============================================================================
 
 // =============================================================================
-template <typename T>
-void DeviceVector<T>::assign(T const &hostValue, size_t const &index)
+template <typename T, typename Allocator>
+void DeviceVector<T, Allocator>::assign(T const &hostValue, size_t const &index)
 {
     CudaSafeCall(cudaMemcpy(&(_ptr[index]),  // destination
                             &hostValue,      // source
                             sizeof(T),
-                            cudaMemcpyHostToDevice));
+                            cudaMemcpyDefault));
 }
 // =============================================================================
 
 // =============================================================================
-template <typename T>
-void DeviceVector<T>::cpyHostToDevice(const T * arrIn, size_t const &arrSize)
+template <typename T, typename Allocator>
+void DeviceVector<T, Allocator>::cpyHostToDevice(const T * arrIn,
+                                                 size_t const &arrSize)
 {
     if (arrSize <= _size)
     {
         CudaSafeCall(cudaMemcpy(_ptr,
                                 arrIn,
                                 arrSize*sizeof(T),
-                                cudaMemcpyHostToDevice));
+                                cudaMemcpyDefault));
     }
     else
     {
@@ -319,15 +1394,16 @@ void DeviceVector<T>::cpyHostToDevice(const T * arrIn, size_t const &arrSize)
 // =============================================================================
 
 // =============================================================================
-template <typename T>
-void DeviceVector<T>::cpyDeviceToHost(T * arrOut, size_t const &arrSize)
+template <typename T, typename Allocator>
+void DeviceVector<T, Allocator>::cpyDeviceToHost(T * arrOut,
+                                                 size_t const &arrSize)
 {
     if (_size <= arrSize)
     {
         CudaSafeCall(cudaMemcpy(arrOut,
                                 _ptr,
                                 _size*sizeof(T),
-                                cudaMemcpyDeviceToHost));
+                                cudaMemcpyDefault));
     }
     else
     {
@@ -341,6 +1417,588 @@ void DeviceVector<T>::cpyDeviceToHost(T * arrOut, size_t const &arrSize)
 }
 // =============================================================================
 
+// =============================================================================
+template <typename T, typename Allocator>
+void DeviceVector<T, Allocator>::cpyHostToDeviceAsync(const T * arrIn,
+                                                      size_t const &arrSize,
+                                                      cudaStream_t const stream,
+                                                      size_t const &offset,
+                                                      cudaEvent_t const event)
+{
+    _checkRange(offset, arrSize, "cpyHostToDeviceAsync");
+
+    CudaSafeCall(cudaMemcpyAsync(_ptr + offset,
+                                 arrIn,
+                                 arrSize*sizeof(T),
+                                 cudaMemcpyDefault,
+                                 stream));
+    recordStream(stream);
+
+    if (event != nullptr)
+    {
+        CudaSafeCall(cudaEventRecord(event, stream));
+    }
+}
+// =============================================================================
+
+// =============================================================================
+template <typename T, typename Allocator>
+void DeviceVector<T, Allocator>::cpyDeviceToHostAsync(T * arrOut,
+                                                      size_t const &arrSize,
+                                                      cudaStream_t const stream,
+                                                      size_t const &offset,
+                                                      cudaEvent_t const event)
+{
+    _checkRange(offset, arrSize, "cpyDeviceToHostAsync");
+
+    CudaSafeCall(cudaMemcpyAsync(arrOut,
+                                 _ptr + offset,
+                                 arrSize*sizeof(T),
+                                 cudaMemcpyDefault,
+                                 stream));
+    recordStream(stream);
+
+    if (event != nullptr)
+    {
+        CudaSafeCall(cudaEventRecord(event, stream));
+    }
+}
+// =============================================================================
+
+// =============================================================================
+template <typename T, typename Allocator>
+void DeviceVector<T, Allocator>::cpyHostToDeviceAsync(std::vector<T> const &vecIn,
+                                                      cudaStream_t const stream,
+                                                      size_t const &offset,
+                                                      cudaEvent_t const event)
+{
+    _checkRange(offset, vecIn.size(), "cpyHostToDeviceAsync");
+
+    // Copy into the staging buffer then transfer from there
+    T *staging = reinterpret_cast<T*>(
+                     _getStagingBuffer(vecIn.size()*sizeof(T)));
+    std::copy(vecIn.begin(), vecIn.end(), staging);
+    cpyHostToDeviceAsync(staging, vecIn.size(), stream, offset, event);
+
+    CudaSafeCall(cudaEventRecord(_stagingEvent, stream));
+}
+// =============================================================================
+
+// =============================================================================
+template <typename T, typename Allocator>
+void DeviceVector<T, Allocator>::cpyDeviceToHostAsync(std::vector<T> &vecOut,
+                                                      cudaStream_t const stream,
+                                                      size_t const &offset,
+                                                      cudaEvent_t const event)
+{
+    _checkRange(offset, vecOut.size(), "cpyDeviceToHostAsync");
+
+    // Transfer into the staging buffer then enqueue the copy from there into
+    // vecOut so that it runs as soon as the transfer is done
+    T *staging = reinterpret_cast<T*>(
+                     _getStagingBuffer(vecOut.size()*sizeof(T)));
+    cpyDeviceToHostAsync(staging, vecOut.size(), stream, offset);
+
+    _HostCopy *hostCopy = new _HostCopy{vecOut.data(),
+                                        staging,
+                                        vecOut.size()*sizeof(T)};
+    CudaSafeCall(cudaLaunchHostFunc(stream, _hostCopy, hostCopy));
+
+    CudaSafeCall(cudaEventRecord(_stagingEvent, stream));
+    if (event != nullptr)
+    {
+        CudaSafeCall(cudaEventRecord(event, stream));
+    }
+}
+// =============================================================================
+
+// =============================================================================
+template <typename T, typename Allocator>
+void DeviceVector<T, Allocator>::prefetch(size_t const offset,
+                                          size_t const count,
+                                          int const device,
+                                          cudaStream_t const stream)
+{
+    static_assert(isManagedAllocator<Allocator>::value,
+                  "DeviceVector::prefetch requires managed memory, use the "
+                  "ManagedAllocator");
+    _checkRange(offset, count, "prefetch");
+
+#if CUDART_VERSION >= 13000
+    cudaMemLocation location;
+    location.type = (device == cudaCpuDeviceId)? cudaMemLocationTypeHost:
+                                                 cudaMemLocationTypeDevice;
+    location.id   = device;
+    CudaSafeCall(cudaMemPrefetchAsync(_ptr + offset, count*sizeof(T),
+                                      location, 0, stream));
+#else  // CUDART_VERSION < 13000
+    CudaSafeCall(cudaMemPrefetchAsync(_ptr + offset, count*sizeof(T),
+                                      device, stream));
+#endif  // CUDART_VERSION
+    recordStream(stream);
+}
+// =============================================================================
+
+// =============================================================================
+template <typename T, typename Allocator>
+void DeviceVector<T, Allocator>::advise(size_t const offset,
+                                        size_t const count,
+                                        cudaMemoryAdvise const advice,
+                                        int const device)
+{
+    static_assert(isManagedAllocator<Allocator>::value,
+                  "DeviceVector::advise requires managed memory, use the "
+                  "ManagedAllocator");
+    _checkRange(offset, count, "advise");
+
+#if CUDART_VERSION >= 13000
+    cudaMemLocation location;
+    location.type = (device == cudaCpuDeviceId)? cudaMemLocationTypeHost:
+                                                 cudaMemLocationTypeDevice;
+    location.id   = device;
+    CudaSafeCall(cudaMemAdvise(_ptr + offset, count*sizeof(T), advice,
+                               location));
+#else  // CUDART_VERSION < 13000
+    CudaSafeCall(cudaMemAdvise(_ptr + offset, count*sizeof(T), advice,
+                               device));
+#endif  // CUDART_VERSION
+}
+// =============================================================================
+
+// =============================================================================
+template <typename T, typename Allocator>
+DeviceVectorSnapshot<T>
+DeviceVector<T, Allocator>::snapshot(size_t const offset, size_t const count)
+{
+    _checkRange(offset, count, "snapshot");
+
+    std::vector<T> values(count);
+    CudaSafeCall(cudaMemcpy(values.data(),
+                            _ptr + offset,
+                            count*sizeof(T),
+                            cudaMemcpyDefault));
+
+    return DeviceVectorSnapshot<T>(offset, std::move(values));
+}
+// =============================================================================
+
+#ifdef __CUDACC__
+// =============================================================================
+template <typename T, typename Allocator>
+std::vector<T>
+DeviceVector<T, Allocator>::gather(std::vector<size_t> const &indices,
+                                   cudaStream_t const stream)
+{
+    _checkIndices(indices, "gather");
+    CudaDeviceGuard guard(_device);
+
+    size_t const numIndices  = indices.size();
+    std::vector<T> values(numIndices);
+    if (numIndices == 0)
+    {
+        return values;
+    }
+
+    // Both the staging buffer and the device scratch buffer hold the indices
+    // followed by the values
+    size_t const valueOffset = _alignedOffset(numIndices*sizeof(size_t));
+    size_t const totalBytes  = valueOffset + numIndices*sizeof(T);
+
+    char *staging = _getStagingBuffer(totalBytes);
+    std::memcpy(staging, indices.data(), numIndices*sizeof(size_t));
+
+    char *scratch = _getScratchBuffer(totalBytes, stream);
+    size_t *devIndices = reinterpret_cast<size_t*>(scratch);
+    T      *devValues  = reinterpret_cast<T*>(scratch + valueOffset);
+
+    // Send the indices, gather, then bring the values back
+    CudaSafeCall(cudaMemcpyAsync(devIndices,
+                                 staging,
+                                 numIndices*sizeof(size_t),
+                                 cudaMemcpyDefault,
+                                 stream));
+    unsigned int const numBlocks  = device_vector_kernels::numBlocks(numIndices);
+    unsigned int const numThreads = device_vector_kernels::threadsPerBlock;
+    device_vector_kernels::gather<<<numBlocks, numThreads, 0, stream>>>(
+        _ptr, devIndices, devValues, numIndices);
+    CudaSafeCall(cudaGetLastError());
+    CudaSafeCall(cudaMemcpyAsync(staging + valueOffset,
+                                 devValues,
+                                 numIndices*sizeof(T),
+                                 cudaMemcpyDefault,
+                                 stream));
+    CudaSafeCall(cudaEventRecord(_stagingEvent, stream));
+    _releaseScratchBuffer(stream);
+
+    CudaSafeCall(cudaStreamSynchronize(stream));
+    std::memcpy(values.data(), staging + valueOffset, numIndices*sizeof(T));
+
+    return values;
+}
+// =============================================================================
+
+// =============================================================================
+template <typename T, typename Allocator>
+void DeviceVector<T, Allocator>::scatter(std::vector<size_t> const &indices,
+                                         std::vector<T> const &values,
+                                         cudaStream_t const stream)
+{
+    if (indices.size() != values.size())
+    {
+        throw std::invalid_argument("Warning: DeviceVector.scatter() requires"
+                                    " the same number of indices and values."
+                                    " Got "
+                                    + std::to_string(indices.size())
+                                    + " indices and "
+                                    + std::to_string(values.size())
+                                    + " values");
+    }
+    _checkIndices(indices, "scatter");
+
+    size_t const numIndices = indices.size();
+    if (numIndices == 0)
+    {
+        return;
+    }
+    CudaDeviceGuard guard(_device);
+
+    // Pack the indices followed by the values into the staging buffer so
+    // they can be sent in a single transfer
+    size_t const valueOffset = _alignedOffset(numIndices*sizeof(size_t));
+    size_t const totalBytes  = valueOffset + numIndices*sizeof(T);
+
+    char *staging = _getStagingBuffer(totalBytes);
+    std::memcpy(staging, indices.data(), numIndices*sizeof(size_t));
+    std::memcpy(staging + valueOffset, values.data(), numIndices*sizeof(T));
+
+    char *scratch = _getScratchBuffer(totalBytes, stream);
+
+    // Send everything then scatter
+    CudaSafeCall(cudaMemcpyAsync(scratch,
+                                 staging,
+                                 totalBytes,
+                                 cudaMemcpyDefault,
+                                 stream));
+    CudaSafeCall(cudaEventRecord(_stagingEvent, stream));
+    unsigned int const numBlocks  = device_vector_kernels::numBlocks(numIndices);
+    unsigned int const numThreads = device_vector_kernels::threadsPerBlock;
+    device_vector_kernels::scatter<<<numBlocks, numThreads, 0, stream>>>(
+        reinterpret_cast<T*>(scratch + valueOffset),
+        reinterpret_cast<size_t*>(scratch),
+        _ptr,
+        numIndices);
+    CudaSafeCall(cudaGetLastError());
+    _releaseScratchBuffer(stream);
+    recordStream(stream);
+}
+// =============================================================================
+
+// =============================================================================
+template <typename T, typename Allocator>
+void DeviceVector<T, Allocator>::fill(T const &value, cudaStream_t const stream)
+{
+    if (_size == 0)
+    {
+        return;
+    }
+    CudaDeviceGuard guard(_device);
+
+    unsigned int const numBlocks  = device_vector_kernels::numBlocks(_size);
+    unsigned int const numThreads = device_vector_kernels::threadsPerBlock;
+    device_vector_kernels::fill<<<numBlocks, numThreads, 0, stream>>>(
+        _ptr, _size, value);
+    CudaSafeCall(cudaGetLastError());
+    recordStream(stream);
+}
+// =============================================================================
+
+// =============================================================================
+template <typename T, typename Allocator>
+void DeviceVector<T, Allocator>::iota(T const &start,
+                                      T const &step,
+                                      cudaStream_t const stream)
+{
+    if (_size == 0)
+    {
+        return;
+    }
+    CudaDeviceGuard guard(_device);
+
+    unsigned int const numBlocks  = device_vector_kernels::numBlocks(_size);
+    unsigned int const numThreads = device_vector_kernels::threadsPerBlock;
+    device_vector_kernels::iota<<<numBlocks, numThreads, 0, stream>>>(
+        _ptr, _size, start, step);
+    CudaSafeCall(cudaGetLastError());
+    recordStream(stream);
+}
+// =============================================================================
+
+// =============================================================================
+template <typename T, typename Allocator>
+template <typename UnaryOp>
+void DeviceVector<T, Allocator>::transform(UnaryOp op, cudaStream_t const stream)
+{
+    if (_size == 0)
+    {
+        return;
+    }
+    CudaDeviceGuard guard(_device);
+
+    unsigned int const numBlocks  = device_vector_kernels::numBlocks(_size);
+    unsigned int const numThreads = device_vector_kernels::threadsPerBlock;
+    device_vector_kernels::transform<<<numBlocks, numThreads, 0, stream>>>(
+        _ptr, _size, op);
+    CudaSafeCall(cudaGetLastError());
+    recordStream(stream);
+}
+// =============================================================================
+
+// =============================================================================
+template <typename T, typename Allocator>
+template <typename BinaryOp>
+T DeviceVector<T, Allocator>::reduce(BinaryOp op,
+                                     T const &init,
+                                     cudaStream_t const stream)
+{
+    if (_size == 0)
+    {
+        return init;
+    }
+    CudaDeviceGuard guard(_device);
+
+    // The first pass writes one partial result per block, the second pass
+    // reduces those with a single block and writes the result after them
+    unsigned int const numBlocks  = device_vector_kernels::numBlocks(_size);
+    unsigned int const numThreads = device_vector_kernels::threadsPerBlock;
+    T *partials = reinterpret_cast<T*>(
+        _getScratchBuffer((numBlocks + 1)*sizeof(T), stream));
+
+    device_vector_kernels::reduce<<<numBlocks, numThreads, 0, stream>>>(
+        _ptr, _size, op, init, partials);
+    device_vector_kernels::reduce<<<1, numThreads, 0, stream>>>(
+        partials, numBlocks, op, init, partials + numBlocks);
+    CudaSafeCall(cudaGetLastError());
+
+    // Copy the result back through the staging buffer
+    T *staging = reinterpret_cast<T*>(_getStagingBuffer(sizeof(T)));
+    CudaSafeCall(cudaMemcpyAsync(staging,
+                                 partials + numBlocks,
+                                 sizeof(T),
+                                 cudaMemcpyDefault,
+                                 stream));
+    CudaSafeCall(cudaEventRecord(_stagingEvent, stream));
+    _releaseScratchBuffer(stream);
+
+    CudaSafeCall(cudaStreamSynchronize(stream));
+    return *staging;
+}
+// =============================================================================
+#endif  // __CUDACC__
+
+// =============================================================================
+// Private Methods
+// =============================================================================
+
+// =============================================================================
+template <typename T, typename Allocator>
+void DeviceVector<T, Allocator>::_reallocate(size_t const newCapacity)
+{
+    CudaDeviceGuard guard(_device);
+
+    // Assign old array to a new pointer
+    T * oldDevPtr = _ptr;
+
+    // Determine how many elements to copy
+    size_t const newSize = std::min(_size, newCapacity);
+
+    // Allocate new array
+    _ptr      = static_cast<T*>(Allocator::allocate(newCapacity*sizeof(T)));
+    _capacity = newCapacity;
+    _size     = newSize;
+
+    // Copy the values from the old array to the new array once any work on
+    // other streams is done with it. Both arrays are on `_device` and
+    // cudaMemcpyDefault is used since the allocator might not return device
+    // memory
+    _waitForStreams();
+    CudaSafeCall(cudaMemcpy(_ptr, oldDevPtr, newSize*sizeof(T),
+                            cudaMemcpyDefault));
+
+    // Free the old array
+    Allocator::deallocate(oldDevPtr);
+}
+// =============================================================================
+
+// =============================================================================
+template <typename T, typename Allocator>
+void DeviceVector<T, Allocator>::_recordStream(cudaStream_t const stream,
+                                               int const streamDevice) const
+{
+    // Work on the default stream is already ordered before the free
+    if (stream == 0)
+    {
+        return;
+    }
+
+    // The event has to be on the same device as the stream but the default
+    // stream of any device can wait on it
+    CudaDeviceGuard guard(streamDevice);
+
+    // Only a handful of streams use any one array so a linear search is fine
+    for (auto &streamEvent : _streamEvents)
+    {
+        if (streamEvent.first == stream)
+        {
+            CudaSafeCall(cudaEventRecord(streamEvent.second, stream));
+            return;
+        }
+    }
+
+    cudaEvent_t event;
+    CudaSafeCall(cudaEventCreateWithFlags(&event, cudaEventDisableTiming));
+    CudaSafeCall(cudaEventRecord(event, stream));
+    _streamEvents.emplace_back(stream, event);
+}
+// =============================================================================
+
+// =============================================================================
+template <typename T, typename Allocator>
+void DeviceVector<T, Allocator>::_waitForStreams()
+{
+    // Destroying an event doesn't affect the waits already enqueued on it
+    for (auto &streamEvent : _streamEvents)
+    {
+        CudaSafeCall(cudaStreamWaitEvent(0, streamEvent.second, 0));
+        CudaSafeCall(cudaEventDestroy(streamEvent.second));
+    }
+    _streamEvents.clear();
+}
+// =============================================================================
+
+// =============================================================================
+template <typename T, typename Allocator>
+void DeviceVector<T, Allocator>::_checkRange(size_t const &offset,
+                                             size_t const &count,
+                                             std::string const &caller) const
+{
+    if ((offset > _size) or (count > _size - offset))
+    {
+        throw std::out_of_range("Warning: DeviceVector." + caller + "() "
+                                "detected an out of bounds memory access. "
+                                "Tried to access elements ["
+                                + std::to_string(offset)
+                                + ", "
+                                + std::to_string(offset + count)
+                                + ") of "
+                                + std::to_string(_size));
+    }
+}
+// =============================================================================
+
+// =============================================================================
+template <typename T, typename Allocator>
+char *DeviceVector<T, Allocator>::_getStagingBuffer(size_t const &bytes)
+{
+    if (_stagingEvent == nullptr)
+    {
+        // The event is recorded on streams of `_device`
+        CudaDeviceGuard guard(_device);
+        CudaSafeCall(cudaEventCreateWithFlags(&_stagingEvent,
+                                              cudaEventDisableTiming));
+    }
+    else
+    {
+        // Wait for any previous staged copy to finish with the buffer
+        CudaSafeCall(cudaEventSynchronize(_stagingEvent));
+    }
+
+    if (_stagingBuffer.size() < bytes)
+    {
+        _stagingBuffer.reset(bytes);
+    }
+
+    return _stagingBuffer.data();
+}
+// =============================================================================
+
+// =============================================================================
+template <typename T, typename Allocator>
+char *DeviceVector<T, Allocator>::_getScratchBuffer(size_t const &bytes,
+                                                    cudaStream_t const stream)
+{
+    CudaDeviceGuard guard(_device);
+    if (_scratchEvent == nullptr)
+    {
+        CudaSafeCall(cudaEventCreateWithFlags(&_scratchEvent,
+                                              cudaEventDisableTiming));
+    }
+    else
+    {
+        // The previous use may have been on another stream
+        CudaSafeCall(cudaStreamWaitEvent(stream, _scratchEvent, 0));
+    }
+
+    if (_scratchBytes < bytes)
+    {
+        _freeScratchBuffer();
+        _scratchBuffer = static_cast<char*>(Allocator::allocate(bytes, stream));
+        _scratchBytes  = bytes;
+    }
+
+    return _scratchBuffer;
+}
+// =============================================================================
+
+// =============================================================================
+template <typename T, typename Allocator>
+void DeviceVector<T, Allocator>::_freeScratchBuffer()
+{
+    if (_scratchBuffer == nullptr)
+    {
+        return;
+    }
+
+    // Only happens when the buffer grows or the vector is destroyed, so a
+    // host synchronization here is cheap
+    CudaDeviceGuard guard(_device);
+    CudaSafeCall(cudaEventSynchronize(_scratchEvent));
+    Allocator::deallocate(_scratchBuffer);
+    _scratchBuffer = nullptr;
+    _scratchBytes  = 0;
+}
+// =============================================================================
+
+// =============================================================================
+template <typename T, typename Allocator>
+void DeviceVector<T, Allocator>::_checkIndices(
+    std::vector<size_t> const &indices,
+    std::string const &caller) const
+{
+    for (size_t const index : indices)
+    {
+        if (index >= _size)
+        {
+            throw std::out_of_range("Warning: DeviceVector." + caller + "()"
+                                    " detected an out of bounds memory"
+                                    " access. Tried to access element "
+                                    + std::to_string(index)
+                                    + " of "
+                                    + std::to_string(_size));
+        }
+    }
+}
+// =============================================================================
+
+// =============================================================================
+template <typename T, typename Allocator>
+void DeviceVector<T, Allocator>::_hostCopy(void *userData)
+{
+    _HostCopy *hostCopy = static_cast<_HostCopy*>(userData);
+    std::memcpy(hostCopy->destination, hostCopy->source, hostCopy->bytes);
+    delete hostCopy;
+}
+// =============================================================================
+
 // =============================================================================
 // End definition of DeviceVector class
-// =============================================================================
\ No newline at end of file
+// =============================================================================
@@ -0,0 +1,265 @@
+/*!
+ * \file DeviceVector_benchmarks.cu
+ * \author Robert 'Bob' Caddy (rvc@pitt.edu)
+ * \brief Benchmarks for the DeviceVector class: host/device transfer bandwidth
+ * from pageable and pinned memory, synchronous and asynchronous, across sizes,
+ * the cost of `resize` compared to `reset`, and the latency of element access
+ *
+ * \details Usage: `DeviceVector_benchmarks [--max-bytes N] [--output file.csv]
+ * [--baseline file.csv]`. The results are reported with PerfTimer statistics
+ * and a bandwidth table. `--output` saves them with Benchmark::saveResults()
+ * and `--baseline` compares them against an earlier `--output`, the exit code
+ * is the number of regressions.
+ *
+ */
+
+// STL Includes
+#include <vector>
+#include <string>
+#include <iostream>
+#include <iomanip>
+
+// External Includes
+#include <cuda_runtime.h>
+
+// Local Includes
+#include "../global/global.h"
+#include "../utils/DeviceVector.h"
+#include "../utils/Benchmark.h"
+#include "../utils/cppArgParser.h"
+
+
+namespace // Anonymous namespace
+{
+    /// The directions and ways a transfer can be done
+    std::vector<std::string> const transferDirections{"H2D", "D2H"};
+    std::vector<std::string> const transferModes{"pageable",
+                                                 "pinned",
+                                                 "pinned async"};
+
+    /*!
+     * \brief Get the name of a transfer benchmark
+     *
+     * \param[in] direction "H2D" or "D2H"
+     * \param[in] mode One of `transferModes`
+     * \param[in] bytes The size of the transfer
+     * \return std::string The name
+     */
+    std::string transferName(std::string const &direction,
+                             std::string const &mode,
+                             size_t const bytes)
+    {
+        return direction + " " + mode + " " + std::to_string(bytes) + " B";
+    }
+
+    /*!
+     * \brief Benchmark copies to and from the device of every size in every
+     * transfer mode. The async copies include the stream synchronization
+     *
+     * \param[in,out] benchmark The benchmark runner
+     * \param[in] sizes The sizes to benchmark, in bytes
+     */
+    void benchmarkTransfers(Benchmark &benchmark,
+                            std::vector<size_t> const &sizes)
+    {
+        cudaStream_t stream;
+        CudaSafeCall(cudaStreamCreate(&stream));
+
+        for (size_t const bytes : sizes)
+        {
+            size_t const numElements = bytes / sizeof(double);
+            cuda_utilities::DeviceVector<double> devVector{numElements};
+            std::vector<double> pageable(numElements, 1.0);
+            PinnedHostVector<double> pinned(numElements);
+
+            benchmark.run(transferName("H2D", "pageable", bytes),
+                [&]{devVector.cpyHostToDevice(pageable);});
+            benchmark.run(transferName("H2D", "pinned", bytes),
+                [&]{devVector.cpyHostToDevice(pinned);});
+            benchmark.run(transferName("H2D", "pinned async", bytes), [&]
+            {
+                devVector.cpyHostToDeviceAsync(pinned, stream);
+                CudaSafeCall(cudaStreamSynchronize(stream));
+            });
+
+            benchmark.run(transferName("D2H", "pageable", bytes), [&]
+            {
+                devVector.cpyDeviceToHost(pageable);
+                doNotOptimize(pageable.data());
+            });
+            benchmark.run(transferName("D2H", "pinned", bytes), [&]
+            {
+                devVector.cpyDeviceToHost(pinned);
+                doNotOptimize(pinned.data());
+            });
+            benchmark.run(transferName("D2H", "pinned async", bytes), [&]
+            {
+                devVector.cpyDeviceToHostAsync(pinned, stream);
+                CudaSafeCall(cudaStreamSynchronize(stream));
+                doNotOptimize(pinned.data());
+            });
+        }
+
+        CudaSafeCall(cudaStreamDestroy(stream));
+    }
+
+    /*!
+     * \brief Benchmark doubling the size of a vector with `resize`, which
+     * copies the values, and `reset`, which doesn't. Each iteration constructs
+     * and destroys the vector so the "construct" benchmark is the baseline to
+     * subtract
+     *
+     * \tparam Allocator The allocator of the DeviceVector
+     * \param[in,out] benchmark The benchmark runner
+     * \param[in] sizes The sizes to benchmark, in bytes
+     * \param[in] allocatorName The name of the allocator for the benchmark
+     * names
+     */
+    template <typename Allocator>
+    void benchmarkResize(Benchmark &benchmark,
+                         std::vector<size_t> const &sizes,
+                         std::string const &allocatorName)
+    {
+        for (size_t const bytes : sizes)
+        {
+            size_t const numElements = bytes / sizeof(double);
+            std::string const suffix = " " + allocatorName + " "
+                                       + std::to_string(bytes) + " B";
+
+            benchmark.run("construct" + suffix, [&]
+            {
+                cuda_utilities::DeviceVector<double, Allocator> devVector{numElements};
+                doNotOptimize(devVector.data());
+            });
+            benchmark.run("construct and resize x2" + suffix, [&]
+            {
+                cuda_utilities::DeviceVector<double, Allocator> devVector{numElements};
+                devVector.resize(2 * numElements);
+                doNotOptimize(devVector.data());
+            });
+            benchmark.run("construct and reset x2" + suffix, [&]
+            {
+                cuda_utilities::DeviceVector<double, Allocator> devVector{numElements};
+                devVector.reset(2 * numElements);
+                doNotOptimize(devVector.data());
+            });
+        }
+    }
+
+    /*!
+     * \brief Benchmark reading and writing single elements from the host,
+     * each of which is a blocking copy of one element
+     *
+     * \param[in,out] benchmark The benchmark runner
+     */
+    void benchmarkElementAccess(Benchmark &benchmark)
+    {
+        size_t const vectorSize = 1 << 20;
+        cuda_utilities::DeviceVector<double> devVector{vectorSize};
+        devVector.fill(1.0);
+        CudaSafeCall(cudaDeviceSynchronize());
+
+        // Stride through the vector so consecutive accesses don't hit the same
+        // cache line
+        size_t index = 0;
+        auto const next = [&index]{return index = (index + 4099) % vectorSize;};
+
+        benchmark.run("operator[]", [&]{doNotOptimize(devVector[next()]);});
+        benchmark.run("at",         [&]{doNotOptimize(devVector.at(next()));});
+        benchmark.run("assign",     [&]{devVector.assign(2.0, next());});
+    }
+
+    /*!
+     * \brief Print the mean bandwidth of every transfer benchmark as a table
+     *
+     * \param[in] benchmark The benchmark runner with the transfer results
+     * \param[in] sizes The sizes that were benchmarked, in bytes
+     */
+    void reportBandwidth(Benchmark const &benchmark,
+                         std::vector<size_t> const &sizes)
+    {
+        std::cout << std::endl << "Transfer bandwidth (GB/s):" << std::endl
+                  << std::setw(12) << "bytes";
+        for (std::string const &direction : transferDirections)
+        {
+            for (std::string const &mode : transferModes)
+            {
+                std::cout << std::setw(18) << direction + " " + mode;
+            }
+        }
+        std::cout << std::endl;
+
+        for (size_t const bytes : sizes)
+        {
+            std::cout << std::setw(12) << bytes;
+            for (std::string const &direction : transferDirections)
+            {
+                for (std::string const &mode : transferModes)
+                {
+                    std::string const name = transferName(direction, mode, bytes);
+                    for (BenchmarkResult const &result : benchmark.results())
+                    {
+                        if (result.name == name)
+                        {
+                            // Times are in nanoseconds so bytes/ns is GB/s
+                            std::cout << std::setw(18) << std::fixed
+                                      << std::setprecision(3)
+                                      << bytes / result.timer.averageTime();
+                        }
+                    }
+                }
+            }
+            std::cout << std::defaultfloat << std::endl;
+        }
+    }
+} // Anonymous namespace
+
+// =============================================================================
+// Benchmarks
+// =============================================================================
+int main(int argc, char **argv)
+{
+    InputParser input(argc, argv);
+    size_t const maxBytes = input.get<size_t>("--max-bytes", size_t(1) << 28);
+
+    // Every size from 8 bytes to maxBytes, by factors of four
+    std::vector<size_t> sizes;
+    for (size_t bytes = 8; bytes <= maxBytes; bytes *= 4)
+    {
+        sizes.push_back(bytes);
+    }
+
+    // Shorter than the defaults so the whole sweep takes a few minutes
+    BenchmarkOptions options;
+    options.warmupTime          = 2.E7;
+    options.maxTime             = 1.E9;
+    options.targetRelativeError = 0.02;
+    Benchmark benchmark(options);
+
+    benchmarkTransfers(benchmark, sizes);
+    benchmarkResize<CudaMallocAllocator>(benchmark, sizes, "cudaMalloc");
+    benchmarkResize<CachingDeviceAllocator>(benchmark, sizes, "caching");
+    benchmarkElementAccess(benchmark);
+
+    benchmark.reportStats();
+    reportBandwidth(benchmark, sizes);
+
+    if (input.cmdOptionExists("--output"))
+    {
+        benchmark.saveResults(input.getCmdOption("--output"));
+    }
+
+    // Report the count rather than returning it since exit statuses are
+    // taken mod 256
+    size_t numRegressions = 0;
+    if (input.cmdOptionExists("--baseline"))
+    {
+        std::cout << std::endl << "Comparison to the baseline:" << std::endl;
+        numRegressions = benchmark.compare(input.getCmdOption("--baseline"));
+        std::cout << numRegressions << " regression(s) found" << std::endl;
+    }
+    return (numRegressions > 0)? 1: 0;
+}
+// =============================================================================
+// End benchmarks
+// =============================================================================
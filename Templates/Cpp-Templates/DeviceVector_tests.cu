@@ -10,6 +10,7 @@
 #include <string>
 #include <iostream>
 #include <numeric>
+#include <type_traits>
 
 // External Includes
 #include <gtest/gtest.h>    // Include GoogleTest and related libraries/headers
@@ -18,12 +19,13 @@
 #include "../global/global.h"
 #include "../utils/testing_utilities.h"
 #include "../utils/DeviceVector.h"
+#include "../utils/ShardedDeviceVector.h"
 
 
 namespace // Anonymous namespace
 {
-    template <typename T>
-    void checkPointerAttributes(cuda_utilities::DeviceVector<T> &devVector)
+    template <typename T, typename Allocator>
+    void checkPointerAttributes(cuda_utilities::DeviceVector<T, Allocator> &devVector)
     {
         // Get the pointer information
         cudaPointerAttributes ptrAttributes;
@@ -302,6 +304,622 @@ TEST(tALLDeviceVectorResize,
     }
 }
 
+TEST(tALLDeviceVectorResize,
+     SetSmallerThenLargerSizeExpectNoReallocation)
+{
+    // Initialize the vectors
+    size_t const vectorSize = 10;
+    cuda_utilities::DeviceVector<double> devVector{vectorSize};
+    double *originalPtr = devVector.data();
+
+    // Shrinking and growing back within the capacity should reuse the memory
+    devVector.resize(vectorSize/2);
+    devVector.resize(vectorSize);
+
+    EXPECT_EQ(vectorSize, devVector.size());
+    EXPECT_EQ(vectorSize, devVector.capacity());
+    EXPECT_EQ(originalPtr, devVector.data());
+}
+
+TEST(tALLDeviceVectorPushBack,
+     AppendManyValuesExpectGeometricGrowthAndCorrectMemoryValues)
+{
+    // Initialize the vectors
+    size_t const numValues = 100;
+    cuda_utilities::DeviceVector<double> devVector{0};
+
+    // Append the values and count how many times the memory moves
+    size_t numReallocations = 0;
+    double *previousPtr = devVector.data();
+    for (size_t i = 0; i < numValues; i++)
+    {
+        devVector.push_back(static_cast<double>(i));
+        if (devVector.data() != previousPtr)
+        {
+            numReallocations++;
+            previousPtr = devVector.data();
+        }
+    }
+
+    // Check the size, capacity, and number of reallocations
+    EXPECT_EQ(numValues, devVector.size());
+    EXPECT_LE(numValues, devVector.capacity());
+    EXPECT_GE(2*numValues, devVector.capacity());
+    EXPECT_GE(8ul, numReallocations);
+
+    // Check the values
+    for (size_t i = 0; i < numValues; i++)
+    {
+        EXPECT_EQ(static_cast<double>(i), devVector.at(i));
+    }
+}
+
+TEST(tALLDeviceVectorReserve,
+     ReserveThenShrinkToFitExpectCorrectCapacityAndMemoryValues)
+{
+    // Initialize the vectors
+    size_t const vectorSize  = 10;
+    size_t const newCapacity = 50;
+    cuda_utilities::DeviceVector<double> devVector{vectorSize};
+    std::vector<double> stdVec(vectorSize);
+    std::iota(stdVec.begin(), stdVec.end(), 0);
+    devVector.cpyHostToDevice(stdVec);
+
+    // Reserve more space, the size and values should not change
+    devVector.reserve(newCapacity);
+    EXPECT_EQ(vectorSize, devVector.size());
+    EXPECT_EQ(newCapacity, devVector.capacity());
+    checkPointerAttributes(devVector);
+
+    // Shrink back down
+    devVector.shrink_to_fit();
+    EXPECT_EQ(vectorSize, devVector.size());
+    EXPECT_EQ(vectorSize, devVector.capacity());
+
+    // Check the values
+    for (size_t i = 0; i < vectorSize; i++)
+    {
+        EXPECT_EQ(stdVec.at(i), devVector.at(i));
+    }
+}
+
+TEST(tALLDeviceVectorMove,
+     MoveConstructAndAssignExpectOwnershipTransfer)
+{
+    static_assert(not std::is_copy_constructible<
+                      cuda_utilities::DeviceVector<double>>::value,
+                  "DeviceVector should not be copy constructible");
+
+    // Initialize the vectors
+    size_t const vectorSize = 10;
+    cuda_utilities::DeviceVector<double> devVector{vectorSize};
+    double *originalPtr = devVector.data();
+
+    // Move construct, the memory should be transferred
+    cuda_utilities::DeviceVector<double> movedVector(std::move(devVector));
+    EXPECT_EQ(originalPtr, movedVector.data());
+    EXPECT_EQ(vectorSize, movedVector.size());
+    EXPECT_EQ(nullptr, devVector.data());
+    EXPECT_EQ(0ul, devVector.size());
+
+    // Move assign, the memory should be transferred back
+    devVector = std::move(movedVector);
+    EXPECT_EQ(originalPtr, devVector.data());
+    EXPECT_EQ(vectorSize, devVector.size());
+    EXPECT_EQ(nullptr, movedVector.data());
+    checkPointerAttributes(devVector);
+}
+
+TEST(tALLDeviceVectorMove,
+     StoreInStdVectorExpectCorrectMemoryValues)
+{
+    // Initialize the vectors
+    size_t const vectorSize = 10;
+    size_t const numVectors = 20;
+    std::vector<cuda_utilities::DeviceVector<double>> vecOfVecs;
+    std::vector<double> stdVec(vectorSize);
+
+    // Storing by value forces moves when the std::vector grows
+    for (size_t i = 0; i < numVectors; i++)
+    {
+        std::iota(stdVec.begin(), stdVec.end(), i*vectorSize);
+        vecOfVecs.emplace_back(vectorSize);
+        vecOfVecs.back().cpyHostToDevice(stdVec);
+    }
+
+    // Check the values
+    for (size_t i = 0; i < numVectors; i++)
+    {
+        for (size_t j = 0; j < vectorSize; j++)
+        {
+            EXPECT_EQ(static_cast<double>(i*vectorSize + j),
+                      vecOfVecs.at(i).at(j));
+        }
+    }
+}
+
+TEST(tALLDeviceVectorClone,
+     CloneThenModifyOriginalExpectIndependentCopy)
+{
+    // Initialize the vectors
+    size_t const vectorSize = 10;
+    cuda_utilities::DeviceVector<double> devVector{vectorSize};
+    std::vector<double> stdVec(vectorSize);
+    std::iota(stdVec.begin(), stdVec.end(), 0);
+    devVector.cpyHostToDevice(stdVec);
+
+    // Clone then change the original
+    cuda_utilities::DeviceVector<double> clonedVector = devVector.clone();
+    CudaSafeCall(cudaDeviceSynchronize());
+    devVector.assign(-1.0, 0);
+
+    // Check the values
+    EXPECT_EQ(vectorSize, clonedVector.size());
+    EXPECT_NE(devVector.data(), clonedVector.data());
+    checkPointerAttributes(clonedVector);
+    for (size_t i = 0; i < vectorSize; i++)
+    {
+        EXPECT_EQ(stdVec.at(i), clonedVector.at(i));
+    }
+}
+
+TEST(tALLDeviceVectorAsyncCopy,
+     CopySubRangeOnStreamExpectCorrectMemoryValues)
+{
+    // Initialize the vectors
+    size_t const vectorSize = 10;
+    size_t const offset     = 3;
+    size_t const count      = 5;
+    cuda_utilities::DeviceVector<double> devVector{vectorSize};
+    std::vector<double> stdVec(vectorSize), subVec(count), hostVec(count);
+    std::iota(stdVec.begin(), stdVec.end(), 0);
+    std::iota(subVec.begin(), subVec.end(), 100);
+
+    // Setup the stream and event
+    cudaStream_t stream;
+    cudaEvent_t  event;
+    CudaSafeCall(cudaStreamCreate(&stream));
+    CudaSafeCall(cudaEventCreate(&event));
+
+    // Copy the whole array then overwrite a sub-range of it
+    devVector.cpyHostToDeviceAsync(stdVec, stream);
+    devVector.cpyHostToDeviceAsync(subVec, stream, offset);
+
+    // Copy the sub-range back and wait on the event
+    devVector.cpyDeviceToHostAsync(hostVec, stream, offset, event);
+    CudaSafeCall(cudaEventSynchronize(event));
+
+    // Check the values
+    for (size_t i = 0; i < count; i++)
+    {
+        EXPECT_EQ(subVec.at(i), hostVec.at(i));
+    }
+    for (size_t i = 0; i < vectorSize; i++)
+    {
+        double const fiducialValue = (i >= offset and i < offset + count)?
+                                     subVec.at(i - offset): stdVec.at(i);
+        EXPECT_EQ(fiducialValue, devVector.at(i));
+    }
+
+    CudaSafeCall(cudaEventDestroy(event));
+    CudaSafeCall(cudaStreamDestroy(stream));
+}
+
+TEST(tALLDeviceVectorPinnedHostVectorCopy,
+     CopyToAndFromPinnedMemoryExpectCorrectMemoryValues)
+{
+    // Initialize the vectors
+    size_t const vectorSize = 10;
+    cuda_utilities::DeviceVector<double> devVector{vectorSize};
+    PinnedHostVector<double> pinnedVec(vectorSize), hostVec(vectorSize),
+                             asyncVec(vectorSize);
+    std::iota(pinnedVec.begin(), pinnedVec.end(), 0);
+
+    // Check that the host memory is actually pinned
+    cudaPointerAttributes ptrAttributes;
+    CudaSafeCall(cudaPointerGetAttributes(&ptrAttributes, pinnedVec.data()));
+    EXPECT_EQ(1, ptrAttributes.type) << "ptrAttributes.type should be 1 since "
+                                        "that indicates type cudaMemoryTypeHost";
+
+    // Copy to the device and back with both the synchronous and asynchronous
+    // methods
+    cudaStream_t stream;
+    CudaSafeCall(cudaStreamCreate(&stream));
+    devVector.cpyHostToDevice(pinnedVec);
+    devVector.cpyDeviceToHost(hostVec);
+    devVector.cpyDeviceToHostAsync(asyncVec, stream);
+    CudaSafeCall(cudaStreamSynchronize(stream));
+
+    // Check the values
+    for (size_t i = 0; i < vectorSize; i++)
+    {
+        EXPECT_EQ(pinnedVec.at(i), hostVec.at(i));
+        EXPECT_EQ(pinnedVec.at(i), asyncVec.at(i));
+    }
+
+    CudaSafeCall(cudaStreamDestroy(stream));
+}
+
+TEST(tALLDeviceVectorStagedAsyncCopy,
+     RoundTripStdVectorExpectCorrectMemoryValues)
+{
+    // Initialize the vectors
+    size_t const vectorSize = 10;
+    cuda_utilities::DeviceVector<double> devVector{vectorSize};
+    std::vector<double> stdVec(vectorSize), hostVec(vectorSize);
+    std::iota(stdVec.begin(), stdVec.end(), 0);
+
+    cudaStream_t stream;
+    CudaSafeCall(cudaStreamCreate(&stream));
+
+    // Copy to the device then immediately overwrite the host values, the
+    // staged copy should have already captured the original values
+    devVector.cpyHostToDeviceAsync(stdVec, stream);
+    std::vector<double> const fiducialVec = stdVec;
+    std::fill(stdVec.begin(), stdVec.end(), -1.0);
+
+    // Copy back to the host
+    devVector.cpyDeviceToHostAsync(hostVec, stream);
+    CudaSafeCall(cudaStreamSynchronize(stream));
+
+    // Check the values
+    for (size_t i = 0; i < vectorSize; i++)
+    {
+        EXPECT_EQ(fiducialVec.at(i), hostVec.at(i));
+    }
+
+    CudaSafeCall(cudaStreamDestroy(stream));
+}
+
+TEST(tALLDeviceVectorCachingAllocator,
+     ReallocateSameSizeExpectCacheHitAndValidPointer)
+{
+    // Initialize the vectors
+    size_t const vectorSize = 10;
+    DeviceMemoryPool::Statistics const initialStats =
+        DeviceMemoryPool::instance().getStatistics();
+
+    double *firstPtr;
+    {
+        cuda_utilities::DeviceVector<double, CachingDeviceAllocator>
+            devVector{vectorSize};
+        firstPtr = devVector.data();
+    }
+
+    // Allocating the same size again should be served from the cache
+    cuda_utilities::DeviceVector<double, CachingDeviceAllocator>
+        devVector{vectorSize};
+    DeviceMemoryPool::Statistics const finalStats =
+        DeviceMemoryPool::instance().getStatistics();
+
+    EXPECT_EQ(firstPtr, devVector.data());
+    EXPECT_EQ(initialStats.numAllocations + 2, finalStats.numAllocations);
+    EXPECT_EQ(initialStats.numHits + 1, finalStats.numHits);
+    EXPECT_LE(vectorSize*sizeof(double), finalStats.bytesInUse);
+    EXPECT_LE(finalStats.bytesHeld(), finalStats.highWaterMark);
+
+    // Check the pointer and that it still works
+    checkPointerAttributes(devVector);
+    std::vector<double> stdVec(vectorSize);
+    std::iota(stdVec.begin(), stdVec.end(), 0);
+    devVector.cpyHostToDevice(stdVec);
+    for (size_t i = 0; i < vectorSize; i++)
+    {
+        EXPECT_EQ(stdVec.at(i), devVector.at(i));
+    }
+}
+
+TEST(tALLDeviceVectorCachingAllocator,
+     FreeWithCopyPendingOnOtherStreamExpectCopyUnaffected)
+{
+    // Initialize the vectors. The array is large so the copy is likely to
+    // still be running when the vector is freed
+    size_t const vectorSize = size_t(1) << 24;
+    PinnedHostVector<double> pinnedVec(vectorSize), asyncVec(vectorSize),
+                             overwriteVec(vectorSize);
+    std::iota(pinnedVec.begin(), pinnedVec.end(), 0);
+    std::fill(overwriteVec.begin(), overwriteVec.end(), -1.0);
+
+    cudaStream_t stream;
+    CudaSafeCall(cudaStreamCreateWithFlags(&stream, cudaStreamNonBlocking));
+
+    // Free the vector while the copy out of it is pending on a non-blocking
+    // stream then immediately reuse the memory from the default stream
+    double *firstPtr;
+    {
+        cuda_utilities::DeviceVector<double, CachingDeviceAllocator>
+            devVector{vectorSize};
+        devVector.cpyHostToDevice(pinnedVec);
+        devVector.cpyDeviceToHostAsync(asyncVec, stream);
+        firstPtr = devVector.data();
+    }
+    cuda_utilities::DeviceVector<double, CachingDeviceAllocator>
+        devVector{vectorSize};
+    devVector.cpyHostToDevice(overwriteVec);
+    CudaSafeCall(cudaStreamSynchronize(stream));
+
+    // The memory should have been reused but only after the copy finished
+    EXPECT_EQ(firstPtr, devVector.data());
+    for (size_t i = 0; i < vectorSize; i++)
+    {
+        ASSERT_EQ(pinnedVec.at(i), asyncVec.at(i));
+    }
+
+    CudaSafeCall(cudaStreamDestroy(stream));
+}
+
+TEST(tALLDeviceVectorGatherScatter,
+     ScatterThenGatherIndicesExpectCorrectMemoryValues)
+{
+    // Initialize the vectors
+    size_t const vectorSize = 100;
+    cuda_utilities::DeviceVector<double> devVector{vectorSize};
+    std::vector<double> stdVec(vectorSize);
+    std::iota(stdVec.begin(), stdVec.end(), 0);
+    devVector.cpyHostToDevice(stdVec);
+
+    std::vector<size_t> const indices{97, 3, 42, 0, 64};
+    std::vector<double> const newValues{-1, -2, -3, -4, -5};
+
+    // Gather the original values
+    std::vector<double> gathered = devVector.gather(indices);
+    ASSERT_EQ(indices.size(), gathered.size());
+    for (size_t i = 0; i < indices.size(); i++)
+    {
+        EXPECT_EQ(stdVec.at(indices.at(i)), gathered.at(i));
+    }
+
+    // Scatter new values then gather them back
+    devVector.scatter(indices, newValues);
+    gathered = devVector.gather(indices);
+    for (size_t i = 0; i < indices.size(); i++)
+    {
+        EXPECT_EQ(newValues.at(i), gathered.at(i));
+        stdVec.at(indices.at(i)) = newValues.at(i);
+    }
+
+    // Check that nothing else changed
+    for (size_t i = 0; i < vectorSize; i++)
+    {
+        EXPECT_EQ(stdVec.at(i), devVector.at(i));
+    }
+
+    // A larger batch grows the scratch buffer that the calls share
+    std::vector<size_t> allIndices(vectorSize);
+    std::iota(allIndices.begin(), allIndices.end(), 0);
+    gathered = devVector.gather(allIndices);
+    EXPECT_EQ(stdVec, gathered);
+}
+
+TEST(tALLDeviceVectorSnapshot,
+     SnapshotSubRangeExpectCorrectValuesAndIndexing)
+{
+    // Initialize the vectors
+    size_t const vectorSize = 10;
+    size_t const offset     = 4;
+    size_t const count      = 3;
+    cuda_utilities::DeviceVector<double> devVector{vectorSize};
+    std::vector<double> stdVec(vectorSize);
+    std::iota(stdVec.begin(), stdVec.end(), 0);
+    devVector.cpyHostToDevice(stdVec);
+
+    // Snapshots use the same indices as the DeviceVector
+    DeviceVectorSnapshot<double> const snap = devVector.snapshot(offset, count);
+    EXPECT_EQ(offset, snap.offset());
+    EXPECT_EQ(count,  snap.size());
+    for (size_t i = offset; i < offset + count; i++)
+    {
+        EXPECT_EQ(stdVec.at(i), snap[i]);
+        EXPECT_EQ(stdVec.at(i), snap.at(i));
+    }
+
+    // The snapshot should not change when the device values do
+    devVector.assign(-1.0, offset);
+    EXPECT_EQ(stdVec.at(offset), snap.at(offset));
+
+    // Check the bounds checking
+    EXPECT_THROW(snap.at(offset - 1), std::out_of_range);
+    EXPECT_THROW(snap.at(offset + count), std::out_of_range);
+}
+
+TEST(tALLDeviceVectorFillAndIota,
+     FillThenIotaExpectCorrectMemoryValues)
+{
+    // Initialize the vectors
+    size_t const vectorSize = 1000;
+    cuda_utilities::DeviceVector<double> devVector{vectorSize};
+
+    // Fill and check a snapshot of the values
+    devVector.fill(3.5);
+    DeviceVectorSnapshot<double> filled = devVector.snapshot();
+    for (size_t i = 0; i < vectorSize; i++)
+    {
+        EXPECT_EQ(3.5, filled[i]);
+    }
+
+    // Iota and check a snapshot of the values
+    devVector.iota(10.0, 2.0);
+    DeviceVectorSnapshot<double> iotaValues = devVector.snapshot();
+    for (size_t i = 0; i < vectorSize; i++)
+    {
+        EXPECT_EQ(10.0 + 2.0*i, iotaValues[i]);
+    }
+}
+
+namespace // Anonymous namespace
+{
+    struct SquareFunctor
+    {
+        __host__ __device__ double operator()(double const &x) const
+            {return x * x;}
+    };
+} // Anonymous namespace
+
+TEST(tALLDeviceVectorTransformAndReduce,
+     TransformThenReduceExpectCorrectResults)
+{
+    // Initialize the vectors
+    size_t const vectorSize = 100000;
+    cuda_utilities::DeviceVector<double> devVector{vectorSize};
+    devVector.iota(-50.0);
+
+    // Check the reductions
+    double const fiducialSum = vectorSize * (-50.0 + (vectorSize - 51.0)) / 2.0;
+    EXPECT_DOUBLE_EQ(fiducialSum, devVector.sum());
+    EXPECT_EQ(-50.0, devVector.min());
+    EXPECT_EQ(vectorSize - 51.0, devVector.max());
+
+    // Transform then check with a custom reduction
+    devVector.transform(SquareFunctor());
+    EXPECT_EQ(0.0, devVector.min());
+    EXPECT_EQ((vectorSize - 51.0) * (vectorSize - 51.0),
+              devVector.reduce(device_vector_kernels::Max(), 0.0));
+
+    // Empty vectors return the identity
+    cuda_utilities::DeviceVector<double> emptyVector;
+    EXPECT_EQ(0.0, emptyVector.sum());
+}
+
+TEST(tALLDeviceVectorManagedAllocator,
+     PrefetchAndAdviseExpectManagedMemoryAndCorrectValues)
+{
+    // Initialize the vectors
+    size_t const vectorSize = 10;
+    cuda_utilities::DeviceVector<double, ManagedAllocator> devVector{vectorSize};
+    std::vector<double> stdVec(vectorSize);
+    std::iota(stdVec.begin(), stdVec.end(), 0);
+
+    // Check that the memory is managed
+    cudaPointerAttributes ptrAttributes;
+    CudaSafeCall(cudaPointerGetAttributes(&ptrAttributes, devVector.data()));
+    EXPECT_EQ(3, ptrAttributes.type) << "ptrAttributes.type should be 3 since "
+                                        "that indicates type cudaMemoryTypeManaged";
+
+    // Give advice and prefetch to the device and back
+    int device;
+    CudaSafeCall(cudaGetDevice(&device));
+    devVector.cpyHostToDevice(stdVec);
+    devVector.advise(cudaMemAdviseSetPreferredLocation, device);
+    devVector.prefetch(device);
+    devVector.prefetch(0, vectorSize/2, cudaCpuDeviceId);
+    CudaSafeCall(cudaDeviceSynchronize());
+
+    // Managed memory can be read directly from the host
+    for (size_t i = 0; i < vectorSize; i++)
+    {
+        EXPECT_EQ(stdVec.at(i), devVector.data()[i]);
+        EXPECT_EQ(stdVec.at(i), devVector.at(i));
+    }
+}
+
+TEST(tALLDeviceVectorMappedHostAllocator,
+     ResizeExpectHostMemoryAndCorrectValues)
+{
+    // Initialize the vectors
+    size_t const vectorSize = 10;
+    cuda_utilities::DeviceVector<double, MappedHostAllocator> devVector{vectorSize};
+    std::vector<double> stdVec(vectorSize);
+    std::iota(stdVec.begin(), stdVec.end(), 0);
+    devVector.cpyHostToDevice(stdVec);
+
+    // Resizing should keep the values and the memory type
+    devVector.resize(2*vectorSize);
+    cudaPointerAttributes ptrAttributes;
+    CudaSafeCall(cudaPointerGetAttributes(&ptrAttributes, devVector.data()));
+    EXPECT_EQ(1, ptrAttributes.type) << "ptrAttributes.type should be 1 since "
+                                        "that indicates type cudaMemoryTypeHost";
+    for (size_t i = 0; i < vectorSize; i++)
+    {
+        EXPECT_EQ(stdVec.at(i), devVector.at(i));
+    }
+}
+
+TEST(tALLDeviceVectorMultiGPU, CopyToExpectCorrectDevicesAndValues)
+{
+    int numDevices;
+    CudaSafeCall(cudaGetDeviceCount(&numDevices));
+    int const sourceDevice      = 0;
+    int const destinationDevice = numDevices - 1;
+
+    // Initialize the vectors
+    size_t const vectorSize = 10;
+    cuda_utilities::DeviceVector<double> source{vectorSize, sourceDevice};
+    cuda_utilities::DeviceVector<double> destination{vectorSize,
+                                                     destinationDevice};
+    std::vector<double> stdVec(vectorSize), hostResult(vectorSize);
+    std::iota(stdVec.begin(), stdVec.end(), 0);
+    source.cpyHostToDevice(stdVec);
+
+    // Check that each vector owns memory on the right device
+    EXPECT_EQ(sourceDevice,      source.device());
+    EXPECT_EQ(destinationDevice, destination.device());
+    cudaPointerAttributes ptrAttributes;
+    CudaSafeCall(cudaPointerGetAttributes(&ptrAttributes, destination.data()));
+    EXPECT_EQ(destinationDevice, ptrAttributes.device);
+
+    // Copy, resize the destination to check it stays on its device, then
+    // check the values
+    source.copyTo(destination);
+    CudaSafeCall(cudaDeviceSynchronize());
+    destination.resize(2*vectorSize);
+    CudaSafeCall(cudaPointerGetAttributes(&ptrAttributes, destination.data()));
+    EXPECT_EQ(destinationDevice, ptrAttributes.device);
+    for (size_t i = 0; i < vectorSize; i++)
+    {
+        EXPECT_EQ(stdVec.at(i), destination.at(i));
+    }
+
+    // Too small of a destination should throw
+    cuda_utilities::DeviceVector<double> smallVector{vectorSize/2};
+    EXPECT_THROW(source.copyTo(smallVector), std::out_of_range);
+}
+
+TEST(tALLShardedDeviceVector, RoundTripExpectCorrectShardsAndValues)
+{
+    // Initialize the vectors, three shards on alternating devices
+    int numDevices;
+    CudaSafeCall(cudaGetDeviceCount(&numDevices));
+    std::vector<int> const devices{0, numDevices - 1, 0};
+    size_t const vectorSize = 11;
+    ShardedDeviceVector<double> shardedVec(vectorSize, devices);
+    std::vector<double> stdVec(vectorSize), hostResult;
+    std::iota(stdVec.begin(), stdVec.end(), 0);
+
+    // Check the layout
+    EXPECT_EQ(vectorSize, shardedVec.size());
+    EXPECT_EQ(devices.size(), shardedVec.numShards());
+    EXPECT_EQ(4U, shardedVec.shard(0).size());
+    EXPECT_EQ(4U, shardedVec.shard(1).size());
+    EXPECT_EQ(3U, shardedVec.shard(2).size());
+    EXPECT_EQ(8U, shardedVec.shardOffset(2));
+    EXPECT_EQ(devices.at(1), shardedVec.shard(1).device());
+    EXPECT_EQ((std::pair<size_t, size_t>(1, 1)), shardedVec.locate(5));
+
+    // Copy in and out and check the values
+    shardedVec.cpyHostToDevice(stdVec);
+    shardedVec.cpyDeviceToHost(hostResult);
+    ASSERT_EQ(vectorSize, hostResult.size());
+    for (size_t i = 0; i < vectorSize; i++)
+    {
+        EXPECT_EQ(stdVec.at(i), hostResult.at(i));
+        EXPECT_EQ(stdVec.at(i), shardedVec.at(i));
+    }
+    EXPECT_THROW(shardedVec.at(vectorSize), std::out_of_range);
+
+    // The pinned overloads copy every shard concurrently
+    PinnedHostVector<double> pinnedIn(vectorSize), pinnedOut;
+    std::copy(stdVec.rbegin(), stdVec.rend(), pinnedIn.data());
+    shardedVec.cpyHostToDevice(pinnedIn);
+    shardedVec.cpyDeviceToHost(pinnedOut);
+    ASSERT_EQ(vectorSize, pinnedOut.size());
+    for (size_t i = 0; i < vectorSize; i++)
+    {
+        EXPECT_EQ(pinnedIn.data()[i], pinnedOut.data()[i]);
+    }
+    EXPECT_THROW(shardedVec.cpyHostToDevice(PinnedHostVector<double>(1)),
+                 std::out_of_range);
+}
+
 // =============================================================================
 // Tests for exceptions
 // =============================================================================
@@ -346,3 +964,33 @@ TEST(tALLDeviceVectorStdVectorDeviceToHostCopy,
     // Copy the value to the device memory
     EXPECT_THROW(devVector.cpyDeviceToHost(stdVec), std::out_of_range);
 }
+
+TEST(tALLDeviceVectorAsyncCopy,
+    OutOfBoundsSubRangeExpectThrowOutOfRange)
+{
+    // Initialize the vectors
+    size_t const vectorSize = 10;
+    cuda_utilities::DeviceVector<double> devVector{vectorSize};
+    std::vector<double> stdVec(vectorSize/2);
+
+    // Check that copies that run past the end of the device array throw
+    EXPECT_THROW(devVector.cpyHostToDeviceAsync(stdVec, 0, vectorSize - 1),
+                 std::out_of_range);
+    EXPECT_THROW(devVector.cpyDeviceToHostAsync(stdVec, 0, vectorSize - 1),
+                 std::out_of_range);
+}
+
+TEST(tALLDeviceVectorGatherScatter,
+    OutOfBoundsIndexExpectThrowOutOfRange)
+{
+    // Initialize the vectors
+    size_t const vectorSize = 10;
+    cuda_utilities::DeviceVector<double> devVector{vectorSize};
+    std::vector<size_t> const indices{1, vectorSize};
+    std::vector<double> const values{1.0, 2.0};
+
+    // Check that any out of bounds index throws
+    EXPECT_THROW(devVector.gather(indices), std::out_of_range);
+    EXPECT_THROW(devVector.scatter(indices, values), std::out_of_range);
+    EXPECT_THROW(devVector.snapshot(vectorSize/2, vectorSize), std::out_of_range);
+}
@@ -0,0 +1,338 @@
+/*!
+ * \file HaloPacking.h
+ * \author Robert 'Bob' Caddy (rvc@pitt.edu)
+ * \brief Contains the HaloRegions class and the fused CUDA kernels that pack
+ * and unpack all the halo regions of a 3D device array in a single launch.
+ * This is the GPU alternative to the derived datatype constructors of
+ * PersistentCommunicator, MPI's handling of derived datatypes in device
+ * memory is often very slow. Note that since these are templated the
+ * implementation must be in the header file
+ *
+ */
+
+#pragma once
+
+// STL Includes
+#include <string>
+#include <stdexcept>
+#include <algorithm>
+
+// External Includes
+#include <cuda_runtime.h>
+
+// Local Includes
+#include "CudaUtilities.h"
+
+// =============================================================================
+// Declaration of HaloRegions class
+// =============================================================================
+/*!
+ * \brief Describes up to `maxRegions` rectangular regions of a 3D array that
+ * are packed one after another into a contiguous buffer. The whole struct is
+ * passed to the packing kernels by value so no device memory or copies are
+ * needed to describe the regions.
+ *
+ * \details The array is indexed with x fastest, i.e. element (i, j, k) is at
+ * `i + nx*(j + ny*k)`. Regions are packed in the order they were added and
+ * each region is packed with x fastest as well. This is the same ordering as
+ * a PersistentCommunicator::SubarrayLayout with `MPI_ORDER_FORTRAN`, so a
+ * region packed on the device can be received directly into the full array
+ * on a host with a subarray datatype.
+ *
+ */
+class HaloRegions
+{
+public:
+    /// The maximum number of regions, enough for all 26 neighbors of a 3D
+    /// domain
+    static int constexpr maxRegions = 26;
+
+    /// The extent and location of a single region
+    struct Region
+    {
+        /// The first index of the region in each dimension
+        int start[3];
+
+        /// The number of elements of the region in each dimension
+        int size[3];
+    };
+
+    /*!
+     * \brief Construct a new, empty, Halo Regions object for an array with
+     * the given dimensions
+     *
+     * \param[in] nx The number of elements in the x dimension
+     * \param[in] ny The number of elements in the y dimension
+     * \param[in] nz The number of elements in the z dimension
+     */
+    HaloRegions(int const nx, int const ny, int const nz)
+        : _dims{nx, ny, nz} {}
+
+    /*!
+     * \brief Add a region. Throws a std::out_of_range error if the region
+     * doesn't fit in the array or if there are already `maxRegions` regions
+     *
+     * \param[in] startX The first x index of the region
+     * \param[in] startY The first y index of the region
+     * \param[in] startZ The first z index of the region
+     * \param[in] sizeX The number of elements of the region in x
+     * \param[in] sizeY The number of elements of the region in y
+     * \param[in] sizeZ The number of elements of the region in z
+     * \return size_t The offset of the region in the packed buffer
+     */
+    size_t addRegion(int const startX, int const startY, int const startZ,
+                     int const sizeX,  int const sizeY,  int const sizeZ);
+
+    /*!
+     * \brief Get the number of regions
+     *
+     * \return int The number of regions
+     */
+    int numRegions() const {return _numRegions;}
+
+    /*!
+     * \brief Get the offset of a region in the packed buffer
+     *
+     * \param[in] region The index of the region
+     * \return size_t The offset of the region's first element
+     */
+    size_t offset(int const region) const {return _offsets[region];}
+
+    /*!
+     * \brief Get the number of elements in a region
+     *
+     * \param[in] region The index of the region
+     * \return size_t The number of elements in the region
+     */
+    size_t regionSize(int const region) const
+        {return _offsets[region + 1] - _offsets[region];}
+
+    /*!
+     * \brief Get the total number of elements in all the regions, which is
+     * the size that the packed buffer needs to be
+     *
+     * \return size_t The number of packed elements
+     */
+    __host__ __device__ size_t totalElements() const
+        {return _offsets[_numRegions];}
+
+    /*!
+     * \brief Find the location in the full array of an element of the
+     * packed buffer
+     *
+     * \param[in] packedIndex The index in the packed buffer
+     * \return size_t The index in the full array
+     */
+    __host__ __device__ size_t arrayIndex(size_t const packedIndex) const;
+
+private:
+    /// The dimensions of the full array
+    int _dims[3];
+
+    /// The number of regions that have been added
+    int _numRegions=0;
+
+    /// The regions
+    Region _regions[maxRegions];
+
+    /// The offset of each region in the packed buffer, with the total number
+    /// of elements at the end
+    size_t _offsets[maxRegions + 1] = {0};
+};
+// =============================================================================
+// End declaration of HaloRegions class
+// =============================================================================
+
+// =============================================================================
+// Implementation of HaloRegions class
+// =============================================================================
+
+// =============================================================================
+inline size_t HaloRegions::addRegion(int const startX,
+                                     int const startY,
+                                     int const startZ,
+                                     int const sizeX,
+                                     int const sizeY,
+                                     int const sizeZ)
+{
+    if (_numRegions == maxRegions)
+    {
+        throw std::out_of_range("Warning: HaloRegions.addRegion() can't add "
+                                "more than " + std::to_string(maxRegions)
+                                + " regions");
+    }
+
+    Region const region{{startX, startY, startZ}, {sizeX, sizeY, sizeZ}};
+    for (int dim = 0; dim < 3; dim++)
+    {
+        if ((region.start[dim] < 0) or (region.size[dim] < 0)
+            or (region.start[dim] + region.size[dim] > _dims[dim]))
+        {
+            throw std::out_of_range("Warning: HaloRegions.addRegion() region "
+                                    "doesn't fit in dimension "
+                                    + std::to_string(dim) + " of size "
+                                    + std::to_string(_dims[dim]));
+        }
+    }
+
+    _regions[_numRegions] = region;
+    _offsets[_numRegions + 1] = _offsets[_numRegions]
+                                + size_t(sizeX) * size_t(sizeY) * size_t(sizeZ);
+    return _offsets[_numRegions++];
+}
+// =============================================================================
+
+// =============================================================================
+inline __host__ __device__
+size_t HaloRegions::arrayIndex(size_t const packedIndex) const
+{
+    // There are at most 26 regions so a linear search is faster than a
+    // binary search
+    int r = 0;
+    while (packedIndex >= _offsets[r + 1])
+    {
+        r++;
+    }
+
+    Region const &region = _regions[r];
+    size_t const local = packedIndex - _offsets[r];
+    size_t const i     = local % region.size[0];
+    size_t const j     = (local / region.size[0]) % region.size[1];
+    size_t const k     = local / (size_t(region.size[0]) * region.size[1]);
+
+    return (region.start[0] + i)
+           + _dims[0] * ((region.start[1] + j)
+                         + size_t(_dims[1]) * (region.start[2] + k));
+}
+// =============================================================================
+
+// =============================================================================
+// End implementation of HaloRegions class
+// =============================================================================
+
+#ifdef __CUDACC__
+// =============================================================================
+// Halo packing kernels and launchers
+// =============================================================================
+namespace halo_packing_kernels
+{
+    /// The number of threads per block used by the packing kernels
+    int constexpr threadsPerBlock = 256;
+
+    /*!
+     * \brief Pack all the regions into a contiguous buffer
+     *
+     * \param[in] field The full array
+     * \param[out] packed The packed buffer
+     * \param[in] regions The regions to pack
+     */
+    template <typename T>
+    __global__ void pack(T const *field, T *packed, HaloRegions const regions)
+    {
+        size_t const total = regions.totalElements();
+        for (size_t id = blockIdx.x * blockDim.x + threadIdx.x;
+             id < total;
+             id += blockDim.x * gridDim.x)
+        {
+            packed[id] = field[regions.arrayIndex(id)];
+        }
+    }
+
+    /*!
+     * \brief Unpack a contiguous buffer into all the regions
+     *
+     * \param[in] packed The packed buffer
+     * \param[out] field The full array
+     * \param[in] regions The regions to unpack into
+     */
+    template <typename T>
+    __global__ void unpack(T const *packed, T *field, HaloRegions const regions)
+    {
+        size_t const total = regions.totalElements();
+        for (size_t id = blockIdx.x * blockDim.x + threadIdx.x;
+             id < total;
+             id += blockDim.x * gridDim.x)
+        {
+            field[regions.arrayIndex(id)] = packed[id];
+        }
+    }
+
+    /*!
+     * \brief Compute the number of blocks for a grid-stride loop over
+     * `numElements` elements
+     *
+     * \param[in] numElements The number of elements
+     * \return unsigned int The number of blocks
+     */
+    inline unsigned int numBlocks(size_t const numElements)
+    {
+        size_t const blocks = (numElements + threadsPerBlock - 1)
+                              / threadsPerBlock;
+        return static_cast<unsigned int>(std::min(blocks, size_t(65535)));
+    }
+}  // namespace halo_packing_kernels
+
+/*!
+ * \brief Pack all the regions of `field` into `packed` with a single kernel
+ * launch
+ *
+ * \tparam T The type of the elements
+ * \param[in] field The device pointer to the full array
+ * \param[out] packed The device pointer to the packed buffer. Must have room
+ * for `regions.totalElements()` elements
+ * \param[in] regions The regions to pack
+ * \param[in] stream The stream to launch the kernel on. Defaults to the
+ * default stream
+ */
+template <typename T>
+void packHalos(T const *field,
+               T *packed,
+               HaloRegions const &regions,
+               cudaStream_t const stream=0)
+{
+    size_t const total = regions.totalElements();
+    if (total == 0)
+    {
+        return;
+    }
+
+    unsigned int const numBlocks  = halo_packing_kernels::numBlocks(total);
+    unsigned int const numThreads = halo_packing_kernels::threadsPerBlock;
+    halo_packing_kernels::pack<<<numBlocks, numThreads, 0, stream>>>(
+        field, packed, regions);
+    CudaSafeCall(cudaGetLastError());
+}
+
+/*!
+ * \brief Unpack `packed` into all the regions of `field` with a single kernel
+ * launch
+ *
+ * \tparam T The type of the elements
+ * \param[in] packed The device pointer to the packed buffer
+ * \param[out] field The device pointer to the full array
+ * \param[in] regions The regions to unpack into
+ * \param[in] stream The stream to launch the kernel on. Defaults to the
+ * default stream
+ */
+template <typename T>
+void unpackHalos(T const *packed,
+                 T *field,
+                 HaloRegions const &regions,
+                 cudaStream_t const stream=0)
+{
+    size_t const total = regions.totalElements();
+    if (total == 0)
+    {
+        return;
+    }
+
+    unsigned int const numBlocks  = halo_packing_kernels::numBlocks(total);
+    unsigned int const numThreads = halo_packing_kernels::threadsPerBlock;
+    halo_packing_kernels::unpack<<<numBlocks, numThreads, 0, stream>>>(
+        packed, field, regions);
+    CudaSafeCall(cudaGetLastError());
+}
+// =============================================================================
+// End halo packing kernels and launchers
+// =============================================================================
+#endif  // __CUDACC__
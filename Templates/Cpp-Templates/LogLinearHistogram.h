@@ -0,0 +1,323 @@
+/*!
+ * \file LogLinearHistogram.h
+ * \author Robert 'Bob' Caddy (rvc@pitt.edu)
+ * \brief Contains the LogLinearHistogram class, a fixed memory histogram with
+ * a bounded relative error that is used by PerfTimer for percentiles
+ *
+ */
+
+#pragma once
+
+// STL Includes
+#include <vector>
+#include <cstdint>
+#include <cmath>
+#include <algorithm>
+#include <stdexcept>
+#include <string>
+#include <limits>
+
+// =============================================================================
+// Declaration of LogLinearHistogram class
+// =============================================================================
+/*!
+ * \brief A log-linear histogram of non-negative values in the style of
+ * HdrHistogram
+ *
+ * \details Values are rounded to integers and binned into power of two ranges
+ * that are each split into `subBucketCount / 2` equal sub-buckets, values
+ * below `subBucketCount` get a bucket each. The width of a bucket is therefore
+ * never more than `2 / subBucketCount` of the values in it, so any percentile
+ * is found to within about 1% while the whole range of a 64 bit integer uses
+ * a fixed number of buckets. All the memory is allocated by the constructor
+ * and `record()` is a handful of integer operations. Two histograms are
+ * merged by adding their counts.
+ *
+ */
+class LogLinearHistogram
+{
+public:
+    /// The number of bits of precision in each power of two range
+    static int constexpr subBucketBits = 7;
+
+    /// The number of buckets used for the values below the first power of two
+    /// range
+    static uint64_t constexpr subBucketCount = uint64_t(1) << subBucketBits;
+
+    /// The total number of buckets, enough for any 64 bit value
+    static size_t constexpr numBuckets = subBucketCount
+                                         + (64 - subBucketBits)
+                                         * (subBucketCount / 2);
+
+    /*!
+     * \brief Construct a new, empty, Log Linear Histogram object
+     *
+     */
+    LogLinearHistogram() : _counts(numBuckets, 0) {}
+
+    /*!
+     * \brief Add a value to the histogram. Negative values are recorded as zero
+     *
+     * \param[in] value The value to record
+     * \param[in] count The number of times to record it. Defaults to one
+     */
+    void record(double const value, uint64_t const count = 1)
+    {
+        _counts[bucketIndex(_toInteger(value))] += count;
+        _totalCount += count;
+    }
+
+    /*!
+     * \brief Add all the counts of another histogram to this one
+     *
+     * \param[in] other The histogram to merge into this one
+     */
+    void merge(LogLinearHistogram const &other);
+
+    /*!
+     * \brief Remove all the recorded values
+     *
+     */
+    void reset()
+    {
+        std::fill(_counts.begin(), _counts.end(), 0);
+        _totalCount = 0;
+    }
+
+    /*!
+     * \brief Get the value at a given percentile. Throws a
+     * std::invalid_argument error if the percentile isn't in [0, 100]
+     *
+     * \param[in] percentile The percentile, e.g. 99.9
+     * \return double The midpoint of the bucket that contains the percentile,
+     * zero if the histogram is empty
+     */
+    double percentile(double const percentile) const;
+
+    /*!
+     * \brief Get the total number of recorded values
+     *
+     * \return uint64_t The number of values
+     */
+    uint64_t totalCount() const {return _totalCount;}
+
+    /*!
+     * \brief Get the count of a bucket
+     *
+     * \param[in] bucket The index of the bucket
+     * \return uint64_t The number of values in the bucket
+     */
+    uint64_t count(size_t const bucket) const {return _counts[bucket];}
+
+    /*!
+     * \brief Get all the bucket counts, e.g. to reduce them with MPI
+     *
+     * \return std::vector<uint64_t>& The counts of every bucket
+     */
+    std::vector<uint64_t> const &counts() const {return _counts;}
+
+    /*!
+     * \brief Replace all the bucket counts, e.g. with the result of an MPI
+     * reduction. Throws a std::invalid_argument error if `counts` doesn't
+     * have `numBuckets` elements
+     *
+     * \param[in] counts The counts of every bucket
+     */
+    void setCounts(std::vector<uint64_t> const &counts);
+
+    /*!
+     * \brief Find the bucket of an integer value
+     *
+     * \param[in] value The value
+     * \return size_t The index of its bucket
+     */
+    static size_t bucketIndex(uint64_t const value);
+
+    /*!
+     * \brief Get the smallest value in a bucket
+     *
+     * \param[in] bucket The index of the bucket
+     * \return uint64_t The smallest value in the bucket
+     */
+    static uint64_t lowerBound(size_t const bucket);
+
+    /*!
+     * \brief Get the largest value in a bucket
+     *
+     * \param[in] bucket The index of the bucket
+     * \return uint64_t The largest value in the bucket
+     */
+    static uint64_t upperBound(size_t const bucket);
+
+private:
+    /// The count of each bucket
+    std::vector<uint64_t> _counts;
+
+    /// The total number of recorded values
+    uint64_t _totalCount = 0;
+
+    /*!
+     * \brief Round a value to the nearest non-negative integer
+     *
+     * \param[in] value The value
+     * \return uint64_t The rounded value, saturated at the largest 64 bit
+     * integer
+     */
+    static uint64_t _toInteger(double const value)
+    {
+        if (not (value > 0.))
+        {
+            return 0;
+        }
+        if (value >= 1.8446744073709552E19)  // 2^64
+        {
+            return std::numeric_limits<uint64_t>::max();
+        }
+        return static_cast<uint64_t>(value + 0.5);
+    }
+
+    /*!
+     * \brief Find the index of the most significant set bit
+     *
+     * \param[in] value The value, must not be zero
+     * \return int The index of the most significant set bit
+     */
+    static int _mostSignificantBit(uint64_t const value)
+    {
+#if defined(__GNUC__) || defined(__clang__)
+        return 63 - __builtin_clzll(value);
+#else
+        int bit = 0;
+        while (value >> (bit + 1))
+        {
+            bit++;
+        }
+        return bit;
+#endif
+    }
+};
+// =============================================================================
+// End declaration of LogLinearHistogram class
+// =============================================================================
+
+// =============================================================================
+// Implementation of LogLinearHistogram class
+// =============================================================================
+
+// =============================================================================
+// Public Methods
+// =============================================================================
+
+// =============================================================================
+inline void LogLinearHistogram::merge(LogLinearHistogram const &other)
+{
+    for (size_t i = 0; i < numBuckets; i++)
+    {
+        _counts[i] += other._counts[i];
+    }
+    _totalCount += other._totalCount;
+}
+// =============================================================================
+
+// =============================================================================
+inline double LogLinearHistogram::percentile(double const percentile) const
+{
+    if ((percentile < 0.) or (percentile > 100.))
+    {
+        throw std::invalid_argument("Warning: LogLinearHistogram.percentile() "
+                                    "percentile must be in [0, 100]");
+    }
+    if (_totalCount == 0)
+    {
+        return 0.;
+    }
+
+    // The rank of the value we want, at least the first value
+    uint64_t const target = std::max(uint64_t(1), static_cast<uint64_t>(
+        std::ceil(percentile / 100. * static_cast<double>(_totalCount))));
+
+    uint64_t cumulative = 0;
+    for (size_t i = 0; i < numBuckets; i++)
+    {
+        cumulative += _counts[i];
+        if (cumulative >= target)
+        {
+            return 0.5 * (static_cast<double>(lowerBound(i))
+                          + static_cast<double>(upperBound(i)));
+        }
+    }
+
+    // Only reachable if the counts were set inconsistently
+    return static_cast<double>(upperBound(numBuckets - 1));
+}
+// =============================================================================
+
+// =============================================================================
+inline void LogLinearHistogram::setCounts(std::vector<uint64_t> const &counts)
+{
+    if (counts.size() != numBuckets)
+    {
+        throw std::invalid_argument("Warning: LogLinearHistogram.setCounts() "
+                                    "expected " + std::to_string(numBuckets)
+                                    + " counts, got "
+                                    + std::to_string(counts.size()));
+    }
+    _counts     = counts;
+    _totalCount = 0;
+    for (uint64_t const count : _counts)
+    {
+        _totalCount += count;
+    }
+}
+// =============================================================================
+
+// =============================================================================
+inline size_t LogLinearHistogram::bucketIndex(uint64_t const value)
+{
+    // Values below subBucketCount each have their own bucket
+    if (value < subBucketCount)
+    {
+        return static_cast<size_t>(value);
+    }
+
+    // Otherwise keep the top subBucketBits bits. The leading bit is always
+    // set so there are subBucketCount/2 sub-buckets per power of two
+    int const shift          = _mostSignificantBit(value) - subBucketBits + 1;
+    uint64_t const subBucket = (value >> shift) - subBucketCount / 2;
+    return static_cast<size_t>(subBucketCount
+                               + (shift - 1) * (subBucketCount / 2)
+                               + subBucket);
+}
+// =============================================================================
+
+// =============================================================================
+inline uint64_t LogLinearHistogram::lowerBound(size_t const bucket)
+{
+    if (bucket < subBucketCount)
+    {
+        return bucket;
+    }
+
+    size_t const offset    = bucket - subBucketCount;
+    int const shift        = static_cast<int>(offset / (subBucketCount / 2))
+                             + 1;
+    uint64_t const topBits = offset % (subBucketCount / 2)
+                             + subBucketCount / 2;
+    return topBits << shift;
+}
+// =============================================================================
+
+// =============================================================================
+inline uint64_t LogLinearHistogram::upperBound(size_t const bucket)
+{
+    if (bucket + 1 == numBuckets)
+    {
+        return std::numeric_limits<uint64_t>::max();
+    }
+    return lowerBound(bucket + 1) - 1;
+}
+// =============================================================================
+
+// =============================================================================
+// End implementation of LogLinearHistogram class
+// =============================================================================
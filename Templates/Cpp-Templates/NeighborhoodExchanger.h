@@ -0,0 +1,581 @@
+/*!
+ * \file NeighborhoodExchanger.h
+ * \author Robert 'Bob' Caddy (rvc@pitt.edu)
+ * \brief Contains the declartion and implementation of the
+ * NeighborhoodExchanger class which performs halo exchanges with persistent
+ * neighborhood collectives
+ *
+ */
+
+#pragma once
+
+// STL Includes
+#include <vector>
+#include <string>
+#include <stdexcept>
+
+// External Includes
+#include <mpi.h>
+
+// Local Includes
+#include "PersistentCommunicator.h"
+
+// =============================================================================
+// Declaration of NeighborhoodExchanger class
+// =============================================================================
+/*!
+ * \brief A class for performing a halo exchange with all neighbors in a single
+ * neighborhood collective. The MPI library sees the whole exchange at once so
+ * it can schedule the messages and use on-node shared memory paths, which it
+ * can't do for independent point-to-point messages.
+ *
+ * \details The neighborhood comes from either a Cartesian communicator, with
+ * or without the diagonal (edge and corner) neighbors, or from explicit lists
+ * of source and destination ranks. In both cases the exchanger creates a
+ * distributed graph communicator and the data is described per "slot":
+ * - Cartesian: each slot is a direction, see `direction()` and
+ *   `slotIndex()`. The send block of a slot goes to the neighbor in that
+ *   direction and the receive block of a slot comes from the neighbor in that
+ *   direction. Slots without a neighbor, at a non-periodic boundary, are
+ *   skipped and their counts are ignored.
+ * - Graph: send slot `i` goes to `destinations[i]` and receive slot `i` comes
+ *   from `sources[i]`.
+ *
+ * With MPI-4 the exchange is a persistent `MPI_Neighbor_alltoallv_init`
+ * request, otherwise each `start()` calls `MPI_Ineighbor_alltoallv`. The
+ * buffers passed to `init()` must stay valid while the object exists.
+ *
+ */
+class NeighborhoodExchanger
+{
+public:
+    /*!
+     * \brief Construct a new Neighborhood Exchanger object from a Cartesian
+     * communicator made with `MPI_Cart_create`
+     *
+     * \param[in] cartesianCommunicator The Cartesian communicator
+     * \param[in] includeDiagonals Whether to include the edge and corner
+     * neighbors, e.g. 26 neighbors in 3D, or only the face neighbors, e.g. 6
+     * neighbors in 3D
+     */
+    NeighborhoodExchanger(MPI_Comm const &cartesianCommunicator,
+                          bool     const includeDiagonals);
+
+    /*!
+     * \brief Construct a new Neighborhood Exchanger object from explicit
+     * lists of neighbors. Ranks can be listed more than once
+     *
+     * \param[in] mpiCommunicator The communicator the ranks belong to
+     * \param[in] sources The ranks to receive from
+     * \param[in] destinations The ranks to send to
+     */
+    NeighborhoodExchanger(MPI_Comm         const &mpiCommunicator,
+                          std::vector<int> const &sources,
+                          std::vector<int> const &destinations);
+
+    /*!
+     * \brief Destroy the Neighborhood Exchanger object, freeing the request
+     * and the graph communicator
+     *
+     */
+    ~NeighborhoodExchanger();
+
+    // Copying would free the same request and communicator twice
+    NeighborhoodExchanger(NeighborhoodExchanger const &)            = delete;
+    NeighborhoodExchanger &operator=(NeighborhoodExchanger const &) = delete;
+
+    /*!
+     * \brief Set the buffers and layout of the exchange. This must be called
+     * once before the first `start()`
+     *
+     * \param[in] sendBuffer The buffer holding all the send blocks
+     * \param[in] sendCounts The number of elements in each send slot
+     * \param[in] sendDisplacements The offset of each send slot in
+     * `sendBuffer`, in elements
+     * \param[in] recvBuffer The buffer holding all the receive blocks
+     * \param[in] recvCounts The number of elements in each receive slot
+     * \param[in] recvDisplacements The offset of each receive slot in
+     * `recvBuffer`, in elements
+     * \param[in] mpi_type The MPI_Dataatype of the elements
+     */
+    void init(void const             *sendBuffer,
+              std::vector<int> const &sendCounts,
+              std::vector<int> const &sendDisplacements,
+              void                   *recvBuffer,
+              std::vector<int> const &recvCounts,
+              std::vector<int> const &recvDisplacements,
+              MPI_Datatype     const mpi_type);
+
+    /*!
+     * \brief Set the buffers and layout of the exchange with the
+     * MPI_Datatype inferred from `T`
+     *
+     * \tparam T The type of the elements. Must have an MpiType specialization
+     */
+    template <typename T>
+    void init(T const                *sendBuffer,
+              std::vector<int> const &sendCounts,
+              std::vector<int> const &sendDisplacements,
+              T                      *recvBuffer,
+              std::vector<int> const &recvCounts,
+              std::vector<int> const &recvDisplacements)
+    {
+        init(static_cast<void const*>(sendBuffer), sendCounts, sendDisplacements,
+             static_cast<void*>(recvBuffer), recvCounts, recvDisplacements,
+             mpiTypeOf<T>());
+    }
+
+    /*!
+     * \brief Start the exchange
+     *
+     * \return int The return value of the MPI_Start or
+     * MPI_Ineighbor_alltoallv command
+     */
+    int start();
+
+    /*!
+     * \brief Wait on the exchange to finish
+     *
+     * \return int The return value of the MPI_Wait command
+     */
+    int wait() {return MPI_Wait(&_request, &status);}
+
+    /*!
+     * \brief Test if the exchange is complete
+     *
+     * \param[out] flag The flag that MPI_Test returns
+     * \return int The return value of MPI_Test
+     */
+    int test(int &flag) {return MPI_Test(&_request, &flag, &status);}
+
+    /*!
+     * \brief Get the number of send slots
+     *
+     * \return int The number of send slots
+     */
+    int numSendSlots() const {return static_cast<int>(_sendSlotToEdge.size());}
+
+    /*!
+     * \brief Get the number of receive slots
+     *
+     * \return int The number of receive slots
+     */
+    int numRecvSlots() const {return static_cast<int>(_recvSlotToEdge.size());}
+
+    /*!
+     * \brief Get the rank that a send slot goes to
+     *
+     * \param[in] slot The send slot
+     * \return int The destination rank or `MPI_PROC_NULL` if there isn't one
+     */
+    int sendRank(int const slot) const;
+
+    /*!
+     * \brief Get the rank that a receive slot comes from
+     *
+     * \param[in] slot The receive slot
+     * \return int The source rank or `MPI_PROC_NULL` if there isn't one
+     */
+    int recvRank(int const slot) const;
+
+    /*!
+     * \brief Get the direction of a slot of a Cartesian exchanger
+     *
+     * \param[in] slot The slot
+     * \return std::vector<int> const& The offset, -1, 0, or 1, in each
+     * dimension
+     */
+    std::vector<int> const &direction(int const slot) const
+        {return _directions.at(slot);}
+
+    /*!
+     * \brief Find the slot of a direction of a Cartesian exchanger. Throws a
+     * std::invalid_argument error if the direction isn't one of the slots
+     *
+     * \param[in] direction The offset, -1, 0, or 1, in each dimension
+     * \return int The slot
+     */
+    int slotIndex(std::vector<int> const &direction) const;
+
+    /*!
+     * \brief Get the distributed graph communicator used for the exchange
+     *
+     * \return MPI_Comm The communicator
+     */
+    MPI_Comm communicator() const {return _graphCommunicator;}
+
+    /// The status of the last command that returns a MPI_Status struct
+    MPI_Status status;
+
+private:
+    /// The distributed graph communicator
+    MPI_Comm _graphCommunicator = MPI_COMM_NULL;
+
+    /// The request for the exchange
+    MPI_Request _request = MPI_REQUEST_NULL;
+
+    /// The ranks of the graph edges, in the order MPI uses for the buffers
+    std::vector<int> _sources, _destinations;
+
+    /// The graph edge of each slot, -1 for slots without a neighbor
+    std::vector<int> _sendSlotToEdge, _recvSlotToEdge;
+
+    /// The direction of each slot of a Cartesian exchanger
+    std::vector<std::vector<int>> _directions;
+
+    /// The per edge counts and displacements handed to MPI
+    std::vector<int> _sendCounts, _sendDisplacements;
+    std::vector<int> _recvCounts, _recvDisplacements;
+
+    /// The buffers and type handed to MPI
+    void const  *_sendBuffer = nullptr;
+    void        *_recvBuffer = nullptr;
+    MPI_Datatype _mpiType    = MPI_DATATYPE_NULL;
+
+    /*!
+     * \brief Create the distributed graph communicator from `_sources` and
+     * `_destinations`
+     *
+     * \param[in] mpiCommunicator The communicator the ranks belong to
+     */
+    void _createGraph(MPI_Comm const &mpiCommunicator);
+
+    /*!
+     * \brief Convert per slot counts and displacements to per edge ones
+     *
+     * \param[in] slotValues The per slot values
+     * \param[in] slotToEdge The graph edge of each slot
+     * \param[in] numEdges The number of edges
+     * \param[in] name The name of the argument, used in error messages
+     * \return std::vector<int> The per edge values
+     */
+    static std::vector<int> _toEdges(std::vector<int> const &slotValues,
+                                     std::vector<int> const &slotToEdge,
+                                     size_t           const numEdges,
+                                     std::string      const &name);
+
+    /*!
+     * \brief Throw a std::runtime_error if an MPI call failed
+     *
+     * \param[in] returnCode The return value of the MPI call
+     * \param[in] caller The MPI call, used in the error message
+     */
+    static void _checkMpi(int const returnCode, std::string const &caller);
+};
+// =============================================================================
+// End declaration of NeighborhoodExchanger class
+// =============================================================================
+
+// =============================================================================
+// Implementation of NeighborhoodExchanger class
+// =============================================================================
+
+// =============================================================================
+// Public Methods
+// =============================================================================
+
+// =============================================================================
+inline NeighborhoodExchanger::NeighborhoodExchanger(
+    MPI_Comm const &cartesianCommunicator,
+    bool     const includeDiagonals)
+{
+    int numDims;
+    _checkMpi(MPI_Cartdim_get(cartesianCommunicator, &numDims),
+              "MPI_Cartdim_get");
+    std::vector<int> dims(numDims), periods(numDims), coords(numDims);
+    _checkMpi(MPI_Cart_get(cartesianCommunicator, numDims, dims.data(),
+                           periods.data(), coords.data()),
+              "MPI_Cart_get");
+
+    // Enumerate the directions. Every direction has an opposite direction in
+    // the list and all ranks use the same order
+    int numOffsets = 1;
+    for (int dim = 0; dim < numDims; dim++)
+    {
+        numOffsets *= 3;
+    }
+    for (int i = 0; i < numOffsets; i++)
+    {
+        std::vector<int> offset(numDims);
+        int remainder = i, numNonZero = 0;
+        for (int dim = 0; dim < numDims; dim++)
+        {
+            offset[dim] = remainder % 3 - 1;
+            remainder  /= 3;
+            numNonZero += (offset[dim] != 0);
+        }
+        if ((numNonZero == 1) or (includeDiagonals and numNonZero > 0))
+        {
+            _directions.push_back(offset);
+        }
+    }
+
+    // Find the neighbor in a direction, MPI_PROC_NULL if it's across a
+    // non-periodic boundary
+    auto neighbor = [&](std::vector<int> const &offset, int const sign)
+    {
+        std::vector<int> neighborCoords(numDims);
+        for (int dim = 0; dim < numDims; dim++)
+        {
+            neighborCoords[dim] = coords[dim] + sign * offset[dim];
+            if ((neighborCoords[dim] < 0) or (neighborCoords[dim] >= dims[dim]))
+            {
+                if (not periods[dim])
+                {
+                    return int(MPI_PROC_NULL);
+                }
+                neighborCoords[dim] = (neighborCoords[dim] + dims[dim])
+                                      % dims[dim];
+            }
+        }
+        int rank;
+        _checkMpi(MPI_Cart_rank(cartesianCommunicator, neighborCoords.data(),
+                                &rank),
+                  "MPI_Cart_rank");
+        return rank;
+    };
+
+    // Edge i sends in direction d_i and receives from direction -d_i. When
+    // the same rank is a neighbor in several directions, e.g. with a periodic
+    // dimension of size 2, MPI matches the edges between two ranks in order.
+    // Ordering the sources by the opposite direction guarantees that the
+    // k-th block sent to a rank is the k-th block it receives from us and
+    // lands in the right halo
+    size_t const numDirections = _directions.size();
+    _sendSlotToEdge.assign(numDirections, -1);
+    _recvSlotToEdge.assign(numDirections, -1);
+    for (size_t i = 0; i < numDirections; i++)
+    {
+        int const destination = neighbor(_directions[i], 1);
+        if (destination != MPI_PROC_NULL)
+        {
+            _sendSlotToEdge[i] = static_cast<int>(_destinations.size());
+            _destinations.push_back(destination);
+        }
+
+        int const source = neighbor(_directions[i], -1);
+        if (source != MPI_PROC_NULL)
+        {
+            // This edge receives from direction -d_i
+            std::vector<int> opposite(_directions[i]);
+            for (int &component : opposite)
+            {
+                component = -component;
+            }
+            int const edge = static_cast<int>(_sources.size());
+            _recvSlotToEdge[slotIndex(opposite)] = edge;
+            _sources.push_back(source);
+        }
+    }
+
+    _createGraph(cartesianCommunicator);
+}
+// =============================================================================
+
+// =============================================================================
+inline NeighborhoodExchanger::NeighborhoodExchanger(
+    MPI_Comm         const &mpiCommunicator,
+    std::vector<int> const &sources,
+    std::vector<int> const &destinations)
+    :
+    _sources(sources),
+    _destinations(destinations)
+{
+    for (size_t i = 0; i < _destinations.size(); i++)
+    {
+        _sendSlotToEdge.push_back(static_cast<int>(i));
+    }
+    for (size_t i = 0; i < _sources.size(); i++)
+    {
+        _recvSlotToEdge.push_back(static_cast<int>(i));
+    }
+
+    _createGraph(mpiCommunicator);
+}
+// =============================================================================
+
+// =============================================================================
+inline NeighborhoodExchanger::~NeighborhoodExchanger()
+{
+    if (_request != MPI_REQUEST_NULL)
+    {
+        MPI_Request_free(&_request);
+    }
+    if (_graphCommunicator != MPI_COMM_NULL)
+    {
+        MPI_Comm_free(&_graphCommunicator);
+    }
+}
+// =============================================================================
+
+// =============================================================================
+inline void NeighborhoodExchanger::init(
+    void const             *sendBuffer,
+    std::vector<int> const &sendCounts,
+    std::vector<int> const &sendDisplacements,
+    void                   *recvBuffer,
+    std::vector<int> const &recvCounts,
+    std::vector<int> const &recvDisplacements,
+    MPI_Datatype     const mpi_type)
+{
+    size_t const numSend = _destinations.size(), numRecv = _sources.size();
+    _sendCounts        = _toEdges(sendCounts, _sendSlotToEdge, numSend,
+                                  "sendCounts");
+    _sendDisplacements = _toEdges(sendDisplacements, _sendSlotToEdge, numSend,
+                                  "sendDisplacements");
+    _recvCounts        = _toEdges(recvCounts, _recvSlotToEdge, numRecv,
+                                  "recvCounts");
+    _recvDisplacements = _toEdges(recvDisplacements, _recvSlotToEdge, numRecv,
+                                  "recvDisplacements");
+    _sendBuffer = sendBuffer;
+    _recvBuffer = recvBuffer;
+    _mpiType    = mpi_type;
+
+#if MPI_VERSION >= 4
+    if (_request != MPI_REQUEST_NULL)
+    {
+        MPI_Request_free(&_request);
+    }
+    _checkMpi(MPI_Neighbor_alltoallv_init(_sendBuffer,
+                                          _sendCounts.data(),
+                                          _sendDisplacements.data(),
+                                          _mpiType,
+                                          _recvBuffer,
+                                          _recvCounts.data(),
+                                          _recvDisplacements.data(),
+                                          _mpiType,
+                                          _graphCommunicator,
+                                          MPI_INFO_NULL,
+                                          &_request),
+              "MPI_Neighbor_alltoallv_init");
+#endif  // MPI_VERSION >= 4
+}
+// =============================================================================
+
+// =============================================================================
+inline int NeighborhoodExchanger::start()
+{
+    if (_mpiType == MPI_DATATYPE_NULL)
+    {
+        throw std::runtime_error("Warning: NeighborhoodExchanger.start() "
+                                 "called before init()");
+    }
+
+#if MPI_VERSION >= 4
+    return MPI_Start(&_request);
+#else  // MPI_VERSION < 4
+    return MPI_Ineighbor_alltoallv(_sendBuffer,
+                                   _sendCounts.data(),
+                                   _sendDisplacements.data(),
+                                   _mpiType,
+                                   _recvBuffer,
+                                   _recvCounts.data(),
+                                   _recvDisplacements.data(),
+                                   _mpiType,
+                                   _graphCommunicator,
+                                   &_request);
+#endif  // MPI_VERSION
+}
+// =============================================================================
+
+// =============================================================================
+inline int NeighborhoodExchanger::sendRank(int const slot) const
+{
+    int const edge = _sendSlotToEdge.at(slot);
+    return (edge < 0)? MPI_PROC_NULL: _destinations[edge];
+}
+// =============================================================================
+
+// =============================================================================
+inline int NeighborhoodExchanger::recvRank(int const slot) const
+{
+    int const edge = _recvSlotToEdge.at(slot);
+    return (edge < 0)? MPI_PROC_NULL: _sources[edge];
+}
+// =============================================================================
+
+// =============================================================================
+inline int NeighborhoodExchanger::slotIndex(
+    std::vector<int> const &direction) const
+{
+    for (size_t i = 0; i < _directions.size(); i++)
+    {
+        if (_directions[i] == direction)
+        {
+            return static_cast<int>(i);
+        }
+    }
+    throw std::invalid_argument("Warning: NeighborhoodExchanger.slotIndex() "
+                                "the direction is not one of the slots");
+}
+// =============================================================================
+
+// =============================================================================
+// Private Methods
+// =============================================================================
+
+// =============================================================================
+inline void NeighborhoodExchanger::_createGraph(MPI_Comm const &mpiCommunicator)
+{
+    // Reordering would change the ranks the edges were computed with
+    int const reorder = 0;
+    int const inDegree  = static_cast<int>(_sources.size());
+    int const outDegree = static_cast<int>(_destinations.size());
+    _checkMpi(MPI_Dist_graph_create_adjacent(mpiCommunicator,
+                                             inDegree,
+                                             _sources.data(),
+                                             MPI_UNWEIGHTED,
+                                             outDegree,
+                                             _destinations.data(),
+                                             MPI_UNWEIGHTED,
+                                             MPI_INFO_NULL,
+                                             reorder,
+                                             &_graphCommunicator),
+              "MPI_Dist_graph_create_adjacent");
+}
+// =============================================================================
+
+// =============================================================================
+inline std::vector<int> NeighborhoodExchanger::_toEdges(
+    std::vector<int> const &slotValues,
+    std::vector<int> const &slotToEdge,
+    size_t           const numEdges,
+    std::string      const &name)
+{
+    if (slotValues.size() != slotToEdge.size())
+    {
+        throw std::invalid_argument("Warning: NeighborhoodExchanger.init() "
+                                    "expected " + name + " to have "
+                                    + std::to_string(slotToEdge.size())
+                                    + " elements, got "
+                                    + std::to_string(slotValues.size()));
+    }
+
+    std::vector<int> edgeValues(numEdges, 0);
+    for (size_t slot = 0; slot < slotToEdge.size(); slot++)
+    {
+        if (slotToEdge[slot] >= 0)
+        {
+            edgeValues[slotToEdge[slot]] = slotValues[slot];
+        }
+    }
+    return edgeValues;
+}
+// =============================================================================
+
+// =============================================================================
+inline void NeighborhoodExchanger::_checkMpi(int const returnCode,
+                                             std::string const &caller)
+{
+    if (returnCode != MPI_SUCCESS)
+    {
+        throw std::runtime_error("NeighborhoodExchanger: " + caller
+                                 + " failed. Error Code: "
+                                 + std::to_string(returnCode));
+    }
+}
+// =============================================================================
+
+// =============================================================================
+// End implementation of NeighborhoodExchanger class
+// =============================================================================
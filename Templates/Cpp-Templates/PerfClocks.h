@@ -0,0 +1,220 @@
+/*!
+ * \file PerfClocks.h
+ * \author Robert 'Bob' Caddy (rvc@pitt.edu)
+ * \brief Contains the clock policies that BasicPerfTimer can be built with:
+ * any std::chrono clock, CLOCK_MONOTONIC_RAW on Linux, and the invariant time
+ * stamp counter on x86
+ *
+ */
+
+#pragma once
+
+// STL Includes
+#include <chrono>
+#include <cstdint>
+
+// External Includes
+#if defined(__linux__)
+    #include <time.h>
+#endif  // __linux__
+
+#if (defined(__x86_64__) || defined(__i386__)) && !defined(__CUDA_ARCH__)
+    #define PERF_CLOCKS_HAVE_TSC
+    #include <x86intrin.h>
+    #include <cpuid.h>
+#endif  // x86
+
+// =============================================================================
+// Clock policies
+// =============================================================================
+/*!
+ * \brief A clock policy that uses a std::chrono clock
+ *
+ * \details A clock policy has a `time_point` type, a static `now()` that
+ * returns one, a static `nanoseconds(start, end)` that converts the
+ * difference of two to nanoseconds, and a static `initialize()` that
+ * BasicPerfTimer calls from its constructor to do any setup that shouldn't
+ * happen while timing.
+ *
+ * \tparam StdClock The std::chrono clock
+ */
+template <typename StdClock>
+struct ChronoClock
+{
+    /// The type returned by `now()`
+    using time_point = typename StdClock::time_point;
+
+    /// Nothing to set up
+    static void initialize() {}
+
+    /*!
+     * \brief Read the clock
+     *
+     * \return time_point The current time
+     */
+    static time_point now() {return StdClock::now();}
+
+    /*!
+     * \brief Get the time between two readings of the clock
+     *
+     * \param[in] start The earlier reading
+     * \param[in] end The later reading
+     * \return double The time between the readings in nanoseconds
+     */
+    static double nanoseconds(time_point const &start, time_point const &end)
+        {return std::chrono::duration<double, std::nano>(end - start).count();}
+};
+
+/// `std::chrono::steady_clock`, monotonic on every platform. The default
+using SteadyClock = ChronoClock<std::chrono::steady_clock>;
+
+/// `std::chrono::high_resolution_clock`, which is `system_clock` and not
+/// monotonic on some standard libraries
+using HighResolutionClock = ChronoClock<std::chrono::high_resolution_clock>;
+
+#if defined(__linux__) && defined(CLOCK_MONOTONIC_RAW)
+/*!
+ * \brief A clock policy that uses `clock_gettime(CLOCK_MONOTONIC_RAW)`, a
+ * monotonic clock that isn't slewed by NTP
+ *
+ */
+struct MonotonicRawClock
+{
+    /// The time in nanoseconds
+    using time_point = int64_t;
+
+    /// Nothing to set up
+    static void initialize() {}
+
+    /*!
+     * \brief Read the clock
+     *
+     * \return time_point The current time in nanoseconds
+     */
+    static time_point now()
+    {
+        timespec time;
+        clock_gettime(CLOCK_MONOTONIC_RAW, &time);
+        return int64_t(time.tv_sec) * 1000000000 + time.tv_nsec;
+    }
+
+    /*!
+     * \brief Get the time between two readings of the clock
+     *
+     * \param[in] start The earlier reading
+     * \param[in] end The later reading
+     * \return double The time between the readings in nanoseconds
+     */
+    static double nanoseconds(time_point const &start, time_point const &end)
+        {return static_cast<double>(end - start);}
+};
+#endif  // __linux__ && CLOCK_MONOTONIC_RAW
+
+#ifdef PERF_CLOCKS_HAVE_TSC
+/*!
+ * \brief A clock policy that reads the x86 time stamp counter
+ *
+ * \details Reading the counter takes a few nanoseconds, compared to tens of
+ * nanoseconds for most system clocks, so very short regions can be timed.
+ * Each read is surrounded by `lfence` so the work being timed can't be
+ * reordered around it. Ticks are converted to nanoseconds with a frequency
+ * that is measured against `std::chrono::steady_clock` the first time a timer
+ * using this clock is constructed, which takes `calibrationTime`.
+ *
+ * The conversion is only meaningful if the processor has an invariant TSC,
+ * one that ticks at a constant rate regardless of frequency scaling and sleep
+ * states and is synchronized across cores. Check `isInvariant()`, nearly
+ * every x86 processor from the last decade has one.
+ *
+ */
+struct TscClock
+{
+    /// The raw counter
+    using time_point = uint64_t;
+
+    /// How long the calibration runs for
+    static std::chrono::milliseconds constexpr calibrationTime{20};
+
+    /// Calibrate the counter if it hasn't been yet
+    static void initialize() {nanosecondsPerTick();}
+
+    /*!
+     * \brief Read the counter
+     *
+     * \return time_point The current counter value
+     */
+    static time_point now()
+    {
+        _mm_lfence();
+        uint64_t const ticks = __rdtsc();
+        _mm_lfence();
+        return ticks;
+    }
+
+    /*!
+     * \brief Get the time between two readings of the counter
+     *
+     * \param[in] start The earlier reading
+     * \param[in] end The later reading
+     * \return double The time between the readings in nanoseconds
+     */
+    static double nanoseconds(time_point const &start, time_point const &end)
+        {return static_cast<double>(end - start) * nanosecondsPerTick();}
+
+    /*!
+     * \brief Get the calibrated length of a tick. The first call runs the
+     * calibration, it is thread safe
+     *
+     * \return double The number of nanoseconds per tick
+     */
+    static double nanosecondsPerTick()
+    {
+        static double const calibrated = _calibrate();
+        return calibrated;
+    }
+
+    /*!
+     * \brief Check if the processor reports an invariant TSC
+     *
+     * \return true The TSC ticks at a constant rate
+     * \return false The TSC rate may change, don't use this clock
+     */
+    static bool isInvariant()
+    {
+        unsigned int eax, ebx, ecx, edx;
+        if ((__get_cpuid_max(0x80000000, nullptr) < 0x80000007)
+            or (__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) == 0))
+        {
+            return false;
+        }
+        return (edx & (1u << 8)) != 0;
+    }
+
+private:
+    /*!
+     * \brief Measure the length of a tick against std::chrono::steady_clock
+     *
+     * \return double The number of nanoseconds per tick
+     */
+    static double _calibrate()
+    {
+        using std::chrono::steady_clock;
+
+        steady_clock::time_point const startTime  = steady_clock::now();
+        uint64_t const                 startTicks = now();
+
+        steady_clock::time_point endTime;
+        do
+        {
+            endTime = steady_clock::now();
+        } while (endTime - startTime < calibrationTime);
+        uint64_t const endTicks = now();
+
+        return std::chrono::duration<double, std::nano>(endTime - startTime)
+               .count() / static_cast<double>(endTicks - startTicks);
+    }
+};
+#endif  // PERF_CLOCKS_HAVE_TSC
+// =============================================================================
+// End clock policies
+// =============================================================================
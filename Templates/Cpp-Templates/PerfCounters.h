@@ -0,0 +1,926 @@
+/*!
+ * \file PerfCounters.h
+ * \author Robert 'Bob' Caddy (rvc@pitt.edu)
+ * \brief Contains the PerfCounterGroup class, which reads hardware performance
+ * counters with Linux's perf_event_open, and the BasicCountedPerfTimer class,
+ * a PerfTimer that also counts cycles, instructions, cache misses, and FLOPs
+ * and reports the IPC, miss rates, and bandwidth of the region it times
+ *
+ */
+
+#pragma once
+
+// STL Includes
+#include <string>
+#include <vector>
+#include <memory>
+#include <algorithm>
+#include <iostream>
+#include <limits>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <cerrno>
+#include <stdexcept>
+
+// External Includes
+#if defined(__linux__) && __has_include(<linux/perf_event.h>)
+    #define PERF_COUNTERS_HAVE_PERF_EVENT
+    #include <linux/perf_event.h>
+    #include <sys/ioctl.h>
+    #include <sys/syscall.h>
+    #include <unistd.h>
+#endif  // __linux__
+
+// Local Includes
+#include "PerfTimer.h"
+
+// =============================================================================
+// Declaration of PerfCounter struct
+// =============================================================================
+/*!
+ * \brief A hardware event to count, in terms of `perf_event_attr`
+ *
+ */
+struct PerfCounter
+{
+    /// The name to report the count under
+    std::string name;
+
+    /// The `perf_event_attr::type`, e.g. PERF_TYPE_HARDWARE or PERF_TYPE_RAW
+    uint32_t type;
+
+    /// The `perf_event_attr::config`
+    uint64_t config;
+
+    /// The number of floating point operations per count. Zero if the event
+    /// doesn't count floating point operations
+    double flopsPerCount = 0.;
+
+    /// The names of the counters that the derived metrics use
+    static constexpr char const *cycles        = "cycles";
+    static constexpr char const *instructions  = "instructions";
+    static constexpr char const *llcReferences = "LLC references";
+    static constexpr char const *llcMisses     = "LLC misses";
+
+    /*!
+     * \brief Get the counters used by default: cycles, instructions, and last
+     * level cache references and misses. These are generic events that the
+     * kernel maps to every processor that it supports
+     *
+     * \return std::vector<PerfCounter> The default counters
+     */
+    static std::vector<PerfCounter> defaults();
+
+    /*!
+     * \brief Get the counters of the double precision FLOPs retired on Intel
+     * processors from Skylake on, `FP_ARITH_INST_RETIRED`, weighted by the
+     * number of operations per instruction with FMAs counted as two.
+     *
+     * \details There is no generic FLOP event, these are raw events that mean
+     * something else, or nothing, on other processors. Only add them on Intel
+     * processors that have them
+     *
+     * \return std::vector<PerfCounter> The FLOP counters
+     */
+    static std::vector<PerfCounter> intelDoubleFlops();
+};
+// =============================================================================
+// End declaration of PerfCounter struct
+// =============================================================================
+
+// =============================================================================
+// Declaration of PerfCounterGroup class
+// =============================================================================
+/*!
+ * \brief A group of hardware performance counters that count the calling
+ * thread in user space and are always scheduled onto the processor together
+ *
+ * \details The counters are opened and enabled by the constructor and run
+ * until the group is destroyed. `start()` and `stop()` each read all of the
+ * counters with a single `read()` and `stop()` adds the differences to the
+ * totals. If the kernel multiplexes the group with other groups because there
+ * aren't enough hardware counters the differences are scaled up by the time
+ * enabled over the time running, like `perf stat` does.
+ *
+ * Counters that can't be opened are skipped, see `isCounted()`. If the first
+ * counter, the group leader, can't be opened, e.g. because
+ * `/proc/sys/kernel/perf_event_paranoid` forbids it or there is no PMU in a
+ * virtual machine, then the group isn't available and counts nothing, which
+ * is also the case on systems other than Linux. Processors typically have
+ * four to eight general purpose counters, a group with more counters than
+ * that is never scheduled.
+ *
+ * A group must only be started and stopped by the thread that constructed
+ * it. It doesn't count threads that the calling thread creates.
+ *
+ */
+class PerfCounterGroup
+{
+public:
+    /*!
+     * \brief Construct a new Perf Counter Group object and start counting
+     *
+     * \param[in] counters The counters in the group
+     */
+    explicit PerfCounterGroup(std::vector<PerfCounter> const &counters);
+
+    /*!
+     * \brief Destroy the Perf Counter Group object and close the counters
+     *
+     */
+    ~PerfCounterGroup();
+
+    // Copying would close the same file descriptors twice
+    PerfCounterGroup(PerfCounterGroup const &)            = delete;
+    PerfCounterGroup &operator=(PerfCounterGroup const &) = delete;
+
+    /*!
+     * \brief Read the counters at the start of a region. Does nothing if the
+     * group is already started
+     *
+     */
+    void start();
+
+    /*!
+     * \brief Read the counters at the end of a region and add the differences
+     * to the totals. Does nothing if the group isn't started
+     *
+     */
+    void stop();
+
+    /*!
+     * \brief Set every total to zero
+     *
+     */
+    void reset();
+
+    /*!
+     * \brief Check if the group leader could be opened. If not nothing is
+     * counted
+     *
+     * \return true The group is counting
+     * \return false The group isn't counting, see `error()`
+     */
+    bool available() const {return not _fileDescriptors.empty();}
+
+    /*!
+     * \brief Get the reason that the group isn't available
+     *
+     * \return std::string const& The error, empty if the group is available
+     */
+    std::string const &error() const {return _error;}
+
+    /*!
+     * \brief Get the number of counters that were requested
+     *
+     * \return size_t The number of counters
+     */
+    size_t size() const {return _counters.size();}
+
+    /*!
+     * \brief Get one of the requested counters
+     *
+     * \param[in] i The index of the counter
+     * \return PerfCounter const& The counter
+     */
+    PerfCounter const &counter(size_t const i) const {return _counters.at(i);}
+
+    /*!
+     * \brief Check if a counter could be opened. Throws a std::out_of_range
+     * error if `i` is out of range
+     *
+     * \param[in] i The index of the counter
+     * \return true The counter is being counted
+     * \return false The counter couldn't be opened
+     */
+    bool isCounted(size_t const i) const {return _slots.at(i) >= 0;}
+
+    /*!
+     * \brief Get the total count of a counter over every start/stop pair.
+     * Throws a std::out_of_range error if `i` is out of range
+     *
+     * \param[in] i The index of the counter
+     * \return double The total count, scaled for multiplexing. Zero if the
+     * counter isn't counted
+     */
+    double total(size_t const i) const {return _totals.at(i);}
+
+    /*!
+     * \brief Get the fraction of the time between the starts and stops that
+     * the group was actually on the processor
+     *
+     * \return double The fraction, one if the group was never multiplexed
+     */
+    double runningFraction() const
+        {return (_totalEnabled > 0)? double(_totalRunning) / _totalEnabled: 1.;}
+
+private:
+    /// The requested counters
+    std::vector<PerfCounter> _counters;
+
+    /// The position of each requested counter in the values read from the
+    /// group, -1 if it isn't counted
+    std::vector<int> _slots;
+
+    /// The file descriptors of the counters that were opened, the leader is
+    /// first
+    std::vector<int> _fileDescriptors;
+
+    /// Why the group isn't available
+    std::string _error;
+
+    /// The values read by `start()` and the buffer for `read()`: the number
+    /// of values, the time enabled, the time running, then the values
+    std::vector<uint64_t> _startValues;
+    std::vector<uint64_t> _buffer;
+
+    /// The totals of each requested counter
+    std::vector<double> _totals;
+
+    /// The total time enabled and running between the starts and stops
+    uint64_t _totalEnabled = 0;
+    uint64_t _totalRunning = 0;
+
+    /// Indicates if the group is started
+    bool _started = false;
+
+    /*!
+     * \brief Read every counter in the group into `values`
+     *
+     * \param[out] values The values, in the group's read format
+     * \return true The read succeeded
+     * \return false The read failed
+     */
+    bool _read(std::vector<uint64_t> &values) const;
+};
+// =============================================================================
+// End declaration of PerfCounterGroup class
+// =============================================================================
+
+// =============================================================================
+// Declaration of BasicCountedPerfTimer class
+// =============================================================================
+/*!
+ * \brief A PerfTimer that also reads hardware counters on every start and
+ * stop
+ *
+ * \details The counters are split into PerfCounterGroups of at most
+ * `maxGroupSize` in the order given, so ratios of counters in the same group,
+ * e.g. the IPC from the default counters, are exact even when the groups are
+ * multiplexed. `reportStats()` reports the timer statistics followed by the
+ * total of every counter and the metrics that can be derived from the
+ * counters that are available:
+ * - IPC, instructions per cycle
+ * - LLC miss rate, the fraction of last level cache references that missed
+ * - LLC MPKI, the last level cache misses per thousand instructions
+ * - Bandwidth, the LLC misses times the cache line size over the time. This
+ *   is an estimate of the memory bandwidth, it doesn't include writebacks or
+ *   hardware prefetches
+ * - FLOP rate, from the counters with a nonzero `flopsPerCount`
+ *
+ * Each start/stop pair costs one `read()` system call per group on top of the
+ * time of a PerfTimer, about a microsecond, so the regions being timed should
+ * be much longer than that. The counters are read outside the timed interval.
+ * Without counters, see PerfCounterGroup, it is a plain PerfTimer.
+ *
+ * \tparam Clock The clock policy, see PerfClocks.h. Defaults to SteadyClock
+ */
+template <typename Clock = SteadyClock>
+class BasicCountedPerfTimer
+{
+public:
+    /// The timer type
+    using Timer = BasicPerfTimer<Clock>;
+
+    /// The largest number of counters put in one group
+    static size_t constexpr maxGroupSize = 4;
+
+    /*!
+     * \brief Construct a new Counted Perf Timer object and open the counters
+     *
+     * \param[in] name The name of the timer
+     * \param[in] counters The counters to read. Defaults to
+     * PerfCounter::defaults()
+     * \param[in] mode How to store the raw time differences. Defaults to
+     * storing all of them
+     * \param[in] numRawSamples The size of the ring buffer in streaming mode.
+     * Defaults to 1024
+     */
+    BasicCountedPerfTimer(std::string const &name,
+                          std::vector<PerfCounter> const &counters
+                              = PerfCounter::defaults(),
+                          PerfTimerMode const mode = PerfTimerMode::storeAll,
+                          size_t const numRawSamples = 1024);
+
+    /*!
+     * \brief Read the counters and start the timer
+     *
+     */
+    void startTimer();
+
+    /*!
+     * \brief Stop the timer and read the counters
+     *
+     */
+    void stopTimer();
+
+    /*!
+     * \brief Get the timer holding the time statistics
+     *
+     * \return Timer const& The timer
+     */
+    Timer const &timer() const {return _timer;}
+
+    /*!
+     * \brief Check if any of the counters are being counted
+     *
+     * \return true At least one counter is counted
+     * \return false Nothing is counted, this is a plain PerfTimer
+     */
+    bool countersAvailable() const;
+
+    /*!
+     * \brief Check if a counter is being counted
+     *
+     * \param[in] name The name of the counter
+     * \return true The counter was requested and could be opened
+     * \return false The counter wasn't requested or couldn't be opened
+     */
+    bool isCounted(std::string const &name) const;
+
+    /*!
+     * \brief Get the total count of a counter. Throws a std::out_of_range
+     * error if the counter isn't counted
+     *
+     * \param[in] name The name of the counter
+     * \return double The total count, scaled for multiplexing
+     */
+    double count(std::string const &name) const;
+
+    /*!
+     * \brief Get the instructions per cycle
+     *
+     * \return double The IPC, NaN if either counter isn't counted
+     */
+    double ipc() const;
+
+    /*!
+     * \brief Get the fraction of last level cache references that missed
+     *
+     * \return double The miss rate, NaN if either counter isn't counted
+     */
+    double llcMissRate() const;
+
+    /*!
+     * \brief Get the last level cache misses per thousand instructions
+     *
+     * \return double The MPKI, NaN if either counter isn't counted
+     */
+    double llcMissesPerKiloInstruction() const;
+
+    /*!
+     * \brief Get the estimated memory bandwidth, the last level cache misses
+     * times the cache line size over the total time
+     *
+     * \return double The bandwidth in bytes per second, NaN if the misses
+     * aren't counted
+     */
+    double bandwidth() const;
+
+    /*!
+     * \brief Get the floating point operations per second from the counters
+     * with a nonzero `flopsPerCount`
+     *
+     * \return double The FLOP rate, NaN if there are no FLOP counters
+     */
+    double flopRate() const;
+
+    /*!
+     * \brief Print out the timer statistics, counter totals, and derived
+     * metrics
+     *
+     * \param[in] outStream What stream to write out to. Defaults to std::cout
+     */
+    void reportStats(std::ostream &outStream = std::cout);
+
+    /*!
+     * \brief Reset the timer and the counter totals
+     *
+     */
+    void reset();
+
+private:
+    /// The timer
+    Timer _timer;
+
+    /// The settings the timer was created with, used by `reset()`
+    PerfTimerMode _mode;
+    size_t        _numRawSamples;
+
+    /// The counter groups
+    std::vector<std::unique_ptr<PerfCounterGroup>> _groups;
+
+    /// The size of a cache line in bytes
+    double _cacheLineBytes;
+
+    /*!
+     * \brief Find a counted counter
+     *
+     * \param[in] name The name of the counter
+     * \param[out] total The total count if it is counted
+     * \return true The counter is counted
+     * \return false The counter isn't counted
+     */
+    bool _find(std::string const &name, double &total) const;
+};
+
+/// The counted timer with the default clock
+using CountedPerfTimer = BasicCountedPerfTimer<>;
+// =============================================================================
+// End declaration of BasicCountedPerfTimer class
+// =============================================================================
+
+// =============================================================================
+// Implementation of PerfCounter struct
+// =============================================================================
+
+// =============================================================================
+inline std::vector<PerfCounter> PerfCounter::defaults()
+{
+#ifdef PERF_COUNTERS_HAVE_PERF_EVENT
+    return {{cycles,        PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+            {instructions,  PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+            {llcReferences, PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_REFERENCES},
+            {llcMisses,     PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES}};
+#else  // PERF_COUNTERS_HAVE_PERF_EVENT
+    return {};
+#endif  // PERF_COUNTERS_HAVE_PERF_EVENT
+}
+// =============================================================================
+
+// =============================================================================
+inline std::vector<PerfCounter> PerfCounter::intelDoubleFlops()
+{
+#ifdef PERF_COUNTERS_HAVE_PERF_EVENT
+    // Event 0xC7 with the umask in the second byte
+    return {{"FP scalar double",      PERF_TYPE_RAW, 0x01C7, 1.},
+            {"FP 128b packed double", PERF_TYPE_RAW, 0x04C7, 2.},
+            {"FP 256b packed double", PERF_TYPE_RAW, 0x10C7, 4.},
+            {"FP 512b packed double", PERF_TYPE_RAW, 0x40C7, 8.}};
+#else  // PERF_COUNTERS_HAVE_PERF_EVENT
+    return {};
+#endif  // PERF_COUNTERS_HAVE_PERF_EVENT
+}
+// =============================================================================
+
+// =============================================================================
+// End implementation of PerfCounter struct
+// =============================================================================
+
+// =============================================================================
+// Implementation of PerfCounterGroup class
+// =============================================================================
+
+// =============================================================================
+// Public Methods
+// =============================================================================
+
+// =============================================================================
+inline PerfCounterGroup::PerfCounterGroup(
+    std::vector<PerfCounter> const &counters)
+    :
+    _counters(counters),
+    _slots(counters.size(), -1),
+    _totals(counters.size(), 0.)
+{
+#ifdef PERF_COUNTERS_HAVE_PERF_EVENT
+    for (size_t i = 0; i < _counters.size(); i++)
+    {
+        perf_event_attr attributes;
+        std::memset(&attributes, 0, sizeof(attributes));
+        attributes.size           = sizeof(attributes);
+        attributes.type           = _counters[i].type;
+        attributes.config         = _counters[i].config;
+        attributes.read_format    = PERF_FORMAT_GROUP
+                                    | PERF_FORMAT_TOTAL_TIME_ENABLED
+                                    | PERF_FORMAT_TOTAL_TIME_RUNNING;
+        attributes.disabled       = _fileDescriptors.empty()? 1: 0;
+        attributes.exclude_kernel = 1;
+        attributes.exclude_hv     = 1;
+
+        // This thread on any CPU
+        int const leader = _fileDescriptors.empty()? -1: _fileDescriptors[0];
+        int const fileDescriptor = static_cast<int>(
+            syscall(SYS_perf_event_open, &attributes, 0, -1, leader, 0));
+        if (fileDescriptor < 0)
+        {
+            if (_fileDescriptors.empty())
+            {
+                _error = "perf_event_open failed for " + _counters[i].name
+                         + ": " + std::strerror(errno);
+                break;
+            }
+            continue;
+        }
+
+        _slots[i] = static_cast<int>(_fileDescriptors.size());
+        _fileDescriptors.push_back(fileDescriptor);
+    }
+
+    if (available())
+    {
+        ioctl(_fileDescriptors[0], PERF_EVENT_IOC_RESET,  PERF_IOC_FLAG_GROUP);
+        ioctl(_fileDescriptors[0], PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+        _startValues.resize(3 + _fileDescriptors.size());
+        _buffer.resize(3 + _fileDescriptors.size());
+    }
+#else  // PERF_COUNTERS_HAVE_PERF_EVENT
+    _error = "perf_event_open is only available on Linux";
+#endif  // PERF_COUNTERS_HAVE_PERF_EVENT
+}
+// =============================================================================
+
+// =============================================================================
+inline PerfCounterGroup::~PerfCounterGroup()
+{
+#ifdef PERF_COUNTERS_HAVE_PERF_EVENT
+    // Close the members before the leader
+    for (size_t i = _fileDescriptors.size(); i > 0; i--)
+    {
+        close(_fileDescriptors[i - 1]);
+    }
+#endif  // PERF_COUNTERS_HAVE_PERF_EVENT
+}
+// =============================================================================
+
+// =============================================================================
+inline void PerfCounterGroup::start()
+{
+    if (available() and not _started)
+    {
+        _started = _read(_startValues);
+    }
+}
+// =============================================================================
+
+// =============================================================================
+inline void PerfCounterGroup::stop()
+{
+    if (not _started)
+    {
+        return;
+    }
+    _started = false;
+
+    if (not _read(_buffer))
+    {
+        return;
+    }
+
+    uint64_t const enabled = _buffer[1] - _startValues[1];
+    uint64_t const running = _buffer[2] - _startValues[2];
+    _totalEnabled += enabled;
+    _totalRunning += running;
+
+    // If the group was never on the processor there is nothing to scale
+    if (running == 0)
+    {
+        return;
+    }
+    double const scale = static_cast<double>(enabled) / running;
+    for (size_t i = 0; i < _counters.size(); i++)
+    {
+        if (_slots[i] >= 0)
+        {
+            size_t const j = 3 + static_cast<size_t>(_slots[i]);
+            _totals[i] += static_cast<double>(_buffer[j] - _startValues[j])
+                          * scale;
+        }
+    }
+}
+// =============================================================================
+
+// =============================================================================
+inline void PerfCounterGroup::reset()
+{
+    std::fill(_totals.begin(), _totals.end(), 0.);
+    _totalEnabled = 0;
+    _totalRunning = 0;
+    _started      = false;
+}
+// =============================================================================
+
+// =============================================================================
+// Private Methods
+// =============================================================================
+
+// =============================================================================
+inline bool PerfCounterGroup::_read(std::vector<uint64_t> &values) const
+{
+#ifdef PERF_COUNTERS_HAVE_PERF_EVENT
+    size_t const numBytes = values.size() * sizeof(uint64_t);
+    return ::read(_fileDescriptors[0], values.data(), numBytes)
+           == static_cast<ssize_t>(numBytes);
+#else  // PERF_COUNTERS_HAVE_PERF_EVENT
+    return false;
+#endif  // PERF_COUNTERS_HAVE_PERF_EVENT
+}
+// =============================================================================
+
+// =============================================================================
+// End implementation of PerfCounterGroup class
+// =============================================================================
+
+// =============================================================================
+// Implementation of BasicCountedPerfTimer class
+// =============================================================================
+
+// =============================================================================
+// Public Methods
+// =============================================================================
+
+// =============================================================================
+template <typename Clock>
+BasicCountedPerfTimer<Clock>::BasicCountedPerfTimer(
+    std::string const &name,
+    std::vector<PerfCounter> const &counters,
+    PerfTimerMode const mode,
+    size_t const numRawSamples)
+    :
+    _timer(name, mode, numRawSamples),
+    _mode(mode),
+    _numRawSamples(numRawSamples),
+    _cacheLineBytes(64.)
+{
+    for (size_t start = 0; start < counters.size(); start += maxGroupSize)
+    {
+        size_t const end = std::min(start + maxGroupSize, counters.size());
+        std::vector<PerfCounter> const group(counters.begin() + start,
+                                             counters.begin() + end);
+        _groups.emplace_back(new PerfCounterGroup(group));
+    }
+
+#if defined(PERF_COUNTERS_HAVE_PERF_EVENT) && defined(_SC_LEVEL1_DCACHE_LINESIZE)
+    long const lineSize = sysconf(_SC_LEVEL1_DCACHE_LINESIZE);
+    if (lineSize > 0)
+    {
+        _cacheLineBytes = static_cast<double>(lineSize);
+    }
+#endif  // PERF_COUNTERS_HAVE_PERF_EVENT && _SC_LEVEL1_DCACHE_LINESIZE
+}
+// =============================================================================
+
+// =============================================================================
+template <typename Clock>
+void BasicCountedPerfTimer<Clock>::startTimer()
+{
+    // Read the counters first so the reads aren't timed
+    for (std::unique_ptr<PerfCounterGroup> &group : _groups)
+    {
+        group->start();
+    }
+    _timer.startTimer();
+}
+// =============================================================================
+
+// =============================================================================
+template <typename Clock>
+void BasicCountedPerfTimer<Clock>::stopTimer()
+{
+    _timer.stopTimer();
+    for (std::unique_ptr<PerfCounterGroup> &group : _groups)
+    {
+        group->stop();
+    }
+}
+// =============================================================================
+
+// =============================================================================
+template <typename Clock>
+bool BasicCountedPerfTimer<Clock>::countersAvailable() const
+{
+    for (std::unique_ptr<PerfCounterGroup> const &group : _groups)
+    {
+        if (group->available())
+        {
+            return true;
+        }
+    }
+    return false;
+}
+// =============================================================================
+
+// =============================================================================
+template <typename Clock>
+bool BasicCountedPerfTimer<Clock>::isCounted(std::string const &name) const
+{
+    double total;
+    return _find(name, total);
+}
+// =============================================================================
+
+// =============================================================================
+template <typename Clock>
+double BasicCountedPerfTimer<Clock>::count(std::string const &name) const
+{
+    double total;
+    if (not _find(name, total))
+    {
+        throw std::out_of_range("Warning: CountedPerfTimer.count() the counter "
+                                + name + " isn't counted");
+    }
+    return total;
+}
+// =============================================================================
+
+// =============================================================================
+template <typename Clock>
+double BasicCountedPerfTimer<Clock>::ipc() const
+{
+    double cycles, instructions;
+    if (_find(PerfCounter::cycles, cycles)
+        and _find(PerfCounter::instructions, instructions) and cycles > 0.)
+    {
+        return instructions / cycles;
+    }
+    return std::numeric_limits<double>::quiet_NaN();
+}
+// =============================================================================
+
+// =============================================================================
+template <typename Clock>
+double BasicCountedPerfTimer<Clock>::llcMissRate() const
+{
+    double references, misses;
+    if (_find(PerfCounter::llcReferences, references)
+        and _find(PerfCounter::llcMisses, misses) and references > 0.)
+    {
+        return misses / references;
+    }
+    return std::numeric_limits<double>::quiet_NaN();
+}
+// =============================================================================
+
+// =============================================================================
+template <typename Clock>
+double BasicCountedPerfTimer<Clock>::llcMissesPerKiloInstruction() const
+{
+    double instructions, misses;
+    if (_find(PerfCounter::instructions, instructions)
+        and _find(PerfCounter::llcMisses, misses) and instructions > 0.)
+    {
+        return 1000. * misses / instructions;
+    }
+    return std::numeric_limits<double>::quiet_NaN();
+}
+// =============================================================================
+
+// =============================================================================
+template <typename Clock>
+double BasicCountedPerfTimer<Clock>::bandwidth() const
+{
+    double misses;
+    if (_find(PerfCounter::llcMisses, misses) and _timer.totalTime() > 0.)
+    {
+        // Total time is in nanoseconds
+        return misses * _cacheLineBytes / (_timer.totalTime() * 1.E-9);
+    }
+    return std::numeric_limits<double>::quiet_NaN();
+}
+// =============================================================================
+
+// =============================================================================
+template <typename Clock>
+double BasicCountedPerfTimer<Clock>::flopRate() const
+{
+    bool   found = false;
+    double flops = 0.;
+    for (std::unique_ptr<PerfCounterGroup> const &group : _groups)
+    {
+        for (size_t i = 0; i < group->size(); i++)
+        {
+            if (group->isCounted(i) and group->counter(i).flopsPerCount > 0.)
+            {
+                found  = true;
+                flops += group->total(i) * group->counter(i).flopsPerCount;
+            }
+        }
+    }
+
+    if (found and _timer.totalTime() > 0.)
+    {
+        return flops / (_timer.totalTime() * 1.E-9);
+    }
+    return std::numeric_limits<double>::quiet_NaN();
+}
+// =============================================================================
+
+// =============================================================================
+template <typename Clock>
+void BasicCountedPerfTimer<Clock>::reportStats(std::ostream &outStream)
+{
+    _timer.reportStats(outStream);
+
+    if (not countersAvailable())
+    {
+        outStream << "  Counters: unavailable";
+        if (not _groups.empty())
+        {
+            outStream << ", " << _groups.front()->error();
+        }
+        outStream << std::endl;
+        return;
+    }
+
+    // The totals of every counter
+    outStream << "  Counters: ";
+    bool first = true;
+    for (std::unique_ptr<PerfCounterGroup> const &group : _groups)
+    {
+        for (size_t i = 0; i < group->size(); i++)
+        {
+            outStream << (first? "": ", ") << group->counter(i).name << ": ";
+            if (group->isCounted(i))
+            {
+                outStream << group->total(i);
+            }
+            else
+            {
+                outStream << "n/a";
+            }
+            first = false;
+        }
+        if (group->runningFraction() < 1.)
+        {
+            outStream << " (multiplexed, running "
+                      << 100. * group->runningFraction() << "%)";
+        }
+    }
+    outStream << std::endl;
+
+    // The derived metrics, skipping the ones that can't be computed
+    outStream << "  Metrics: ";
+    first = true;
+    auto const metric = [&](char const *name, double const value,
+                            double const scale, char const *unit)
+    {
+        if (not std::isnan(value))
+        {
+            outStream << (first? "": ", ") << name << ": " << value * scale
+                      << unit;
+            first = false;
+        }
+    };
+    metric("IPC",                   ipc(),                         1.,    "");
+    metric("LLC miss rate",         llcMissRate(),                 100.,  "%");
+    metric("LLC MPKI",              llcMissesPerKiloInstruction(), 1.,    "");
+    metric("Estimated bandwidth",   bandwidth(),                   1.E-9, "GB/s");
+    metric("FLOP rate",             flopRate(),                    1.E-9, "GFLOP/s");
+    if (first)
+    {
+        outStream << "n/a";
+    }
+    outStream << std::endl;
+}
+// =============================================================================
+
+// =============================================================================
+template <typename Clock>
+void BasicCountedPerfTimer<Clock>::reset()
+{
+    _timer = Timer(_timer.name(), _mode, _numRawSamples);
+    for (std::unique_ptr<PerfCounterGroup> &group : _groups)
+    {
+        group->reset();
+    }
+}
+// =============================================================================
+
+// =============================================================================
+// Private Methods
+// =============================================================================
+
+// =============================================================================
+template <typename Clock>
+bool BasicCountedPerfTimer<Clock>::_find(std::string const &name,
+                                         double &total) const
+{
+    for (std::unique_ptr<PerfCounterGroup> const &group : _groups)
+    {
+        for (size_t i = 0; i < group->size(); i++)
+        {
+            if (group->counter(i).name == name and group->isCounted(i))
+            {
+                total = group->total(i);
+                return true;
+            }
+        }
+    }
+    return false;
+}
+// =============================================================================
+
+// =============================================================================
+// End implementation of BasicCountedPerfTimer class
+// =============================================================================
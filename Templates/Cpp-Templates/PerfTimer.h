@@ -19,12 +19,54 @@
 #include <fstream>
 #include <numeric>
 #include <algorithm>
+#include <limits>
 #include <cmath>
 #include <cstring>
+#include <cerrno>
+#include <cstdint>
+#include <stdexcept>
+
+// Local Includes
+#include "LogLinearHistogram.h"
+#include "PerfClocks.h"
 
 // =============================================================================
-// Declaration of PerfTimer Class
+// Declaration of BasicPerfTimer Class
 // =============================================================================
+/// How the raw time differences are stored
+enum class PerfTimerMode
+{
+    /// Keep every time difference
+    storeAll,
+
+    /// Keep only the most recent time differences in a fixed size ring
+    /// buffer
+    streaming
+};
+
+/// The summary statistics of a timer, everything but the histogram and
+/// raw time differences. All times are in nanoseconds
+struct PerfTimerStatistics
+{
+    /// The number of trials
+    size_t count = 0;
+
+    /// The sum of all the time differences
+    double totalTime = 0.;
+
+    /// The mean of the time differences
+    double mean = 0.;
+
+    /// The sum of the squared differences from the mean
+    double m2 = 0.;
+
+    /// The fastest time difference
+    double minTime = std::numeric_limits<double>::max();
+
+    /// The slowest time difference
+    double maxTime = std::numeric_limits<double>::lowest();
+};
+
 /*!
  * \brief A class for timing pieces of code
  * \details To use this timer class simply initialize it with the name you want
@@ -36,22 +78,58 @@
  * which saves the statistics and raw time differences to a given csv file. Note
  * that it will overwrite without asking
  *
+ * The statistics are always accumulated as the timer runs, using Welford's
+ * online algorithm for the mean and variance, so they never need the raw time
+ * differences. By default every time difference is also kept. In
+ * `Mode::streaming` only the most recent `numRawSamples` are kept in a ring
+ * buffer that is allocated by the constructor, so the memory used by the
+ * timer is fixed and PerfTimer::stopTimer() never allocates.
+ *
+ * Every time difference is also recorded in a LogLinearHistogram, which has a
+ * fixed size, so that the percentiles can be reported in either mode without
+ * sorting the time differences. Timers, e.g. from different threads, can be
+ * combined with PerfTimer::merge().
+ *
+ * For large numbers of samples PerfTimer::saveTimingDataBinary() writes the
+ * raw time differences as little-endian doubles instead of text, and in
+ * append mode only writes the ones recorded since the last append so a long
+ * run can flush its samples periodically, see that function for the format.
+ *
+ * The clock is a policy, see PerfClocks.h. `PerfTimer` uses
+ * `std::chrono::steady_clock`, `BasicPerfTimer<MonotonicRawClock>` and
+ * `BasicPerfTimer<TscClock>` are available where those clocks are. Timers
+ * with different clocks can be merged since they all record nanoseconds.
+ *
+ * \tparam Clock The clock policy. Defaults to SteadyClock
  */
-class PerfTimer
+template <typename Clock = SteadyClock>
+class BasicPerfTimer
 {
 public:
+    /// How the raw time differences are stored, see PerfTimerMode
+    using Mode = PerfTimerMode;
+
+    /// The summary statistics of a timer, see PerfTimerStatistics
+    using Statistics = PerfTimerStatistics;
+
     /*!
      * \brief Construct a new Perf Timer object
      *
      * \param[in] name The name of the timer
+     * \param[in] mode How to store the raw time differences. Defaults to
+     * storing all of them
+     * \param[in] numRawSamples The size of the ring buffer in streaming mode.
+     * Ignored in `Mode::storeAll`. Defaults to 1024
      */
-    PerfTimer(std::string name);
+    BasicPerfTimer(std::string name,
+                   Mode const mode = Mode::storeAll,
+                   size_t const numRawSamples = 1024);
 
     /*!
      * \brief Destroy the Perf Timer object. Uses the default destructor
      *
      */
-    ~PerfTimer() = default;
+    ~BasicPerfTimer() = default;
 
     /*!
      * \brief Start the timer
@@ -62,11 +140,20 @@ public:
 
     /*!
      * \brief Stop the timer
-     * \details Stops the timer, appends the change in time to a private
-     * std::vector in nanoseconds, then sets _activeTimer to false
+     * \details Stops the timer, adds the change in time in nanoseconds to the
+     * statistics and the raw time differences, then sets _activeTimer to false
      */
     void stopTimer();
 
+    /*!
+     * \brief Add a time difference that was measured some other way, e.g.
+     * with CUDA events by DevicePerfTimer, to the statistics and the raw time
+     * differences
+     *
+     * \param[in] diff The time difference in nanoseconds
+     */
+    void addSample(double const diff);
+
     /*!
      * \brief Compute and print out all the statistics for the timer
      *
@@ -78,53 +165,310 @@ public:
      * \brief Writes all the time differences (in nanoseconds) to the given file
      * along with timer name and timer statistics.
      *
-     * \details File format is .csv with two header lines. The two headers lines
-     * are what is written out by PerfTimer::reportStats and the third line is
-     * the measure time differences for each use of the timer.
+     * \details File format is .csv with three header lines. The three headers
+     * lines are what is written out by PerfTimer::reportStats and the fourth
+     * line is the measure time differences for each use of the timer. In
+     * streaming mode only the time differences still in the ring buffer are
+     * written, oldest first. The rest of the file is the histogram, a line
+     * with the column names and then one line per non-empty bucket with the
+     * lower and upper bounds of the bucket in nanoseconds and its count.
      *
      * \param[in] filePath The path at which to write the output file. If the
      * file already exists it will be overwritten without asking.
      */
     void saveTimingData(std::string filePath);
 
+    /*!
+     * \brief Writes the raw time differences (in nanoseconds) to the given
+     * file in a binary format
+     *
+     * \details The file starts with a header: the 8 characters `PERFTIMR`, a
+     * uint32 format version (currently 1), a uint32 length of the timer name,
+     * and then the name. After that come blocks, each a uint64 number of
+     * samples followed by that many doubles. Every number is little-endian so
+     * e.g. a block can be read with `numpy.fromfile(file, "<f8", count)`.
+     * Overwriting writes the header and a single block of all the time
+     * differences that have been kept. Appending writes the header only if the
+     * file doesn't exist or is empty, and then a block of the time
+     * differences recorded since the last call to this function. In streaming
+     * mode append at least every `numRawSamples` trials, time differences that
+     * have left the ring buffer can't be written.
+     *
+     * \param[in] filePath The path at which to write the output file
+     * \param[in] append If true add to the end of the file, otherwise
+     * overwrite it without asking. Defaults to false
+     */
+    void saveTimingDataBinary(std::string const &filePath,
+                              bool const append = false);
+
+    /*!
+     * \brief Read all the time differences from a file written by
+     * PerfTimer::saveTimingDataBinary(). Throws a std::runtime_error if the
+     * file can't be opened or isn't in the right format
+     *
+     * \param[in] filePath The path of the file
+     * \param[out] name If not null, set to the name of the timer. Defaults to
+     * null
+     * \return std::vector<double> The time differences in nanoseconds, in the
+     * order they were written
+     */
+    static std::vector<double> readBinaryTimingData(
+        std::string const &filePath,
+        std::string *name = nullptr);
+
+    /*!
+     * \brief Get the number of times the timer has been started and stopped
+     *
+     * \return size_t The number of trials
+     */
+    size_t numTrials() const {return _count;}
+
+    /*!
+     * \brief Get the total time of all the trials
+     *
+     * \return double The total time in nanoseconds
+     */
+    double totalTime() const {return _totalTime;}
+
+    /*!
+     * \brief Get the average time of the trials
+     *
+     * \return double The average time in nanoseconds, zero if there are no
+     * trials
+     */
+    double averageTime() const {return _mean;}
+
+    /*!
+     * \brief Get the standard deviation of the trials
+     *
+     * \return double The standard deviation in nanoseconds, zero if there are
+     * no trials
+     */
+    double standardDeviation() const
+        {return (_count > 0)? std::sqrt(_m2 / _count): 0.;}
+
+    /*!
+     * \brief Get the fastest trial
+     *
+     * \return double The fastest time in nanoseconds, zero if there are no
+     * trials
+     */
+    double minTime() const {return (_count > 0)? _minTime: 0.;}
+
+    /*!
+     * \brief Get the slowest trial
+     *
+     * \return double The slowest time in nanoseconds, zero if there are no
+     * trials
+     */
+    double maxTime() const {return (_count > 0)? _maxTime: 0.;}
+
+    /*!
+     * \brief Get the raw time differences that have been kept, oldest first
+     *
+     * \return std::vector<double> The time differences in nanoseconds
+     */
+    std::vector<double> rawSamples() const;
+
+    /*!
+     * \brief Get the time at a given percentile from the histogram. Accurate
+     * to about 1%
+     *
+     * \param[in] percentile The percentile, e.g. 99.9
+     * \return double The time in nanoseconds, zero if there are no trials
+     */
+    double percentile(double const percentile) const
+    {
+        return (_count > 0)?
+               std::min(std::max(_histogram.percentile(percentile), _minTime),
+                        _maxTime):
+               0.;
+    }
+
+    /*!
+     * \brief Get the histogram of the time differences
+     *
+     * \return LogLinearHistogram const& The histogram in nanoseconds
+     */
+    LogLinearHistogram const &histogram() const {return _histogram;}
+
+    /*!
+     * \brief Combine the statistics, histogram, and raw time differences of
+     * another timer into this one, as if all of its trials had been timed by
+     * this timer
+     *
+     * \tparam OtherClock The clock of the other timer
+     * \param[in] other The timer to merge into this one
+     */
+    template <typename OtherClock>
+    void merge(BasicPerfTimer<OtherClock> const &other);
+
+    /*!
+     * \brief Combine statistics and a histogram, e.g. reduced from other
+     * MPI ranks, into this timer. The raw time differences are unchanged
+     *
+     * \param[in] statistics The statistics to merge into this timer
+     * \param[in] histogram The histogram to merge into this timer
+     */
+    void merge(Statistics const &statistics,
+               LogLinearHistogram const &histogram);
+
+    /*!
+     * \brief Get the summary statistics of the timer
+     *
+     * \return Statistics The statistics
+     */
+    Statistics statistics() const
+        {return {_count, _totalTime, _mean, _m2, _minTime, _maxTime};}
+
+    /*!
+     * \brief Combine two sets of statistics with the parallel algorithm of
+     * Chan et al., the result is the statistics of all the trials of both
+     *
+     * \param[in] a The first statistics
+     * \param[in] b The second statistics
+     * \return Statistics The combined statistics
+     */
+    static Statistics combine(Statistics const &a, Statistics const &b);
+
+    /*!
+     * \brief Get the name of the timer
+     *
+     * \return std::string const& The name
+     */
+    std::string const &name() const {return _name;}
+
+    /*!
+     * \brief Write the non-empty buckets of the histogram as csv, a line with
+     * the column names and then one line per bucket with the lower and upper
+     * bounds of the bucket in nanoseconds and its count
+     *
+     * \param[in] outStream What stream to write out to
+     */
+    void reportHistogram(std::ostream &outStream) const;
+
+    /*!
+     * \brief Figure out the proper units for a given time.
+     * \details Determines the proper units to use for time (nanoseconds,
+     * microseconds, milliseconds, seconds, minutes, or hours) and returns the
+     * time scaled to that unit along with the unit itself. Used by all the
+     * reports so that anything built on PerfTimer prints times the same way
+     *
+     * \param[in,out] time The time in nanoseconds, scaled to `unit`
+     * \param[out] unit The unit
+     */
+    static void convertTime(double &time, std::string &unit);
+
 private:
     /// Stores the start time
-    std::chrono::high_resolution_clock::time_point _startTime;
+    typename Clock::time_point _startTime;
 
-    /// Stores time differences in nanoseconds
+    /// Stores time differences in nanoseconds. In streaming mode this is the
+    /// ring buffer
     std::vector<double> _timeDiff;
 
+    /// How the raw time differences are stored
+    Mode _mode;
+
+    /// The index in the ring buffer that the next time difference is
+    /// written to
+    size_t _nextSample = 0;
+
+    /// The number of raw time differences that have been stored. This is
+    /// less than the number of trials after merging statistics without
+    /// samples
+    size_t _numStored = 0;
+
+    /// The number of raw time differences stored when
+    /// PerfTimer::saveTimingDataBinary() was last called
+    size_t _numWritten = 0;
+
+    /// The number of trials
+    size_t _count = 0;
+
+    /// The sum of all the time differences
+    double _totalTime = 0.;
+
+    /// The running mean of the time differences
+    double _mean = 0.;
+
+    /// The running sum of the squared differences from the mean
+    double _m2 = 0.;
+
+    /// The fastest time difference
+    double _minTime = std::numeric_limits<double>::max();
+
+    /// The slowest time difference
+    double _maxTime = std::numeric_limits<double>::lowest();
+
+    /// The histogram of the time differences
+    LogLinearHistogram _histogram;
+
     /// Indicates if a timer is active. If there is an active timer then it's
-    /// `false`, else it is `true`
+    /// `true`, else it is `false`
     bool _activeTimer;
 
     /// The name of the timer. To be printed out in the final output
     std::string _name;
 
     /*!
-     * \brief Figure out the proper units for a given time.
-     * \details Determines the proper units to use for time (nanoseconds,
-     * microseconds, milliseconds, seconds, minutes, or hours) and returns the
-     * time scaled to that unit along with the unit itself
+     * \brief Add a time difference to the raw time differences
      *
-     * \param[in,out] time
-     * \param[out] unit
+     * \param[in] diff The time difference in nanoseconds
      */
-    void _converter(double &time, std::string &unit);
+    void _storeRawSample(double const diff);
+
+    /// The first bytes of a binary timing file
+    static constexpr char const *_binaryMagic = "PERFTIMR";
+
+    /// The version of the binary timing file format
+    static uint32_t constexpr _binaryVersion = 1;
+
+    /*!
+     * \brief Check if the host stores numbers little-endian
+     *
+     * \return true The host is little-endian
+     * \return false The host is big-endian
+     */
+    static bool _isLittleEndian()
+    {
+        uint16_t const one = 1;
+        unsigned char firstByte;
+        std::memcpy(&firstByte, &one, 1);
+        return firstByte == 1;
+    }
+
+    /*!
+     * \brief Write 64 bit values little-endian
+     *
+     * \param[in] outStream The stream to write to
+     * \param[in] values The values, any 8 byte type
+     * \param[in] numValues The number of values
+     */
+    static void _writeLittleEndian(std::ostream &outStream,
+                                   void const *values,
+                                   size_t const numValues);
 
     /*!
-     * \brief Compute the standard deviation of _timeDiff
+     * \brief Read 64 bit values that were written little-endian
      *
-     * \return double The standard deviation of _timeDiff
+     * \param[in] inStream The stream to read from
+     * \param[out] values Where to put the values, any 8 byte type
+     * \param[in] numValues The number of values
      */
-    double _standardDeviation();
+    static void _readLittleEndian(std::istream &inStream,
+                                  void *values,
+                                  size_t const numValues);
 };
 // =============================================================================
-// End declaration of PerfTimer Class
+// End declaration of BasicPerfTimer Class
 // =============================================================================
 
+/// A timer using `std::chrono::steady_clock`
+using PerfTimer = BasicPerfTimer<>;
+
 // =============================================================================
-// Implementation of PerfTimer Class
+// Implementation of BasicPerfTimer Class
 // =============================================================================
 
 // =============================================================================
@@ -132,15 +476,29 @@ private:
 // =============================================================================
 
 // =============================================================================
-PerfTimer::PerfTimer(std::string name)
+template <typename Clock>
+BasicPerfTimer<Clock>::BasicPerfTimer(std::string name,
+                                      Mode const mode,
+                                      size_t const numRawSamples)
     :
+    _mode(mode),
     _activeTimer(false),
     _name(name)
-{}
+{
+    // Any setup of the clock, e.g. calibration, happens here
+    Clock::initialize();
+
+    // Allocate the whole ring buffer up front so that stopTimer never does
+    if (_mode == Mode::streaming)
+    {
+        _timeDiff.resize(std::max(numRawSamples, size_t(1)));
+    }
+}
 // =============================================================================
 
 // =============================================================================
-void PerfTimer::startTimer()
+template <typename Clock>
+void BasicPerfTimer<Clock>::startTimer()
 {
     // Check if a timer is already running
     if (_activeTimer)
@@ -149,82 +507,184 @@ void PerfTimer::startTimer()
     }
     else
     {
-        _startTime = std::chrono::high_resolution_clock::now();
+        _activeTimer = true;
+        _startTime = Clock::now();
     }
 }
 // =============================================================================
 
 // =============================================================================
-void PerfTimer::stopTimer()
+template <typename Clock>
+void BasicPerfTimer<Clock>::stopTimer()
 {
-    // Compute the time difference and write it to _timeDiff
-    double diff = static_cast<double> ((std::chrono::high_resolution_clock::now() - _startTime).count());
-    _timeDiff.push_back(diff);
+    // Compute the time difference and add it to the statistics
+    typename Clock::time_point const stopTime = Clock::now();
+    double diff = Clock::nanoseconds(_startTime, stopTime);
+    addSample(diff);
 
     _activeTimer = false;
 }
 // =============================================================================
 
 // =============================================================================
-void PerfTimer::reportStats(std::ostream &outStream)
+template <typename Clock>
+void BasicPerfTimer<Clock>::addSample(double const diff)
 {
-    // Compute statistics in nanoseconds
-    double totalTime = std::accumulate(_timeDiff.begin(), _timeDiff.end(), 0.);
-    double avgTime   = totalTime / static_cast<double>(_timeDiff.size());
-    double stdDev    = _standardDeviation();
-    auto   minMax    = std::minmax_element(_timeDiff.begin(),_timeDiff.end());
-    double minTime   = *minMax.first ;
-    double maxTime   = *minMax.second;
+    // Welford's online algorithm for the mean and variance
+    _count++;
+    double const delta = diff - _mean;
+    _mean += delta / static_cast<double>(_count);
+    _m2   += delta * (diff - _mean);
+
+    _totalTime += diff;
+    _minTime    = std::min(_minTime, diff);
+    _maxTime    = std::max(_maxTime, diff);
+    _histogram.record(diff);
+
+    _storeRawSample(diff);
+}
+// =============================================================================
+
+// =============================================================================
+template <typename Clock>
+void BasicPerfTimer<Clock>::reportStats(std::ostream &outStream)
+{
+    // Get the statistics in nanoseconds
+    double totalTime = _totalTime;
+    double avgTime   = averageTime();
+    double stdDev    = standardDeviation();
+    double minTime   = this->minTime();
+    double maxTime   = this->maxTime();
 
     // Convert values
     std::string totalTimeUnit, avgTimeUnit, stdDevTimeUnit, minTimeUnit, maxTimeUnit;
-    _converter(totalTime, totalTimeUnit);
-    _converter(avgTime,   avgTimeUnit);
-    _converter(stdDev,    stdDevTimeUnit);
-    _converter(minTime,   minTimeUnit);
-    _converter(maxTime,   maxTimeUnit);
+    convertTime(totalTime, totalTimeUnit);
+    convertTime(avgTime,   avgTimeUnit);
+    convertTime(stdDev,    stdDevTimeUnit);
+    convertTime(minTime,   minTimeUnit);
+    convertTime(maxTime,   maxTimeUnit);
 
     outStream << "Timer name: " << _name << std::endl  << "  " <<
-    "Number of trials: "   << _timeDiff.size()            << ", " <<
+    "Number of trials: "   << _count                      << ", " <<
     "Total time: "         << totalTime << totalTimeUnit  << ", " <<
     "Average Time: "       << avgTime   << avgTimeUnit    << ", " <<
     "Standard Deviation: " << stdDev    << stdDevTimeUnit << ", " <<
     "Fastest Run: "        << minTime   << minTimeUnit    << ", " <<
     "Slowest Run: "        << maxTime   << maxTimeUnit    << std::endl;
+
+    // Get and convert the percentiles
+    double const percentiles[] = {50., 90., 99., 99.9};
+    outStream << "  Percentiles: ";
+    for (size_t i = 0; i < 4; i++)
+    {
+        double time = percentile(percentiles[i]);
+        std::string timeUnit;
+        convertTime(time, timeUnit);
+        outStream << ((i > 0)? ", ": "") << "p" << percentiles[i] << ": "
+                  << time << timeUnit;
+    }
+    outStream << std::endl;
 }
 // =============================================================================
 
 // =============================================================================
-void PerfTimer::saveTimingData(std::string filePath)
+template <typename Clock>
+void BasicPerfTimer<Clock>::saveTimingData(std::string filePath)
 {
     // Open the file
     std::ofstream saveFile(filePath);
 
     // Check that the file opened
-    if (saveFile.is_open())
-    {
-        std::cout << "yes I'm open" << std::endl;
-    }
-    else
+    if (not saveFile.is_open())
     {
         std::cerr << "PerfTimer output file failed to open. Error: "
                   <<  std::strerror(errno)
                   << std::endl;
+        return;
     }
 
     // Write out the header info to the file
     reportStats(saveFile);
 
-    // Write the vector to the file
-    saveFile << _timeDiff[0];
-    if (_timeDiff.size() > 0)
+    // Write the raw time differences to the file
+    std::vector<double> const samples = rawSamples();
+    for (size_t i = 0; i < samples.size(); i++)
+    {
+        saveFile << ((i > 0)? ",": "") << samples[i];
+    }
+    saveFile << std::endl;
+
+    // Write the histogram to the file
+    reportHistogram(saveFile);
+
+    // Close the file
+    saveFile.close();
+}
+// =============================================================================
+
+// =============================================================================
+template <typename Clock>
+void BasicPerfTimer<Clock>::saveTimingDataBinary(std::string const &filePath,
+                                                 bool const append)
+{
+    // When appending only write the header to a new or empty file
+    bool writeHeader = true;
+    if (append)
+    {
+        std::ifstream existingFile(filePath, std::ios::binary | std::ios::ate);
+        writeHeader = not (existingFile.is_open() and existingFile.tellg() > 0);
+    }
+
+    // Open the file
+    std::ios::openmode const openMode = append? std::ios::app: std::ios::trunc;
+    std::ofstream saveFile(filePath, std::ios::binary | openMode);
+    if (not saveFile.is_open())
+    {
+        std::cerr << "PerfTimer output file failed to open. Error: "
+                  <<  std::strerror(errno)
+                  << std::endl;
+        return;
+    }
+
+    if (writeHeader)
     {
-        for (size_t i = 1; i < _timeDiff.size(); i++)
+        uint32_t const header[2] = {_binaryVersion,
+                                    static_cast<uint32_t>(_name.size())};
+        unsigned char headerBytes[8];
+        for (size_t i = 0; i < 8; i++)
         {
-            saveFile << "," << _timeDiff[i];
+            headerBytes[i] = static_cast<unsigned char>(header[i / 4]
+                                                        >> (8 * (i % 4)));
         }
+        saveFile.write(_binaryMagic, 8);
+        saveFile.write(reinterpret_cast<char const *>(headerBytes), 8);
+        saveFile.write(_name.data(), _name.size());
     }
-    saveFile << std::endl;
+
+    // Find the samples to write. They are either contiguous in _timeDiff or,
+    // in streaming mode, end just before _nextSample which may wrap around
+    size_t const numKept = (_mode == Mode::storeAll)?
+                           _timeDiff.size():
+                           std::min(_numStored, _timeDiff.size());
+    size_t const numNew  = append? std::min(_numStored - _numWritten, numKept):
+                                   numKept;
+
+    uint64_t const blockSize = numNew;
+    _writeLittleEndian(saveFile, &blockSize, 1);
+    if (_mode == Mode::storeAll)
+    {
+        _writeLittleEndian(saveFile, _timeDiff.data() + numKept - numNew,
+                           numNew);
+    }
+    else
+    {
+        size_t const first = (_nextSample + _timeDiff.size() - numNew)
+                             % _timeDiff.size();
+        size_t const firstPart = std::min(numNew, _timeDiff.size() - first);
+        _writeLittleEndian(saveFile, _timeDiff.data() + first, firstPart);
+        _writeLittleEndian(saveFile, _timeDiff.data(), numNew - firstPart);
+    }
+    _numWritten = _numStored;
 
     // Close the file
     saveFile.close();
@@ -232,11 +692,168 @@ void PerfTimer::saveTimingData(std::string filePath)
 // =============================================================================
 
 // =============================================================================
-// Private Methods
+template <typename Clock>
+std::vector<double> BasicPerfTimer<Clock>::readBinaryTimingData(
+    std::string const &filePath,
+    std::string *name)
+{
+    std::ifstream readFile(filePath, std::ios::binary);
+    if (not readFile.is_open())
+    {
+        throw std::runtime_error("Warning: PerfTimer.readBinaryTimingData() "
+                                 "failed to open " + filePath + ". Error: "
+                                 + std::strerror(errno));
+    }
+
+    // Check and read the header
+    char magic[8];
+    unsigned char headerBytes[8];
+    readFile.read(magic, 8);
+    readFile.read(reinterpret_cast<char *>(headerBytes), 8);
+    uint32_t header[2] = {0, 0};
+    for (size_t i = 0; i < 8; i++)
+    {
+        header[i / 4] |= uint32_t(headerBytes[i]) << (8 * (i % 4));
+    }
+    if (not readFile or (std::memcmp(magic, _binaryMagic, 8) != 0)
+        or (header[0] != _binaryVersion))
+    {
+        throw std::runtime_error("Warning: PerfTimer.readBinaryTimingData() "
+                                 + filePath + " is not a version "
+                                 + std::to_string(_binaryVersion)
+                                 + " binary timing file");
+    }
+
+    std::string timerName(header[1], '\0');
+    readFile.read(&timerName[0], header[1]);
+    if (name != nullptr)
+    {
+        *name = timerName;
+    }
+
+    // Read the blocks until the end of the file
+    std::vector<double> samples;
+    uint64_t blockSize;
+    while (readFile.peek() != std::char_traits<char>::eof())
+    {
+        _readLittleEndian(readFile, &blockSize, 1);
+        size_t const oldSize = samples.size();
+        samples.resize(oldSize + blockSize);
+        _readLittleEndian(readFile, samples.data() + oldSize, blockSize);
+        if (not readFile)
+        {
+            throw std::runtime_error("Warning: PerfTimer.readBinaryTimingData()"
+                                     " " + filePath + " is truncated");
+        }
+    }
+    return samples;
+}
 // =============================================================================
 
 // =============================================================================
-void PerfTimer::_converter(double &time, std::string &unit)
+template <typename Clock>
+std::vector<double> BasicPerfTimer<Clock>::rawSamples() const
+{
+    if (_mode == Mode::storeAll)
+    {
+        return _timeDiff;
+    }
+
+    // Until the ring buffer wraps around the oldest sample is at the start
+    size_t const numStored = std::min(_numStored, _timeDiff.size());
+    size_t const oldest    = (_numStored > _timeDiff.size())? _nextSample: 0;
+
+    std::vector<double> samples(numStored);
+    for (size_t i = 0; i < numStored; i++)
+    {
+        samples[i] = _timeDiff[(oldest + i) % _timeDiff.size()];
+    }
+    return samples;
+}
+// =============================================================================
+
+// =============================================================================
+template <typename Clock>
+template <typename OtherClock>
+void BasicPerfTimer<Clock>::merge(BasicPerfTimer<OtherClock> const &other)
+{
+    // Copy the raw time differences first in case other is this timer
+    std::vector<double> const otherSamples = other.rawSamples();
+
+    merge(other.statistics(), other.histogram());
+    for (double const diff : otherSamples)
+    {
+        _storeRawSample(diff);
+    }
+}
+// =============================================================================
+
+// =============================================================================
+template <typename Clock>
+void BasicPerfTimer<Clock>::merge(Statistics const &statistics,
+                                  LogLinearHistogram const &histogram)
+{
+    Statistics const combined = combine(this->statistics(), statistics);
+    _count     = combined.count;
+    _totalTime = combined.totalTime;
+    _mean      = combined.mean;
+    _m2        = combined.m2;
+    _minTime   = combined.minTime;
+    _maxTime   = combined.maxTime;
+    _histogram.merge(histogram);
+}
+// =============================================================================
+
+// =============================================================================
+template <typename Clock>
+PerfTimerStatistics BasicPerfTimer<Clock>::combine(Statistics const &a,
+                                                   Statistics const &b)
+{
+    if (a.count == 0)
+    {
+        return b;
+    }
+    if (b.count == 0)
+    {
+        return a;
+    }
+
+    double const countA = static_cast<double>(a.count);
+    double const countB = static_cast<double>(b.count);
+    double const total  = countA + countB;
+    double const delta  = b.mean - a.mean;
+
+    Statistics result;
+    result.count     = a.count + b.count;
+    result.totalTime = a.totalTime + b.totalTime;
+    result.mean      = a.mean + delta * countB / total;
+    result.m2        = a.m2 + b.m2 + delta * delta * countA * countB / total;
+    result.minTime   = std::min(a.minTime, b.minTime);
+    result.maxTime   = std::max(a.maxTime, b.maxTime);
+    return result;
+}
+// =============================================================================
+
+// =============================================================================
+template <typename Clock>
+void BasicPerfTimer<Clock>::reportHistogram(std::ostream &outStream) const
+{
+    outStream << "lower bound (ns),upper bound (ns),count" << std::endl;
+    for (size_t i = 0; i < LogLinearHistogram::numBuckets; i++)
+    {
+        if (_histogram.count(i) > 0)
+        {
+            outStream << LogLinearHistogram::lowerBound(i) << ","
+                      << LogLinearHistogram::upperBound(i) << ","
+                      << _histogram.count(i)               << std::endl;
+        }
+    }
+}
+// =============================================================================
+
+// =============================================================================
+template <typename Clock>
+void BasicPerfTimer<Clock>::convertTime(double &time, std::string &unit)
 {
     if (time <= 1.0E3)  // less than a microsecond
     {
@@ -277,21 +894,73 @@ void PerfTimer::_converter(double &time, std::string &unit)
 }
 // =============================================================================
 
+// =============================================================================
+// Private Methods
+// =============================================================================
+
+// =============================================================================
+template <typename Clock>
+void BasicPerfTimer<Clock>::_storeRawSample(double const diff)
+{
+    if (_mode == Mode::storeAll)
+    {
+        _timeDiff.push_back(diff);
+    }
+    else
+    {
+        _timeDiff[_nextSample] = diff;
+        _nextSample = (_nextSample + 1) % _timeDiff.size();
+    }
+    _numStored++;
+}
+// =============================================================================
+
+// =============================================================================
+template <typename Clock>
+void BasicPerfTimer<Clock>::_writeLittleEndian(std::ostream &outStream,
+                                               void const *values,
+                                               size_t const numValues)
+{
+    char const *bytes = static_cast<char const *>(values);
+    if (_isLittleEndian())
+    {
+        outStream.write(bytes, numValues * 8);
+        return;
+    }
+
+    // Swap each value into a small buffer to keep the writes large
+    size_t constexpr bufferValues = 512;
+    char buffer[bufferValues * 8];
+    for (size_t start = 0; start < numValues; start += bufferValues)
+    {
+        size_t const count = std::min(bufferValues, numValues - start);
+        for (size_t i = 0; i < count * 8; i++)
+        {
+            buffer[i] = bytes[start * 8 + (i / 8) * 8 + (7 - i % 8)];
+        }
+        outStream.write(buffer, count * 8);
+    }
+}
+// =============================================================================
 
 // =============================================================================
-double PerfTimer::_standardDeviation()
+template <typename Clock>
+void BasicPerfTimer<Clock>::_readLittleEndian(std::istream &inStream,
+                                              void *values,
+                                              size_t const numValues)
 {
-    double sum = std::accumulate(_timeDiff.begin(), _timeDiff.end(), 0.0);
-    double mean = sum / _timeDiff.size();
-
-    std::vector<double> diff(_timeDiff.size());
-    std::transform(_timeDiff.begin(), _timeDiff.end(), diff.begin(),
-                std::bind2nd(std::minus<double>(), mean));
-    double sq_sum = std::inner_product(diff.begin(), diff.end(), diff.begin(), 0.0);
-    return std::sqrt(sq_sum / _timeDiff.size());
+    char *bytes = static_cast<char *>(values);
+    inStream.read(bytes, numValues * 8);
+    if (not _isLittleEndian())
+    {
+        for (size_t i = 0; i < numValues; i++)
+        {
+            std::reverse(bytes + i * 8, bytes + (i + 1) * 8);
+        }
+    }
 }
 // =============================================================================
 
 // =============================================================================
-// End implementation of PerfTimer Class
+// End implementation of BasicPerfTimer Class
 // =============================================================================
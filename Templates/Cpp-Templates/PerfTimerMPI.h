@@ -0,0 +1,339 @@
+/*!
+ * \file PerfTimerMPI.h
+ * \author Robert 'Bob' Caddy (rvc@pitt.edu)
+ * \brief Contains functions to reduce PerfTimers across MPI ranks and report
+ * the global statistics, including the load imbalance, from a single rank
+ *
+ */
+
+#pragma once
+
+// STL Includes
+#include <string>
+#include <vector>
+#include <iostream>
+#include <fstream>
+#include <cstring>
+#include <cerrno>
+
+// External Includes
+#include <mpi.h>
+
+// Local Includes
+#include "PerfTimer.h"
+
+// =============================================================================
+// Declaration of the MPI PerfTimer functions
+// =============================================================================
+/// The result of reducing a PerfTimer across ranks
+struct GlobalPerfTimer
+{
+    /// The merged statistics and histogram of every rank. Holds no raw time
+    /// differences
+    PerfTimer timer;
+
+    /// The number of ranks the timer was reduced over
+    int numRanks;
+
+    /// The rank with the largest total time and that total time
+    int    slowestRank;
+    double slowestTotalTime;
+
+    /// The rank with the smallest total time and that total time
+    int    fastestRank;
+    double fastestTotalTime;
+
+    /*!
+     * \brief Get the load imbalance, the largest total time over the average
+     * total time. One is perfectly balanced
+     *
+     * \return double The load imbalance
+     */
+    double imbalance() const
+    {
+        double const average = timer.totalTime() / numRanks;
+        return (average > 0.)? slowestTotalTime / average: 1.;
+    }
+};
+
+/*!
+ * \brief Reduce a timer over every rank of `mpiCommunicator` with
+ * `MPI_Reduce`. The counts, means, and variances are combined with a custom
+ * `MPI_Op`, the histograms are summed, and the slowest and fastest ranks are
+ * found with `MPI_MAXLOC` and `MPI_MINLOC` on the total times. Must be called
+ * by every rank of `mpiCommunicator`
+ *
+ * \param[in] timer This rank's timer
+ * \param[in] mpiCommunicator The communicator to reduce over. Defaults to
+ * `MPI_COMM_WORLD`
+ * \param[in] root The rank that gets the result. Defaults to zero
+ * \return GlobalPerfTimer The reduced timer. Only meaningful on `root`
+ */
+inline GlobalPerfTimer reduceTimer(PerfTimer const &timer,
+                                   MPI_Comm  const &mpiCommunicator = MPI_COMM_WORLD,
+                                   int       const root = 0);
+
+/*!
+ * \brief Reduce every timer across the ranks and print out the global
+ * statistics and load imbalance of each one on `root`. Must be called by
+ * every rank of `mpiCommunicator` with the timers in the same order
+ *
+ * \param[in] timers This rank's timers
+ * \param[in] mpiCommunicator The communicator to reduce over. Defaults to
+ * `MPI_COMM_WORLD`
+ * \param[in] outStream What stream to write out to on `root`. Defaults to
+ * std::cout
+ * \param[in] root The rank that writes the report. Defaults to zero
+ */
+inline void reportStatsGlobal(std::vector<PerfTimer const *> const &timers,
+                              MPI_Comm const &mpiCommunicator = MPI_COMM_WORLD,
+                              std::ostream   &outStream = std::cout,
+                              int      const root = 0);
+
+/*!
+ * \brief Reduce every timer across the ranks and write the global statistics,
+ * load imbalance, and histogram of each one to a single file from `root`.
+ * Must be called by every rank of `mpiCommunicator` with the timers in the
+ * same order. If the file already exists it will be overwritten without
+ * asking
+ *
+ * \param[in] timers This rank's timers
+ * \param[in] filePath The path at which to write the output file
+ * \param[in] mpiCommunicator The communicator to reduce over. Defaults to
+ * `MPI_COMM_WORLD`
+ * \param[in] root The rank that writes the file. Defaults to zero
+ */
+inline void saveTimingDataGlobal(std::vector<PerfTimer const *> const &timers,
+                                 std::string const &filePath,
+                                 MPI_Comm const &mpiCommunicator = MPI_COMM_WORLD,
+                                 int      const root = 0);
+
+namespace perf_timer_mpi
+{
+    /// The number of doubles that a PerfTimer::Statistics is packed into
+    int constexpr numStatisticsFields = 6;
+
+    /*!
+     * \brief The `MPI_User_function` that combines packed statistics
+     *
+     * \param[in] in The packed statistics from another rank
+     * \param[in,out] inout The packed statistics to combine into
+     * \param[in] len The number of packed statistics
+     */
+    inline void combineStatistics(void *in,
+                                  void *inout,
+                                  int *len,
+                                  MPI_Datatype *);
+
+    /*!
+     * \brief Pack statistics into doubles. The count is exact up to 2^53
+     *
+     * \param[in] statistics The statistics
+     * \param[out] packed The packed statistics
+     */
+    inline void pack(PerfTimer::Statistics const &statistics, double *packed);
+
+    /*!
+     * \brief Unpack statistics from doubles
+     *
+     * \param[in] packed The packed statistics
+     * \return PerfTimer::Statistics The statistics
+     */
+    inline PerfTimer::Statistics unpack(double const *packed);
+
+    /*!
+     * \brief Write the load imbalance line of the report
+     *
+     * \param[in] global The reduced timer
+     * \param[in] outStream What stream to write out to
+     */
+    inline void reportImbalance(GlobalPerfTimer const &global,
+                                std::ostream &outStream);
+}  // namespace perf_timer_mpi
+// =============================================================================
+// End declaration of the MPI PerfTimer functions
+// =============================================================================
+
+// =============================================================================
+// Implementation of the MPI PerfTimer functions
+// =============================================================================
+
+// =============================================================================
+inline GlobalPerfTimer reduceTimer(PerfTimer const &timer,
+                                   MPI_Comm  const &mpiCommunicator,
+                                   int       const root)
+{
+    int rank, numRanks;
+    MPI_Comm_rank(mpiCommunicator, &rank);
+    MPI_Comm_size(mpiCommunicator, &numRanks);
+
+    // Reduce the statistics with a custom operation on packed doubles
+    MPI_Datatype statisticsType;
+    MPI_Type_contiguous(perf_timer_mpi::numStatisticsFields, MPI_DOUBLE,
+                        &statisticsType);
+    MPI_Type_commit(&statisticsType);
+    MPI_Op combineOp;
+    MPI_Op_create(&perf_timer_mpi::combineStatistics, 1, &combineOp);
+
+    double localStatistics[perf_timer_mpi::numStatisticsFields];
+    double globalStatistics[perf_timer_mpi::numStatisticsFields];
+    perf_timer_mpi::pack(timer.statistics(), localStatistics);
+    MPI_Reduce(localStatistics, globalStatistics, 1, statisticsType,
+               combineOp, root, mpiCommunicator);
+
+    MPI_Op_free(&combineOp);
+    MPI_Type_free(&statisticsType);
+
+    // Reduce the histograms
+    std::vector<uint64_t> globalCounts(LogLinearHistogram::numBuckets);
+    MPI_Reduce(timer.histogram().counts().data(), globalCounts.data(),
+               static_cast<int>(LogLinearHistogram::numBuckets),
+               MPI_UINT64_T, MPI_SUM, root, mpiCommunicator);
+
+    // Find the slowest and fastest ranks
+    struct {double time; int rank;} local{timer.totalTime(), rank},
+                                    slowest, fastest;
+    MPI_Reduce(&local, &slowest, 1, MPI_DOUBLE_INT, MPI_MAXLOC, root,
+               mpiCommunicator);
+    MPI_Reduce(&local, &fastest, 1, MPI_DOUBLE_INT, MPI_MINLOC, root,
+               mpiCommunicator);
+
+    GlobalPerfTimer global{PerfTimer(timer.name()), numRanks,
+                           -1, 0., -1, 0.};
+    if (rank == root)
+    {
+        LogLinearHistogram histogram;
+        histogram.setCounts(globalCounts);
+        global.timer.merge(perf_timer_mpi::unpack(globalStatistics),
+                           histogram);
+        global.slowestRank      = slowest.rank;
+        global.slowestTotalTime = slowest.time;
+        global.fastestRank      = fastest.rank;
+        global.fastestTotalTime = fastest.time;
+    }
+    return global;
+}
+// =============================================================================
+
+// =============================================================================
+inline void reportStatsGlobal(std::vector<PerfTimer const *> const &timers,
+                              MPI_Comm const &mpiCommunicator,
+                              std::ostream   &outStream,
+                              int      const root)
+{
+    int rank;
+    MPI_Comm_rank(mpiCommunicator, &rank);
+
+    for (PerfTimer const *timer : timers)
+    {
+        GlobalPerfTimer global = reduceTimer(*timer, mpiCommunicator, root);
+        if (rank == root)
+        {
+            global.timer.reportStats(outStream);
+            perf_timer_mpi::reportImbalance(global, outStream);
+        }
+    }
+}
+// =============================================================================
+
+// =============================================================================
+inline void saveTimingDataGlobal(std::vector<PerfTimer const *> const &timers,
+                                 std::string const &filePath,
+                                 MPI_Comm const &mpiCommunicator,
+                                 int      const root)
+{
+    int rank;
+    MPI_Comm_rank(mpiCommunicator, &rank);
+
+    // Only the root rank touches the filesystem
+    std::ofstream saveFile;
+    if (rank == root)
+    {
+        saveFile.open(filePath);
+        if (not saveFile.is_open())
+        {
+            std::cerr << "PerfTimer output file failed to open. Error: "
+                      <<  std::strerror(errno)
+                      << std::endl;
+        }
+    }
+
+    // Every rank must take part in the reductions even if the file failed to
+    // open
+    for (PerfTimer const *timer : timers)
+    {
+        GlobalPerfTimer global = reduceTimer(*timer, mpiCommunicator, root);
+        if (saveFile.is_open())
+        {
+            global.timer.reportStats(saveFile);
+            perf_timer_mpi::reportImbalance(global, saveFile);
+            global.timer.reportHistogram(saveFile);
+        }
+    }
+}
+// =============================================================================
+
+// =============================================================================
+inline void perf_timer_mpi::combineStatistics(void *in,
+                                              void *inout,
+                                              int *len,
+                                              MPI_Datatype *)
+{
+    double const *inStatistics    = static_cast<double const *>(in);
+    double       *inoutStatistics = static_cast<double *>(inout);
+    for (int i = 0; i < *len; i++)
+    {
+        double const *a = inStatistics    + i * numStatisticsFields;
+        double       *b = inoutStatistics + i * numStatisticsFields;
+        pack(PerfTimer::combine(unpack(a), unpack(b)), b);
+    }
+}
+// =============================================================================
+
+// =============================================================================
+inline void perf_timer_mpi::pack(PerfTimer::Statistics const &statistics,
+                                 double *packed)
+{
+    packed[0] = static_cast<double>(statistics.count);
+    packed[1] = statistics.totalTime;
+    packed[2] = statistics.mean;
+    packed[3] = statistics.m2;
+    packed[4] = statistics.minTime;
+    packed[5] = statistics.maxTime;
+}
+// =============================================================================
+
+// =============================================================================
+inline PerfTimer::Statistics perf_timer_mpi::unpack(double const *packed)
+{
+    PerfTimer::Statistics statistics;
+    statistics.count     = static_cast<size_t>(packed[0]);
+    statistics.totalTime = packed[1];
+    statistics.mean      = packed[2];
+    statistics.m2        = packed[3];
+    statistics.minTime   = packed[4];
+    statistics.maxTime   = packed[5];
+    return statistics;
+}
+// =============================================================================
+
+// =============================================================================
+inline void perf_timer_mpi::reportImbalance(GlobalPerfTimer const &global,
+                                            std::ostream &outStream)
+{
+    // Total times per rank are in nanoseconds
+    outStream << "  Ranks: "                << global.numRanks
+              << ", Slowest rank: "         << global.slowestRank
+              << " (" << global.slowestTotalTime * 1.E-9 << "s)"
+              << ", Fastest rank: "         << global.fastestRank
+              << " (" << global.fastestTotalTime * 1.E-9 << "s)"
+              << ", Average total time: "
+              << global.timer.totalTime() / global.numRanks * 1.E-9 << "s"
+              << ", Load imbalance (max/mean): " << global.imbalance()
+              << std::endl;
+}
+// =============================================================================
+
+// =============================================================================
+// End implementation of the MPI PerfTimer functions
+// =============================================================================
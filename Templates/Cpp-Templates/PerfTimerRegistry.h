@@ -0,0 +1,281 @@
+/*!
+ * \file PerfTimerRegistry.h
+ * \author Robert 'Bob' Caddy (rvc@pitt.edu)
+ * \brief Contains the PerfTimerRegistry class, a global registry of named
+ * PerfTimers that gives each thread its own timer so that threaded code can be
+ * timed without data races or contention
+ *
+ */
+
+#pragma once
+
+// STL Includes
+#include <string>
+#include <string_view>
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <memory>
+#include <mutex>
+#include <iostream>
+#include <stdexcept>
+
+// Local Includes
+#include "PerfTimer.h"
+
+// =============================================================================
+// Declaration of PerfTimerRegistry class
+// =============================================================================
+/*!
+ * \brief A global, thread-safe, registry of PerfTimers keyed by name
+ *
+ * \details Each thread that asks for a timer gets its own slot for that name.
+ * The slots are aligned to cache lines so threads never write to the same
+ * cache line and the lookup is cached in a thread local map, so after the
+ * first call on each thread `localTimer()` takes no locks and the timer itself
+ * is only ever touched by its own thread. The mutex is only taken to create a
+ * slot and to read the slots when they are merged.
+ *
+ * `merged()` and `reportStats()` combine all the slots of a name with
+ * PerfTimer::merge(). They read the other threads' timers so they should be
+ * called when those threads aren't timing anything, e.g. after an OpenMP
+ * parallel region or after joining the worker threads. For example
+ *
+ * \code
+ * #pragma omp parallel for
+ * for (int i = 0; i < n; i++)
+ * {
+ *     PerfTimer &timer = PerfTimerRegistry::instance().localTimer("pack");
+ *     timer.startTimer();
+ *     pack(i);
+ *     timer.stopTimer();
+ * }
+ * PerfTimerRegistry::instance().reportStats();
+ * \endcode
+ *
+ */
+class PerfTimerRegistry
+{
+public:
+    /*!
+     * \brief Get the global registry
+     *
+     * \return PerfTimerRegistry& The registry
+     */
+    static PerfTimerRegistry &instance()
+    {
+        static PerfTimerRegistry registry;
+        return registry;
+    }
+
+    // The registry is a singleton
+    PerfTimerRegistry(PerfTimerRegistry const &)            = delete;
+    PerfTimerRegistry &operator=(PerfTimerRegistry const &) = delete;
+
+    /*!
+     * \brief Get the calling thread's timer for `name`, creating it the first
+     * time this thread asks for that name. The returned reference stays valid
+     * for the life of the program and must only be used by the calling thread
+     *
+     * \param[in] name The name of the timer
+     * \param[in] mode How the new timer stores the raw time differences. Only
+     * used when the timer is created
+     * \param[in] numRawSamples The size of the new timer's ring buffer in
+     * streaming mode. Only used when the timer is created
+     * \return PerfTimer& The calling thread's timer
+     */
+    PerfTimer &localTimer(std::string_view const &name,
+                          PerfTimer::Mode const mode = PerfTimer::Mode::storeAll,
+                          size_t const numRawSamples = 1024);
+
+    /*!
+     * \brief Combine the timers of every thread for `name` into a single
+     * timer. Throws a std::out_of_range error if there is no timer with that
+     * name
+     *
+     * \param[in] name The name of the timer
+     * \return PerfTimer The combined timer
+     */
+    PerfTimer merged(std::string const &name) const;
+
+    /*!
+     * \brief Get the names of all the timers, in alphabetical order
+     *
+     * \return std::vector<std::string> The names
+     */
+    std::vector<std::string> names() const;
+
+    /*!
+     * \brief Get the number of threads that have a timer for `name`
+     *
+     * \param[in] name The name of the timer
+     * \return size_t The number of threads, zero if there is no timer with
+     * that name
+     */
+    size_t numThreads(std::string const &name) const;
+
+    /*!
+     * \brief Merge and print out the statistics of every timer
+     *
+     * \param[in] outStream What stream to write out to. Defaults to std::cout
+     */
+    void reportStats(std::ostream &outStream = std::cout) const;
+
+    /*!
+     * \brief Reset every timer. The timers are reset in place so references
+     * returned by `localTimer()` stay valid. Must not be called while any
+     * thread is timing something
+     *
+     */
+    void reset();
+
+private:
+    /// A single thread's timer, aligned so that no two slots share a cache
+    /// line
+    struct alignas(64) Slot
+    {
+        /// The timer
+        PerfTimer timer;
+
+        /// The settings the timer was created with, used by `reset()`
+        PerfTimer::Mode mode;
+        size_t          numRawSamples;
+    };
+
+    /// Guards `_slots`. Never taken on the hot path
+    mutable std::mutex _mutex;
+
+    /// The slots of every thread for each name
+    std::map<std::string, std::vector<std::unique_ptr<Slot>>> _slots;
+
+    /*!
+     * \brief Construct a new, empty, Perf Timer Registry object. Use
+     * `instance()` to get the registry
+     *
+     */
+    PerfTimerRegistry() = default;
+};
+// =============================================================================
+// End declaration of PerfTimerRegistry class
+// =============================================================================
+
+// =============================================================================
+// Implementation of PerfTimerRegistry class
+// =============================================================================
+
+// =============================================================================
+// Public Methods
+// =============================================================================
+
+// =============================================================================
+inline PerfTimer &PerfTimerRegistry::localTimer(std::string_view const &name,
+                                                PerfTimer::Mode const mode,
+                                                size_t const numRawSamples)
+{
+    // Each thread caches the slots it owns, the registry is a singleton so this
+    // can't refer to another registry. The keys view the names in `_slots`,
+    // which are never erased, so looking up a literal doesn't allocate
+    static thread_local std::unordered_map<std::string_view, PerfTimer *> cache;
+
+    auto const cached = cache.find(name);
+    if (cached != cache.end())
+    {
+        return *cached->second;
+    }
+
+    // First use of this name on this thread, create a slot
+    std::unique_ptr<Slot> slot(new Slot{PerfTimer(std::string(name), mode,
+                                                  numRawSamples),
+                                        mode,
+                                        numRawSamples});
+    PerfTimer *timer = &slot->timer;
+    std::string_view key;
+    {
+        std::lock_guard<std::mutex> lock(_mutex);
+        auto &slots = *_slots.emplace(std::string(name),
+                                      std::vector<std::unique_ptr<Slot>>()).first;
+        slots.second.push_back(std::move(slot));
+        key = slots.first;
+    }
+    cache.emplace(key, timer);
+    return *timer;
+}
+// =============================================================================
+
+// =============================================================================
+inline PerfTimer PerfTimerRegistry::merged(std::string const &name) const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    auto const slots = _slots.find(name);
+    if (slots == _slots.end())
+    {
+        throw std::out_of_range("Warning: PerfTimerRegistry.merged() no timer "
+                                "named " + name);
+    }
+
+    // Merge into a timer with the settings of the first slot
+    Slot const &first = *slots->second.front();
+    PerfTimer result(name, first.mode, first.numRawSamples);
+    for (std::unique_ptr<Slot> const &slot : slots->second)
+    {
+        result.merge(slot->timer);
+    }
+    return result;
+}
+// =============================================================================
+
+// =============================================================================
+inline std::vector<std::string> PerfTimerRegistry::names() const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    std::vector<std::string> result;
+    for (auto const &slots : _slots)
+    {
+        result.push_back(slots.first);
+    }
+    return result;
+}
+// =============================================================================
+
+// =============================================================================
+inline size_t PerfTimerRegistry::numThreads(std::string const &name) const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    auto const slots = _slots.find(name);
+    return (slots == _slots.end())? 0: slots->second.size();
+}
+// =============================================================================
+
+// =============================================================================
+inline void PerfTimerRegistry::reportStats(std::ostream &outStream) const
+{
+    for (std::string const &name : names())
+    {
+        merged(name).reportStats(outStream);
+    }
+}
+// =============================================================================
+
+// =============================================================================
+inline void PerfTimerRegistry::reset()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    for (auto &slots : _slots)
+    {
+        for (std::unique_ptr<Slot> &slot : slots.second)
+        {
+            slot->timer = PerfTimer(slots.first,
+                                    slot->mode,
+                                    slot->numRawSamples);
+        }
+    }
+}
+// =============================================================================
+
+// =============================================================================
+// End implementation of PerfTimerRegistry class
+// =============================================================================
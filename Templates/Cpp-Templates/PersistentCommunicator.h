@@ -11,11 +11,80 @@
 
 // STL Includes
 #include <exception>
+#include <stdexcept>
+#include <string>
+#include <complex>
+#include <cstdint>
+#include <vector>
+#include <memory>
+#include <fstream>
+#include <cstring>
+#include <cerrno>
+#include <limits>
 
 // External Includes
 #include <mpi.h>
 
 // Local Includes
+#include "PerfTimer.h"
+
+// =============================================================================
+// Compile time mapping from C++ types to MPI_Datatypes
+// =============================================================================
+/*!
+ * \brief Maps a C++ type to the matching MPI_Datatype at compile time. Using
+ * a type without a specialization is a compile error. Specialize this for
+ * custom types, e.g. ones with a committed derived datatype.
+ *
+ * \tparam T The C++ type
+ */
+template <typename T>
+struct MpiType
+{
+    static_assert(sizeof(T) == 0, "MpiType has no MPI_Datatype for this type,"
+                                  " add a specialization for it");
+};
+
+/// Define a specialization of MpiType. `MPI_Datatype`s are not constant
+/// expressions in every MPI implementation so they are returned by a function
+#define MPI_TYPE_SPECIALIZATION(cppType, mpiType)                   \
+    template <>                                                     \
+    struct MpiType<cppType>                                         \
+    {                                                               \
+        static MPI_Datatype get() {return mpiType;}                 \
+    };
+
+MPI_TYPE_SPECIALIZATION(char,                      MPI_CHAR)
+MPI_TYPE_SPECIALIZATION(signed char,               MPI_SIGNED_CHAR)
+MPI_TYPE_SPECIALIZATION(unsigned char,             MPI_UNSIGNED_CHAR)
+MPI_TYPE_SPECIALIZATION(short,                     MPI_SHORT)
+MPI_TYPE_SPECIALIZATION(unsigned short,            MPI_UNSIGNED_SHORT)
+MPI_TYPE_SPECIALIZATION(int,                       MPI_INT)
+MPI_TYPE_SPECIALIZATION(unsigned int,              MPI_UNSIGNED)
+MPI_TYPE_SPECIALIZATION(long,                      MPI_LONG)
+MPI_TYPE_SPECIALIZATION(unsigned long,             MPI_UNSIGNED_LONG)
+MPI_TYPE_SPECIALIZATION(long long,                 MPI_LONG_LONG)
+MPI_TYPE_SPECIALIZATION(unsigned long long,        MPI_UNSIGNED_LONG_LONG)
+MPI_TYPE_SPECIALIZATION(float,                     MPI_FLOAT)
+MPI_TYPE_SPECIALIZATION(double,                    MPI_DOUBLE)
+MPI_TYPE_SPECIALIZATION(long double,               MPI_LONG_DOUBLE)
+MPI_TYPE_SPECIALIZATION(bool,                      MPI_CXX_BOOL)
+MPI_TYPE_SPECIALIZATION(std::complex<float>,       MPI_CXX_FLOAT_COMPLEX)
+MPI_TYPE_SPECIALIZATION(std::complex<double>,      MPI_CXX_DOUBLE_COMPLEX)
+
+#undef MPI_TYPE_SPECIALIZATION
+
+/*!
+ * \brief Get the MPI_Datatype that matches `T`
+ *
+ * \tparam T The C++ type
+ * \return MPI_Datatype The matching MPI_Datatype
+ */
+template <typename T>
+inline MPI_Datatype mpiTypeOf() {return MpiType<T>::get();}
+// =============================================================================
+// End compile time mapping from C++ types to MPI_Datatypes
+// =============================================================================
 
 // =============================================================================
 // Declaration of PersistentCommunicator class
@@ -23,10 +92,76 @@
 /*!
  * \brief A class for performing persistent MPI communication.
  *
+ * \details When built against an MPI-4 library the class also supports
+ * partitioned communication with `MPI_Psend_init` and `MPI_Precv_init`. In
+ * that mode the buffer is split into equal partitions and the sender marks
+ * each one ready with `markReady()` as soon as it has been filled, e.g. by
+ * the thread or kernel that computed it, so early partitions are transferred
+ * while later ones are still being computed. The receiver can check for
+ * individual partitions with `parrived()`.
+ *
+ * Non-contiguous data, such as the faces of a 3D array, can be communicated
+ * without packing by using the StridedLayout or SubarrayLayout constructors.
+ * These build and commit a derived datatype that is freed in the destructor
+ * and MPI reads or writes the elements directly from the full array.
+ *
+ * Calling `enableInstrumentation()` makes every `start()` to completion cycle
+ * record the number of bytes communicated, the latency from `start()` until
+ * the communication completed, and the time spent blocked in `wait()`. The
+ * timings are kept in PerfTimer objects so the usual statistics are
+ * available and `writeCommunicationMatrix()` gathers them from all ranks.
+ * Completions that happen outside of this class, e.g. by waiting directly on
+ * `getRequest()`, are not recorded.
+ *
  */
 class PersistentCommunicator
 {
 public:
+    /// A strided layout for `MPI_Type_vector`: `count` blocks of
+    /// `blockLength` elements with the starts of the blocks `stride` elements
+    /// apart
+    struct StridedLayout
+    {
+        /// The number of blocks
+        int count;
+
+        /// The number of elements in each block
+        int blockLength;
+
+        /// The number of elements between the start of each block
+        int stride;
+    };
+
+    /// A subarray layout for `MPI_Type_create_subarray`. The buffer pointer
+    /// points to the start of the full array, not the subarray
+    struct SubarrayLayout
+    {
+        /// The number of elements in each dimension of the full array
+        std::vector<int> sizes;
+
+        /// The number of elements in each dimension of the subarray
+        std::vector<int> subsizes;
+
+        /// The starting index of the subarray in each dimension
+        std::vector<int> starts;
+
+        /// The storage order, `MPI_ORDER_C` (last dimension fastest) or
+        /// `MPI_ORDER_FORTRAN` (first dimension fastest)
+        int order = MPI_ORDER_C;
+    };
+
+#if MPI_VERSION >= 4
+    /// The layout of a partitioned communication
+    struct Partitions
+    {
+        /// The number of partitions the buffer is split into
+        int       numPartitions;
+
+        /// The number of elements in each partition
+        MPI_Count elementsPerPartition;
+    };
+#endif  // MPI_VERSION >= 4
+
     /*!
      * \brief Construct a new Persistent Communicator object
      *
@@ -53,24 +188,275 @@ public:
                            MPI_Comm     const &mpiCommunicator = MPI_COMM_WORLD);
 
     /*!
-     * \brief Destroy the Persistent Communicator object
+     * \brief Construct a new Persistent Communicator object that
+     * communicates a strided selection of elements, e.g. a face of a 2D or 3D
+     * array, with an `MPI_Type_vector` derived datatype
      *
+     * \param[in] commKind What kind of communication to perform. Options are
+     * "send" and "receive". Anything else will throw a std::invalid_argument
+     * error
+     * \param[in] bufferPointer The pointer to the first element of the first
+     * block
+     * \param[in] layout The number, length, and stride of the blocks
+     * \param[in] elementType The MPI_Dataatype of each element
+     * \param[in] otherRank The rank of the other MPI processing being
+     * communicated with. In the case of a send this is the recipient rank and
+     * in the case of a receive this is the senders rank
+     * \param[in] tag Tag for the communication, defaults to zero.
+     * \param[in] mpiCommunicator The MPI communicator to use. Defaults to
+     * `MPI_COMM_WORLD`
+     */
+    PersistentCommunicator(std::string   const &commKind,
+                           void                *bufferPointer,
+                           StridedLayout const &layout,
+                           MPI_Datatype  const elementType,
+                           int           const &otherRank,
+                           int           const &tag = 0,
+                           MPI_Comm      const &mpiCommunicator = MPI_COMM_WORLD)
+        : PersistentCommunicator(_AdoptType{}, commKind, bufferPointer,
+                                 _makeStridedType(layout, elementType),
+                                 otherRank, tag, mpiCommunicator)
+    {}
+
+    /*!
+     * \brief Construct a new Persistent Communicator object that
+     * communicates a subarray of an N-dimensional array, e.g. a halo region,
+     * with an `MPI_Type_create_subarray` derived datatype
+     *
+     * \param[in] commKind What kind of communication to perform. Options are
+     * "send" and "receive". Anything else will throw a std::invalid_argument
+     * error
+     * \param[in] bufferPointer The pointer to the first element of the full
+     * array
+     * \param[in] layout The sizes, subsizes, starts, and order of the
+     * subarray. Throws a std::invalid_argument error if the vectors are not
+     * all the same length
+     * \param[in] elementType The MPI_Dataatype of each element
+     * \param[in] otherRank The rank of the other MPI processing being
+     * communicated with. In the case of a send this is the recipient rank and
+     * in the case of a receive this is the senders rank
+     * \param[in] tag Tag for the communication, defaults to zero.
+     * \param[in] mpiCommunicator The MPI communicator to use. Defaults to
+     * `MPI_COMM_WORLD`
      */
-    ~PersistentCommunicator(){MPI_Request_free(&_request);};
+    PersistentCommunicator(std::string    const &commKind,
+                           void                 *bufferPointer,
+                           SubarrayLayout const &layout,
+                           MPI_Datatype   const elementType,
+                           int            const &otherRank,
+                           int            const &tag = 0,
+                           MPI_Comm       const &mpiCommunicator = MPI_COMM_WORLD)
+        : PersistentCommunicator(_AdoptType{}, commKind, bufferPointer,
+                                 _makeSubarrayType(layout, elementType),
+                                 otherRank, tag, mpiCommunicator)
+    {}
+
+#if MPI_VERSION >= 4
+    /*!
+     * \brief Construct a new partitioned Persistent Communicator object.
+     * Requires MPI-4. The number of partitions on the sender and receiver can
+     * differ as long as the total size of the message is the same. Throws a
+     * std::out_of_range error if the total number of elements doesn't fit in
+     * an `int`
+     *
+     * \param[in] commKind What kind of communication to perform. Options are
+     * "send" and "receive". Anything else will throw a std::invalid_argument
+     * error
+     * \param[in] bufferPointer The pointer to the begining of the memory
+     * segment to send
+     * \param[in] partitions The number of partitions and the number of
+     * elements in each
+     * \param[in] mpi_type The MPI_Dataatype of the communication
+     * \param[in] otherRank The rank of the other MPI processing being
+     * communicated with. In the case of a send this is the recipient rank and
+     * in the case of a receive this is the senders rank
+     * \param[in] tag Tag for the communication, defaults to zero.
+     * \param[in] mpiCommunicator The MPI communicator to use. Defaults to
+     * `MPI_COMM_WORLD`
+     */
+    PersistentCommunicator(std::string  const &commKind,
+                           void               *bufferPointer,
+                           Partitions   const &partitions,
+                           MPI_Datatype const mpi_type,
+                           int          const &otherRank,
+                           int          const &tag = 0,
+                           MPI_Comm     const &mpiCommunicator = MPI_COMM_WORLD);
+
+    /*!
+     * \brief Mark a partition of a partitioned send as ready to be sent. Can
+     * be called between `start()` and `wait()` from any thread if MPI was
+     * initialized with `MPI_THREAD_MULTIPLE`. Each partition must be marked
+     * ready exactly once per `start()`
+     *
+     * \param[in] partition The index of the partition
+     * \return int The return value of the MPI_Pready command
+     */
+    int markReady(int const &partition)
+    {
+        _checkPartitioned("markReady");
+        return MPI_Pready(partition, _request);
+    }
+
+    /*!
+     * \brief Mark the partitions [`low`, `high`] of a partitioned send as
+     * ready to be sent
+     *
+     * \param[in] low The index of the first partition
+     * \param[in] high The index of the last partition, inclusive
+     * \return int The return value of the MPI_Pready_range command
+     */
+    int markReadyRange(int const &low, int const &high)
+    {
+        _checkPartitioned("markReadyRange");
+        return MPI_Pready_range(low, high, _request);
+    }
+
+    /*!
+     * \brief Check if a partition of a partitioned receive has arrived. Can
+     * be called between `start()` and `wait()`
+     *
+     * \param[in] partition The index of the partition
+     * \return true The partition has arrived and can be used
+     * \return false The partition has not arrived yet
+     */
+    bool parrived(int const &partition)
+    {
+        _checkPartitioned("parrived");
+        int flag;
+        MPI_Parrived(_request, partition, &flag);
+        return flag != 0;
+    }
+#endif  // MPI_VERSION >= 4
+
+    /*!
+     * \brief Check if this is a partitioned communication
+     *
+     * \return true The communication is partitioned
+     * \return false The communication is a regular persistent communication
+     */
+    bool isPartitioned() const {return _partitioned;}
+
+    /// The performance statistics of an instrumented communication
+    struct Instrumentation
+    {
+        /// The number of completed communications
+        size_t numCommunications = 0;
+
+        /// The number of bytes communicated by each communication
+        size_t bytesPerCommunication = 0;
+
+        /// The time from `start()` until the communication was seen to be
+        /// complete by `wait()` or `test()`
+        PerfTimer latency{"Communication latency"};
+
+        /// The time spent blocked in `wait()`
+        PerfTimer blocked{"Time blocked in wait"};
+
+        /*!
+         * \brief Get the total number of bytes communicated
+         *
+         * \return size_t The total number of bytes
+         */
+        size_t totalBytes() const
+            {return numCommunications * bytesPerCommunication;}
+
+        /*!
+         * \brief Get the achieved bandwidth, the total bytes divided by the
+         * total latency
+         *
+         * \return double The bandwidth in bytes per second, zero if nothing
+         * has been communicated
+         */
+        double bandwidth() const
+        {
+            double const seconds = latency.totalTime() * 1.E-9;
+            return (seconds > 0.)? totalBytes() / seconds: 0.;
+        }
+    };
+
+    /*!
+     * \brief Start recording the statistics of every communication. Calling
+     * this again resets the statistics
+     *
+     */
+    void enableInstrumentation();
+
+    /*!
+     * \brief Check if the communication is being instrumented
+     *
+     * \return true `enableInstrumentation()` has been called
+     * \return false The communication is not being instrumented
+     */
+    bool isInstrumented() const {return _instrumentation != nullptr;}
+
+    /*!
+     * \brief Get the statistics of the communication. Throws a
+     * std::runtime_error if instrumentation hasn't been enabled
+     *
+     * \return Instrumentation const& The statistics
+     */
+    Instrumentation const &instrumentation() const
+    {
+        if (not isInstrumented())
+        {
+            throw std::runtime_error("Warning: PersistentCommunicator."
+                                     "instrumentation() called without "
+                                     "calling enableInstrumentation() first");
+        }
+        return *_instrumentation;
+    }
+
+    /*!
+     * \brief Destroy the Persistent Communicator object and free the derived
+     * datatype if one was created
+     *
+     */
+    ~PersistentCommunicator()
+    {
+        MPI_Request_free(&_request);
+        if (_derivedType != MPI_DATATYPE_NULL)
+        {
+            MPI_Type_free(&_derivedType);
+        }
+    };
+
+    // Copying would free the same request twice
+    PersistentCommunicator(PersistentCommunicator const &)            = delete;
+    PersistentCommunicator &operator=(PersistentCommunicator const &) = delete;
 
     /*!
      * \brief Start the MPI communication
      *
      * \return int The return value of the MPI_Start command
      */
-    int start(){return MPI_Start(&_request);}
+    int start()
+    {
+        if (isInstrumented())
+        {
+            _instrumentation->latency.startTimer();
+            _inFlight = true;
+        }
+        return MPI_Start(&_request);
+    }
 
     /*!
      * \brief Wait on the MPI communication to finish
      *
      * \return int The return value of the MPI_Wait command
      */
-    int wait() {return MPI_Wait(&_request, &status);}
+    int wait()
+    {
+        if (not (isInstrumented() and _inFlight))
+        {
+            return MPI_Wait(&_request, &status);
+        }
+
+        _instrumentation->blocked.startTimer();
+        int const returnValue = MPI_Wait(&_request, &status);
+        _instrumentation->blocked.stopTimer();
+        _recordCompletion();
+        return returnValue;
+    }
 
     /*!
      * \brief Test if the communication is complete
@@ -78,7 +464,15 @@ public:
      * \param[out] flag The flag that MPI_Test returns
      * \return int The return value of MPI_Test
      */
-    int test(int &flag) {return MPI_Test(&_request, &flag, &status);}
+    int test(int &flag)
+    {
+        int const returnValue = MPI_Test(&_request, &flag, &status);
+        if (flag and isInstrumented() and _inFlight)
+        {
+            _recordCompletion();
+        }
+        return returnValue;
+    }
 
     /*!
      * \brief Get the MPI_Request object
@@ -87,6 +481,32 @@ public:
      */
     MPI_Request getRequest(){return _request;}
 
+    /*!
+     * \brief Initialize a persistent send or receive request. This is what
+     * the constructor uses and it is shared with PersistentCommunicatorGroup
+     *
+     * \param[in] commKind What kind of communication to perform. Options are
+     * "send" and "receive". Anything else will throw a std::invalid_argument
+     * error
+     * \param[in] bufferPointer The pointer to the begining of the memory
+     * segment to communicate
+     * \param[in] numElements The number of elements to communicate
+     * \param[in] mpi_type The MPI_Dataatype of the communication
+     * \param[in] otherRank The rank of the other MPI processing being
+     * communicated with
+     * \param[in] tag Tag for the communication
+     * \param[in] mpiCommunicator The MPI communicator to use
+     * \return MPI_Request The new, inactive, persistent request. Throws a
+     * std::runtime_error if MPI fails to initialize it
+     */
+    static MPI_Request initRequest(std::string  const &commKind,
+                                   void               *bufferPointer,
+                                   int          const &numElements,
+                                   MPI_Datatype const mpi_type,
+                                   int          const &otherRank,
+                                   int          const &tag,
+                                   MPI_Comm     const &mpiCommunicator);
+
     /// The status of the last command that returns a MPI_Status struct
     MPI_Status status;
 
@@ -96,9 +516,13 @@ public:
     /// The pointer to the start of the buffer
     void *       const bufferPointer;
 
-    /// The number of elements being communicated
+    /// The number of elements being communicated. For a partitioned
+    /// communication this is the total over all partitions
     int          const numElements;
 
+    /// The number of partitions. One unless the communication is partitioned
+    int          const numPartitions = 1;
+
     /// The MPI_Datatype being communicated. Note that this is a hex value
     MPI_Datatype const mpi_type;
 
@@ -115,11 +539,160 @@ public:
 private:
     /// The MPI request for the persistent communication
     MPI_Request _request;
+
+    /// Whether the request was created with `MPI_Psend_init` or
+    /// `MPI_Precv_init`
+    bool _partitioned = false;
+
+    /// The derived datatype created by the StridedLayout or SubarrayLayout
+    /// constructors, `MPI_DATATYPE_NULL` otherwise
+    MPI_Datatype _derivedType = MPI_DATATYPE_NULL;
+
+    /// The statistics of the communication, null unless
+    /// `enableInstrumentation()` has been called
+    std::unique_ptr<Instrumentation> _instrumentation;
+
+    /// Whether an instrumented communication has been started but its
+    /// completion hasn't been recorded yet
+    bool _inFlight = false;
+
+    /*!
+     * \brief Record the completion of an instrumented communication
+     *
+     */
+    void _recordCompletion()
+    {
+        _instrumentation->latency.stopTimer();
+        _instrumentation->numCommunications++;
+        _inFlight = false;
+    }
+
+    /// Tag selecting the constructor that takes ownership of a derived
+    /// datatype. Needed since `MPI_Datatype` and `MPI_Comm` are plain integers
+    /// in some MPI implementations, which would make the overloads ambiguous
+    struct _AdoptType {};
+
+    /*!
+     * \brief Construct a communicator of a single element of the committed
+     * derived datatype `derivedType` and take ownership of it. If the
+     * construction throws then `derivedType` is freed before the exception
+     * propagates
+     *
+     * \param[in] commKind What kind of communication to perform
+     * \param[in] bufferPointer The pointer to the buffer
+     * \param[in] derivedType The committed derived datatype to adopt
+     * \param[in] otherRank The rank of the other MPI process
+     * \param[in] tag Tag for the communication
+     * \param[in] mpiCommunicator The MPI communicator to use
+     */
+    PersistentCommunicator(_AdoptType,
+                           std::string  const &commKind,
+                           void               *bufferPointer,
+                           MPI_Datatype       derivedType,
+                           int          const &otherRank,
+                           int          const &tag,
+                           MPI_Comm     const &mpiCommunicator);
+
+    /*!
+     * \brief Build and commit an `MPI_Type_vector` datatype
+     *
+     * \param[in] layout The number, length, and stride of the blocks
+     * \param[in] elementType The MPI_Dataatype of each element
+     * \return MPI_Datatype The committed datatype
+     */
+    static MPI_Datatype _makeStridedType(StridedLayout const &layout,
+                                         MPI_Datatype  const elementType);
+
+    /*!
+     * \brief Build and commit an `MPI_Type_create_subarray` datatype
+     *
+     * \param[in] layout The sizes, subsizes, starts, and order of the
+     * subarray
+     * \param[in] elementType The MPI_Dataatype of each element
+     * \return MPI_Datatype The committed datatype
+     */
+    static MPI_Datatype _makeSubarrayType(SubarrayLayout const &layout,
+                                          MPI_Datatype   const elementType);
+
+#if MPI_VERSION >= 4
+    /*!
+     * \brief Get the total number of elements of a partitioned communication.
+     * Throws a std::out_of_range error if it is negative or doesn't fit in
+     * the `int` that `numElements` is stored in
+     *
+     * \param[in] partitions The number of partitions and the number of
+     * elements in each
+     * \return int The total number of elements
+     */
+    static int _totalElements(Partitions const &partitions)
+    {
+        MPI_Count const maxElements = std::numeric_limits<int>::max();
+        if (partitions.numPartitions < 0
+            or partitions.elementsPerPartition < 0
+            or (partitions.numPartitions > 0
+                and partitions.elementsPerPartition
+                    > maxElements / partitions.numPartitions))
+        {
+            throw std::out_of_range("Warning: PersistentCommunicator "
+                                    "partitioned communication of "
+                                    + std::to_string(partitions.numPartitions)
+                                    + " partitions of "
+                                    + std::to_string(static_cast<long long>(
+                                          partitions.elementsPerPartition))
+                                    + " elements doesn't fit in an int");
+        }
+        return static_cast<int>(partitions.numPartitions
+                                * partitions.elementsPerPartition);
+    }
+#endif  // MPI_VERSION >= 4
+
+    /*!
+     * \brief Throw a std::runtime_error if the communication isn't
+     * partitioned
+     *
+     * \param[in] caller The name of the calling method, used in the error
+     * message
+     */
+    void _checkPartitioned(std::string const &caller) const
+    {
+        if (not _partitioned)
+        {
+            throw std::runtime_error("Warning: PersistentCommunicator."
+                                     + caller + "() can only be called on a "
+                                     "partitioned communication");
+        }
+    }
 };
 // =============================================================================
 // End declaration of PersistentCommunicator class
 // =============================================================================
 
+/*!
+ * \brief Gather the statistics of the instrumented communications on every
+ * rank and write them to a single csv file on `root`. Must be called by every
+ * rank of `mpiCommunicator`.
+ *
+ * \details Each line of the file is one communication: its kind, the source
+ * and destination ranks in `mpiCommunicator`, the number of communications,
+ * the total bytes, the average latency and average time blocked in `wait()`
+ * in nanoseconds, and the achieved bandwidth in GB/s. Sends and receives are
+ * both listed so a slow link shows up as a long blocked time on the receiving
+ * side and a load imbalance as long blocked times on every link into a rank.
+ * Communicators that aren't instrumented are skipped. If the file already
+ * exists it will be overwritten without asking.
+ *
+ * \param[in] communicators The communicators on this rank
+ * \param[in] filePath The path of the output file, only used on `root`
+ * \param[in] mpiCommunicator The communicator to gather over and whose
+ * ranks are written to the file. Defaults to `MPI_COMM_WORLD`
+ * \param[in] root The rank that writes the file. Defaults to zero
+ */
+inline void writeCommunicationMatrix(
+    std::vector<PersistentCommunicator const *> const &communicators,
+    std::string const &filePath,
+    MPI_Comm    const &mpiCommunicator = MPI_COMM_WORLD,
+    int         const root = 0);
+
 // =============================================================================
 // Implementation of PersistentCommunicator class
 // =============================================================================
@@ -129,7 +702,7 @@ private:
 // =============================================================================
 
 // =============================================================================
-PersistentCommunicator::PersistentCommunicator(std::string  const &commKind,
+inline PersistentCommunicator::PersistentCommunicator(std::string  const &commKind,
                                                void               *bufferPointer,
                                                int          const &numElements,
                                                MPI_Datatype const mpi_type,
@@ -144,7 +717,92 @@ PersistentCommunicator::PersistentCommunicator(std::string  const &commKind,
     otherRank(otherRank),
     tag(tag),
     mpiCommunicator(mpiCommunicator)
+{
+    _request = initRequest(commKind,
+                           bufferPointer,
+                           numElements,
+                           mpi_type,
+                           otherRank,
+                           tag,
+                           mpiCommunicator);
+}
+// =============================================================================
+
+// =============================================================================
+#if MPI_VERSION >= 4
+inline PersistentCommunicator::PersistentCommunicator(
+    std::string  const &commKind,
+    void               *bufferPointer,
+    Partitions   const &partitions,
+    MPI_Datatype const mpi_type,
+    int          const &otherRank,
+    int          const &tag,
+    MPI_Comm     const &mpiCommunicator)
+    :
+    commKind(commKind),
+    bufferPointer(bufferPointer),
+    numElements(_totalElements(partitions)),
+    numPartitions(partitions.numPartitions),
+    mpi_type(mpi_type),
+    otherRank(otherRank),
+    tag(tag),
+    mpiCommunicator(mpiCommunicator),
+    _partitioned(true)
 {
+    int status;
+    if (commKind == "send")
+    {
+        status = MPI_Psend_init(bufferPointer,
+                                partitions.numPartitions,
+                                partitions.elementsPerPartition,
+                                mpi_type,
+                                otherRank,
+                                tag,
+                                mpiCommunicator,
+                                MPI_INFO_NULL,
+                                &_request);
+    }
+    else if (commKind == "receive")
+    {
+        status = MPI_Precv_init(bufferPointer,
+                                partitions.numPartitions,
+                                partitions.elementsPerPartition,
+                                mpi_type,
+                                otherRank,
+                                tag,
+                                mpiCommunicator,
+                                MPI_INFO_NULL,
+                                &_request);
+    }
+    else
+    {
+        throw std::invalid_argument("Invalid commKind passed to "
+                                    "PersistentCommunicator. Expected \"send\" "
+                                    "or \"receive\", got " + commKind);
+    }
+
+    // Check that the communication was initialized
+    if (status != 0)
+    {
+        throw std::runtime_error("MPI partitioned communication failed to "
+                                 "initialize. Error Code: "
+                                 + std::to_string(status));
+    }
+}
+#endif  // MPI_VERSION >= 4
+// =============================================================================
+
+// =============================================================================
+inline MPI_Request PersistentCommunicator::initRequest(
+    std::string  const &commKind,
+    void               *bufferPointer,
+    int          const &numElements,
+    MPI_Datatype const mpi_type,
+    int          const &otherRank,
+    int          const &tag,
+    MPI_Comm     const &mpiCommunicator)
+{
+    MPI_Request request;
     int status;
     if (commKind == "send")
     {
@@ -154,7 +812,7 @@ PersistentCommunicator::PersistentCommunicator(std::string  const &commKind,
                                otherRank,
                                tag,
                                mpiCommunicator,
-                               &_request);
+                               &request);
     }
     else if (commKind == "receive")
     {
@@ -164,7 +822,7 @@ PersistentCommunicator::PersistentCommunicator(std::string  const &commKind,
                                otherRank,
                                tag,
                                mpiCommunicator,
-                               &_request);
+                               &request);
     }
     else
     {
@@ -180,6 +838,21 @@ PersistentCommunicator::PersistentCommunicator(std::string  const &commKind,
                                  "initialize. Error Code: "
                                  + std::to_string(status));
     }
+
+    return request;
+}
+// =============================================================================
+
+// =============================================================================
+inline void PersistentCommunicator::enableInstrumentation()
+{
+    int typeSize;
+    MPI_Type_size(mpi_type, &typeSize);
+
+    _instrumentation.reset(new Instrumentation);
+    _instrumentation->bytesPerCommunication = size_t(numElements)
+                                              * size_t(typeSize);
+    _inFlight = false;
 }
 // =============================================================================
 
@@ -187,6 +860,198 @@ PersistentCommunicator::PersistentCommunicator(std::string  const &commKind,
 // Private Methods
 // =============================================================================
 
+// =============================================================================
+inline PersistentCommunicator::PersistentCommunicator(
+    _AdoptType,
+    std::string  const &commKind,
+    void               *bufferPointer,
+    MPI_Datatype       derivedType,
+    int          const &otherRank,
+    int          const &tag,
+    MPI_Comm     const &mpiCommunicator)
+try
+    :
+    PersistentCommunicator(commKind, bufferPointer, 1, derivedType,
+                           otherRank, tag, mpiCommunicator)
+{
+    _derivedType = derivedType;
+}
+catch (...)
+{
+    // The delegated constructor threw so the destructor won't run. The
+    // exception is rethrown automatically at the end of this handler
+    MPI_Type_free(&derivedType);
+}
+// =============================================================================
+
+// =============================================================================
+inline MPI_Datatype PersistentCommunicator::_makeStridedType(
+    StridedLayout const &layout,
+    MPI_Datatype  const elementType)
+{
+    MPI_Datatype stridedType;
+    int status = MPI_Type_vector(layout.count,
+                                 layout.blockLength,
+                                 layout.stride,
+                                 elementType,
+                                 &stridedType);
+    if (status == 0)
+    {
+        status = MPI_Type_commit(&stridedType);
+    }
+
+    if (status != 0)
+    {
+        throw std::runtime_error("MPI_Type_vector failed to create the "
+                                 "derived datatype. Error Code: "
+                                 + std::to_string(status));
+    }
+    return stridedType;
+}
+// =============================================================================
+
+// =============================================================================
+inline MPI_Datatype PersistentCommunicator::_makeSubarrayType(
+    SubarrayLayout const &layout,
+    MPI_Datatype   const elementType)
+{
+    if ((layout.subsizes.size() != layout.sizes.size())
+        or (layout.starts.size() != layout.sizes.size()))
+    {
+        throw std::invalid_argument("Invalid SubarrayLayout passed to "
+                                    "PersistentCommunicator. sizes, subsizes, "
+                                    "and starts must have the same length");
+    }
+
+    MPI_Datatype subarrayType;
+    int status = MPI_Type_create_subarray(static_cast<int>(layout.sizes.size()),
+                                          layout.sizes.data(),
+                                          layout.subsizes.data(),
+                                          layout.starts.data(),
+                                          layout.order,
+                                          elementType,
+                                          &subarrayType);
+    if (status == 0)
+    {
+        status = MPI_Type_commit(&subarrayType);
+    }
+
+    if (status != 0)
+    {
+        throw std::runtime_error("MPI_Type_create_subarray failed to create "
+                                 "the derived datatype. Error Code: "
+                                 + std::to_string(status));
+    }
+    return subarrayType;
+}
+// =============================================================================
+
 // =============================================================================
 // End implementation of PersistentCommunicator class
-// =============================================================================
\ No newline at end of file
+// =============================================================================
+
+// =============================================================================
+inline void writeCommunicationMatrix(
+    std::vector<PersistentCommunicator const *> const &communicators,
+    std::string const &filePath,
+    MPI_Comm    const &mpiCommunicator,
+    int         const root)
+{
+    // The number of fields in each record
+    int constexpr numFields = 7;
+
+    int rank, numRanks;
+    MPI_Comm_rank(mpiCommunicator, &rank);
+    MPI_Comm_size(mpiCommunicator, &numRanks);
+
+    MPI_Group matrixGroup;
+    MPI_Comm_group(mpiCommunicator, &matrixGroup);
+
+    // Pack the local records. Ranks are stored as doubles so that a single
+    // gather is enough, they are exact up to 2^53
+    std::vector<double> localRecords;
+    for (PersistentCommunicator const *communicator : communicators)
+    {
+        if (not communicator->isInstrumented())
+        {
+            continue;
+        }
+
+        // Translate the other rank into a rank of mpiCommunicator
+        MPI_Group group;
+        MPI_Comm_group(communicator->mpiCommunicator, &group);
+        int otherRank;
+        MPI_Group_translate_ranks(group, 1, &communicator->otherRank,
+                                  matrixGroup, &otherRank);
+        MPI_Group_free(&group);
+        if (otherRank == MPI_UNDEFINED)
+        {
+            otherRank = -1;
+        }
+
+        bool const isSend = communicator->commKind == "send";
+        PersistentCommunicator::Instrumentation const &stats
+            = communicator->instrumentation();
+        localRecords.insert(localRecords.end(),
+                            {double(isSend),
+                             double(isSend? rank: otherRank),
+                             double(isSend? otherRank: rank),
+                             double(stats.numCommunications),
+                             double(stats.totalBytes()),
+                             stats.latency.averageTime(),
+                             stats.blocked.averageTime()});
+    }
+    MPI_Group_free(&matrixGroup);
+
+    // Gather the records on the root rank
+    int const localSize = static_cast<int>(localRecords.size());
+    std::vector<int> sizes(rank == root? numRanks: 0);
+    MPI_Gather(&localSize, 1, MPI_INT,
+               sizes.data(), 1, MPI_INT, root, mpiCommunicator);
+
+    std::vector<int> displacements(sizes.size(), 0);
+    for (size_t i = 1; i < sizes.size(); i++)
+    {
+        displacements[i] = displacements[i-1] + sizes[i-1];
+    }
+    std::vector<double> allRecords(sizes.empty()? 0:
+                                   displacements.back() + sizes.back());
+    MPI_Gatherv(localRecords.data(), localSize, MPI_DOUBLE,
+                allRecords.data(), sizes.data(), displacements.data(),
+                MPI_DOUBLE, root, mpiCommunicator);
+
+    if (rank != root)
+    {
+        return;
+    }
+
+    // Write out the file
+    std::ofstream saveFile(filePath);
+    if (not saveFile.is_open())
+    {
+        std::cerr << "writeCommunicationMatrix output file failed to open. "
+                  << "Error: " << std::strerror(errno) << std::endl;
+        return;
+    }
+
+    saveFile << "kind,source,destination,communications,bytes,"
+             << "average latency (ns),average blocked (ns),bandwidth (GB/s)"
+             << std::endl;
+    for (size_t i = 0; i < allRecords.size(); i += numFields)
+    {
+        // Bytes per nanosecond is GB/s
+        double const *record      = allRecords.data() + i;
+        double const totalLatency = record[3] * record[5];
+        double const bandwidth    = (totalLatency > 0.)?
+                                    record[4] / totalLatency: 0.;
+        saveFile << ((record[0] != 0.)? "send": "receive")  << ","
+                 << static_cast<long long>(record[1])       << ","
+                 << static_cast<long long>(record[2])       << ","
+                 << static_cast<long long>(record[3])       << ","
+                 << static_cast<long long>(record[4])       << ","
+                 << record[5]                               << ","
+                 << record[6]                               << ","
+                 << bandwidth                               << std::endl;
+    }
+}
+// =============================================================================
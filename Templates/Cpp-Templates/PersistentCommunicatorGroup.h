@@ -0,0 +1,694 @@
+/*!
+ * \file PersistentCommunicatorGroup.h
+ * \author Robert 'Bob' Caddy (rvc@pitt.edu)
+ * \brief Contains the declartion and implementation of the
+ * PersistentCommunicatorGroup class which is used for managing many MPI
+ * persistent communications at once
+ *
+ */
+
+#pragma once
+
+// STL Includes
+#include <vector>
+#include <string>
+#include <stdexcept>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+
+// External Includes
+#include <mpi.h>
+
+// Local Includes
+#include "PersistentCommunicator.h"
+
+// =============================================================================
+// Declaration of PersistentCommunicatorGroup class
+// =============================================================================
+/*!
+ * \brief A class for performing many persistent MPI communications together,
+ * e.g. all the halo sends and receives of a time step.
+ *
+ * \details The requests are stored in a contiguous array so the whole group
+ * is started, waited on, or tested with a single `MPI_Startall`,
+ * `MPI_Waitall`, `MPI_Waitany`, or `MPI_Testsome` call instead of one MPI
+ * call per message. Communications are identified by the index returned when
+ * they are added. MPI starts the requests in the order they were added so
+ * add the receives before the sends to avoid unexpected messages.
+ * Communications must not be added while the group is active.
+ *
+ * Many MPI libraries only move large (rendezvous) messages forward from
+ * inside MPI calls. To overlap communication with computation either call
+ * `poll()` periodically from the compute loop or start a background progress
+ * thread with `startProgressThread()`. The group records when each
+ * communication started and finished and when `waitAll()` was called, and
+ * `overlap()` reports how much of each transfer was hidden behind the
+ * computation done between `startAll()` and `waitAll()`.
+ *
+ */
+class PersistentCommunicatorGroup
+{
+public:
+    /*!
+     * \brief Construct a new, empty, Persistent Communicator Group object
+     *
+     * \param[in] mpiCommunicator The MPI communicator that all the
+     * communications use. Defaults to `MPI_COMM_WORLD`
+     */
+    explicit PersistentCommunicatorGroup(
+        MPI_Comm const &mpiCommunicator = MPI_COMM_WORLD)
+        : mpiCommunicator(mpiCommunicator) {}
+
+    /*!
+     * \brief Destroy the Persistent Communicator Group object and free all
+     * the requests
+     *
+     */
+    ~PersistentCommunicatorGroup();
+
+    // Copying would free the same requests twice
+    PersistentCommunicatorGroup(PersistentCommunicatorGroup const &) = delete;
+    PersistentCommunicatorGroup &operator=(
+        PersistentCommunicatorGroup const &) = delete;
+
+    /*!
+     * \brief Add a persistent send to the group
+     *
+     * \param[in] bufferPointer The pointer to the begining of the memory
+     * segment to send
+     * \param[in] numElements The number of elements to send
+     * \param[in] mpi_type The MPI_Dataatype of the communication
+     * \param[in] destinationRank The rank to send to
+     * \param[in] tag Tag for the communication, defaults to zero.
+     * \return size_t The index of the communication within the group
+     */
+    size_t addSend(void               *bufferPointer,
+                   int          const &numElements,
+                   MPI_Datatype const mpi_type,
+                   int          const &destinationRank,
+                   int          const &tag = 0)
+    {
+        return _add("send", bufferPointer, numElements, mpi_type,
+                    destinationRank, tag);
+    }
+
+    /*!
+     * \brief Add a persistent send to the group with the MPI_Datatype
+     * inferred from `T`
+     *
+     * \details This has its own name, rather than overloading the untyped
+     * version, because where `MPI_Datatype` is an `int`, e.g. MPICH, a call
+     * with a datatype would otherwise match this with the datatype as the rank
+     *
+     * \tparam T The type of the elements. Must have an MpiType specialization
+     * \param[in] bufferPointer The pointer to the first element to send
+     * \param[in] numElements The number of elements to send
+     * \param[in] destinationRank The rank to send to
+     * \param[in] tag Tag for the communication, defaults to zero.
+     * \return size_t The index of the communication within the group
+     */
+    template <typename T>
+    size_t addTypedSend(T         *bufferPointer,
+                        int const &numElements,
+                        int const &destinationRank,
+                        int const &tag = 0)
+    {
+        return addSend(bufferPointer, numElements, mpiTypeOf<T>(),
+                       destinationRank, tag);
+    }
+
+    /*!
+     * \brief Add a persistent receive to the group
+     *
+     * \param[in] bufferPointer The pointer to the begining of the memory
+     * segment to receive into
+     * \param[in] numElements The number of elements to receive
+     * \param[in] mpi_type The MPI_Dataatype of the communication
+     * \param[in] sourceRank The rank to receive from
+     * \param[in] tag Tag for the communication, defaults to zero.
+     * \return size_t The index of the communication within the group
+     */
+    size_t addReceive(void               *bufferPointer,
+                      int          const &numElements,
+                      MPI_Datatype const mpi_type,
+                      int          const &sourceRank,
+                      int          const &tag = 0)
+    {
+        return _add("receive", bufferPointer, numElements, mpi_type,
+                    sourceRank, tag);
+    }
+
+    /*!
+     * \brief Add a persistent receive to the group with the MPI_Datatype
+     * inferred from `T`
+     *
+     * \details See addTypedSend() for why this isn't an overload
+     *
+     * \tparam T The type of the elements. Must have an MpiType specialization
+     * \param[in] bufferPointer The pointer to the first element to receive
+     * into
+     * \param[in] numElements The number of elements to receive
+     * \param[in] sourceRank The rank to receive from
+     * \param[in] tag Tag for the communication, defaults to zero.
+     * \return size_t The index of the communication within the group
+     */
+    template <typename T>
+    size_t addTypedReceive(T         *bufferPointer,
+                           int const &numElements,
+                           int const &sourceRank,
+                           int const &tag = 0)
+    {
+        return addReceive(bufferPointer, numElements, mpiTypeOf<T>(),
+                          sourceRank, tag);
+    }
+
+    /*!
+     * \brief Start all the communications with `MPI_Startall`
+     *
+     * \return int The return value of the MPI_Startall command
+     */
+    int startAll();
+
+    /*!
+     * \brief Wait for all the communications to finish with `MPI_Waitall`.
+     * The statuses are available from `status()` afterwards, and
+     * `waitAny()` and `testSome()` don't return any more communications this
+     * round. Returns immediately if the group hasn't been started
+     *
+     * \return int The return value of the MPI_Waitall command
+     */
+    int waitAll();
+
+    /*!
+     * \brief Wait for any one communication to finish with `MPI_Waitany`.
+     * Useful for unpacking each message as soon as it arrives. Each
+     * communication is returned once per round; ones that `poll()` or the
+     * progress thread already saw finish are returned first without calling
+     * MPI
+     *
+     * \param[out] index The index of the communication that finished or
+     * `MPI_UNDEFINED` if all of them have already been returned
+     * \return int The return value of the MPI_Waitany command,
+     * `MPI_SUCCESS` if it wasn't called
+     */
+    int waitAny(int &index);
+
+    /*!
+     * \brief Test which communications have finished with `MPI_Testsome`
+     *
+     * \param[out] completed The indices of the communications that finished
+     * and haven't been returned by this or `waitAny()` yet, including those
+     * seen by `poll()` or the progress thread. Resized to the number that
+     * finished, re-use the same vector to avoid allocations. Empty if none
+     * finished and contains only `MPI_UNDEFINED` if all of them have already
+     * been returned
+     * \return int The return value of the MPI_Testsome command,
+     * `MPI_SUCCESS` if it wasn't called
+     */
+    int testSome(std::vector<int> &completed);
+
+    /*!
+     * \brief Test if all the communications have finished with `MPI_Testall`
+     *
+     * \param[out] flag The flag that MPI_Testall returns
+     * \return int The return value of the MPI_Testall command
+     */
+    int testAll(int &flag);
+
+    /*!
+     * \brief Cooperatively make progress on the active communications with
+     * `MPI_Testsome`. Call this every so often, e.g. between the tiles of an
+     * interior kernel, to keep messages moving while computing
+     *
+     * \return size_t The number of communications that are still active
+     */
+    size_t poll();
+
+    /*!
+     * \brief Start a background thread that calls `poll()` every `interval`
+     * until `stopProgressThread()` is called or the group is destroyed.
+     * Requires MPI to be initialized with `MPI_THREAD_MULTIPLE`, throws a
+     * std::runtime_error otherwise. All the methods of the group are safe to
+     * call while the thread is running
+     *
+     * \param[in] interval The time between polls. Defaults to 20 microseconds
+     */
+    void startProgressThread(
+        std::chrono::microseconds const interval=std::chrono::microseconds(20));
+
+    /*!
+     * \brief Stop the background progress thread. Does nothing if it isn't
+     * running
+     *
+     */
+    void stopProgressThread();
+
+    /// The communication/computation overlap of one communication
+    struct Overlap
+    {
+        /// Seconds from `startAll()` until the communication finished
+        double transferTime;
+
+        /// Seconds of the transfer that happened before `waitAll()` was
+        /// called, i.e. that were hidden behind computation
+        double hiddenTime;
+
+        /*!
+         * \brief The fraction of the transfer that was hidden
+         *
+         * \return double The fraction in [0, 1]. One if the transfer took no
+         * time at all
+         */
+        double hiddenFraction() const
+            {return (transferTime > 0.0)? hiddenTime / transferTime: 1.0;}
+    };
+
+    /*!
+     * \brief Get the overlap of a communication from the last round. The
+     * time a communication finished is when a wait, test, or poll first saw
+     * it finished, so poll often for accurate results
+     *
+     * \param[in] index The index of the communication
+     * \return Overlap The transfer time and the part of it that was hidden
+     */
+    Overlap overlap(size_t const index) const;
+
+    /*!
+     * \brief Get the time spent blocked in the last `waitAll()`, i.e. the
+     * communication time that was not hidden
+     *
+     * \return double The time in seconds
+     */
+    double exposedTime() const {return _exposedTime;}
+
+    /*!
+     * \brief Get the number of communications in the group
+     *
+     * \return size_t The number of communications
+     */
+    size_t size() const {return _requests.size();}
+
+    /*!
+     * \brief Get the status of a communication from the last wait or test
+     * that completed it
+     *
+     * \param[in] index The index of the communication
+     * \return MPI_Status const& The status of the communication
+     */
+    MPI_Status const &status(size_t const index) const
+        {return _statuses.at(index);}
+
+    /*!
+     * \brief Get the MPI_Request of a communication
+     *
+     * \param[in] index The index of the communication
+     * \return MPI_Request The MPI request of the communication
+     */
+    MPI_Request getRequest(size_t const index) const
+        {return _requests.at(index);}
+
+    /// The MPI communicator that all the communications use. Note that this
+    /// is a hex value
+    MPI_Comm const mpiCommunicator;
+
+private:
+    /// The persistent requests, contiguous so they can be passed to MPI
+    /// together
+    std::vector<MPI_Request> _requests;
+
+    /// The statuses of the requests, filled in by the wait and test methods
+    std::vector<MPI_Status> _statuses;
+
+    /// Scratch space for the wait and test methods so that they don't
+    /// allocate
+    std::vector<MPI_Status> _scratchStatuses;
+    std::vector<int>        _scratchIndices;
+
+    /// Whether each communication is inactive, i.e. has finished since the
+    /// last `startAll()` or hasn't been started yet
+    std::vector<char> _completed;
+
+    /// The indices of the communications in the order they finished this
+    /// round. Those from `_numReported` on haven't been returned by
+    /// `waitAny()` or `testSome()` yet, e.g. because `poll()` saw them first
+    std::vector<int> _finishedOrder;
+
+    /// The number of entries of `_finishedOrder` that have been returned
+    size_t _numReported=0;
+
+    /// The number of communications that haven't finished yet
+    size_t _numActive=0;
+
+    /// The `MPI_Wtime` of the last `startAll()`
+    double _startTime=0.0;
+
+    /// The `MPI_Wtime` at which `waitAll()` was called, negative if it
+    /// hasn't been called since the last `startAll()`
+    double _waitTime=-1.0;
+
+    /// The time spent blocked in the last `waitAll()`
+    double _exposedTime=0.0;
+
+    /// The `MPI_Wtime` at which each communication was seen to finish
+    std::vector<double> _completionTimes;
+
+    /// Serializes all MPI calls on the requests when the progress thread is
+    /// running
+    mutable std::mutex _mutex;
+
+    /// The background progress thread
+    std::thread _progressThread;
+
+    /// Set to false to stop the progress thread
+    std::atomic<bool> _progressRunning{false};
+
+    /*!
+     * \brief Record the communications that MPI reported as finished and
+     * queue them to be returned by `waitAny()` or `testSome()`. The statuses
+     * of communications that had already finished are not overwritten
+     *
+     * \param[in] numCompleted The number of finished communications
+     * \param[in] indices The indices of the finished communications
+     * \param[in] statuses The statuses, in the same order as `indices`
+     */
+    void _recordCompletions(int const numCompleted,
+                            int const *indices,
+                            MPI_Status const *statuses);
+
+    /*!
+     * \brief Call `MPI_Testsome` and record the results, `_mutex` must be
+     * held
+     *
+     * \param[out] numCompleted The number of communications that finished
+     * \return int The return value of the MPI_Testsome command
+     */
+    int _testSome(int &numCompleted);
+
+    /*!
+     * \brief Initialize a persistent request and add it to the group
+     *
+     * \param[in] commKind Either "send" or "receive"
+     * \param[in] bufferPointer The pointer to the buffer
+     * \param[in] numElements The number of elements to communicate
+     * \param[in] mpi_type The MPI_Dataatype of the communication
+     * \param[in] otherRank The rank of the other MPI process
+     * \param[in] tag Tag for the communication
+     * \return size_t The index of the communication within the group
+     */
+    size_t _add(std::string  const &commKind,
+                void               *bufferPointer,
+                int          const &numElements,
+                MPI_Datatype const mpi_type,
+                int          const &otherRank,
+                int          const &tag);
+};
+// =============================================================================
+// End declaration of PersistentCommunicatorGroup class
+// =============================================================================
+
+// =============================================================================
+// Implementation of PersistentCommunicatorGroup class
+// =============================================================================
+
+// =============================================================================
+// Public Methods
+// =============================================================================
+
+// =============================================================================
+inline PersistentCommunicatorGroup::~PersistentCommunicatorGroup()
+{
+    stopProgressThread();
+    for (MPI_Request &request : _requests)
+    {
+        MPI_Request_free(&request);
+    }
+}
+// =============================================================================
+
+// =============================================================================
+inline int PersistentCommunicatorGroup::startAll()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    std::fill(_completed.begin(), _completed.end(), 0);
+    _finishedOrder.clear();
+    _numReported = 0;
+    _numActive   = _requests.size();
+    _waitTime    = -1.0;
+    _exposedTime = 0.0;
+    _startTime   = MPI_Wtime();
+
+    if (_requests.empty())
+    {
+        return MPI_SUCCESS;
+    }
+    return MPI_Startall(static_cast<int>(_requests.size()), _requests.data());
+}
+// =============================================================================
+
+// =============================================================================
+inline int PersistentCommunicatorGroup::waitAll()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    _waitTime = MPI_Wtime();
+    int const returnCode = MPI_Waitall(static_cast<int>(_requests.size()),
+                                       _requests.data(),
+                                       _scratchStatuses.data());
+    // Record every communication that hadn't already been seen finishing
+    int numCompleted = 0;
+    for (size_t i = 0; i < _requests.size(); i++)
+    {
+        if (not _completed[i])
+        {
+            _scratchStatuses[numCompleted] = _scratchStatuses[i];
+            _scratchIndices[numCompleted++] = static_cast<int>(i);
+        }
+    }
+    _recordCompletions(numCompleted, _scratchIndices.data(),
+                       _scratchStatuses.data());
+    _numReported = _finishedOrder.size();
+    _exposedTime = MPI_Wtime() - _waitTime;
+
+    return returnCode;
+}
+// =============================================================================
+
+// =============================================================================
+inline int PersistentCommunicatorGroup::waitAny(int &index)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    // Only wait if nothing has finished that wasn't returned yet
+    int returnCode = MPI_SUCCESS;
+    if ((_numReported == _finishedOrder.size()) and (_numActive > 0))
+    {
+        MPI_Status status;
+        returnCode = MPI_Waitany(static_cast<int>(_requests.size()),
+                                 _requests.data(),
+                                 &index,
+                                 &status);
+        if (index != MPI_UNDEFINED)
+        {
+            _recordCompletions(1, &index, &status);
+        }
+    }
+
+    index = (_numReported < _finishedOrder.size())?
+            _finishedOrder[_numReported++]: MPI_UNDEFINED;
+    return returnCode;
+}
+// =============================================================================
+
+// =============================================================================
+inline int PersistentCommunicatorGroup::testSome(std::vector<int> &completed)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    int returnCode = MPI_SUCCESS;
+    if (_numActive > 0)
+    {
+        int numCompleted;
+        returnCode = _testSome(numCompleted);
+    }
+
+    if ((_numReported == _finishedOrder.size()) and (_numActive == 0))
+    {
+        completed.assign(1, MPI_UNDEFINED);
+    }
+    else
+    {
+        completed.assign(_finishedOrder.begin() + _numReported,
+                         _finishedOrder.end());
+        _numReported = _finishedOrder.size();
+    }
+    return returnCode;
+}
+// =============================================================================
+
+// =============================================================================
+inline int PersistentCommunicatorGroup::testAll(int &flag)
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    // MPI_Testall gives empty statuses for requests that were already
+    // inactive so MPI_Testsome is used to only record the new completions
+    int numCompleted;
+    int const returnCode = _testSome(numCompleted);
+    flag = (_numActive == 0);
+    if (flag)
+    {
+        _numReported = _finishedOrder.size();
+    }
+    return returnCode;
+}
+// =============================================================================
+
+// =============================================================================
+inline size_t PersistentCommunicatorGroup::poll()
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    if (_numActive > 0)
+    {
+        int numCompleted;
+        _testSome(numCompleted);
+    }
+    return _numActive;
+}
+// =============================================================================
+
+// =============================================================================
+inline void PersistentCommunicatorGroup::startProgressThread(
+    std::chrono::microseconds const interval)
+{
+    int provided;
+    MPI_Query_thread(&provided);
+    if (provided < MPI_THREAD_MULTIPLE)
+    {
+        throw std::runtime_error("Warning: PersistentCommunicatorGroup."
+                                 "startProgressThread() requires MPI to be "
+                                 "initialized with MPI_THREAD_MULTIPLE");
+    }
+    if (_progressRunning)
+    {
+        return;
+    }
+
+    _progressRunning = true;
+    _progressThread  = std::thread([this, interval]()
+    {
+        while (_progressRunning)
+        {
+            poll();
+            std::this_thread::sleep_for(interval);
+        }
+    });
+}
+// =============================================================================
+
+// =============================================================================
+inline void PersistentCommunicatorGroup::stopProgressThread()
+{
+    _progressRunning = false;
+    if (_progressThread.joinable())
+    {
+        _progressThread.join();
+    }
+}
+// =============================================================================
+
+// =============================================================================
+inline PersistentCommunicatorGroup::Overlap
+PersistentCommunicatorGroup::overlap(size_t const index) const
+{
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    double const completionTime = _completionTimes.at(index);
+    double const waitTime       = (_waitTime < 0.0)? completionTime: _waitTime;
+
+    Overlap result;
+    result.transferTime = completionTime - _startTime;
+    result.hiddenTime   = std::min(completionTime, waitTime) - _startTime;
+    return result;
+}
+// =============================================================================
+
+// =============================================================================
+// Private Methods
+// =============================================================================
+
+// =============================================================================
+inline size_t PersistentCommunicatorGroup::_add(
+    std::string  const &commKind,
+    void               *bufferPointer,
+    int          const &numElements,
+    MPI_Datatype const mpi_type,
+    int          const &otherRank,
+    int          const &tag)
+{
+    // The progress thread reads these vectors, which can be reallocated here
+    std::lock_guard<std::mutex> lock(_mutex);
+
+    _requests.push_back(PersistentCommunicator::initRequest(commKind,
+                                                            bufferPointer,
+                                                            numElements,
+                                                            mpi_type,
+                                                            otherRank,
+                                                            tag,
+                                                            mpiCommunicator));
+    _statuses.emplace_back();
+    _scratchStatuses.emplace_back();
+    _scratchIndices.push_back(0);
+    _completed.push_back(1);
+    _finishedOrder.reserve(_requests.size());
+    _completionTimes.push_back(0.0);
+    return _requests.size() - 1;
+}
+// =============================================================================
+
+// =============================================================================
+inline void PersistentCommunicatorGroup::_recordCompletions(
+    int const numCompleted,
+    int const *indices,
+    MPI_Status const *statuses)
+{
+    double const now = MPI_Wtime();
+    for (int i = 0; i < numCompleted; i++)
+    {
+        int const index = indices[i];
+        if (not _completed[index])
+        {
+            _completed[index]       = 1;
+            _statuses[index]        = statuses[i];
+            _completionTimes[index] = now;
+            _finishedOrder.push_back(index);
+            _numActive--;
+        }
+    }
+}
+// =============================================================================
+
+// =============================================================================
+inline int PersistentCommunicatorGroup::_testSome(int &numCompleted)
+{
+    int const returnCode = MPI_Testsome(static_cast<int>(_requests.size()),
+                                        _requests.data(),
+                                        &numCompleted,
+                                        _scratchIndices.data(),
+                                        _scratchStatuses.data());
+    if (numCompleted != MPI_UNDEFINED)
+    {
+        _recordCompletions(numCompleted, _scratchIndices.data(),
+                           _scratchStatuses.data());
+    }
+    return returnCode;
+}
+// =============================================================================
+
+// =============================================================================
+// End implementation of PersistentCommunicatorGroup class
+// =============================================================================
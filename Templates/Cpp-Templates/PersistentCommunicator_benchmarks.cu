@@ -0,0 +1,816 @@
+/*!
+ * \file PersistentCommunicator_benchmarks.cu
+ * \author Robert 'Bob' Caddy (rvc@pitt.edu)
+ * \brief MPI benchmarks comparing persistent communication, with
+ * PersistentCommunicator and DevicePersistentCommunicator, against plain
+ * `MPI_Isend`/`MPI_Irecv` and neighborhood collectives: ping-pong latency and
+ * bandwidth sweeps, multi-pair bandwidth, and a 3D 26 neighbor halo exchange,
+ * with host and DeviceVector buffers
+ *
+ * \details Usage: `mpirun -n N PersistentCommunicator_benchmarks [options]`
+ * - `--max-bytes N` The largest message of the sweeps. Defaults to 4 MiB
+ * - `--iterations N` The number of timed repetitions. Defaults to 100
+ * - `--warmup N` The number of untimed repetitions first. Defaults to 10
+ * - `--window N` The messages in flight per pair in the multi-pair test.
+ *   Defaults to 16
+ * - `--halo-cells N` The cells per side of each rank's cube. Defaults to 64
+ * - `--halo-width N` The depth of the halo in cells. Defaults to 2
+ * - `--buffers host|device|both` Which buffers to use. Defaults to both
+ * - `--output file` Write the global statistics and histogram of every
+ *   timer with saveTimingDataGlobal()
+ *
+ * The ping-pong runs between ranks 0 and 1, the multi-pair test between rank
+ * `i` and `i + N/2`, and the halo exchange on a periodic 3D Cartesian
+ * decomposition of every rank. Large messages show where the MPI library
+ * switches from the eager to the rendezvous protocol as a jump in the
+ * ping-pong latency. Device buffers are passed directly to MPI when it is
+ * CUDA-aware, see isCudaAwareMpi(), otherwise DevicePersistentCommunicator
+ * stages them and the plain and neighborhood methods are skipped. When MPI
+ * provides `MPI_THREAD_MULTIPLE` the host halo exchange is also run with the
+ * PersistentCommunicatorGroup progress thread running. To validate a
+ * new cluster submit it with `../slurm-template.slurm` on two or more nodes, one
+ * rank per GPU, so the ping-pong and multi-pair runs cross the fabric.
+ *
+ */
+
+// STL Includes
+#include <vector>
+#include <string>
+#include <memory>
+#include <iostream>
+#include <iomanip>
+
+// External Includes
+#include <mpi.h>
+#include <cuda_runtime.h>
+
+// Local Includes
+#include "../global/global.h"
+#include "../utils/DeviceVector.h"
+#include "../utils/PersistentCommunicator.h"
+#include "../utils/PersistentCommunicatorGroup.h"
+#include "../utils/DevicePersistentCommunicator.h"
+#include "../utils/NeighborhoodExchanger.h"
+#include "../utils/PerfTimerMPI.h"
+#include "../utils/cppArgParser.h"
+
+
+namespace // Anonymous namespace
+{
+    /// The settings of the benchmarks, the same on every rank
+    struct Settings
+    {
+        size_t maxBytes   = 4 * 1024 * 1024;
+        int    iterations = 100;
+        int    warmup     = 10;
+        int    window     = 16;
+        int    haloCells  = 64;
+        int    haloWidth  = 2;
+        bool   host       = true;
+        bool   device     = true;
+        bool   cudaAware  = false;
+        bool   progress   = false;
+    };
+
+    /// A message of a benchmark, in bytes of the send or receive buffer
+    struct Message
+    {
+        size_t offset;
+        int    bytes;
+        int    otherRank;
+        int    tag;
+    };
+
+    /// The timers of every benchmark, in the same order on every rank
+    using Timers = std::vector<std::unique_ptr<PerfTimer>>;
+
+    // =========================================================================
+    /*!
+     * \brief The sends and receives of one rank in a benchmark, started and
+     * waited on separately so the same benchmark can run with every method
+     *
+     */
+    class MessageSet
+    {
+    public:
+        virtual ~MessageSet() = default;
+        virtual void startReceives() = 0;
+        virtual void startSends()    = 0;
+        virtual void waitReceives()  = 0;
+        virtual void waitSends()     = 0;
+    };
+
+    /// Persistent requests in a PersistentCommunicatorGroup, one for the
+    /// receives and one for the sends, so each is a single MPI call.
+    /// Optionally with the progress thread of each group running
+    class PersistentMessages : public MessageSet
+    {
+    public:
+        PersistentMessages(std::vector<Message> const &sends,
+                           std::vector<Message> const &receives,
+                           char *sendBuffer,
+                           char *recvBuffer,
+                           bool const progressThread)
+        {
+            for (Message const &message : receives)
+            {
+                _receives.addTypedReceive(recvBuffer + message.offset,
+                                          message.bytes, message.otherRank,
+                                          message.tag);
+            }
+            for (Message const &message : sends)
+            {
+                _sends.addTypedSend(sendBuffer + message.offset,
+                                    message.bytes, message.otherRank,
+                                    message.tag);
+            }
+            if (progressThread)
+            {
+                _receives.startProgressThread();
+                _sends.startProgressThread();
+            }
+        }
+        void startReceives() override {_receives.startAll();}
+        void startSends()    override {_sends.startAll();}
+        void waitReceives()  override {_receives.waitAll();}
+        void waitSends()     override {_sends.waitAll();}
+
+    private:
+        PersistentCommunicatorGroup _receives, _sends;
+    };
+
+    /// Plain `MPI_Isend` and `MPI_Irecv`, with host or CUDA-aware device
+    /// pointers
+    class PlainMessages : public MessageSet
+    {
+    public:
+        PlainMessages(std::vector<Message> const &sends,
+                      std::vector<Message> const &receives,
+                      char *sendBuffer,
+                      char *recvBuffer)
+            :
+            _sends(sends), _receives(receives),
+            _sendBuffer(sendBuffer), _recvBuffer(recvBuffer),
+            _sendRequests(sends.size()), _recvRequests(receives.size())
+        {}
+        void startReceives() override
+        {
+            for (size_t i = 0; i < _receives.size(); i++)
+            {
+                Message const &message = _receives[i];
+                MPI_Irecv(_recvBuffer + message.offset, message.bytes, MPI_CHAR,
+                          message.otherRank, message.tag, MPI_COMM_WORLD,
+                          &_recvRequests[i]);
+            }
+        }
+        void startSends() override
+        {
+            for (size_t i = 0; i < _sends.size(); i++)
+            {
+                Message const &message = _sends[i];
+                MPI_Isend(_sendBuffer + message.offset, message.bytes, MPI_CHAR,
+                          message.otherRank, message.tag, MPI_COMM_WORLD,
+                          &_sendRequests[i]);
+            }
+        }
+        void waitReceives() override
+        {
+            MPI_Waitall(static_cast<int>(_recvRequests.size()),
+                        _recvRequests.data(), MPI_STATUSES_IGNORE);
+        }
+        void waitSends() override
+        {
+            MPI_Waitall(static_cast<int>(_sendRequests.size()),
+                        _sendRequests.data(), MPI_STATUSES_IGNORE);
+        }
+
+    private:
+        std::vector<Message>     _sends, _receives;
+        char                    *_sendBuffer, *_recvBuffer;
+        std::vector<MPI_Request> _sendRequests, _recvRequests;
+    };
+
+    /// One DevicePersistentCommunicator per message, CUDA-aware or staged.
+    /// Waiting on the receives also waits for the staged copies to the device
+    class DeviceMessages : public MessageSet
+    {
+    public:
+        DeviceMessages(std::vector<Message> const &sends,
+                       std::vector<Message> const &receives,
+                       cuda_utilities::DeviceVector<char> &sendBuffer,
+                       cuda_utilities::DeviceVector<char> &recvBuffer,
+                       bool const cudaAware)
+        {
+            for (Message const &message : receives)
+            {
+                _receives.emplace_back(new Communicator("receive", recvBuffer,
+                    message.otherRank, message.tag, MPI_COMM_WORLD,
+                    message.offset, message.bytes, 0, cudaAware));
+            }
+            for (Message const &message : sends)
+            {
+                _sends.emplace_back(new Communicator("send", sendBuffer,
+                    message.otherRank, message.tag, MPI_COMM_WORLD,
+                    message.offset, message.bytes, 0, cudaAware));
+            }
+        }
+        void startReceives() override {for (auto &r : _receives) r->start();}
+        void startSends()    override {for (auto &s : _sends)    s->start();}
+        void waitReceives()  override
+        {
+            for (auto &receive : _receives)
+            {
+                receive->wait();
+            }
+            CudaSafeCall(cudaStreamSynchronize(0));
+        }
+        void waitSends() override {for (auto &s : _sends) s->wait();}
+
+    private:
+        using Communicator = DevicePersistentCommunicator<char>;
+        std::vector<std::unique_ptr<Communicator>> _receives, _sends;
+    };
+
+    /// A NeighborhoodExchanger. The whole exchange is one request, it is
+    /// started with the sends and waited on with them
+    class NeighborhoodMessages : public MessageSet
+    {
+    public:
+        NeighborhoodMessages(MPI_Comm const &cartesianCommunicator,
+                             std::vector<Message> const &sends,
+                             std::vector<Message> const &receives,
+                             std::vector<std::vector<int>> const &directions,
+                             char *sendBuffer,
+                             char *recvBuffer)
+            : _exchanger(cartesianCommunicator, true)
+        {
+            // Map each slot of the exchanger to the message in its direction
+            int const numSlots = _exchanger.numSendSlots();
+            std::vector<int> counts(numSlots), displacements(numSlots);
+            for (int slot = 0; slot < numSlots; slot++)
+            {
+                for (size_t i = 0; i < directions.size(); i++)
+                {
+                    if (directions[i] == _exchanger.direction(slot))
+                    {
+                        counts[slot]        = sends[i].bytes;
+                        displacements[slot] = static_cast<int>(sends[i].offset);
+                    }
+                }
+            }
+            // The buffers have the same layout and the receive of a slot
+            // comes from the neighbor in that direction
+            std::vector<int> recvDisplacements(numSlots);
+            for (int slot = 0; slot < numSlots; slot++)
+            {
+                for (size_t i = 0; i < directions.size(); i++)
+                {
+                    if (directions[i] == _exchanger.direction(slot))
+                    {
+                        recvDisplacements[slot]
+                            = static_cast<int>(receives[i].offset);
+                    }
+                }
+            }
+            _exchanger.init(sendBuffer, counts, displacements,
+                            recvBuffer, counts, recvDisplacements);
+        }
+        void startReceives() override {}
+        void startSends()    override {_exchanger.start();}
+        void waitReceives()  override {}
+        void waitSends()     override {_exchanger.wait();}
+
+    private:
+        NeighborhoodExchanger _exchanger;
+    };
+    // =========================================================================
+
+    // =========================================================================
+    /// The send and receive buffers of a benchmark on the host or device
+    struct Buffers
+    {
+        Buffers(size_t const sendBytes, size_t const recvBytes, bool const device)
+        {
+            if (device)
+            {
+                deviceSend.reset(new cuda_utilities::DeviceVector<char>(sendBytes));
+                deviceRecv.reset(new cuda_utilities::DeviceVector<char>(recvBytes));
+                deviceSend->fill(1);
+                CudaSafeCall(cudaDeviceSynchronize());
+            }
+            else
+            {
+                hostSend.assign(sendBytes, 1);
+                hostRecv.assign(recvBytes, 0);
+            }
+        }
+        char *send() {return deviceSend? deviceSend->data(): hostSend.data();}
+        char *recv() {return deviceRecv? deviceRecv->data(): hostRecv.data();}
+
+        std::vector<char> hostSend, hostRecv;
+        std::unique_ptr<cuda_utilities::DeviceVector<char>> deviceSend, deviceRecv;
+    };
+
+    /*!
+     * \brief Get the methods that can run with the given buffers
+     *
+     * \param[in] settings The settings
+     * \param[in] device Whether the buffers are on the device
+     * \param[in] halo Whether to include the methods only the halo exchange
+     * compares, the neighborhood collective and the progress thread
+     * \return std::vector<std::string> The methods
+     */
+    std::vector<std::string> methods(Settings const &settings,
+                                     bool const device,
+                                     bool const halo)
+    {
+        std::vector<std::string> result{"persistent"};
+        if (halo and not device and settings.progress)
+        {
+            result.push_back("persistent progress");
+        }
+        if (not device or settings.cudaAware)
+        {
+            result.push_back("isend/irecv");
+            if (halo)
+            {
+                result.push_back("neighborhood");
+            }
+        }
+        return result;
+    }
+
+    /*!
+     * \brief Make the MessageSet of a method. The neighborhood collective is
+     * made by the halo benchmark
+     */
+    std::unique_ptr<MessageSet> makeMessages(std::string const &method,
+                                             Settings const &settings,
+                                             std::vector<Message> const &sends,
+                                             std::vector<Message> const &receives,
+                                             Buffers &buffers)
+    {
+        if (method == "isend/irecv")
+        {
+            return std::unique_ptr<MessageSet>(new PlainMessages(
+                sends, receives, buffers.send(), buffers.recv()));
+        }
+        if (buffers.deviceSend)
+        {
+            return std::unique_ptr<MessageSet>(new DeviceMessages(
+                sends, receives, *buffers.deviceSend, *buffers.deviceRecv,
+                settings.cudaAware));
+        }
+        return std::unique_ptr<MessageSet>(new PersistentMessages(
+            sends, receives, buffers.send(), buffers.recv(),
+            method == "persistent progress"));
+    }
+
+    /// The order a rank starts and waits on its messages
+    enum class Order
+    {
+        /// Receive, send, wait for the send then the reply
+        initiator,
+
+        /// Receive, wait for it, then reply
+        responder,
+
+        /// Receive and send everything, then wait for everything
+        allAtOnce,
+
+        /// Not taking part
+        idle
+    };
+
+    /*!
+     * \brief Do one exchange in the given order
+     */
+    void exchange(MessageSet &messages, Order const order)
+    {
+        switch (order)
+        {
+            case Order::initiator:
+                messages.startReceives();
+                messages.startSends();
+                messages.waitSends();
+                messages.waitReceives();
+                break;
+            case Order::responder:
+                messages.startReceives();
+                messages.waitReceives();
+                messages.startSends();
+                messages.waitSends();
+                break;
+            case Order::allAtOnce:
+                messages.startReceives();
+                messages.startSends();
+                messages.waitReceives();
+                messages.waitSends();
+                break;
+            case Order::idle:
+                break;
+        }
+    }
+
+    /*!
+     * \brief Do `settings.warmup` untimed and `settings.iterations` timed
+     * exchanges on the ranks that take part, with a barrier on every rank
+     * before and after the timed ones. Every rank gets the timer, empty if it
+     * was idle, so the timers line up across ranks
+     *
+     * \return PerfTimer const& The timer
+     */
+    PerfTimer const &timeExchanges(Timers &timers,
+                                   std::string const &name,
+                                   Settings const &settings,
+                                   MessageSet &messages,
+                                   Order const order)
+    {
+        timers.emplace_back(new PerfTimer(name));
+        PerfTimer &timer = *timers.back();
+
+        bool const active = order != Order::idle;
+        for (int i = 0; active and i < settings.warmup; i++)
+        {
+            exchange(messages, order);
+        }
+        MPI_Barrier(MPI_COMM_WORLD);
+        for (int i = 0; active and i < settings.iterations; i++)
+        {
+            timer.startTimer();
+            exchange(messages, order);
+            timer.stopTimer();
+        }
+        MPI_Barrier(MPI_COMM_WORLD);
+        return timer;
+    }
+
+    /*!
+     * \brief Print a table with a row per message size and a column per
+     * method on rank 0
+     */
+    void printTable(std::string const &title,
+                    std::vector<size_t> const &sizes,
+                    std::vector<std::string> const &columns,
+                    std::vector<std::vector<double>> const &values)
+    {
+        int rank;
+        MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+        if (rank != 0 or columns.empty())
+        {
+            return;
+        }
+
+        std::cout << std::endl << title << ":" << std::endl
+                  << std::setw(12) << "bytes";
+        for (std::string const &column : columns)
+        {
+            std::cout << std::setw(28) << column;
+        }
+        std::cout << std::endl;
+        for (size_t i = 0; i < sizes.size(); i++)
+        {
+            std::cout << std::setw(12) << sizes[i] << std::fixed
+                      << std::setprecision(3);
+            for (std::vector<double> const &column : values)
+            {
+                std::cout << std::setw(28) << column[i];
+            }
+            std::cout << std::defaultfloat << std::endl;
+        }
+    }
+    // =========================================================================
+
+    // =========================================================================
+    /*!
+     * \brief Ping-pong between ranks 0 and 1 for every size and method. The
+     * latency is half the round trip and the bandwidth is the size over the
+     * latency
+     */
+    void benchmarkPingPong(Settings const &settings,
+                           std::vector<size_t> const &sizes,
+                           Timers &timers)
+    {
+        int rank, numRanks;
+        MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+        MPI_Comm_size(MPI_COMM_WORLD, &numRanks);
+        if (numRanks < 2)
+        {
+            return;
+        }
+        Order const order = (rank == 0)? Order::initiator:
+                            (rank == 1)? Order::responder: Order::idle;
+
+        std::vector<std::string> columns;
+        std::vector<std::vector<double>> latency, bandwidth;
+        for (bool const device : {false, true})
+        {
+            if ((device and not settings.device) or (not device and not settings.host))
+            {
+                continue;
+            }
+            std::string const buffer = device? "device": "host";
+
+            for (std::string const &method : methods(settings, device, false))
+            {
+                columns.push_back(buffer + " " + method);
+                latency.emplace_back();
+                bandwidth.emplace_back();
+                for (size_t const bytes : sizes)
+                {
+                    bool const active = order != Order::idle;
+                    std::vector<Message> messages;
+                    if (active)
+                    {
+                        messages.push_back({0, static_cast<int>(bytes), 1 - rank, 0});
+                    }
+                    Buffers buffers(active? bytes: 0, active? bytes: 0, device);
+                    std::unique_ptr<MessageSet> set = makeMessages(
+                        method, settings, messages, messages, buffers);
+
+                    PerfTimer const &timer = timeExchanges(timers,
+                        "ping-pong " + columns.back() + " " + std::to_string(bytes)
+                        + " B", settings, *set, order);
+
+                    // Times are in nanoseconds so bytes/ns is GB/s
+                    double const halfRoundTrip = timer.averageTime() / 2.;
+                    latency.back().push_back(halfRoundTrip * 1.E-3);
+                    bandwidth.back().push_back((halfRoundTrip > 0.)?
+                                               bytes / halfRoundTrip: 0.);
+                }
+            }
+        }
+
+        printTable("Ping-pong latency (µs, half round trip)",
+                   sizes, columns, latency);
+        printTable("Ping-pong bandwidth (GB/s)", sizes, columns, bandwidth);
+    }
+    // =========================================================================
+
+    // =========================================================================
+    /*!
+     * \brief Send `settings.window` messages at a time from rank `i` to
+     * `i + N/2` for every `i` below N/2, acknowledged with one byte, and
+     * report the bandwidth of all the pairs together, from the slowest sender
+     */
+    void benchmarkMultiPair(Settings const &settings,
+                            std::vector<size_t> const &sizes,
+                            Timers &timers)
+    {
+        int rank, numRanks;
+        MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+        MPI_Comm_size(MPI_COMM_WORLD, &numRanks);
+        int const numPairs = numRanks / 2;
+        if (numPairs < 1)
+        {
+            return;
+        }
+        bool const sender   = rank < numPairs;
+        bool const receiver = (rank >= numPairs) and (rank < 2 * numPairs);
+        Order const order = sender?   Order::initiator:
+                            receiver? Order::responder: Order::idle;
+        int const partner = sender? rank + numPairs: rank - numPairs;
+        int const ackTag  = settings.window;
+
+        std::vector<std::string> columns;
+        std::vector<std::vector<double>> bandwidth;
+        for (bool const device : {false, true})
+        {
+            if ((device and not settings.device) or (not device and not settings.host))
+            {
+                continue;
+            }
+            std::string const buffer = device? "device": "host";
+
+            for (std::string const &method : methods(settings, device, false))
+            {
+                columns.push_back(buffer + " " + method);
+                bandwidth.emplace_back();
+                for (size_t const bytes : sizes)
+                {
+                    // The window of messages one way and the acknowledgement
+                    // the other, each window message has its own slice
+                    size_t const windowBytes = bytes * settings.window;
+                    std::vector<Message> sends, receives;
+                    std::vector<Message> &data = sender? sends: receives;
+                    std::vector<Message> &ack  = sender? receives: sends;
+                    for (int i = 0; (sender or receiver) and i < settings.window; i++)
+                    {
+                        data.push_back({i * bytes, static_cast<int>(bytes),
+                                        partner, i});
+                    }
+                    if (sender or receiver)
+                    {
+                        ack.push_back({0, 1, partner, ackTag});
+                    }
+                    size_t const sendBytes = sender? windowBytes: receiver? 1: 0;
+                    size_t const recvBytes = receiver? windowBytes: sender? 1: 0;
+                    Buffers buffers(sendBytes, recvBytes, device);
+                    std::unique_ptr<MessageSet> set = makeMessages(
+                        method, settings, sends, receives, buffers);
+
+                    PerfTimer const &timer = timeExchanges(timers,
+                        "multi-pair " + columns.back() + " " + std::to_string(bytes)
+                        + " B", settings, *set, order);
+
+                    GlobalPerfTimer const global = reduceTimer(timer);
+                    double const totalBytes = double(numPairs) * windowBytes
+                                              * settings.iterations;
+                    bandwidth.back().push_back((global.slowestTotalTime > 0.)?
+                        totalBytes / global.slowestTotalTime: 0.);
+                }
+            }
+        }
+
+        printTable("Multi-pair bandwidth (GB/s, " + std::to_string(numPairs)
+                   + " pairs, window of " + std::to_string(settings.window) + ")",
+                   sizes, columns, bandwidth);
+    }
+    // =========================================================================
+
+    // =========================================================================
+    /*!
+     * \brief Exchange the faces, edges, and corners of a cube of
+     * `settings.haloCells` cells of doubles with all 26 neighbors on a
+     * periodic 3D decomposition and report the global statistics and load
+     * imbalance of each method
+     */
+    void benchmarkHalo(Settings const &settings, Timers &timers)
+    {
+        int rank, numRanks;
+        MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+        MPI_Comm_size(MPI_COMM_WORLD, &numRanks);
+
+        // The ranks keep their numbers so they can be used with MPI_COMM_WORLD
+        int dims[3] = {0, 0, 0}, periods[3] = {1, 1, 1}, coords[3];
+        MPI_Dims_create(numRanks, 3, dims);
+        MPI_Comm cartesian;
+        MPI_Cart_create(MPI_COMM_WORLD, 3, dims, periods, 0, &cartesian);
+        MPI_Cart_coords(cartesian, rank, 3, coords);
+
+        // Every direction, the neighbor in it, and the size of its halo
+        std::vector<std::vector<int>> directions;
+        std::vector<Message> sends, receives;
+        size_t totalBytes = 0;
+        for (int dz = -1; dz <= 1; dz++)
+        {
+            for (int dy = -1; dy <= 1; dy++)
+            {
+                for (int dx = -1; dx <= 1; dx++)
+                {
+                    if (dx != 0 or dy != 0 or dz != 0)
+                    {
+                        directions.push_back({dz, dy, dx});
+                    }
+                }
+            }
+        }
+        auto const index = [&directions](std::vector<int> const &direction)
+        {
+            for (size_t i = 0; i < directions.size(); i++)
+            {
+                if (directions[i] == direction)
+                {
+                    return static_cast<int>(i);
+                }
+            }
+            return -1;
+        };
+        for (std::vector<int> const &direction : directions)
+        {
+            int neighborCoords[3], neighbor;
+            size_t cells = 1;
+            for (int dim = 0; dim < 3; dim++)
+            {
+                neighborCoords[dim] = (coords[dim] + direction[dim] + dims[dim])
+                                      % dims[dim];
+                cells *= (direction[dim] == 0)? settings.haloCells
+                                              : settings.haloWidth;
+            }
+            MPI_Cart_rank(cartesian, neighborCoords, &neighbor);
+
+            // The neighbor in `direction` sends towards us, in the opposite
+            // direction, and tags the message with that direction
+            std::vector<int> const opposite{-direction[0], -direction[1],
+                                            -direction[2]};
+            int const bytes = static_cast<int>(cells * sizeof(double));
+            sends.push_back({totalBytes, bytes, neighbor, index(direction)});
+            receives.push_back({totalBytes, bytes, neighbor, index(opposite)});
+            totalBytes += bytes;
+        }
+
+        std::vector<PerfTimer const *> haloTimers;
+        for (bool const device : {false, true})
+        {
+            if ((device and not settings.device) or (not device and not settings.host))
+            {
+                continue;
+            }
+            std::string const buffer = device? "device": "host";
+
+            for (std::string const &method : methods(settings, device, true))
+            {
+                Buffers buffers(totalBytes, totalBytes, device);
+                std::unique_ptr<MessageSet> set;
+                if (method == "neighborhood")
+                {
+                    set.reset(new NeighborhoodMessages(cartesian, sends, receives,
+                                                       directions, buffers.send(),
+                                                       buffers.recv()));
+                }
+                else
+                {
+                    set = makeMessages(method, settings, sends, receives, buffers);
+                }
+                haloTimers.push_back(&timeExchanges(timers,
+                    "halo " + buffer + " " + method, settings, *set,
+                    Order::allAtOnce));
+            }
+        }
+
+        if (rank == 0)
+        {
+            std::cout << std::endl << "26 neighbor halo exchange ("
+                      << dims[0] << "x" << dims[1] << "x" << dims[2]
+                      << " ranks, " << settings.haloCells << "^3 cells, width "
+                      << settings.haloWidth << ", " << totalBytes
+                      << " bytes sent per rank):" << std::endl;
+        }
+        reportStatsGlobal(haloTimers);
+
+        MPI_Comm_free(&cartesian);
+    }
+    // =========================================================================
+} // Anonymous namespace
+
+// =============================================================================
+// Benchmarks
+// =============================================================================
+int main(int argc, char **argv)
+{
+    // The progress thread of PersistentCommunicatorGroup needs full thread
+    // support, the rest of the benchmarks don't
+    int provided;
+    MPI_Init_thread(&argc, &argv, MPI_THREAD_MULTIPLE, &provided);
+    int rank;
+    MPI_Comm_rank(MPI_COMM_WORLD, &rank);
+
+    {
+        InputParser input(argc, argv);
+        Settings settings;
+        settings.maxBytes   = input.get("--max-bytes",  settings.maxBytes);
+        settings.iterations = input.get("--iterations", settings.iterations);
+        settings.warmup     = input.get("--warmup",     settings.warmup);
+        settings.window     = input.get("--window",     settings.window);
+        settings.haloCells  = input.get("--halo-cells", settings.haloCells);
+        settings.haloWidth  = input.get("--halo-width", settings.haloWidth);
+        std::string const buffers = input.get("--buffers", "both");
+        settings.host   = (buffers == "host")   or (buffers == "both");
+        settings.device = (buffers == "device") or (buffers == "both");
+
+        // Every rank must agree on whether device pointers go straight to MPI
+        int cudaAware = isCudaAwareMpi()? 1: 0;
+        MPI_Allreduce(MPI_IN_PLACE, &cudaAware, 1, MPI_INT, MPI_LAND,
+                      MPI_COMM_WORLD);
+        settings.cudaAware = cudaAware == 1;
+        int progress = (provided >= MPI_THREAD_MULTIPLE)? 1: 0;
+        MPI_Allreduce(MPI_IN_PLACE, &progress, 1, MPI_INT, MPI_LAND,
+                      MPI_COMM_WORLD);
+        settings.progress = progress == 1;
+        if (rank == 0 and settings.device)
+        {
+            std::cout << "Device buffers are "
+                      << (settings.cudaAware? "passed directly to CUDA-aware MPI"
+                                            : "staged through pinned host memory")
+                      << std::endl;
+        }
+
+        // Every size up to the largest, doubling each step
+        std::vector<size_t> sizes;
+        for (size_t bytes = 1; bytes <= settings.maxBytes; bytes *= 2)
+        {
+            sizes.push_back(bytes);
+        }
+
+        Timers timers;
+        benchmarkPingPong(settings, sizes, timers);
+        benchmarkMultiPair(settings, sizes, timers);
+        benchmarkHalo(settings, timers);
+
+        if (input.cmdOptionExists("--output"))
+        {
+            std::vector<PerfTimer const *> allTimers;
+            for (std::unique_ptr<PerfTimer> const &timer : timers)
+            {
+                allTimers.push_back(timer.get());
+            }
+            saveTimingDataGlobal(allTimers, input.getCmdOption("--output"));
+        }
+    }
+
+    MPI_Finalize();
+    return 0;
+}
+// =============================================================================
+// End benchmarks
+// =============================================================================
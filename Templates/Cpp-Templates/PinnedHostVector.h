@@ -0,0 +1,347 @@
+/*!
+ * \file PinnedHostVector.h
+ * \author Robert 'Bob' Caddy (rvc@pitt.edu)
+ * \brief Contains the declartion and implementation of the PinnedHostVector
+ * class, a page-locked host array used for fast transfers to and from a
+ * DeviceVector. Note that since this is a templated class the implementation
+ * must be in the header file
+ *
+ */
+
+#pragma once
+
+// STL Includes
+#include <string>
+#include <stdexcept>
+#include <algorithm>
+#include <type_traits>
+
+// External Includes
+#include <cuda_runtime.h>
+
+// Local Includes
+#include "CudaUtilities.h"
+
+// =============================================================================
+// Declaration of PinnedHostVector class
+// =============================================================================
+/*!
+ * \brief A templatized class to encapsulate a page-locked (pinned) host array
+ * in a std::vector like interface. Transfers between pinned memory and the
+ * device don't have to be staged through the driver's internal buffer so they
+ * run at the full bandwidth of the interconnect and `cudaMemcpyAsync` calls
+ * are truly asynchronous.
+ *
+ * \details The memory is either allocated by the class with `cudaMallocHost`
+ * or, using the `(T *, size_t)` constructor, an existing host array is
+ * page-locked in place with `cudaHostRegister`. In the latter case the class
+ * does not own the memory and it cannot be resized. Pinned memory is a
+ * limited resource and allocating it is slow so these vectors should be
+ * allocated once and reused.
+ *
+ * \tparam T Any trivially copyable type
+ */
+template <typename T>
+class PinnedHostVector
+{
+    static_assert(std::is_trivially_copyable<T>::value,
+                  "PinnedHostVector requires a trivially copyable type");
+public:
+    /*!
+     * \brief Construct a new Pinned Host Vector object with `cudaMallocHost`.
+     * The values in memory are not initialized.
+     *
+     * \param[in] size The number of elements desired in the array. Defaults
+     * to zero which allocates nothing
+     */
+    explicit PinnedHostVector(size_t const size=0) {_allocate(size);}
+
+    /*!
+     * \brief Construct a new Pinned Host Vector object by page-locking an
+     * existing host array with `cudaHostRegister`. The array is not copied
+     * and must outlive this object. This is useful for pinning the memory of
+     * a std::vector that can't be replaced, just make sure that the
+     * std::vector is not resized while it's registered.
+     *
+     * \param[in] hostPtr The pointer to the host array to register
+     * \param[in] size The number of elements in the host array
+     */
+    PinnedHostVector(T * hostPtr, size_t const size);
+
+    /*!
+     * \brief Destroy the Pinned Host Vector object by calling the
+     * `_deAllocate` private method
+     *
+     */
+    ~PinnedHostVector() {_deAllocate();}
+
+    // Copying would result in a double free so only moves are allowed
+    PinnedHostVector(PinnedHostVector const &)            = delete;
+    PinnedHostVector &operator=(PinnedHostVector const &) = delete;
+
+    /*!
+     * \brief Move construct a Pinned Host Vector, takes ownership of the
+     * memory of `other` and leaves it empty
+     *
+     * \param[in,out] other The vector to move from
+     */
+    PinnedHostVector(PinnedHostVector &&other) noexcept
+        : _size(other._size), _ptr(other._ptr), _registered(other._registered)
+    {
+        other._size       = 0;
+        other._ptr        = nullptr;
+        other._registered = false;
+    }
+
+    /*!
+     * \brief Move assign a Pinned Host Vector, frees the current memory then
+     * takes ownership of the memory of `other` and leaves it empty
+     *
+     * \param[in,out] other The vector to move from
+     * \return PinnedHostVector& This vector
+     */
+    PinnedHostVector &operator=(PinnedHostVector &&other) noexcept
+    {
+        if (this != &other)
+        {
+            _deAllocate();
+            std::swap(_size,       other._size);
+            std::swap(_ptr,        other._ptr);
+            std::swap(_registered, other._registered);
+        }
+        return *this;
+    }
+
+    /*!
+     * \brief Get the raw host pointer
+     *
+     * \return T* The pointer to the pinned array
+     */
+    T* data() {return _ptr;}
+
+    /*!
+     * \brief Get the raw host pointer
+     *
+     * \return T const* The pointer to the pinned array
+     */
+    T const* data() const {return _ptr;}
+
+    /*!
+     * \brief Get the number of elements in the array.
+     *
+     * \return size_t The number of elements in the array
+     */
+    size_t size() const {return _size;}
+
+    /*!
+     * \brief Check if the array is empty
+     *
+     * \return true The array has no elements
+     * \return false The array has at least one element
+     */
+    bool empty() const {return _size == 0;}
+
+    /*!
+     * \brief Check if the memory was registered with `cudaHostRegister`
+     * rather than allocated by this object
+     *
+     * \return true The memory is registered and not owned by this object
+     * \return false The memory was allocated with `cudaMallocHost`
+     */
+    bool isRegistered() const {return _registered;}
+
+    /// Iterators so the vector can be used with STL algorithms
+    T* begin() {return _ptr;}
+    T* end()   {return _ptr + _size;}
+    T const* begin() const {return _ptr;}
+    T const* end()   const {return _ptr + _size;}
+
+    /*!
+     * \brief Access an element of the array without bounds checking
+     *
+     * \param[in] index The index of the desired value
+     * \return T& The value at ptr[index]
+     */
+    T& operator [] (size_t const &index) {return _ptr[index];}
+    T const& operator [] (size_t const &index) const {return _ptr[index];}
+
+    /*!
+     * \brief Access an element of the array with bounds checking
+     *
+     * \param[in] index The index of the desired value
+     * \return T& The value at ptr[index]
+     */
+    T& at(size_t const index);
+    T const& at(size_t const index) const
+        {return const_cast<PinnedHostVector*>(this)->at(index);}
+
+    /*!
+     * \brief Resize the array to contain `newSize` elements. The first
+     * `min(size(), newSize)` values are kept and the rest are not initialized.
+     * Like `DeviceVector::resize` this requires a new allocation and a copy so
+     * it is slow. Throws a std::runtime_error if the memory is registered
+     * rather than owned by this object.
+     *
+     * \param[in] newSize The desired size of the array
+     */
+    void resize(size_t const newSize);
+
+    /*!
+     * \brief Reset the size of the array. This frees the old array and
+     * allocates a new one; all values in the array may be lost. Throws a
+     * std::runtime_error if the memory is registered rather than owned by
+     * this object.
+     *
+     * \param[in] newSize The desired size of the array
+     */
+    void reset(size_t const newSize);
+
+private:
+    /// The size of the host array
+    size_t _size=0;
+
+    /// The pointer to the host array
+    T *_ptr=nullptr;
+
+    /// Whether or not the memory was registered with `cudaHostRegister`
+    bool _registered=false;
+
+    /*!
+     * \brief Allocate the pinned host array with `cudaMallocHost`
+     *
+     * \param[in] size The size of the array to allocate
+     */
+    void _allocate(size_t const size)
+    {
+        _size = size;
+        if (size > 0)
+        {
+            CudaSafeCall(cudaMallocHost(&_ptr, size*sizeof(T)));
+        }
+    }
+
+    /*!
+     * \brief Free or unregister the pinned host array
+     *
+     */
+    void _deAllocate();
+
+    /*!
+     * \brief Throw a std::runtime_error if the memory is registered
+     *
+     * \param[in] caller The name of the calling method, used in the error
+     * message
+     */
+    void _checkOwnership(std::string const &caller) const;
+};
+// =============================================================================
+// End declaration of PinnedHostVector class
+// =============================================================================
+
+
+// =============================================================================
+// Definition of PinnedHostVector class
+// =============================================================================
+
+// =============================================================================
+// Public Methods
+// =============================================================================
+
+// =============================================================================
+template <typename T>
+PinnedHostVector<T>::PinnedHostVector(T * hostPtr, size_t const size)
+    :
+    _size(size),
+    _ptr(hostPtr),
+    _registered(true)
+{
+    CudaSafeCall(cudaHostRegister(_ptr, _size*sizeof(T),
+                                  cudaHostRegisterDefault));
+}
+// =============================================================================
+
+// =============================================================================
+template <typename T>
+T& PinnedHostVector<T>::at(size_t const index)
+{
+    if (index < _size)
+    {
+        return _ptr[index];
+    }
+    else
+    {
+        throw std::out_of_range("Warning: PinnedHostVector.at() detected an"
+                                " out of bounds memory access. Tried to"
+                                " access element "
+                                + std::to_string(index)
+                                + " of "
+                                + std::to_string(_size));
+    }
+}
+// =============================================================================
+
+// =============================================================================
+template <typename T>
+void PinnedHostVector<T>::resize(size_t const newSize)
+{
+    _checkOwnership("resize");
+
+    // Allocate the new array then move the values and ownership over
+    PinnedHostVector<T> newVec(newSize);
+    std::copy(_ptr, _ptr + std::min(_size, newSize), newVec.data());
+    *this = std::move(newVec);
+}
+// =============================================================================
+
+// =============================================================================
+template <typename T>
+void PinnedHostVector<T>::reset(size_t const newSize)
+{
+    _checkOwnership("reset");
+
+    _deAllocate();
+    _allocate(newSize);
+}
+// =============================================================================
+
+// =============================================================================
+// Private Methods
+// =============================================================================
+
+// =============================================================================
+template <typename T>
+void PinnedHostVector<T>::_deAllocate()
+{
+    if (_ptr != nullptr)
+    {
+        if (_registered)
+        {
+            CudaSafeCall(cudaHostUnregister(_ptr));
+        }
+        else
+        {
+            CudaSafeCall(cudaFreeHost(_ptr));
+        }
+    }
+    _ptr        = nullptr;
+    _size       = 0;
+    _registered = false;
+}
+// =============================================================================
+
+// =============================================================================
+template <typename T>
+void PinnedHostVector<T>::_checkOwnership(std::string const &caller) const
+{
+    if (_registered)
+    {
+        throw std::runtime_error("Warning: PinnedHostVector." + caller + "()"
+                                 " cannot be called on registered memory that"
+                                 " is not owned by the PinnedHostVector");
+    }
+}
+// =============================================================================
+
+// =============================================================================
+// End definition of PinnedHostVector class
+// =============================================================================
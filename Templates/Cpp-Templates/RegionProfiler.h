@@ -0,0 +1,667 @@
+/*!
+ * \file RegionProfiler.h
+ * \author Robert 'Bob' Caddy (rvc@pitt.edu)
+ * \brief Contains the BasicRegionProfiler class, a profiler of nested named
+ * regions that keeps PerfTimer statistics of the inclusive and exclusive time
+ * of every call path and writes them out as a call tree, a Chrome trace, or
+ * folded stacks for flame graphs
+ *
+ */
+
+#pragma once
+
+// STL Includes
+#include <string>
+#include <string_view>
+#include <vector>
+#include <memory>
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <cerrno>
+#include <stdexcept>
+#include <type_traits>
+
+// Local Includes
+#include "PerfTimer.h"
+#include "ScopedTimer.h"
+
+// =============================================================================
+// Declaration of BasicRegionProfiler class
+// =============================================================================
+/*!
+ * \brief A profiler of nested regions
+ *
+ * \details Regions are opened with `beginRegion()` and closed with
+ * `endRegion()`, or with a ScopedRegion or PERF_REGION, and nest like a call
+ * stack. Each distinct call path, e.g. `timestep;halo exchange;pack`, gets a
+ * node in a call tree with two PerfTimers: the inclusive time of each call and
+ * the exclusive time, the inclusive time minus the time spent in the regions
+ * nested inside that call. The same region name reached through different
+ * paths gets different nodes, so `pack` inside `halo exchange` and `pack`
+ * inside `output` are kept apart.
+ *
+ * The results can be written out as
+ * - a call tree, with `reportStats()`
+ * - a Chrome trace event file, with `saveChromeTrace()`, which can be opened
+ *   in `chrome://tracing` or Perfetto. Requires `maxTraceEvents` to be set
+ * - folded stacks, with `saveFoldedStacks()`, one line per call path with the
+ *   exclusive time in nanoseconds, the input to `flamegraph.pl` and speedscope
+ *
+ * Opening a region looks up the child by name among the children of the
+ * current node, so it doesn't allocate after the first call on each path.
+ * The node timers are in `PerfTimerMode::streaming` by default so the memory
+ * used doesn't grow with the run time. A profiler must only be used by one
+ * thread, give each thread its own. Region names must not contain `;`, it
+ * separates the names in a path.
+ *
+ * \tparam Clock The clock policy, see PerfClocks.h. Defaults to SteadyClock
+ */
+template <typename Clock = SteadyClock>
+class BasicRegionProfiler
+{
+public:
+    /// The timer type of the nodes
+    using Timer = BasicPerfTimer<Clock>;
+
+    /*!
+     * \brief Construct a new, empty, Region Profiler object
+     *
+     * \param[in] maxTraceEvents The largest number of region calls to keep
+     * for `saveChromeTrace()`, later calls are still profiled but not traced.
+     * The space for them is allocated here. Defaults to zero, no tracing
+     * \param[in] mode How the node timers store the raw time differences.
+     * Defaults to streaming
+     * \param[in] numRawSamples The size of the node timers' ring buffers in
+     * streaming mode. Defaults to 128
+     */
+    BasicRegionProfiler(size_t const maxTraceEvents = 0,
+                        PerfTimerMode const mode = PerfTimerMode::streaming,
+                        size_t const numRawSamples = 128);
+
+    // The nodes point at each other
+    BasicRegionProfiler(BasicRegionProfiler const &)            = delete;
+    BasicRegionProfiler &operator=(BasicRegionProfiler const &) = delete;
+
+    /*!
+     * \brief Open a region nested inside the currently open region, or at the
+     * top level if no region is open
+     *
+     * \param[in] name The name of the region
+     */
+    void beginRegion(std::string_view const name);
+
+    /*!
+     * \brief Close the most recently opened region. If no region is open then
+     * nothing is done and an error message is printed
+     *
+     */
+    void endRegion();
+
+    /*!
+     * \brief Get the number of regions that are currently open
+     *
+     * \return size_t The depth of the region stack
+     */
+    size_t depth() const {return _stack.size();}
+
+    /*!
+     * \brief Get the call paths of every node, depth first in the order they
+     * were first reached
+     *
+     * \return std::vector<std::string> The paths, names separated by `;`
+     */
+    std::vector<std::string> paths() const;
+
+    /*!
+     * \brief Get the timer of the inclusive time of a call path. Throws a
+     * std::out_of_range error if the path has never been reached
+     *
+     * \param[in] path The names of the regions separated by `;`
+     * \return Timer const& The inclusive timer
+     */
+    Timer const &inclusiveTimer(std::string const &path) const
+        {return _find(path).inclusive;}
+
+    /*!
+     * \brief Get the timer of the exclusive time of a call path. Throws a
+     * std::out_of_range error if the path has never been reached
+     *
+     * \param[in] path The names of the regions separated by `;`
+     * \return Timer const& The exclusive timer
+     */
+    Timer const &exclusiveTimer(std::string const &path) const
+        {return _find(path).exclusive;}
+
+    /*!
+     * \brief Get the number of region calls kept for the trace
+     *
+     * \return size_t The number of trace events
+     */
+    size_t numTraceEvents() const {return _trace.size();}
+
+    /*!
+     * \brief Print out the call tree with the calls, inclusive and exclusive
+     * time, and share of the parent's time of every node
+     *
+     * \param[in] outStream What stream to write out to. Defaults to std::cout
+     */
+    void reportStats(std::ostream &outStream = std::cout) const;
+
+    /*!
+     * \brief Write the traced region calls to a Chrome trace event JSON file.
+     * If the file already exists it will be overwritten without asking
+     *
+     * \param[in] filePath The path at which to write the output file
+     * \param[in] pid The process ID to tag the events with, e.g. the MPI
+     * rank. Defaults to zero
+     * \param[in] tid The thread ID to tag the events with. Defaults to zero
+     */
+    void saveChromeTrace(std::string const &filePath,
+                         int const pid = 0,
+                         int const tid = 0) const;
+
+    /*!
+     * \brief Write the exclusive time of every call path in the folded stack
+     * format, `path time` with the time in integer nanoseconds. If the file
+     * already exists it will be overwritten without asking
+     *
+     * \param[in] filePath The path at which to write the output file
+     */
+    void saveFoldedStacks(std::string const &filePath) const;
+
+    /*!
+     * \brief Remove every node and trace event. Throws a std::runtime_error
+     * if any region is open
+     *
+     */
+    void reset();
+
+private:
+    /// A call path in the call tree
+    struct Node
+    {
+        /// The name of the region
+        std::string name;
+
+        /// The names on the path from the top level to this node, separated
+        /// by `;`
+        std::string path;
+
+        /// The inclusive and exclusive time of each call
+        Timer inclusive;
+        Timer exclusive;
+
+        /// The nodes nested inside this one, in the order they were first
+        /// reached
+        std::vector<std::unique_ptr<Node>> children;
+    };
+
+    /// An open region
+    struct Frame
+    {
+        /// The node of the region
+        Node *node;
+
+        /// The time the region was opened
+        typename Clock::time_point startTime;
+
+        /// The inclusive time of the regions nested inside this call so far
+        double childTime;
+    };
+
+    /// A traced region call, times in nanoseconds since `_epoch`
+    struct TraceEvent
+    {
+        Node const *node;
+        double      startTime;
+        double      duration;
+    };
+
+    /// The settings of the node timers
+    PerfTimerMode _mode;
+    size_t        _numRawSamples;
+
+    /// The root of the call tree. Its children are the top level regions
+    Node _root;
+
+    /// The open regions, innermost last
+    std::vector<Frame> _stack;
+
+    /// The traced region calls, in the order they were closed
+    std::vector<TraceEvent> _trace;
+    size_t                  _maxTraceEvents;
+
+    /// The time that the trace events are relative to
+    typename Clock::time_point _epoch;
+
+    /*!
+     * \brief Find the child of a node with the given name, creating it if it
+     * doesn't exist
+     *
+     * \param[in] parent The parent node
+     * \param[in] name The name of the child
+     * \return Node* The child
+     */
+    Node *_child(Node &parent, std::string_view const name);
+
+    /*!
+     * \brief Find the node of a call path. Throws a std::out_of_range error
+     * if the path has never been reached
+     *
+     * \param[in] path The names of the regions separated by `;`
+     * \return Node const& The node
+     */
+    Node const &_find(std::string const &path) const;
+
+    /*!
+     * \brief Call a function on every node below `node`, depth first
+     *
+     * \param[in] node The node to start from, not visited itself
+     * \param[in] depth The depth of the children of `node`
+     * \param[in] visit The function, called with the node, its depth, and
+     * its parent
+     */
+    template <typename Visitor>
+    static void _visit(Node const &node, size_t const depth, Visitor &&visit);
+
+    /*!
+     * \brief Write a string as a JSON string, with quotes and escapes
+     *
+     * \param[in] outStream The stream to write to
+     * \param[in] string The string
+     */
+    static void _writeJsonString(std::ostream &outStream,
+                                 std::string const &string);
+};
+
+/// The region profiler with the default clock
+using RegionProfiler = BasicRegionProfiler<>;
+// =============================================================================
+// End declaration of BasicRegionProfiler class
+// =============================================================================
+
+// =============================================================================
+// Declaration of ScopedRegion class
+// =============================================================================
+/*!
+ * \brief Opens a region when it is constructed and closes it when it is
+ * destroyed, so the region is closed however the scope is left
+ *
+ * \tparam Profiler The type of the profiler. Defaults to RegionProfiler
+ */
+template <typename Profiler = RegionProfiler>
+class ScopedRegion
+{
+public:
+    /*!
+     * \brief Construct a new Scoped Region object and open the region
+     *
+     * \param[in] profiler The profiler, must outlive this object
+     * \param[in] name The name of the region
+     */
+    ScopedRegion(Profiler &profiler, std::string_view const name)
+        : _profiler(profiler)
+        {_profiler.beginRegion(name);}
+
+    /*!
+     * \brief Destroy the Scoped Region object and close the region
+     *
+     */
+    ~ScopedRegion() {_profiler.endRegion();}
+
+    // Copying would close the region twice
+    ScopedRegion(ScopedRegion const &)            = delete;
+    ScopedRegion &operator=(ScopedRegion const &) = delete;
+
+private:
+    /// The profiler being used
+    Profiler &_profiler;
+};
+// =============================================================================
+// End declaration of ScopedRegion class
+// =============================================================================
+
+// =============================================================================
+// Scoped region macro
+// =============================================================================
+/*!
+ * \def PERF_REGION(profiler, name)
+ * \brief Profile the rest of the enclosing scope as the region `name` of
+ * `profiler`. Expands to nothing when PERFTIMER_DISABLE is defined, like
+ * PERF_SCOPE
+ */
+#ifdef PERFTIMER_DISABLE
+    #define PERF_REGION(profiler, name) static_cast<void>(0)
+#else  // PERFTIMER_DISABLE
+    #define PERF_REGION(profiler, name)                                     \
+        ScopedRegion<std::remove_reference_t<decltype(profiler)>>           \
+            PERF_CONCAT_(perfRegion_, __COUNTER__)(profiler, name)
+#endif  // PERFTIMER_DISABLE
+// =============================================================================
+// End scoped region macro
+// =============================================================================
+
+// =============================================================================
+// Implementation of BasicRegionProfiler class
+// =============================================================================
+
+// =============================================================================
+// Public Methods
+// =============================================================================
+
+// =============================================================================
+template <typename Clock>
+BasicRegionProfiler<Clock>::BasicRegionProfiler(size_t const maxTraceEvents,
+                                                PerfTimerMode const mode,
+                                                size_t const numRawSamples)
+    :
+    _mode(mode),
+    _numRawSamples(numRawSamples),
+    _root{"", "", Timer(""), Timer(""), {}},
+    _maxTraceEvents(maxTraceEvents),
+    _epoch(Clock::now())
+{
+    // Allocate up front so that endRegion never does
+    _stack.reserve(64);
+    _trace.reserve(maxTraceEvents);
+}
+// =============================================================================
+
+// =============================================================================
+template <typename Clock>
+void BasicRegionProfiler<Clock>::beginRegion(std::string_view const name)
+{
+    Node *parent = _stack.empty()? &_root: _stack.back().node;
+    Node *node   = _child(*parent, name);
+
+    // Read the clock last so the lookup isn't counted
+    _stack.push_back({node, Clock::now(), 0.});
+}
+// =============================================================================
+
+// =============================================================================
+template <typename Clock>
+void BasicRegionProfiler<Clock>::endRegion()
+{
+    // Read the clock first so the bookkeeping isn't counted
+    typename Clock::time_point const stopTime = Clock::now();
+
+    if (_stack.empty())
+    {
+        std::cout << "RegionProfiler::no region is open. No action taken";
+        return;
+    }
+
+    Frame const frame = _stack.back();
+    _stack.pop_back();
+
+    double const inclusive = Clock::nanoseconds(frame.startTime, stopTime);
+    frame.node->inclusive.addSample(inclusive);
+    frame.node->exclusive.addSample(inclusive - frame.childTime);
+    if (not _stack.empty())
+    {
+        _stack.back().childTime += inclusive;
+    }
+
+    if (_trace.size() < _maxTraceEvents)
+    {
+        _trace.push_back({frame.node,
+                          Clock::nanoseconds(_epoch, frame.startTime),
+                          inclusive});
+    }
+}
+// =============================================================================
+
+// =============================================================================
+template <typename Clock>
+std::vector<std::string> BasicRegionProfiler<Clock>::paths() const
+{
+    std::vector<std::string> result;
+    _visit(_root, 0, [&result](Node const &node, size_t, Node const &)
+        {result.push_back(node.path);});
+    return result;
+}
+// =============================================================================
+
+// =============================================================================
+template <typename Clock>
+void BasicRegionProfiler<Clock>::reportStats(std::ostream &outStream) const
+{
+    // The share of the top level regions is of their sum
+    double topLevelTime = 0.;
+    for (std::unique_ptr<Node> const &node : _root.children)
+    {
+        topLevelTime += node->inclusive.totalTime();
+    }
+
+    outStream << "Region profile:" << std::endl;
+    _visit(_root, 0, [&](Node const &node,
+                         size_t const depth,
+                         Node const &parent)
+    {
+        double const parentTime = (&parent == &_root)?
+                                  topLevelTime: parent.inclusive.totalTime();
+        double const share = (parentTime > 0.)?
+                             100. * node.inclusive.totalTime() / parentTime: 0.;
+
+        double inclusive = node.inclusive.totalTime();
+        double exclusive = node.exclusive.totalTime();
+        double average   = node.inclusive.averageTime();
+        std::string inclusiveUnit, exclusiveUnit, averageUnit;
+        Timer::convertTime(inclusive, inclusiveUnit);
+        Timer::convertTime(exclusive, exclusiveUnit);
+        Timer::convertTime(average,   averageUnit);
+
+        outStream << std::string(2 * (depth + 1), ' ') << node.name << ": " <<
+        "Calls: "        << node.inclusive.numTrials()             << ", " <<
+        "Inclusive: "    << inclusive << inclusiveUnit
+                         << " (" << share << "% of parent)"        << ", " <<
+        "Exclusive: "    << exclusive << exclusiveUnit             << ", " <<
+        "Average Time: " << average   << averageUnit               << std::endl;
+    });
+}
+// =============================================================================
+
+// =============================================================================
+template <typename Clock>
+void BasicRegionProfiler<Clock>::saveChromeTrace(std::string const &filePath,
+                                                 int const pid,
+                                                 int const tid) const
+{
+    std::ofstream saveFile(filePath);
+    if (not saveFile.is_open())
+    {
+        std::cerr << "RegionProfiler output file failed to open. Error: "
+                  <<  std::strerror(errno)
+                  << std::endl;
+        return;
+    }
+
+    // Complete events, "X", with the times in microseconds
+    saveFile << std::fixed << std::setprecision(3)
+             << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[";
+    for (size_t i = 0; i < _trace.size(); i++)
+    {
+        TraceEvent const &event = _trace[i];
+        saveFile << ((i > 0)? ",\n": "\n") << "{\"name\":";
+        _writeJsonString(saveFile, event.node->name);
+        saveFile << ",\"cat\":";
+        _writeJsonString(saveFile, event.node->path);
+        saveFile << ",\"ph\":\"X\""
+                 << ",\"ts\":"  << event.startTime * 1.E-3
+                 << ",\"dur\":" << event.duration  * 1.E-3
+                 << ",\"pid\":" << pid
+                 << ",\"tid\":" << tid << "}";
+    }
+    saveFile << "\n]}" << std::endl;
+
+    saveFile.close();
+}
+// =============================================================================
+
+// =============================================================================
+template <typename Clock>
+void BasicRegionProfiler<Clock>::saveFoldedStacks(
+    std::string const &filePath) const
+{
+    std::ofstream saveFile(filePath);
+    if (not saveFile.is_open())
+    {
+        std::cerr << "RegionProfiler output file failed to open. Error: "
+                  <<  std::strerror(errno)
+                  << std::endl;
+        return;
+    }
+
+    _visit(_root, 0, [&saveFile](Node const &node, size_t, Node const &)
+    {
+        long long const exclusive = std::llround(node.exclusive.totalTime());
+        if (exclusive > 0)
+        {
+            saveFile << node.path << " " << exclusive << std::endl;
+        }
+    });
+
+    saveFile.close();
+}
+// =============================================================================
+
+// =============================================================================
+template <typename Clock>
+void BasicRegionProfiler<Clock>::reset()
+{
+    if (not _stack.empty())
+    {
+        throw std::runtime_error("Warning: RegionProfiler.reset() called with "
+                                 + std::to_string(_stack.size())
+                                 + " regions open");
+    }
+
+    _root.children.clear();
+    _trace.clear();
+    _epoch = Clock::now();
+}
+// =============================================================================
+
+// =============================================================================
+// Private Methods
+// =============================================================================
+
+// =============================================================================
+template <typename Clock>
+typename BasicRegionProfiler<Clock>::Node *BasicRegionProfiler<Clock>::_child(
+    Node &parent,
+    std::string_view const name)
+{
+    // Regions usually have few children so a linear search is fastest
+    for (std::unique_ptr<Node> &child : parent.children)
+    {
+        if (child->name == name)
+        {
+            return child.get();
+        }
+    }
+
+    std::string path = parent.path;
+    if (not path.empty())
+    {
+        path += ';';
+    }
+    path += name;
+
+    parent.children.emplace_back(new Node{std::string(name),
+                                          path,
+                                          Timer(path, _mode, _numRawSamples),
+                                          Timer(path, _mode, _numRawSamples),
+                                          {}});
+    return parent.children.back().get();
+}
+// =============================================================================
+
+// =============================================================================
+template <typename Clock>
+typename BasicRegionProfiler<Clock>::Node const &
+BasicRegionProfiler<Clock>::_find(std::string const &path) const
+{
+    Node const *node = &_root;
+    size_t start = 0;
+    while (node != nullptr and start <= path.size())
+    {
+        size_t end = path.find(';', start);
+        if (end == std::string::npos)
+        {
+            end = path.size();
+        }
+        std::string_view const name(path.data() + start, end - start);
+
+        Node const *parent = node;
+        node = nullptr;
+        for (std::unique_ptr<Node> const &child : parent->children)
+        {
+            if (child->name == name)
+            {
+                node = child.get();
+                break;
+            }
+        }
+        start = end + 1;
+    }
+
+    if (node == nullptr)
+    {
+        throw std::out_of_range("Warning: RegionProfiler._find() no region "
+                                "with the path " + path);
+    }
+    return *node;
+}
+// =============================================================================
+
+// =============================================================================
+template <typename Clock>
+template <typename Visitor>
+void BasicRegionProfiler<Clock>::_visit(Node const &node,
+                                        size_t const depth,
+                                        Visitor &&visit)
+{
+    for (std::unique_ptr<Node> const &child : node.children)
+    {
+        visit(*child, depth, node);
+        _visit(*child, depth + 1, visit);
+    }
+}
+// =============================================================================
+
+// =============================================================================
+template <typename Clock>
+void BasicRegionProfiler<Clock>::_writeJsonString(std::ostream &outStream,
+                                                  std::string const &string)
+{
+    outStream << '"';
+    for (char const c : string)
+    {
+        if (c == '"' or c == '\\')
+        {
+            outStream << '\\' << c;
+        }
+        else if (static_cast<unsigned char>(c) < 0x20)
+        {
+            char escaped[7];
+            std::snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+            outStream << escaped;
+        }
+        else
+        {
+            outStream << c;
+        }
+    }
+    outStream << '"';
+}
+// =============================================================================
+
+// =============================================================================
+// End implementation of BasicRegionProfiler class
+// =============================================================================
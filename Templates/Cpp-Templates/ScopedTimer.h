@@ -0,0 +1,102 @@
+/*!
+ * \file ScopedTimer.h
+ * \author Robert 'Bob' Caddy (rvc@pitt.edu)
+ * \brief Contains the ScopedTimer class, which times a scope with a PerfTimer,
+ * and the PERF_SCOPE macros that can be compiled out of production builds by
+ * defining PERFTIMER_DISABLE
+ *
+ */
+
+#pragma once
+
+// STL Includes
+#include <type_traits>
+
+// Local Includes
+#include "PerfTimer.h"
+#include "PerfTimerRegistry.h"
+
+// =============================================================================
+// Declaration of ScopedTimer class
+// =============================================================================
+/*!
+ * \brief Starts a PerfTimer when it is constructed and stops it when it is
+ * destroyed, so the timer is stopped however the scope is left, including by
+ * an early return or an exception
+ *
+ * \details The timer isn't re-entrant, a ScopedTimer must not be nested
+ * inside another one that uses the same PerfTimer, e.g. in a recursive
+ * function. Works with anything that has `startTimer()` and `stopTimer()`,
+ * e.g. a BasicPerfTimer with any clock or a DevicePerfTimer, and the type is
+ * deduced from the constructor argument.
+ *
+ * \tparam Timer The type of the timer. Defaults to PerfTimer
+ */
+template <typename Timer = PerfTimer>
+class ScopedTimer
+{
+public:
+    /*!
+     * \brief Construct a new Scoped Timer object and start the timer
+     *
+     * \param[in] timer The timer to start, must outlive this object
+     */
+    explicit ScopedTimer(Timer &timer) : _timer(timer)
+        {_timer.startTimer();}
+
+    /*!
+     * \brief Destroy the Scoped Timer object and stop the timer
+     *
+     */
+    ~ScopedTimer() {_timer.stopTimer();}
+
+    // Copying would stop the timer twice
+    ScopedTimer(ScopedTimer const &)            = delete;
+    ScopedTimer &operator=(ScopedTimer const &) = delete;
+
+private:
+    /// The timer being used
+    Timer &_timer;
+};
+// =============================================================================
+// End declaration of ScopedTimer class
+// =============================================================================
+
+// =============================================================================
+// Scoped timing macros
+// =============================================================================
+/*!
+ * \def PERF_SCOPE(name)
+ * \brief Time the rest of the enclosing scope with the calling thread's
+ * PerfTimerRegistry timer called `name`. The timer is looked up once per
+ * thread per call site, so `name` must be the same every time a given
+ * PERF_SCOPE is reached
+ *
+ * \def PERF_SCOPE_TIMER(timer)
+ * \brief Time the rest of the enclosing scope with `timer`, any timer that
+ * ScopedTimer accepts
+ *
+ * Both macros expand to nothing when PERFTIMER_DISABLE is defined, so they
+ * can be left in the source permanently at no cost in release builds.
+ */
+#ifdef PERFTIMER_DISABLE
+    #define PERF_SCOPE(name)        static_cast<void>(0)
+    #define PERF_SCOPE_TIMER(timer) static_cast<void>(0)
+#else  // PERFTIMER_DISABLE
+    #define PERF_CONCAT_IMPL_(a, b) a##b
+    #define PERF_CONCAT_(a, b)      PERF_CONCAT_IMPL_(a, b)
+
+    #define PERF_SCOPE_IMPL_(name, id)                                      \
+        static thread_local PerfTimer &PERF_CONCAT_(perfScopeTimer_, id)    \
+            = PerfTimerRegistry::instance().localTimer(name);               \
+        ScopedTimer<PerfTimer> PERF_CONCAT_(perfScope_, id)(                \
+            PERF_CONCAT_(perfScopeTimer_, id))
+
+    #define PERF_SCOPE(name)        PERF_SCOPE_IMPL_(name, __COUNTER__)
+    #define PERF_SCOPE_TIMER(timer)                                         \
+        ScopedTimer<std::remove_reference_t<decltype(timer)>>               \
+            PERF_CONCAT_(perfScope_, __COUNTER__)(timer)
+#endif  // PERFTIMER_DISABLE
+// =============================================================================
+// End scoped timing macros
+// =============================================================================
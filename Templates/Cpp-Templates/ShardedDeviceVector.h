@@ -0,0 +1,458 @@
+/*!
+ * \file ShardedDeviceVector.h
+ * \author Robert 'Bob' Caddy (rvc@pitt.edu)
+ * \brief Contains the declartion and implementation of the
+ * ShardedDeviceVector class, a single logical array split across the GPUs in
+ * a node. Note that since this is a templated class the implementation must
+ * be in the header file
+ *
+ */
+
+#pragma once
+
+// STL Includes
+#include <vector>
+#include <string>
+#include <stdexcept>
+#include <utility>
+#include <algorithm>
+#include <numeric>
+
+// External Includes
+#include <cuda_runtime.h>
+
+// Local Includes
+#include "CudaUtilities.h"
+#include "DeviceVector.h"
+#include "PinnedHostVector.h"
+
+// =============================================================================
+// Declaration of ShardedDeviceVector class
+// =============================================================================
+/*!
+ * \brief A templatized class that splits one logical array into contiguous
+ * shards, each stored in a DeviceVector on a different device. The shards
+ * are as close to equal in size as possible with the first
+ * `size % numShards` shards holding one extra element.
+ *
+ * \details Each shard has its own non-blocking stream so that transfers and
+ * kernels on different devices run concurrently; use `stream(i)` when
+ * launching work on shard `i`. Peer access is enabled between all the
+ * devices on construction so that `shard(i).copyTo(shard(j))`, e.g. for a
+ * halo exchange, goes directly over NVLink/PCIe when possible.
+ *
+ * \tparam T Any type supported by DeviceVector
+ * \tparam Allocator The allocator used for each shard
+ */
+template <typename T, typename Allocator = CudaMallocAllocator>
+class ShardedDeviceVector
+{
+public:
+    /*!
+     * \brief Construct a new Sharded Device Vector object
+     *
+     * \param[in] size The total number of elements in the array
+     * \param[in] devices The device of each shard. A device can be listed
+     * more than once. Defaults to one shard on every visible device
+     */
+    explicit ShardedDeviceVector(size_t const size,
+                                 std::vector<int> const &devices=_allDevices());
+
+    /*!
+     * \brief Destroy the Sharded Device Vector object. The shards free
+     * themselves, this just destroys the streams
+     *
+     */
+    ~ShardedDeviceVector() {_destroyStreams();}
+
+    // Copying would result in a double free
+    ShardedDeviceVector(ShardedDeviceVector const &)            = delete;
+    ShardedDeviceVector &operator=(ShardedDeviceVector const &) = delete;
+
+    /*!
+     * \brief Move construct a Sharded Device Vector, takes ownership of the
+     * shards and streams of `other` and leaves it empty
+     *
+     * \param[in,out] other The vector to move from
+     */
+    ShardedDeviceVector(ShardedDeviceVector &&other) noexcept
+        :
+        _size(other._size),
+        _shards(std::move(other._shards)),
+        _offsets(std::move(other._offsets)),
+        _streams(std::move(other._streams))
+    {
+        other._size = 0;
+        other._shards.clear();
+        other._offsets.clear();
+        other._streams.clear();
+    }
+
+    /*!
+     * \brief Move assign a Sharded Device Vector, frees the current shards
+     * and streams then takes ownership of those of `other`
+     *
+     * \param[in,out] other The vector to move from
+     * \return ShardedDeviceVector& This vector
+     */
+    ShardedDeviceVector &operator=(ShardedDeviceVector &&other) noexcept
+    {
+        if (this != &other)
+        {
+            _destroyStreams();
+            _size    = 0;
+            _shards.clear();
+            _offsets.clear();
+            std::swap(_size,    other._size);
+            std::swap(_shards,  other._shards);
+            std::swap(_offsets, other._offsets);
+            std::swap(_streams, other._streams);
+        }
+        return *this;
+    }
+
+    /*!
+     * \brief Get the total number of elements in the array
+     *
+     * \return size_t The number of elements across all shards
+     */
+    size_t size() const {return _size;}
+
+    /*!
+     * \brief Get the number of shards
+     *
+     * \return size_t The number of shards
+     */
+    size_t numShards() const {return _shards.size();}
+
+    /*!
+     * \brief Get a shard
+     *
+     * \param[in] shardIndex The index of the shard
+     * \return DeviceVector<T, Allocator>& The shard
+     */
+    DeviceVector<T, Allocator> &shard(size_t const shardIndex)
+        {return _shards.at(shardIndex);}
+
+    /*!
+     * \brief Get the stream associated with a shard
+     *
+     * \param[in] shardIndex The index of the shard
+     * \return cudaStream_t The stream on the shard's device
+     */
+    cudaStream_t stream(size_t const shardIndex) const
+        {return _streams.at(shardIndex);}
+
+    /*!
+     * \brief Get the global index of the first element of a shard
+     *
+     * \param[in] shardIndex The index of the shard
+     * \return size_t The global index of the shard's first element
+     */
+    size_t shardOffset(size_t const shardIndex) const
+        {return _offsets.at(shardIndex);}
+
+    /*!
+     * \brief Find which shard holds an element. Throws a std::out_of_range
+     * error if the index is outside the array
+     *
+     * \param[in] index The global index of the element
+     * \return std::pair<size_t, size_t> The index of the shard and the index
+     * of the element within the shard
+     */
+    std::pair<size_t, size_t> locate(size_t const index) const;
+
+    /*!
+     * \brief Return a value from device memory with bounds checking. This
+     * method performs a cudaMemcpy to copy the desired element to the host
+     * then returns it
+     *
+     * \param[in] index The global index of the desired value
+     * \return T The value at the global index
+     */
+    T const at(size_t const index);
+
+    /*!
+     * \brief Copy a host array into the shards. The host memory is pageable
+     * so CUDA does each copy synchronously and the shards are copied one
+     * after the other, use the PinnedHostVector overload to copy them
+     * concurrently. Throws a std::out_of_range error if the host array is not
+     * the same size as this array
+     *
+     * \param[in] vecIn The host vector to copy from
+     */
+    void cpyHostToDevice(std::vector<T> const &vecIn)
+        {_cpyHostToDevice(vecIn.data(), vecIn.size());}
+
+    /*!
+     * \brief Copy a pinned host array into the shards. Each shard is copied
+     * on its own stream so the copies to different devices overlap, this
+     * returns when all of them are complete. Throws a std::out_of_range error
+     * if the host array is not the same size as this array
+     *
+     * \param[in] vecIn The pinned host vector to copy from
+     */
+    void cpyHostToDevice(PinnedHostVector<T> const &vecIn)
+        {_cpyHostToDevice(vecIn.data(), vecIn.size());}
+
+    /*!
+     * \brief Copy the shards into a host array. The host memory is pageable
+     * so the shards are copied one after the other, use the PinnedHostVector
+     * overload to copy them concurrently. The host array is resized if needed
+     *
+     * \param[out] vecOut The host vector to copy into
+     */
+    void cpyDeviceToHost(std::vector<T> &vecOut)
+    {
+        vecOut.resize(_size);
+        _cpyDeviceToHost(vecOut.data());
+    }
+
+    /*!
+     * \brief Copy the shards into a pinned host array. Each shard is copied
+     * on its own stream so the copies from different devices overlap, this
+     * returns when all of them are complete. The host array is resized if
+     * needed
+     *
+     * \param[out] vecOut The pinned host vector to copy into
+     */
+    void cpyDeviceToHost(PinnedHostVector<T> &vecOut)
+    {
+        if (vecOut.size() != _size)
+        {
+            vecOut.resize(_size);
+        }
+        _cpyDeviceToHost(vecOut.data());
+    }
+
+    /*!
+     * \brief Wait for all work on all the shard streams to finish
+     *
+     */
+    void synchronize();
+
+private:
+    /// The total number of elements
+    size_t _size=0;
+
+    /// The shards of the array
+    std::vector<DeviceVector<T, Allocator>> _shards;
+
+    /// The global index of the first element of each shard
+    std::vector<size_t> _offsets;
+
+    /// One stream per shard, created on the shard's device
+    std::vector<cudaStream_t> _streams;
+
+    /*!
+     * \brief Get a list of all the visible devices
+     *
+     * \return std::vector<int> The devices [0, cudaGetDeviceCount)
+     */
+    static std::vector<int> _allDevices();
+
+    /*!
+     * \brief Destroy all the streams
+     *
+     */
+    void _destroyStreams();
+
+    /*!
+     * \brief Copy a host array into the shards, each on its own stream, and
+     * wait for all the copies. Throws a std::out_of_range error if the host
+     * array is not the same size as this array
+     *
+     * \param[in] hostPtr The host array to copy from
+     * \param[in] hostSize The number of elements in the host array
+     */
+    void _cpyHostToDevice(T const *hostPtr, size_t const hostSize);
+
+    /*!
+     * \brief Copy the shards into a host array of `size()` elements, each on
+     * its own stream, and wait for all the copies
+     *
+     * \param[out] hostPtr The host array to copy into
+     */
+    void _cpyDeviceToHost(T *hostPtr);
+};
+// =============================================================================
+// End declaration of ShardedDeviceVector class
+// =============================================================================
+
+
+// =============================================================================
+// Definition of ShardedDeviceVector class
+// =============================================================================
+
+// =============================================================================
+// Public Methods
+// =============================================================================
+
+// =============================================================================
+template <typename T, typename Allocator>
+ShardedDeviceVector<T, Allocator>::ShardedDeviceVector(
+    size_t const size,
+    std::vector<int> const &devices)
+    :
+    _size(size)
+{
+    if (devices.empty())
+    {
+        throw std::invalid_argument("Warning: ShardedDeviceVector requires at"
+                                    " least one device");
+    }
+
+    size_t const numShards = devices.size();
+    size_t const baseSize  = size / numShards;
+    size_t const remainder = size % numShards;
+
+    _shards.reserve(numShards);
+    _offsets.reserve(numShards);
+    _streams.reserve(numShards);
+
+    size_t offset = 0;
+    for (size_t i = 0; i < numShards; i++)
+    {
+        size_t const shardSize = baseSize + ((i < remainder)? 1: 0);
+        _shards.emplace_back(shardSize, devices[i]);
+        _offsets.push_back(offset);
+        offset += shardSize;
+
+        CudaDeviceGuard guard(devices[i]);
+        cudaStream_t stream;
+        CudaSafeCall(cudaStreamCreateWithFlags(&stream, cudaStreamNonBlocking));
+        _streams.push_back(stream);
+    }
+
+    // Enable peer access between all pairs of devices for shard to shard
+    // copies
+    for (size_t i = 0; i < numShards; i++)
+    {
+        for (size_t j = 0; j < numShards; j++)
+        {
+            enablePeerAccess(devices[i], devices[j]);
+        }
+    }
+}
+// =============================================================================
+
+// =============================================================================
+template <typename T, typename Allocator>
+std::pair<size_t, size_t>
+ShardedDeviceVector<T, Allocator>::locate(size_t const index) const
+{
+    if (index >= _size)
+    {
+        throw std::out_of_range("Warning: ShardedDeviceVector.locate()"
+                                " detected an out of bounds memory access."
+                                " Tried to access element "
+                                + std::to_string(index)
+                                + " of "
+                                + std::to_string(_size));
+    }
+
+    // The offsets are sorted so find the last shard starting at or before
+    // the index, skipping over any empty shards
+    size_t shardIndex = std::upper_bound(_offsets.begin(), _offsets.end(),
+                                         index) - _offsets.begin() - 1;
+    return {shardIndex, index - _offsets[shardIndex]};
+}
+// =============================================================================
+
+// =============================================================================
+template <typename T, typename Allocator>
+T const ShardedDeviceVector<T, Allocator>::at(size_t const index)
+{
+    std::pair<size_t, size_t> const location = locate(index);
+    return _shards[location.first].at(location.second);
+}
+// =============================================================================
+
+// =============================================================================
+template <typename T, typename Allocator>
+void ShardedDeviceVector<T, Allocator>::synchronize()
+{
+    for (cudaStream_t const stream : _streams)
+    {
+        CudaSafeCall(cudaStreamSynchronize(stream));
+    }
+}
+// =============================================================================
+
+// =============================================================================
+// Private Methods
+// =============================================================================
+
+// =============================================================================
+template <typename T, typename Allocator>
+std::vector<int> ShardedDeviceVector<T, Allocator>::_allDevices()
+{
+    int numDevices = 0;
+    CudaSafeCall(cudaGetDeviceCount(&numDevices));
+
+    std::vector<int> devices(numDevices);
+    std::iota(devices.begin(), devices.end(), 0);
+    return devices;
+}
+// =============================================================================
+
+// =============================================================================
+template <typename T, typename Allocator>
+void ShardedDeviceVector<T, Allocator>::_destroyStreams()
+{
+    for (size_t i = 0; i < _streams.size(); i++)
+    {
+        CudaDeviceGuard guard(_shards[i].device());
+        CudaSafeCall(cudaStreamDestroy(_streams[i]));
+    }
+    _streams.clear();
+}
+// =============================================================================
+
+// =============================================================================
+template <typename T, typename Allocator>
+void ShardedDeviceVector<T, Allocator>::_cpyHostToDevice(T const *hostPtr,
+                                                         size_t const hostSize)
+{
+    if (hostSize != _size)
+    {
+        throw std::out_of_range("Warning: ShardedDeviceVector.cpyHostToDevice()"
+                                " requires a host vector with "
+                                + std::to_string(_size)
+                                + " elements, got "
+                                + std::to_string(hostSize));
+    }
+
+    for (size_t i = 0; i < _shards.size(); i++)
+    {
+        if (_shards[i].size() > 0)
+        {
+            _shards[i].cpyHostToDeviceAsync(hostPtr + _offsets[i],
+                                            _shards[i].size(),
+                                            _streams[i]);
+        }
+    }
+    synchronize();
+}
+// =============================================================================
+
+// =============================================================================
+template <typename T, typename Allocator>
+void ShardedDeviceVector<T, Allocator>::_cpyDeviceToHost(T *hostPtr)
+{
+    for (size_t i = 0; i < _shards.size(); i++)
+    {
+        if (_shards[i].size() > 0)
+        {
+            _shards[i].cpyDeviceToHostAsync(hostPtr + _offsets[i],
+                                            _shards[i].size(),
+                                            _streams[i]);
+        }
+    }
+    synchronize();
+}
+// =============================================================================
+
+// =============================================================================
+// End definition of ShardedDeviceVector class
+// =============================================================================
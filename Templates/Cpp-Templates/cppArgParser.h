@@ -7,9 +7,19 @@
 
 // STL includes
 #include <string>
+#include <string_view>
 #include <algorithm>
+#include <unordered_map>
 #include <vector>
+#include <memory>
 #include <stdexcept>
+#include <charconv>
+#include <type_traits>
+
+// External includes
+#ifdef INPUTPARSER_USE_MPI
+    #include <mpi.h>
+#endif  // INPUTPARSER_USE_MPI
 
 /*!
  * \brief Class for parsing input flags. Modified from
@@ -19,7 +29,17 @@
  * call `InputParser.getCmdOption("flagString")`, note that this will throw and
  * error if the flag doesn't exists. You can use
  * InputParser.cmdOptionExists("flagString")` to just check if a specific flag
- * exists.
+ * exists. `InputParser.get<T>("flagString", default)` converts the argument to
+ * `T`, or returns `default` if the flag doesn't exist.
+ *
+ * Arguments can be given as `--flag value` or `--flag=value`. They are indexed
+ * once, when the parser is constructed, so every lookup is a hash lookup. The
+ * index holds views into argv, which outlives the parser, so nothing is copied.
+ * If the same flag is given more than once the first one is used.
+ *
+ * When compiled with `INPUTPARSER_USE_MPI` defined the parser can also be
+ * constructed from the arguments of one rank, which are broadcast to every
+ * other rank so they all see the same configuration.
  */
 class InputParser{
     public:
@@ -29,28 +49,37 @@ class InputParser{
          * the flag exists and is not empty
          *
          * \param option The string option to look for
-         * \return const std::string& The option the follows a given flag
+         * \return std::string The option the follows a given flag
          */
-        const std::string& getCmdOption(const std::string &option) const
+        std::string getCmdOption(std::string_view const &option) const
         {
-            // First check that the option exists
-            if(not cmdOptionExists(option))
-            {
-                std::string errMessage = "Error: argument '" + option + "' not found. ";
-                throw std::invalid_argument(errMessage);
-            }
+            return std::string(getCmdOptionView(option));
+        }
+        // =====================================================================
 
-            std::vector<std::string>::const_iterator itr;
-            itr =  std::find(this->tokens.begin(), this->tokens.end(), option);
-            if (itr != this->tokens.end() && ++itr != this->tokens.end())
+        // =====================================================================
+        /*!
+         * \brief Get the option that follows the given flag without copying
+         * it. Also checks that the flag exists and is not empty
+         *
+         * \param option The string option to look for
+         * \return std::string_view The option the follows a given flag, valid
+         * for as long as argv and this object are
+         */
+        std::string_view getCmdOptionView(std::string_view const &option) const
+        {
+            auto const itr = this->index.find(option);
+            if (itr == this->index.end())
             {
-                return *itr;
+                std::string errMessage = "Error: argument '" + std::string(option) + "' not found. ";
+                throw std::invalid_argument(errMessage);
             }
-            else
+            if (itr->second.data() == nullptr)
             {
-                std::string errMessage = "Error: empty argument '" + option + "'";
+                std::string errMessage = "Error: empty argument '" + std::string(option) + "'";
                 throw std::invalid_argument(errMessage);
             }
+            return itr->second;
         }
         // =====================================================================
 
@@ -63,10 +92,102 @@ class InputParser{
          * \return true The option flag exists in argv
          * \return false The option flage does not exist in argv
          */
-        bool cmdOptionExists(const std::string &option) const
+        bool cmdOptionExists(std::string_view const &option) const
+        {
+            return this->index.find(option) != this->index.end();
+        }
+        // =====================================================================
+
+        // =====================================================================
+        /*!
+         * \brief Get the option that follows the given flag converted to `T`.
+         * Numbers are converted with `std::from_chars` and must use the whole
+         * option. A `bool` flag without a value, e.g. `--verbose`, is true.
+         *
+         * \tparam T The type to convert to. An arithmetic type, `bool`,
+         * `std::string`, or `std::string_view`
+         * \param option The string option to look for
+         * \return T The converted option
+         */
+        template <typename T>
+        T get(std::string_view const &option) const
         {
-            return std::find(this->tokens.begin(), this->tokens.end(), option)
-            != this->tokens.end();
+            if constexpr (std::is_same_v<T, bool>)
+            {
+                // The token after a bare flag can be another flag, so only
+                // the explicit values make it false
+                auto const itr = this->index.find(option);
+                if (itr == this->index.end())
+                {
+                    std::string errMessage = "Error: argument '" + std::string(option) + "' not found. ";
+                    throw std::invalid_argument(errMessage);
+                }
+                return not (itr->second == "false" or itr->second == "0");
+            }
+            else if constexpr (std::is_same_v<T, std::string>
+                               or std::is_same_v<T, std::string_view>)
+            {
+                return T(getCmdOptionView(option));
+            }
+            else
+            {
+                static_assert(std::is_arithmetic_v<T>,
+                              "InputParser::get only converts to arithmetic types and strings");
+                std::string_view const value = getCmdOptionView(option);
+                T result{};
+                auto const [end, error] = std::from_chars(value.data(),
+                                                          value.data() + value.size(),
+                                                          result);
+                if (error == std::errc::result_out_of_range)
+                {
+                    std::string errMessage = "Error: argument '" + std::string(option)
+                                             + "' value '" + std::string(value)
+                                             + "' is out of range";
+                    throw std::out_of_range(errMessage);
+                }
+                if (error != std::errc() or end != value.data() + value.size())
+                {
+                    std::string errMessage = "Error: argument '" + std::string(option)
+                                             + "' value '" + std::string(value)
+                                             + "' is not a valid number";
+                    throw std::invalid_argument(errMessage);
+                }
+                return result;
+            }
+        }
+        // =====================================================================
+
+        // =====================================================================
+        /*!
+         * \brief Get the option that follows the given flag converted to `T`,
+         * or `defaultValue` if the flag doesn't exist. See `get(option)`
+         *
+         * \tparam T The type to convert to
+         * \param option The string option to look for
+         * \param defaultValue The value to return if the flag doesn't exist
+         * \return T The converted option or the default
+         */
+        template <typename T>
+        T get(std::string_view const &option, T const &defaultValue) const
+        {
+            return cmdOptionExists(option)? get<T>(option): defaultValue;
+        }
+        // =====================================================================
+
+        // =====================================================================
+        /*!
+         * \brief Get the option that follows the given flag as a string, or
+         * `defaultValue` if the flag doesn't exist. Without this overload a
+         * string literal default would deduce `T` as a char array, which
+         * can't be returned
+         *
+         * \param option The string option to look for
+         * \param defaultValue The value to return if the flag doesn't exist
+         * \return std::string The option or the default
+         */
+        std::string get(std::string_view const &option, char const *defaultValue) const
+        {
+            return cmdOptionExists(option)? get<std::string>(option): std::string(defaultValue);
         }
         // =====================================================================
 
@@ -80,11 +201,88 @@ class InputParser{
          */
         InputParser (int &argc, char **argv)
         {
-            for (int i=1; i < argc; ++i)
-            this->tokens.push_back(std::string(argv[i]));
+            std::vector<std::string_view> tokens(argv + std::min(argc, 1), argv + argc);
+            this->buildIndex(tokens);
         }
+
+#ifdef INPUTPARSER_USE_MPI
+        /*!
+         * \brief Construct a new Input Parser object from the arguments of
+         * the root rank. Collective over `mpiCommunicator`, the arguments of
+         * the other ranks are ignored
+         *
+         * \param argc argc from main
+         * \param argv argv from main
+         * \param mpiCommunicator The communicator to broadcast over
+         * \param root The rank whose arguments are used
+         */
+        InputParser (int &argc, char **argv, MPI_Comm const &mpiCommunicator, int const &root = 0)
+        {
+            int rank;
+            MPI_Comm_rank(mpiCommunicator, &rank);
+
+            // Pack the arguments one after another, each is null terminated,
+            // then send the size followed by the arguments
+            auto storage = std::make_shared<std::vector<char>>();
+            if (rank == root)
+            {
+                for (int i=1; i < argc; ++i)
+                {
+                    std::string_view const token(argv[i]);
+                    storage->insert(storage->end(), token.begin(), token.end());
+                    storage->push_back('\0');
+                }
+            }
+            unsigned long long numBytes = storage->size();
+            MPI_Bcast(&numBytes, 1, MPI_UNSIGNED_LONG_LONG, root, mpiCommunicator);
+            storage->resize(numBytes);
+            MPI_Bcast(storage->data(), static_cast<int>(numBytes), MPI_CHAR, root, mpiCommunicator);
+
+            std::vector<std::string_view> tokens;
+            for (size_t begin = 0; begin < storage->size();)
+            {
+                tokens.emplace_back(storage->data() + begin);
+                begin += tokens.back().size() + 1;
+            }
+            this->storage = std::move(storage);
+            this->buildIndex(tokens);
+        }
+#endif  // INPUTPARSER_USE_MPI
         ~InputParser() = default;
         // =====================================================================
     private:
-        std::vector <std::string> tokens;
-};
\ No newline at end of file
+        // =====================================================================
+        /*!
+         * \brief Index every token with the token after it, or with the part
+         * after the `=` for `--flag=value`. A flag without a value maps to a
+         * null view
+         *
+         * \param tokens The arguments, without the program name
+         */
+        void buildIndex(std::vector<std::string_view> const &tokens)
+        {
+            this->index.reserve(tokens.size());
+            for (size_t i = 0; i < tokens.size(); ++i)
+            {
+                std::string_view const token = tokens[i];
+                size_t const equals = token.find('=');
+                if (token.size() > 1 and token[0] == '-' and equals != std::string_view::npos)
+                {
+                    this->index.emplace(token.substr(0, equals), token.substr(equals + 1));
+                }
+                else
+                {
+                    this->index.emplace(token, (i + 1 < tokens.size())? tokens[i + 1]
+                                                                      : std::string_view());
+                }
+            }
+        }
+        // =====================================================================
+
+        /// Each flag and the option that follows it
+        std::unordered_map<std::string_view, std::string_view> index;
+
+        /// The broadcast arguments the index points into, shared so copies of
+        /// the parser stay valid. Null when the index points into argv
+        std::shared_ptr<std::vector<char> const> storage;
+};